@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "zep/line_index.hpp"
+
+namespace Zep
+{
+
+// A bracket in the text.  Opens and closes of the same kind nest; the kinds don't care about each other
+struct BracketMark
+{
+    int32_t offset;
+    uint8_t kind;
+    bool open;
+};
+
+// The brackets in a buffer, and how deeply each one is nested.
+// Like the line index, the brackets are kept in chunks of a few hundred, relative to the start of their chunk, with a prefix sum
+// tree over the chunk sizes; so an edit only moves the brackets in its own chunk.  Each chunk also knows what it does to the depth
+// of each kind, and a tree over those gives the depth at any bracket in O(log n), without walking the brackets before it.
+//
+// A close with nothing open is an error, and the depth stays at 0 instead of going negative, so the brackets after it still pair up.
+// That makes the depth after a run of brackets max(depth + change, floor), which is all a chunk needs to remember
+class BracketIndex
+{
+public:
+    static constexpr uint8_t MaxKinds = 3;
+
+    BracketIndex();
+
+    void Clear();
+
+    // Text was added or removed; the brackets in removed text go with it
+    void Insert(int32_t offset, int32_t length);
+    void Erase(int32_t start, int32_t end);
+
+    // Replace the brackets in the text from start to end with these; in order, with offsets in the buffer
+    void Assign(int32_t start, int32_t end, const std::vector<BracketMark>& brackets);
+
+    // If there is a bracket at the offset, how deep it is; a close is as deep as its open.
+    // It isn't valid if it is a close with nothing open, or the first bracket of a kind which has opens that are never closed
+    auto Find(int32_t offset, int32_t& depth, bool& valid) const -> bool;
+
+    auto size() const -> size_t;
+    auto ToVector() const -> std::vector<BracketMark>;
+
+private:
+    // What a run of brackets does to the depth: it becomes max(depth + change, floor)
+    struct DepthStep
+    {
+        int32_t change = 0;
+        int32_t floor = 0;
+
+        auto Then(const DepthStep& next) const -> DepthStep
+        {
+            return DepthStep{ change + next.change, std::max(floor + next.change, next.floor) };
+        }
+
+        auto Apply(int32_t depth) const -> int32_t
+        {
+            return std::max(depth + change, floor);
+        }
+    };
+
+    struct Summary
+    {
+        std::array<DepthStep, MaxKinds> steps{};
+        std::array<int32_t, MaxKinds> counts{};
+
+        auto Then(const Summary& next) const -> Summary;
+    };
+
+    struct Chunk
+    {
+        int32_t size = 0; // Characters
+        std::vector<BracketMark> brackets; // Offsets from the chunk start
+        std::vector<DepthStep> before; // For each bracket, what the ones of its kind before it in the chunk do
+        Summary summary;
+    };
+
+    void Replace(int32_t start, int32_t end, int32_t length, const std::vector<BracketMark>& brackets);
+    void Summarize(Chunk& chunk);
+    void Rebuild(size_t first, size_t last, const std::vector<BracketMark>& brackets, int32_t chunkStart, int32_t size);
+    void UpdateTrees();
+    void UpdateSummary(size_t chunk);
+    auto SummaryBefore(size_t chunk) const -> Summary;
+    auto ChunkStart(size_t chunk) const -> int32_t;
+    auto FindChunk(int32_t offset) const -> size_t;
+
+private:
+    std::vector<Chunk> m_chunks;
+    PrefixSumTree m_chunkSizes;
+    std::vector<Summary> m_summaries; // A tree; the chunks are the leaves, from m_leaves on
+    size_t m_leaves = 1;
+};
+
+} // namespace Zep
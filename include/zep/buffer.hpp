@@ -4,8 +4,9 @@
 #include <set>
 
 #include "zep/editor.hpp"
-#include "zep/gap_buffer.hpp"
+#include "zep/line_index.hpp"
 #include "zep/line_widgets.hpp"
+#include "zep/text_storage.hpp"
 #include "zep/theme.hpp"
 
 #include "zep/mcommon/file/path.hpp"
@@ -14,9 +15,10 @@ namespace Zep
 {
 
 class ZepSyntax;
+class IZepMappedFile;
 class ZepTheme;
 class ZepMode;
-enum class ThemeColor;
+enum class ThemeColor : uint8_t;
 
 enum class SearchDirection
 {
@@ -47,7 +49,8 @@ enum : uint32_t
     Dirty = (1 << 4), // Has the file been changed?
     HasWarnings = (1 << 6),
     HasErrors = (1 << 7),
-    DefaultBuffer = (1 << 8) // Default startup buffer
+    DefaultBuffer = (1 << 8), // Default startup buffer
+    Loading = (1 << 9) // The file is still streaming in
 };
 } // namespace FileFlags
 
@@ -214,7 +217,7 @@ public:
 
     auto GetLineCount() const -> int32_t
     {
-        return int32_t(m_lineEnds.size());
+        return int32_t(m_lineIndex.size());
     }
     auto GetBufferLine(BufferLocation location) const -> int32_t;
     static auto LocationFromOffset(const BufferLocation& location, int32_t offset) -> BufferLocation;
@@ -222,15 +225,23 @@ public:
     auto LocationFromOffsetByChars(const BufferLocation& location, int32_t offset, LineLocation clampLimit = LineLocation::None) const -> BufferLocation;
     auto EndLocation() const -> BufferLocation;
 
-    auto GetText() -> GapBuffer<utf8>&
+    auto GetText() -> TextStorage<utf8>&
     {
-        return m_gapBuffer;
+        return m_text;
     }
-    auto GetLineEnds() const -> std::vector<int32_t>
+    // The line index itself; iterate it, or index it by line, without copying it
+    auto GetLineEnds() const -> const LineIndex&
     {
-        return m_lineEnds;
+        return m_lineIndex;
     }
 
+    // Read the text without copying it.
+    // The callback gets each contiguous run of text in [start, end), in order, and returns false to stop
+    void ForEachSegment(BufferLocation start, BufferLocation end, const std::function<bool(std::string_view)>& fn) const;
+
+    void SetStorageType(TextStorageType type);
+    auto GetStorageType() const -> TextStorageType;
+
     auto TestFlags(uint32_t flags) -> bool
     {
         return (m_fileFlags & flags) == flags;
@@ -326,20 +337,29 @@ public:
 
     auto IsHidden() const -> bool;
 
+    // How much of a streaming file has arrived, 0->1
+    auto GetLoadProgress() const -> float;
+
 private:
     // Internal
-    auto SearchWord(uint32_t searchType, GapBuffer<utf8>::const_iterator itrBegin, GapBuffer<utf8>::const_iterator itrEnd, SearchDirection dir) const -> GapBuffer<utf8>::const_iterator;
+    auto SearchWord(uint32_t searchType, TextStorage<utf8>::const_iterator itrBegin, TextStorage<utf8>::const_iterator itrEnd, SearchDirection dir) const -> TextStorage<utf8>::const_iterator;
     void ClearRangeMarker(const std::shared_ptr<RangeMarker>& spMarker);
 
     void MarkUpdate();
 
+    auto SetMappedText(const std::shared_ptr<IZepMappedFile>& spFile) -> bool;
+    void StreamText(const std::shared_ptr<IZepMappedFile>& spFile, std::string&& text);
+    void UpdateStreamText();
+    void FinishSetText(bool initFromFile);
+    auto WriteText(int64_t& size, const std::function<bool(const utf8*, size_t)>& fnWrite) const -> bool;
+
     void UpdateForInsert(const BufferLocation& startOffset, const BufferLocation& endOffset);
     void UpdateForDelete(const BufferLocation& startOffset, const BufferLocation& endOffset);
 
 private:
     bool m_dirty = false; // Is the text modified?
-    GapBuffer<utf8> m_gapBuffer; // Storage for the text - a gap buffer for efficiency
-    std::vector<int32_t> m_lineEnds; // End of each line
+    TextStorage<utf8> m_text; // Storage for the text - a gap buffer, or a piece table for big files
+    LineIndex m_lineIndex; // End of each line
     uint32_t m_fileFlags = 0;
     BufferType m_bufferType = BufferType::Normal;
     std::shared_ptr<ZepSyntax> m_spSyntax;
@@ -356,6 +376,10 @@ private:
     SyntaxProvider m_syntaxProvider;
     uint64_t m_updateCount = 0;
     uint64_t m_lastUpdateTime = 0;
+
+    struct StreamLoad;
+    std::shared_ptr<StreamLoad> m_spStreamLoad; // Only while a big file is still arriving
+    std::weak_ptr<IZepMappedFile> m_wpMappedFile; // The file the text is a view of, if it is mapped; the text keeps it alive
 };
 
 // Notification payload
@@ -367,7 +391,8 @@ enum class BufferMessageType
     TextDeleted,
     TextAdded,
     Loaded,
-    MarkersChanged
+    MarkersChanged,
+    LineWidgetsChanged // The lines in the range are a different size; the text is the same
 };
 
 struct BufferMessage : public ZepMessage
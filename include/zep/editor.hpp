@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <deque>
 #include <map>
 #include <memory>
@@ -62,6 +63,7 @@ enum
 {
     None = (0),
     DisableThreads = (1 << 0),
+    WorkerThreads = (1 << 1), // Work goes on other threads even when there is only one core, so it can be tested there
 };
 } // namespace ZepEditorFlags
 
@@ -202,6 +204,9 @@ struct EditorConfig
     bool cursorLineSolid = false;
     float backgroundFadeTime = 60.0F;
     float backgroundFadeWait = 60.0F;
+    uint64_t pieceTableFileSize = 16 * 1024 * 1024; // Files at least this big are loaded into a piece table
+    uint64_t streamFileSize = 32 * 1024 * 1024; // Files at least this big are shown while they load
+    bool lazySyntax = false; // Color what the windows show first, and the rest of the file on the editor tick; for buffers opened after it is set
 };
 
 class ZepEditor
@@ -228,6 +233,11 @@ public:
     void Display();
 
     void RegisterSyntaxFactory(const std::vector<std::string>& mappings, const SyntaxProvider& provider);
+
+    // Languages described in TOML files (see syntax_grammar.hpp), for buffers opened after they are loaded.
+    // A bad file is reported on the command line, and false returned
+    auto LoadSyntaxGrammar(const ZepPath& path) -> bool;
+    void LoadSyntaxGrammars(const ZepPath& dir);
     auto Broadcast(const std::shared_ptr<ZepMessage>& message) -> bool;
     void RegisterCallback(IZepComponent* pClient)
     {
@@ -370,7 +380,7 @@ private:
     tBuffers m_buffers;
     uint32_t m_flags = 0;
 
-    mutable bool m_bPendingRefresh = true;
+    mutable std::atomic<bool> m_bPendingRefresh = { true }; // The highlighter sets this from its thread
     mutable bool m_lastCursorBlink = false;
 
     std::vector<std::string> m_commandLines; // Command information, shown under the buffer
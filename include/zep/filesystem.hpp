@@ -2,6 +2,7 @@
 
 #include "zep/mcommon/file/path.hpp"
 
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
@@ -11,6 +12,32 @@
 namespace Zep
 {
 
+// A read only view of a whole file, mapped into memory by the file system.
+// The data is valid for as long as this object is alive.
+class IZepMappedFile
+{
+public:
+    virtual ~IZepMappedFile() = default;
+    [[nodiscard]] virtual auto Data() const -> const uint8_t* = 0;
+    [[nodiscard]] virtual auto Size() const -> size_t = 0;
+
+    // True if the file can't be replaced while it is mapped, as on Windows; then a buffer copies out what it uses before saving
+    [[nodiscard]] virtual auto LocksFile() const -> bool
+    {
+        return false;
+    }
+};
+
+// Writes a file a block at a time.
+// Nothing replaces the file until Commit; if the writer goes away before that, the file is left as it was.
+class IZepFileWriter
+{
+public:
+    virtual ~IZepFileWriter() = default;
+    virtual auto Write(const void* pData, size_t size) -> bool = 0;
+    virtual auto Commit() -> bool = 0;
+};
+
 // Zep's view of the outside world in terms of files
 // Below there is a version of this that will work on most platforms using std's <filesystem> for file operations
 // If you want to expose your app's view of the world, you need to implement this minimal set of functions
@@ -22,6 +49,23 @@ public:
     virtual auto Read(const ZepPath& filePath) -> std::string = 0;
     virtual auto Write(const ZepPath& filePath, const void* pData, size_t size) -> bool = 0;
 
+    // Optional; map a file into memory instead of reading it, so big files can be loaded without a copy.
+    // Files smaller than minSize aren't worth a mapping.  Return nullptr for those, or if the file can't be mapped, and it will be Read instead.
+    virtual auto Map(const ZepPath& filePath, size_t minSize) -> std::shared_ptr<IZepMappedFile>
+    {
+        (void)filePath;
+        (void)minSize;
+        return nullptr;
+    }
+
+    // Optional; open a file to be written in blocks, so a buffer can be saved without copying all of it first.
+    // Return nullptr if that can't be done, and the whole file will be passed to Write instead.
+    virtual auto OpenWriter(const ZepPath& filePath) -> std::shared_ptr<IZepFileWriter>
+    {
+        (void)filePath;
+        return nullptr;
+    }
+
     // The rootpath is either the git working directory or the app current working directory
     [[nodiscard]] virtual auto GetSearchRoot(const ZepPath& start) const -> ZepPath = 0;
 
@@ -54,6 +98,8 @@ public:
     ZepFileSystemCPP();
     virtual std::string Read(const ZepPath& filePath) override;
     virtual bool Write(const ZepPath& filePath, const void* pData, size_t size) override;
+    virtual std::shared_ptr<IZepMappedFile> Map(const ZepPath& filePath, size_t minSize) override;
+    virtual std::shared_ptr<IZepFileWriter> OpenWriter(const ZepPath& filePath) override;
     virtual void ScanDirectory(const ZepPath& path, std::function<bool(const ZepPath& path, bool& dont_recurse)> fnScan) const override;
     virtual void SetWorkingDirectory(const ZepPath& path) override;
     virtual const ZepPath& GetWorkingDirectory() const override;
@@ -29,8 +29,15 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.*/
 #include <memory>
 #include <cassert>
 #include <climits>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <limits>
+#include <new>
 #include <string>
+#include <type_traits>
+
+#include "zep/span_find.hpp"
 
 #ifdef _DEBUG
 #define DEBUG_FILL_GAP for (auto* pCh = m_pGapStart; pCh < m_pGapEnd; pCh++) { *pCh = '@'; }
@@ -47,12 +54,34 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.*/
 // Editors like emacs use it to efficiently manage an edit buffer.
 // For the curious, you can ask emacs for the gap position and fixed_size by evaluating (gap-fixed_size), (gap-position)
 
+// How big a gap to leave when the gap runs out.
+// It is a fraction of the text, so that big pastes into a big buffer don't keep growing it a little at a time.
+struct GapBufferGrowth
+{
+    size_t minGap = 1000;
+    size_t maxGap = 64 * 1024 * 1024;
+    float factor = 0.5f;
+};
+
+// Counts of the work done growing the buffer, to check the growth policy against a real workload
+struct GapBufferStats
+{
+    uint64_t allocations = 0;   // Fresh blocks
+    uint64_t reallocations = 0; // Blocks grown
+    uint64_t inPlace = 0;       // Blocks grown without moving them
+    uint64_t bytesMoved = 0;    // Copied or moved to make room
+};
+
 template <class T, class A = std::allocator<T>>
 class GapBuffer
 {
 public:
     static const int DEFAULT_GAP = 1000;
 
+    // Trivial values in plain memory can be grown with realloc; it will often extend the block where it is,
+    // and glibc moves big blocks by remapping their pages (mremap) rather than copying them
+    static constexpr bool UseRealloc = std::is_trivially_copyable<T>::value && std::is_same<A, std::allocator<T>>::value;
+
     using allocator_type = A;
     using value_type = typename std::allocator_traits<A>::value_type;
     using difference_type = typename std::allocator_traits<A>::difference_type;
@@ -64,7 +93,8 @@ public:
     T *m_pEnd = nullptr;         // Pointer after the end 
     T *m_pGapStart = nullptr;    // Gap start position
     T *m_pGapEnd = nullptr;      // End of the gap, just beyond
-    size_t m_defaultGap = 0;     // Current fixed_size of gap
+    GapBufferGrowth m_growth;    // How the gap grows
+    GapBufferStats m_stats;      // Growth counters
     A _alloc;                    // The memory allocator to use
 
     // An iterator used to walk the buffer
@@ -187,8 +217,8 @@ public:
 
     // No assign/copy for now
     explicit GapBuffer(int size = 0, int gapSize = DEFAULT_GAP)
-        : m_defaultGap(gapSize)
     {
+        m_growth.minGap = size_t(gapSize);
         if (size == 0)
         {
             clear();
@@ -211,14 +241,35 @@ public:
     {
         Free();
 
-        m_pStart = get_allocator().allocate(m_defaultGap);
+        m_pStart = Allocate(m_growth.minGap);
 
         //  SG_____gE -- gap visualization
         m_pGapStart = m_pStart;
-        m_pGapEnd = m_pStart + m_defaultGap;
+        m_pGapEnd = m_pStart + m_growth.minGap;
         m_pEnd = m_pGapEnd;
     }
 
+    // The min gap only applies to the next clear or growth
+    void SetGrowth(const GapBufferGrowth& growth)
+    {
+        m_growth = growth;
+    }
+
+    auto GetGrowth() const -> const GapBufferGrowth&
+    {
+        return m_growth;
+    }
+
+    auto GetStats() const -> const GapBufferStats&
+    {
+        return m_stats;
+    }
+
+    void ResetStats()
+    {
+        m_stats = GapBufferStats();
+    }
+
     // Make buffer this fixed_size, but only ever actually grow the memory for now.
     void resize(size_t newSize)
     {
@@ -239,29 +290,15 @@ public:
             return;
         }
        
-        // New total fixed_size and new gap fixed_size
+        // New total fixed_size; the gap stays where it is, and the new entries go on the end
         auto bufferSize = CurrentSizeWithGap() + sizeIncrease;
+        auto gapStart = m_pGapStart - m_pStart;
+        auto gapSize = CurrentGapSize();
 
-        // Make the new buffer
-        auto pNewStart = get_allocator().allocate((const size_t)bufferSize);
-
-        memcpy(pNewStart, m_pStart, CurrentSizeWithGap() * sizeof(T));
-
-        // First section, before gap - copy into place
-        if ((m_pGapStart - m_pStart) > 0)
-        {
-            memcpy(pNewStart, m_pStart, (m_pGapStart - m_pStart) * sizeof(T));
-        }
-
-        // Free the old memory
-        if (m_pStart)
-        {
-            get_allocator().deallocate(m_pStart, CurrentSizeWithGap());
-        }
+        auto pNewStart = Grow(size_t(bufferSize));
 
         // Fix up the new pointers (gap hasn't changed, end is bigger)
-        auto gapSize = CurrentGapSize();
-        m_pGapStart = pNewStart + (m_pGapStart - m_pStart);
+        m_pGapStart = pNewStart + gapStart;
         m_pGapEnd = m_pGapStart + gapSize;
         m_pStart = pNewStart;
         m_pEnd = pNewStart + bufferSize;
@@ -279,37 +316,25 @@ public:
        
         // New total fixed_size and new gap fixed_size
         auto bufferSize = CurrentSizeWithGap() + sizeIncrease;
+        auto gapStart = m_pGapStart - m_pStart;
+        auto tailSize = m_pEnd - m_pGapEnd;
 
-        // Make the new buffer
-        auto pNewStart = get_allocator().allocate((const size_t)bufferSize);
-
-        // First section, before gap - copy into place
-        if ((m_pGapStart - m_pStart) > 0)
-        {
-            memcpy(pNewStart, m_pStart, (m_pGapStart - m_pStart) * sizeof(T));
-        }
-
-        // Note: Gap is copied; it is 'junk until used'
-
-        // Last section - copy into place
-        auto pNewGapStart = m_pGapStart + (pNewStart - m_pStart);
-        auto pNewGapEnd = pNewGapStart + newGapSize;
-        if (m_pGapEnd < m_pEnd)
-        {
-            memcpy(pNewGapEnd, m_pGapEnd, (m_pEnd - m_pGapEnd) * sizeof(T));
-        }
+        // Note: Gap is kept; it is 'junk until used'
+        auto pNewStart = Grow(size_t(bufferSize));
 
-        // Free the old memory
-        if (m_pStart)
+        // Last section - move up to the new end
+        auto pNewEnd = pNewStart + bufferSize;
+        if (tailSize > 0)
         {
-            get_allocator().deallocate(m_pStart, CurrentSizeWithGap());
+            memmove(pNewEnd - tailSize, pNewStart + gapStart + (m_pGapEnd - m_pGapStart), tailSize * sizeof(T));
+            m_stats.bytesMoved += uint64_t(tailSize * sizeof(T));
         }
 
         // Fix up the new pointers 
-        m_pGapStart = pNewStart + (m_pGapStart - m_pStart);
-        m_pGapEnd = m_pGapStart + newGapSize;
         m_pStart = pNewStart;
-        m_pEnd = pNewStart + bufferSize;
+        m_pEnd = pNewEnd;
+        m_pGapStart = pNewStart + gapStart;
+        m_pGapEnd = m_pGapStart + newGapSize;
 
         DEBUG_FILL_GAP;
     }
@@ -338,6 +363,29 @@ public:
         return str;
     }
 
+    // Visit the contiguous runs of values covering [begin, end), in order; the parts either side of the gap.
+    // The callback gets a begin/end pointer pair, and returns false to stop the walk.
+    template<class F>
+    void ForEachSegment(size_type begin, size_type end, F&& fn) const
+    {
+        end = std::min(end, size());
+        auto gapStart = size_type(m_pGapStart - m_pStart);
+        if (begin < gapStart)
+        {
+            auto segmentEnd = std::min(end, gapStart);
+            if (begin < segmentEnd && !fn((const T*)m_pStart + begin, (const T*)m_pStart + segmentEnd))
+            {
+                return;
+            }
+        }
+
+        auto segmentBegin = std::max(begin, gapStart);
+        if (segmentBegin < end)
+        {
+            fn((const T*)m_pGapEnd + (segmentBegin - gapStart), (const T*)m_pGapEnd + (end - gapStart));
+        }
+    }
+
     // Assign the whole buffer to this range of values
     template<class iter>
     void assign(iter srcBegin, iter srcEnd)
@@ -532,95 +580,42 @@ public:
 
     // Here we split the find into 2 seperate searches; because we can be smart and search
     // either side of the gap.  This is more efficient that using an iterator which will keep
-    // checking for the gap and trying to jump it
+    // checking for the gap and trying to jump it.  Each side is a plain run of memory, so it
+    // can be searched with memchr or a table lookup (see span_find.hpp)
     template<class ForwardIt>
     auto find_first_of(T* pStart,  T* pEnd, ForwardIt s_first, ForwardIt s_last) const -> T*
     {
-        assert(pEnd <= m_pEnd);
-        assert(pStart <= pEnd);
-        while (pStart < m_pGapStart &&
-            pStart < pEnd)
-        {
-            for (ForwardIt it = s_first; it != s_last; ++it) 
-            {
-                if (*pStart == *it) 
-                {
-                    assert(pStart <= pEnd);
-                    return pStart;
-                }
-            }
-            pStart++;
-        }
-
-        // Skip the gap
-        if (pStart >= m_pGapStart && pStart < m_pGapEnd)
-        {
-            pStart = m_pGapEnd;
-        }
-
-        while (pStart < pEnd)
-        {
-            for (ForwardIt it = s_first; it != s_last; ++it) 
-            {
-                if (*pStart == *it) 
-                {
-                    assert(pStart <= pEnd);
-                    return pStart;
-                }
-            }
-            pStart++;
-        }
-        assert(pStart <= pEnd);
-        return pEnd;
+        SpanFindSet<T, ForwardIt> set(s_first, s_last);
+        return FindInRuns(pStart, pEnd, [&](const T* pBegin, const T* pRunEnd) {
+            return SpanFindFirstOf(pBegin, pRunEnd, set);
+        });
     }
 
     template<class ForwardIt>
     auto find_first_not_of(T* pStart,  T* pEnd, ForwardIt s_first, ForwardIt s_last) const -> T*
     {
-        bool found;
-        while (pStart < m_pGapStart &&
-            pStart < pEnd)
-        {
-            found = false;
-            for (ForwardIt it = s_first; it != s_last; ++it) 
-            {
-                if (*pStart == *it) 
-                {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
-            {
-                return pStart;
-            }
-            pStart++;
-        }
+        SpanFindSet<T, ForwardIt> set(s_first, s_last);
+        return FindInRuns(pStart, pEnd, [&](const T* pBegin, const T* pRunEnd) {
+            return SpanFindFirstNotOf(pBegin, pRunEnd, set);
+        });
+    }
 
-        // Skip the gap
-        if (pStart >= m_pGapStart && pStart < m_pGapEnd)
-        {
-            pStart = m_pGapEnd;
-        }
+    auto find(T* pStart, T* pEnd, const T& value) const -> T*
+    {
+        return FindInRuns(pStart, pEnd, [&](const T* pBegin, const T* pRunEnd) {
+            return SpanFind(pBegin, pRunEnd, value);
+        });
+    }
 
-        while (pStart < pEnd)
-        {
-            found = false;
-            for (ForwardIt it = s_first; it != s_last; ++it)
-            {
-                if (*pStart == *it)
-                {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
-            {
-                return pStart;
-            }
-            pStart++;
-        }
-        return pEnd;
+    auto find(const_iterator first, const_iterator last, const T& value) const -> const_iterator
+    {
+        assert(first <= last);
+        T* pVal = find(GetGaplessPtr(first.p), GetGaplessPtr(last.p), value);
+        auto itr = const_iterator(*this, GetGaplessOffset(pVal));
+        // Return invalid if we walked to end without finding
+        if (itr == last)
+            itr = end();
+        return itr;
     }
 
     // Wrappers around find_*
@@ -684,7 +679,7 @@ private:
         if (m_pStart)
         {
             // Free all memory, including the gap
-            get_allocator().deallocate(m_pStart, m_pEnd - m_pStart);
+            Deallocate(m_pStart, m_pEnd - m_pStart);
         }
         m_pStart = nullptr;
         m_pEnd = nullptr;
@@ -692,6 +687,106 @@ private:
         m_pGapStart = nullptr;
     }
 
+    auto Allocate(size_t count) -> T*
+    {
+        m_stats.allocations++;
+        if constexpr (UseRealloc)
+        {
+            auto pMem = static_cast<T*>(std::malloc(std::max(count, size_t(1)) * sizeof(T)));
+            if (!pMem)
+            {
+                throw std::bad_alloc();
+            }
+            return pMem;
+        }
+        else
+        {
+            return get_allocator().allocate(count);
+        }
+    }
+
+    void Deallocate(T* pMem, size_t count)
+    {
+        if constexpr (UseRealloc)
+        {
+            (void)count;
+            std::free(pMem);
+        }
+        else
+        {
+            get_allocator().deallocate(pMem, count);
+        }
+    }
+
+    // Make the whole block bigger, keeping what is in it at the same offsets
+    auto Grow(size_t newSize) -> T*
+    {
+        m_stats.reallocations++;
+        auto oldSize = CurrentSizeWithGap();
+        if constexpr (UseRealloc)
+        {
+            auto pMem = static_cast<T*>(std::realloc(m_pStart, newSize * sizeof(T)));
+            if (!pMem)
+            {
+                throw std::bad_alloc();
+            }
+
+            // We can't see a remap, so count any move as a copy
+            if (pMem == m_pStart)
+            {
+                m_stats.inPlace++;
+            }
+            else
+            {
+                m_stats.bytesMoved += uint64_t(oldSize * sizeof(T));
+            }
+            return pMem;
+        }
+        else
+        {
+            auto pMem = get_allocator().allocate(newSize);
+            if (m_pStart)
+            {
+                memcpy(pMem, m_pStart, oldSize * sizeof(T));
+                m_stats.bytesMoved += uint64_t(oldSize * sizeof(T));
+                get_allocator().deallocate(m_pStart, oldSize);
+            }
+            return pMem;
+        }
+    }
+
+    // How much room to leave when the gap has to grow
+    auto GrowthGap() const -> size_t
+    {
+        auto gap = size_t(double(size()) * m_growth.factor);
+        return std::max(m_growth.minGap, std::min(gap, m_growth.maxGap));
+    }
+
+    // Search the runs either side of the gap in [pStart, pEnd); fn returns the match in a run, or the end of it
+    template<class F>
+    auto FindInRuns(T* pStart, T* pEnd, F&& fn) const -> T*
+    {
+        assert(pEnd <= m_pEnd);
+        assert(pStart <= pEnd);
+        if (pStart < m_pGapStart)
+        {
+            auto pRunEnd = std::min(pEnd, m_pGapStart);
+            auto pFound = fn(pStart, pRunEnd);
+            if (pFound != pRunEnd)
+            {
+                return const_cast<T*>(pFound);
+            }
+        }
+
+        // Skip the gap
+        pStart = std::max(pStart, m_pGapEnd);
+        if (pStart < pEnd)
+        {
+            return const_cast<T*>(fn(pStart, pEnd));
+        }
+        return pEnd;
+    }
+
     // Return a buffer pos, but skip the gap - used by iterators to walk the buffer
     inline auto GetBufferPtr(size_t offset, bool skipGap = true) const -> T*
     {
@@ -712,7 +807,7 @@ private:
 
         if ((m_pGapEnd - m_pGapStart) < int64_t(size))
         {
-            resizeGap(size + m_defaultGap);
+            resizeGap(size + GrowthGap());
         }
     }
 
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Zep
+{
+
+// Keyword lookup for the syntax highlighters, with a perfect hash built by the compiler.
+// Every word gets its own slot, so a lookup is one hash of the token, one mix to find the slot, and one compare;
+// no allocation and no tree walk.
+// The words are split into buckets by hash, and each bucket gets a seed which moves its words into free slots
+// (the 'hash and displace' scheme).  Finding the seeds is done in constexpr code, from the word lists in syntax_providers.cpp
+
+inline constexpr auto KeywordToLower(char ch) -> char
+{
+    return (ch >= 'A' && ch <= 'Z') ? char(ch - 'A' + 'a') : ch;
+}
+
+// FNV-1a
+inline constexpr auto KeywordHash(std::string_view word, bool caseInsensitive = false) -> uint32_t
+{
+    uint32_t hash = 2166136261u;
+    for (auto ch : word)
+    {
+        hash ^= uint8_t(caseInsensitive ? KeywordToLower(ch) : ch);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Where a word goes with its bucket's seed
+inline constexpr auto KeywordSlot(uint32_t hash, uint32_t seed, uint32_t slotMask) -> uint32_t
+{
+    auto x = hash ^ (seed * 0x9E3779B9u);
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    return x & slotMask;
+}
+
+// A view of a built table; cheap to copy, and points at storage which lives for the program
+class KeywordTable
+{
+public:
+    constexpr KeywordTable() = default;
+    constexpr KeywordTable(const std::string_view* pSlots, uint32_t slotMask, const uint32_t* pSeeds, uint32_t bucketCount, size_t maxLength)
+        : m_pSlots(pSlots)
+        , m_slotMask(slotMask)
+        , m_pSeeds(pSeeds)
+        , m_bucketCount(bucketCount)
+        , m_maxLength(maxLength)
+    {
+    }
+
+    // Case insensitive lookups need lower case words in the table
+    auto Contains(std::string_view word, bool caseInsensitive = false) const -> bool
+    {
+        if (word.empty() || word.size() > m_maxLength)
+        {
+            return false;
+        }
+
+        auto hash = KeywordHash(word, caseInsensitive);
+        auto& slot = m_pSlots[KeywordSlot(hash, m_pSeeds[hash % m_bucketCount], m_slotMask)];
+        if (!caseInsensitive)
+        {
+            return slot == word;
+        }
+
+        if (slot.size() != word.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < word.size(); i++)
+        {
+            if (KeywordToLower(word[i]) != slot[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    auto empty() const -> bool
+    {
+        return m_maxLength == 0;
+    }
+
+private:
+    const std::string_view* m_pSlots = nullptr;
+    uint32_t m_slotMask = 0;
+    const uint32_t* m_pSeeds = nullptr;
+    uint32_t m_bucketCount = 1;
+    size_t m_maxLength = 0;
+};
+
+// The storage for a table of N words; make these static constexpr, with MakeKeywordTable
+template <size_t N>
+class KeywordTableStorage
+{
+public:
+    static constexpr auto CalcSlotCount() -> uint32_t
+    {
+        // At most half full, so the seeds are quick to find
+        uint32_t count = 1;
+        while (count < N * 2)
+        {
+            count <<= 1;
+        }
+        return count;
+    }
+
+    static constexpr uint32_t SlotCount = CalcSlotCount();
+    static constexpr uint32_t BucketCount = uint32_t(N / 2 + 1);
+    static constexpr size_t MaxBucketSize = 16;
+
+    constexpr explicit KeywordTableStorage(const std::array<std::string_view, N>& words)
+    {
+        // Hash the words into buckets, leaving out any repeats; they would never find a slot
+        std::array<uint32_t, N> hashes{};
+        std::array<bool, N> repeat{};
+        std::array<uint32_t, BucketCount + 1> bucketStart{};
+        for (size_t i = 0; i < N; i++)
+        {
+            for (size_t j = 0; j < i; j++)
+            {
+                repeat[i] = repeat[i] || words[j] == words[i];
+            }
+            hashes[i] = KeywordHash(words[i]);
+            if (!repeat[i])
+            {
+                bucketStart[hashes[i] % BucketCount + 1]++;
+                m_maxLength = words[i].size() > m_maxLength ? words[i].size() : m_maxLength;
+            }
+        }
+
+        // Group the words by bucket
+        for (uint32_t b = 0; b < BucketCount; b++)
+        {
+            bucketStart[b + 1] += bucketStart[b];
+        }
+        std::array<uint32_t, N> members{};
+        std::array<uint32_t, BucketCount> fill{};
+        for (size_t i = 0; i < N; i++)
+        {
+            if (!repeat[i])
+            {
+                auto b = hashes[i] % BucketCount;
+                members[bucketStart[b] + fill[b]++] = uint32_t(i);
+            }
+        }
+
+        // Place the biggest buckets first, while there is the most room
+        std::array<uint32_t, BucketCount> order{};
+        for (uint32_t b = 0; b < BucketCount; b++)
+        {
+            order[b] = b;
+            for (auto o = b; o > 0 && fill[order[o - 1]] < fill[order[o]]; o--)
+            {
+                auto tmp = order[o];
+                order[o] = order[o - 1];
+                order[o - 1] = tmp;
+            }
+        }
+
+        std::array<bool, SlotCount> used{};
+        for (auto b : order)
+        {
+            auto count = fill[b];
+            if (count == 0)
+            {
+                break;
+            }
+
+            // A bucket this big means a terrible hash; stop the build rather than search forever
+            if (count > MaxBucketSize)
+            {
+                throw "Keyword bucket too big";
+            }
+
+            // Find a seed which puts every word in the bucket in a free slot of its own
+            for (uint32_t seed = 1;; seed++)
+            {
+                std::array<uint32_t, MaxBucketSize> slots{};
+                auto fits = true;
+                for (uint32_t m = 0; m < count && fits; m++)
+                {
+                    slots[m] = KeywordSlot(hashes[members[bucketStart[b] + m]], seed, SlotCount - 1);
+                    fits = !used[slots[m]];
+                    for (uint32_t other = 0; other < m && fits; other++)
+                    {
+                        fits = slots[other] != slots[m];
+                    }
+                }
+
+                if (fits)
+                {
+                    m_seeds[b] = seed;
+                    for (uint32_t m = 0; m < count; m++)
+                    {
+                        used[slots[m]] = true;
+                        m_slots[slots[m]] = words[members[bucketStart[b] + m]];
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    constexpr auto Table() const -> KeywordTable
+    {
+        return KeywordTable(m_slots.data(), SlotCount - 1, m_seeds.data(), BucketCount, m_maxLength);
+    }
+
+private:
+    std::array<std::string_view, SlotCount> m_slots{};
+    std::array<uint32_t, BucketCount> m_seeds{};
+    size_t m_maxLength = 0;
+};
+
+template <class... Words>
+constexpr auto MakeKeywordTable(Words... words) -> KeywordTableStorage<sizeof...(Words)>
+{
+    return KeywordTableStorage<sizeof...(Words)>(std::array<std::string_view, sizeof...(Words)>{ std::string_view(words)... });
+}
+
+// A table of words which are only known at run time; for example a syntax provider's own word lists.
+// It is built the same way, and keeps its own copy of the words; its table is good for as long as it is alive
+class KeywordSet
+{
+public:
+    explicit KeywordSet(const std::set<std::string_view>& words);
+    KeywordSet(const KeywordSet&) = delete;
+    auto operator=(const KeywordSet&) -> KeywordSet& = delete;
+
+    auto Table() const -> KeywordTable
+    {
+        return KeywordTable(m_slots.data(), uint32_t(m_slots.size() - 1), m_seeds.data(), uint32_t(m_seeds.size()), m_maxLength);
+    }
+
+private:
+    std::vector<std::string> m_words;
+    std::vector<std::string_view> m_slots;
+    std::vector<uint32_t> m_seeds;
+    size_t m_maxLength = 0;
+};
+
+} // namespace Zep
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace Zep
+{
+
+// A running total over an array, which can be updated and summed in O(log n); also known as a Fenwick tree
+template <typename T>
+class BasicPrefixSumTree
+{
+public:
+    void Build(const std::vector<T>& values)
+    {
+        auto count = values.size();
+        m_tree.assign(count + 1, T(0));
+        for (size_t i = 1; i <= count; i++)
+        {
+            m_tree[i] += values[i - 1];
+            auto parent = i + (i & (~i + 1));
+            if (parent <= count)
+            {
+                m_tree[parent] += m_tree[i];
+            }
+        }
+    }
+
+    void Add(size_t index, T delta)
+    {
+        for (auto i = index + 1; i < m_tree.size(); i += (i & (~i + 1)))
+        {
+            m_tree[i] += delta;
+        }
+    }
+
+    // Sum of the first count values
+    auto Sum(size_t count) const -> T
+    {
+        T total = 0;
+        for (auto i = count; i > 0; i -= (i & (~i + 1)))
+        {
+            total += m_tree[i];
+        }
+        return total;
+    }
+
+    // How many values, from the start, add up to no more than total
+    auto Count(T total) const -> size_t
+    {
+        // Walk down the tree, taking every step that doesn't go over the total.
+        // Only works because the values are never negative
+        auto count = m_tree.size() - 1;
+        size_t step = 1;
+        while ((step << 1) <= count)
+        {
+            step <<= 1;
+        }
+
+        size_t pos = 0;
+        for (; step > 0; step >>= 1)
+        {
+            if (pos + step <= count && m_tree[pos + step] <= total)
+            {
+                pos += step;
+                total -= m_tree[pos];
+            }
+        }
+        return pos;
+    }
+
+private:
+    std::vector<T> m_tree; // 1 based
+};
+
+using PrefixSumTree = BasicPrefixSumTree<int32_t>;
+
+// The end offsets of each line in a buffer.
+// The ends are kept in chunks of a few hundred lines, each relative to the start of its chunk, with a prefix sum tree over the chunk
+// sizes.  So an edit only has to shift the line ends after it in its own chunk, and update the tree; instead of moving every line in the
+// rest of the file.  Looking up a line, or the line for an offset, is O(log n)
+class LineIndex
+{
+private:
+    struct Chunk
+    {
+        std::vector<int32_t> ends; // Relative to the end of the previous chunk
+    };
+
+public:
+    // Walks the line ends in order, a chunk at a time; a view of the index, without copying it
+    class const_iterator
+    {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = int32_t;
+        using pointer = const int32_t*;
+        using reference = int32_t;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        const_iterator(const LineIndex& index, size_t chunk, size_t pos, int32_t chunkStart)
+            : m_pIndex(&index)
+            , m_chunk(chunk)
+            , m_pos(pos)
+            , m_chunkStart(chunkStart)
+        {
+        }
+
+        auto operator==(const const_iterator& rhs) const -> bool { return m_chunk == rhs.m_chunk && m_pos == rhs.m_pos; }
+        auto operator!=(const const_iterator& rhs) const -> bool { return !(*this == rhs); }
+
+        auto operator*() const -> int32_t
+        {
+            return m_chunkStart + m_pIndex->m_chunks[m_chunk].ends[m_pos];
+        }
+
+        auto operator++() -> const_iterator&
+        {
+            auto& ends = m_pIndex->m_chunks[m_chunk].ends;
+            if (++m_pos == ends.size())
+            {
+                m_chunkStart += ends.back();
+                m_chunk++;
+                m_pos = 0;
+            }
+            return *this;
+        }
+
+        auto operator++(int) -> const_iterator
+        {
+            auto old = *this;
+            ++(*this);
+            return old;
+        }
+
+        auto operator--() -> const_iterator&
+        {
+            if (m_pos == 0)
+            {
+                m_chunk--;
+                m_chunkStart -= m_pIndex->m_chunks[m_chunk].ends.back();
+                m_pos = m_pIndex->m_chunks[m_chunk].ends.size();
+            }
+            m_pos--;
+            return *this;
+        }
+
+        auto operator--(int) -> const_iterator
+        {
+            auto old = *this;
+            --(*this);
+            return old;
+        }
+
+    private:
+        const LineIndex* m_pIndex;
+        size_t m_chunk;
+        size_t m_pos;
+        int32_t m_chunkStart;
+    };
+
+    LineIndex();
+
+    void Clear();
+    void Assign(const std::vector<int32_t>& lineEnds);
+    void PushBack(int32_t lineEnd);
+
+    auto size() const -> size_t
+    {
+        return size_t(m_lineCount);
+    }
+
+    [[nodiscard]] auto empty() const -> bool
+    {
+        return m_lineCount == 0;
+    }
+
+    // The offset just after the end of the line
+    auto LineEnd(int32_t line) const -> int32_t;
+
+    auto operator[](int32_t line) const -> int32_t
+    {
+        return LineEnd(line);
+    }
+
+    auto begin() const -> const_iterator
+    {
+        return const_iterator(*this, 0, 0, 0);
+    }
+
+    auto end() const -> const_iterator
+    {
+        return const_iterator(*this, m_chunks.size(), 0, m_chunkSizes.Sum(m_chunks.size()));
+    }
+
+    // The first line which ends after this offset, or size() if none do
+    auto LineFromOffset(int32_t offset) const -> int32_t;
+
+    // Text of this length was inserted at the offset; the new line ends are in the updated text, in order
+    void Insert(int32_t offset, int32_t length, const std::vector<int32_t>& newLineEnds);
+
+    // The text between the offsets was removed
+    void Erase(int32_t startOffset, int32_t endOffset);
+
+    auto ToVector() const -> std::vector<int32_t>;
+
+private:
+    auto ChunkStart(size_t chunk) const -> int32_t;
+    auto FindChunk(int32_t offset) const -> size_t;
+    void Rebuild(std::vector<Chunk>::iterator itrFirst, std::vector<Chunk>::iterator itrLast, const std::vector<int32_t>& lineEnds, int32_t chunkStart);
+    void UpdateTrees();
+
+private:
+    std::vector<Chunk> m_chunks;
+    PrefixSumTree m_chunkSizes; // Characters in each chunk
+    PrefixSumTree m_chunkLines; // Lines in each chunk
+    int32_t m_lineCount = 0;
+};
+
+} // namespace Zep
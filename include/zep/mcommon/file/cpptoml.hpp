@@ -1819,7 +1819,7 @@ public:
 
     void operator()(std::string_view str)
     {
-        std::for_each(str.begin(), str.end() - 1,
+        std::for_each(str.begin(), str.end(),
             [&](char c) { (*this)(c); });
     }
 
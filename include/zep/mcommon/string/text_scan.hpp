@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Zep
+{
+
+// Fast scanning of text for the characters that matter when it comes into a buffer: \n, \r and \t.
+// Uses AVX2 or SSE2 where the CPU has them, and falls back to a plain loop everywhere else.
+enum class TextScanLevel
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// The best level this CPU supports
+auto GetTextScanLevel() -> TextScanLevel;
+auto GetTextScanLevelName(TextScanLevel level) -> const char*;
+
+struct LineCharCounts
+{
+    size_t lineFeeds = 0;
+    size_t carriageReturns = 0;
+    size_t tabs = 0;
+};
+
+// Append the offset of every \n, \r and \t in the text, in order.
+// The counts let the caller size its output before doing anything with them.
+auto ScanLineChars(const uint8_t* pBegin, const uint8_t* pEnd, std::vector<size_t>& offsets, TextScanLevel level = GetTextScanLevel()) -> LineCharCounts;
+
+// Append the end of every line in the text (the offset just after each \n), plus base
+void ScanLineEnds(const uint8_t* pBegin, const uint8_t* pEnd, int32_t base, std::vector<int32_t>& lineEnds, TextScanLevel level = GetTextScanLevel());
+
+} // namespace Zep
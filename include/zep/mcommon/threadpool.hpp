@@ -114,6 +114,11 @@ public:
         this->condition.notify_one();
         return res;
     }
+    // How many threads run the tasks; 0 if they run immediately on the caller's thread
+    auto size() const -> size_t
+    {
+        return workers.size();
+    }
     // the destructor joins all threads
     virtual ~ThreadPool()
     {
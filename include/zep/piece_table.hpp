@@ -0,0 +1,550 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+// An STL-friendly PieceTable
+// The text is described by a list of 'pieces', each one a run of characters in one of two buffers:
+// the original text (never modified after assign), and an 'added' buffer which only ever grows.
+// Inserting text appends it to the added buffer and splices a new piece into the list; deleting text just
+// trims or drops pieces.  Neither operation touches the rest of the text, so the cost of an edit doesn't
+// depend on where it is in the file, unlike the GapBuffer which has to move the gap to the edit point first.
+// The pieces are kept in an implicit treap (a randomly balanced binary tree, ordered by position in the text,
+// where each node knows the length of the text in its subtree), so finding, splitting and joining pieces is O(log n)
+// in the number of pieces.
+// Reads are cached per thread, so walking the table in order with an iterator only searches the tree when it
+// steps onto the next piece.
+template <class T>
+class PieceTable
+{
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = const T&;
+    using const_reference = const T&;
+
+    class const_iterator
+    {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = const T*;
+        using reference = const T&;
+        using iterator_category = std::random_access_iterator_tag;
+
+        size_t p = 0;
+        const PieceTable<T>* pTable = nullptr;
+
+        const_iterator(const PieceTable<T>& table, size_t ptr) : p(ptr), pTable(&table) { }
+
+        auto operator==(const const_iterator& rhs) const -> bool { return (p == rhs.p); }
+        auto operator!=(const const_iterator& rhs) const -> bool { return (p != rhs.p); }
+        auto operator<(const const_iterator& rhs) const -> bool { return (p < rhs.p); }
+        auto operator>(const const_iterator& rhs) const -> bool { return (p > rhs.p); }
+        auto operator<=(const const_iterator& rhs) const -> bool { return (p <= rhs.p); }
+        auto operator>=(const const_iterator& rhs) const -> bool { return (p >= rhs.p); }
+
+        auto operator++() -> const_iterator& { p++; return *this; }
+        auto operator++(int) -> const_iterator { auto pOld = p; p++; return const_iterator(*pTable, pOld); }
+        auto operator--() -> const_iterator& { p--; return *this; }
+        auto operator--(int) -> const_iterator { auto pOld = p; p--; return const_iterator(*pTable, pOld); }
+
+        auto operator+=(difference_type rhs) -> const_iterator& { p += rhs; return *this; }
+        auto operator+(difference_type rhs) const -> const_iterator { return const_iterator(*pTable, p + rhs); }
+        auto operator-=(difference_type rhs) -> const_iterator& { p -= rhs; return *this; }
+        auto operator-(difference_type rhs) const -> const_iterator { return const_iterator(*pTable, p - rhs); }
+        auto operator-(const const_iterator& itr) const -> difference_type { return difference_type(p) - difference_type(itr.p); }
+
+        auto operator*() const -> reference { return (*pTable)[p]; }
+        auto operator->() const -> pointer { return &(*pTable)[p]; }
+        auto operator[](difference_type distance) const -> reference { return (*pTable)[p + distance]; }
+    };
+
+    // The table is read only through iterators; edits go through insert/erase
+    using iterator = const_iterator;
+
+public:
+    PieceTable() = default;
+
+    // No copy constructor yet
+    PieceTable(const PieceTable& copy) = delete;
+    auto operator=(const PieceTable& copy) -> PieceTable& = delete;
+
+    auto begin() const -> const_iterator { return const_iterator(*this, 0); }
+    auto cbegin() const -> const_iterator { return const_iterator(*this, 0); }
+    auto end() const -> const_iterator { return const_iterator(*this, size()); }
+    auto cend() const -> const_iterator { return const_iterator(*this, size()); }
+
+    inline auto size() const -> size_type { return Length(m_root); }
+    [[nodiscard]] inline auto empty() const -> bool { return size() == 0; }
+
+    // Number of pieces currently describing the text; useful for tests and to judge fragmentation
+    auto piece_count() const -> size_type { return m_nodes.size() - m_freeNodes.size(); }
+
+    void clear()
+    {
+        m_nodes.clear();
+        m_freeNodes.clear();
+        m_added.clear();
+        m_root = -1;
+        m_pOriginal = nullptr;
+        m_originalSize = 0;
+        m_spOriginalOwner.reset();
+        Modified();
+    }
+
+    // Assign the whole table to this range of values.  The values become the original buffer.
+    template <class iter>
+    void assign(iter srcBegin, iter srcEnd)
+    {
+        auto spData = std::make_shared<std::vector<T>>(srcBegin, srcEnd);
+        clear();
+
+        m_pOriginal = spData->data();
+        m_originalSize = spData->size();
+        m_spOriginalOwner = spData;
+        if (m_originalSize > 0)
+        {
+            m_root = NewNode(Piece{ Source::Original, 0, m_originalSize });
+        }
+    }
+
+    // Assign the table to a range of memory it doesn't own, without copying it; for example a memory mapped file.
+    // The owner is kept alive until the table is cleared or re-assigned.
+    void assign_view(const T* pBegin, const T* pEnd, std::shared_ptr<const void> spOwner)
+    {
+        clear();
+
+        m_pOriginal = pBegin;
+        m_originalSize = size_t(pEnd - pBegin);
+        m_spOriginalOwner = std::move(spOwner);
+        if (m_originalSize > 0)
+        {
+            m_root = NewNode(Piece{ Source::Original, 0, m_originalSize });
+        }
+    }
+
+    // Copy the parts of the original text still in use into the added text, and let go of the original.
+    // The text doesn't change; but memory the table doesn't own, like a mapped file, is no longer needed
+    void own_original()
+    {
+        if (m_pOriginal == nullptr)
+        {
+            return;
+        }
+
+        std::vector<int32_t> nodes;
+        if (m_root >= 0)
+        {
+            nodes.push_back(m_root);
+        }
+        while (!nodes.empty())
+        {
+            auto& n = m_nodes[nodes.back()];
+            nodes.pop_back();
+            if (n.piece.source == Source::Original)
+            {
+                auto pData = PieceData(n.piece);
+                n.piece.source = Source::Added;
+                n.piece.start = m_added.size();
+                m_added.insert(m_added.end(), pData, pData + n.piece.length);
+            }
+            if (n.left >= 0)
+            {
+                nodes.push_back(n.left);
+            }
+            if (n.right >= 0)
+            {
+                nodes.push_back(n.right);
+            }
+        }
+
+        m_pOriginal = nullptr;
+        m_originalSize = 0;
+        m_spOriginalOwner.reset();
+        Modified();
+    }
+
+    template <class iter>
+    auto insert(const_iterator pt, iter srcStart, iter srcEnd) -> iterator
+    {
+        assert(pt.p <= size());
+
+        auto count = size_t(std::distance(srcStart, srcEnd));
+        if (count == 0)
+        {
+            return iterator(*this, pt.p);
+        }
+
+        auto addStart = m_added.size();
+        m_added.insert(m_added.end(), srcStart, srcEnd);
+
+        InsertPiece(pt.p, Piece{ Source::Added, addStart, count });
+        return iterator(*this, pt.p);
+    }
+
+    auto erase(const_iterator start, const_iterator end) -> iterator
+    {
+        assert(start.p <= end.p && end.p <= size());
+        if (start.p == end.p)
+        {
+            return iterator(*this, start.p);
+        }
+
+        int32_t left;
+        int32_t middle;
+        int32_t right;
+        Split(m_root, start.p, left, right);
+        Split(right, end.p - start.p, middle, right);
+        FreeTree(middle);
+        m_root = Merge(left, right);
+
+        Modified();
+        return iterator(*this, start.p);
+    }
+
+    auto erase(const_iterator start) -> iterator
+    {
+        assert(start.p < size());
+        return erase(start, start + 1);
+    }
+
+    void push_back(const T& v)
+    {
+        insert(end(), &v, &v + 1);
+    }
+
+    void pop_back()
+    {
+        assert(!empty());
+        erase(end() - 1);
+    }
+
+    auto operator[](size_type pos) const -> const_reference
+    {
+        assert(pos < size());
+
+        // Most reads are in order, so remember the last piece this thread looked at
+        struct ReadCache
+        {
+            const PieceTable<T>* pTable = nullptr;
+            uint64_t version = 0;
+            size_t start = 0;
+            size_t end = 0;
+            const T* pData = nullptr;
+        };
+        static thread_local ReadCache cache;
+
+        if (cache.pTable != this || cache.version != m_version || pos < cache.start || pos >= cache.end)
+        {
+            size_t pieceStart;
+            auto node = FindNode(pos, pieceStart);
+            auto& piece = m_nodes[node].piece;
+            cache.pTable = this;
+            cache.version = m_version;
+            cache.start = pieceStart;
+            cache.end = pieceStart + piece.length;
+            cache.pData = PieceData(piece);
+        }
+        return cache.pData[pos - cache.start];
+    }
+
+    auto at(size_type pos) const -> const_reference
+    {
+        return (*this)[pos];
+    }
+
+    // Visit the contiguous runs of text covering [begin, end), in order.
+    // The callback gets a begin/end pointer pair, and returns false to stop the walk.
+    template <class F>
+    void ForEachSegment(size_type begin, size_type end, F&& fn) const
+    {
+        end = std::min(end, size());
+        VisitSegments(m_root, 0, begin, end, fn);
+    }
+
+    // Return a string version of the table; used for testing/validation
+    [[nodiscard]] auto string() const -> std::string
+    {
+        std::string str;
+        str.reserve(size());
+        ForEachSegment(0, size(), [&](const T* pBegin, const T* pEnd) {
+            str.append((const char*)pBegin, (const char*)pEnd);
+            return true;
+        });
+        return str;
+    }
+
+private:
+    enum class Source : uint8_t
+    {
+        Original,
+        Added
+    };
+
+    struct Piece
+    {
+        Source source;
+        size_t start;
+        size_t length;
+    };
+
+    struct Node
+    {
+        Piece piece;
+        size_t subtreeLength;
+        uint32_t priority;
+        int32_t left;
+        int32_t right;
+    };
+
+    void Modified()
+    {
+        static std::atomic<uint64_t> versionCounter{ 0 };
+        m_version = ++versionCounter;
+    }
+
+    inline auto Length(int32_t node) const -> size_t
+    {
+        return node < 0 ? 0 : m_nodes[node].subtreeLength;
+    }
+
+    inline void Update(int32_t node)
+    {
+        auto& n = m_nodes[node];
+        n.subtreeLength = Length(n.left) + n.piece.length + Length(n.right);
+    }
+
+    inline auto PieceData(const Piece& piece) const -> const T*
+    {
+        return (piece.source == Source::Original ? m_pOriginal : m_added.data()) + piece.start;
+    }
+
+    auto NewNode(const Piece& piece) -> int32_t
+    {
+        // Xorshift; the priorities only need to be well spread, not secure
+        m_seed ^= m_seed << 13;
+        m_seed ^= m_seed >> 17;
+        m_seed ^= m_seed << 5;
+
+        Node node{ piece, piece.length, m_seed, -1, -1 };
+        if (!m_freeNodes.empty())
+        {
+            auto index = m_freeNodes.back();
+            m_freeNodes.pop_back();
+            m_nodes[index] = node;
+            return index;
+        }
+        m_nodes.push_back(node);
+        return int32_t(m_nodes.size() - 1);
+    }
+
+    void FreeTree(int32_t node)
+    {
+        if (node < 0)
+        {
+            return;
+        }
+
+        std::vector<int32_t> stack{ node };
+        while (!stack.empty())
+        {
+            auto current = stack.back();
+            stack.pop_back();
+            if (m_nodes[current].left >= 0)
+            {
+                stack.push_back(m_nodes[current].left);
+            }
+            if (m_nodes[current].right >= 0)
+            {
+                stack.push_back(m_nodes[current].right);
+            }
+            m_freeNodes.push_back(current);
+        }
+    }
+
+    // Join two trees, where all of 'left' comes before all of 'right' in the text
+    auto Merge(int32_t left, int32_t right) -> int32_t
+    {
+        if (left < 0)
+        {
+            return right;
+        }
+        if (right < 0)
+        {
+            return left;
+        }
+
+        if (m_nodes[left].priority > m_nodes[right].priority)
+        {
+            m_nodes[left].right = Merge(m_nodes[left].right, right);
+            Update(left);
+            return left;
+        }
+
+        m_nodes[right].left = Merge(left, m_nodes[right].left);
+        Update(right);
+        return right;
+    }
+
+    // Split a tree into the first 'offset' characters and the rest, cutting a piece in 2 if necessary
+    void Split(int32_t node, size_t offset, int32_t& left, int32_t& right)
+    {
+        if (node < 0)
+        {
+            left = right = -1;
+            return;
+        }
+
+        auto leftLength = Length(m_nodes[node].left);
+        auto pieceLength = m_nodes[node].piece.length;
+        if (offset <= leftLength)
+        {
+            int32_t subRight;
+            Split(m_nodes[node].left, offset, left, subRight);
+            m_nodes[node].left = subRight;
+            Update(node);
+            right = node;
+        }
+        else if (offset >= leftLength + pieceLength)
+        {
+            int32_t subLeft;
+            Split(m_nodes[node].right, offset - leftLength - pieceLength, subLeft, right);
+            m_nodes[node].right = subLeft;
+            Update(node);
+            left = node;
+        }
+        else
+        {
+            // The split point is inside this piece; the node keeps the head, a new node takes the tail
+            auto inner = offset - leftLength;
+            auto piece = m_nodes[node].piece;
+            auto tail = NewNode(Piece{ piece.source, piece.start + inner, piece.length - inner });
+
+            auto oldRight = m_nodes[node].right;
+            m_nodes[node].piece.length = inner;
+            m_nodes[node].right = -1;
+            Update(node);
+
+            left = node;
+            right = Merge(tail, oldRight);
+        }
+    }
+
+    void InsertPiece(size_t pos, const Piece& piece)
+    {
+        int32_t left;
+        int32_t right;
+        Split(m_root, pos, left, right);
+
+        // Typing adds text to the end of the added buffer, right after the previous insert.
+        // In that case we can just grow the piece before the insert point instead of adding a new one.
+        auto last = left;
+        while (last >= 0 && m_nodes[last].right >= 0)
+        {
+            last = m_nodes[last].right;
+        }
+
+        if (last >= 0 && piece.source == Source::Added
+            && m_nodes[last].piece.source == Source::Added
+            && m_nodes[last].piece.start + m_nodes[last].piece.length == piece.start)
+        {
+            for (auto node = left; node >= 0; node = m_nodes[node].right)
+            {
+                m_nodes[node].subtreeLength += piece.length;
+            }
+            m_nodes[last].piece.length += piece.length;
+        }
+        else
+        {
+            left = Merge(left, NewNode(piece));
+        }
+
+        m_root = Merge(left, right);
+        Modified();
+    }
+
+    // Find the node holding the character at pos, and the text offset of the start of its piece
+    auto FindNode(size_t pos, size_t& pieceStart) const -> int32_t
+    {
+        auto node = m_root;
+        size_t base = 0;
+        while (node >= 0)
+        {
+            auto& n = m_nodes[node];
+            auto leftLength = Length(n.left);
+            if (pos < base + leftLength)
+            {
+                node = n.left;
+            }
+            else if (pos < base + leftLength + n.piece.length)
+            {
+                pieceStart = base + leftLength;
+                return node;
+            }
+            else
+            {
+                base += leftLength + n.piece.length;
+                node = n.right;
+            }
+        }
+        assert(!"Position outside the piece table");
+        pieceStart = 0;
+        return m_root;
+    }
+
+    template <class F>
+    auto VisitSegments(int32_t node, size_t base, size_t begin, size_t end, F& fn) const -> bool
+    {
+        if (node < 0 || begin >= end)
+        {
+            return true;
+        }
+
+        auto& n = m_nodes[node];
+        auto pieceStart = base + Length(n.left);
+        auto pieceEnd = pieceStart + n.piece.length;
+
+        if (begin < pieceStart && !VisitSegments(n.left, base, begin, end, fn))
+        {
+            return false;
+        }
+
+        auto segStart = std::max(begin, pieceStart);
+        auto segEnd = std::min(end, pieceEnd);
+        if (segStart < segEnd)
+        {
+            auto pData = PieceData(n.piece);
+            if (!fn(pData + (segStart - pieceStart), pData + (segEnd - pieceStart)))
+            {
+                return false;
+            }
+        }
+
+        if (end > pieceEnd)
+        {
+            return VisitSegments(n.right, pieceEnd, begin, end, fn);
+        }
+        return true;
+    }
+
+private:
+    std::vector<Node> m_nodes; // Tree nodes, addressed by index
+    std::vector<int32_t> m_freeNodes; // Released node slots, for reuse
+    int32_t m_root = -1; // Root of the treap; -1 when empty
+    uint32_t m_seed = 0x9E3779B9; // Priority generator state
+
+    const T* m_pOriginal = nullptr; // The original text
+    size_t m_originalSize = 0;
+    std::shared_ptr<const void> m_spOriginalOwner; // Keeps the original text alive
+    std::vector<T> m_added; // Append only buffer of inserted text
+
+    uint64_t m_version = 0; // Changes on every edit; invalidates read caches
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+// Searches over one contiguous run of values, as handed out by the storage ForEachSegment functions.
+// Inside a run there is no gap or piece boundary to check for, so byte text can go to memchr (which is
+// vectorized in every C library we build against), and a set of bytes is tested with a single bit lookup
+// instead of a loop over the set.
+// Anything that isn't byte sized falls back to the std algorithms.
+
+template <class T>
+constexpr bool SpanIsBytes = sizeof(T) == 1 && std::is_integral<T>::value;
+
+// A set of values to search for; built once per search, not once per segment
+template <class T, class ForwardIt>
+class SpanFindSet
+{
+public:
+    SpanFindSet(ForwardIt s_first, ForwardIt s_last)
+        : m_first(s_first)
+        , m_last(s_last)
+    {
+        if constexpr (SpanIsBytes<T>)
+        {
+            for (auto itr = s_first; itr != s_last; itr++)
+            {
+                auto value = uint8_t(*itr);
+                m_bits[value >> 6] |= uint64_t(1) << (value & 63);
+                m_count++;
+            }
+            m_single = m_count == 1 ? T(*s_first) : T(0);
+        }
+    }
+
+    auto Contains(const T& value) const -> bool
+    {
+        if constexpr (SpanIsBytes<T>)
+        {
+            auto byte = uint8_t(value);
+            return ((m_bits[byte >> 6] >> (byte & 63)) & 1) != 0;
+        }
+        else
+        {
+            return std::find(m_first, m_last, value) != m_last;
+        }
+    }
+
+    // A set of one can just be memchr'd
+    auto IsSingle() const -> bool
+    {
+        return m_count == 1;
+    }
+
+    auto Single() const -> T
+    {
+        return m_single;
+    }
+
+private:
+    ForwardIt m_first;
+    ForwardIt m_last;
+    uint64_t m_bits[4] = { 0, 0, 0, 0 }; // One per byte value
+    size_t m_count = 0;
+    T m_single = T(0);
+};
+
+// Build the set once, outside a loop of searches; for short searches, building it can cost more than the search
+template <class T, class ForwardIt>
+auto MakeSpanFindSet(ForwardIt s_first, ForwardIt s_last) -> SpanFindSet<T, ForwardIt>
+{
+    return SpanFindSet<T, ForwardIt>(s_first, s_last);
+}
+
+template <class T>
+auto SpanFind(const T* pBegin, const T* pEnd, const T& value) -> const T*
+{
+    if constexpr (SpanIsBytes<T>)
+    {
+        auto pFound = static_cast<const T*>(memchr(pBegin, int(uint8_t(value)), size_t(pEnd - pBegin)));
+        return pFound ? pFound : pEnd;
+    }
+    else
+    {
+        return std::find(pBegin, pEnd, value);
+    }
+}
+
+template <class T, class Set>
+auto SpanFindFirstOf(const T* pBegin, const T* pEnd, const Set& set) -> const T*
+{
+    if (set.IsSingle())
+    {
+        return SpanFind(pBegin, pEnd, set.Single());
+    }
+    return std::find_if(pBegin, pEnd, [&](const T& value) { return set.Contains(value); });
+}
+
+template <class T, class Set>
+auto SpanFindFirstNotOf(const T* pBegin, const T* pEnd, const Set& set) -> const T*
+{
+    return std::find_if(pBegin, pEnd, [&](const T& value) { return !set.Contains(value); });
+}
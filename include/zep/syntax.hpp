@@ -1,25 +1,25 @@
 #pragma once
 
 #include "zep/buffer.hpp"
+#include "zep/keyword_table.hpp"
+#include "zep/span_find.hpp"
+#include "zep/syntax_store.hpp"
 
 #include <atomic>
 #include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <string_view>
+#include <shared_mutex>
+#include <string>
 #include <vector>
 
 namespace Zep
 {
 
-enum class ThemeColor;
-
-struct CommentEntry
-{
-    bool isStart;
-    bool isMultiLine;
-    uint32_t location;
-    uint32_t entries;
-};
+enum class ThemeColor : uint8_t;
 
 namespace ZepSyntaxFlags
 {
@@ -29,11 +29,57 @@ enum
 };
 } // namespace ZepSyntaxFlags
 
-struct SyntaxData
+// A comment or a string: everything from the open to the close is one color, whatever is in it.
+// The lexer works from a table of these, which the syntax provider gives it
+struct SyntaxRegion
 {
-    ThemeColor foreground = ThemeColor::Normal;
-    ThemeColor background = ThemeColor::None;
-    bool underline = false;
+    std::string open;
+    std::string close; // Empty to run to the end of the line
+    ThemeColor color = ThemeColor::String;
+    char escape = 0; // The character after this one can't close it
+    bool multiLine = true; // Carries on to the next line if it isn't closed
+    bool nested = false; // Each open inside it needs its own close
+
+    // Raw strings, like R"x(...)x" or [==[...]==], have a delimiter after the open, up to delimiterOpen.
+    // They are closed by delimiterClose, the same delimiter, and then the close
+    char delimiterOpen = 0;
+    char delimiterClose = 0;
+    std::string delimiterChars; // What the delimiter can be made of; empty for anything but spaces, brackets and backslashes
+
+    static auto LineComment(const std::string& open) -> SyntaxRegion;
+    static auto BlockComment(const std::string& open, const std::string& close, bool nested = false) -> SyntaxRegion;
+    static auto String(const std::string& quote, char escape = '\\', bool multiLine = true) -> SyntaxRegion;
+    static auto RawString(const std::string& open, char delimiterOpen, char delimiterClose, const std::string& close, const std::string& delimiterChars = "", ThemeColor color = ThemeColor::String) -> SyntaxRegion;
+};
+
+// Tried in order at each place, so a longer open must come before any shorter one it starts with
+using SyntaxRules = std::vector<SyntaxRegion>;
+
+// Line and block comments, and strings and chars with backslash escapes
+auto CSyntaxRules() -> SyntaxRules;
+
+// What the lexer is in the middle of at the end of a line; the next line carries on from here
+struct SyntaxLineState
+{
+    bool lexed = false; // Not lexed yet; never matches a real state
+    uint8_t region = 0; // Inside a comment or string: one more than its index in the rules
+    uint16_t depth = 0; // How many more opens than closes, inside a nested comment
+    uint32_t delimiter = 0; // The raw string delimiter, from the syntax's list of them
+
+    static constexpr auto Normal() -> SyntaxLineState
+    {
+        return SyntaxLineState{ true, 0, 0, 0 };
+    }
+
+    auto operator==(const SyntaxLineState& rhs) const -> bool
+    {
+        return lexed == rhs.lexed && region == rhs.region && depth == rhs.depth && delimiter == rhs.delimiter;
+    }
+
+    auto operator!=(const SyntaxLineState& rhs) const -> bool
+    {
+        return !(*this == rhs);
+    }
 };
 
 class ZepSyntaxAdorn;
@@ -41,13 +87,32 @@ class ZepSyntax : public ZepComponent
 {
 public:
     ZepSyntax(ZepBuffer& buffer,
-        std::set<std::string_view> keywords = std::set<std::string_view>{},
-        std::set<std::string_view> identifiers = std::set<std::string_view>{},
-        uint32_t flags = 0);
+        KeywordTable keywords = KeywordTable{},
+        KeywordTable identifiers = KeywordTable{},
+        uint32_t flags = 0,
+        SyntaxRules rules = CSyntaxRules());
+
+    // For syntax providers with their own word lists; the tables are built from them here
+    ZepSyntax(ZepBuffer& buffer,
+        const std::set<std::string_view>& keywords,
+        const std::set<std::string_view>& identifiers = std::set<std::string_view>{},
+        uint32_t flags = 0,
+        SyntaxRules rules = CSyntaxRules());
     ~ZepSyntax() override;
 
+    // These never wait for the highlighter; they show the last version it published, which may be a version behind the text
     virtual auto GetSyntaxAt(int32_t offset) const -> SyntaxData;
+    auto GetSyntaxAt(const SyntaxSnapshot& snapshot, int32_t offset) const -> SyntaxData;
+
+    // The latest colors; keep hold of it to look up a lot of them
+    auto GetSnapshot() const -> std::shared_ptr<const SyntaxSnapshot>
+    {
+        return std::atomic_load(&m_spSnapshot);
+    }
+
     virtual void UpdateSyntax();
+
+    // Stop every lex and wait for them; what they didn't get to stays pending.  Edits don't need this, they just move the lex on
     virtual void Interrupt();
     virtual void Wait() const;
 
@@ -55,29 +120,92 @@ public:
     {
         return m_processedChar;
     }
-    virtual auto GetText() const -> const std::vector<SyntaxData>&
+
+    // How many lines have been lexed, in total; an edit should only add the lines it really changed
+    auto GetLexedLineCount() const -> uint64_t
+    {
+        return m_lexedLines;
+    }
+
+    // Big runs of lines, such as a newly loaded file, are lexed in chunks of about this many characters, on all the threads in the pool.
+    // 0 lexes everything on one thread; which is the default if the pool has no threads to share the work
+    void SetParallelChunkSize(int32_t size)
     {
-        return m_syntax;
+        m_parallelChunkSize = size;
     }
+
+    // A window is about to show these lines; with lazy syntax, they are colored now if they aren't already
+    void ShowLines(int32_t firstLine, int32_t lastLine);
+
     void Notify(std::shared_ptr<ZepMessage> message) override;
 
+protected:
+    // Color one line, starting in the given state, and return the state at the end of it.
+    // The colors go in the runs, which start empty, from the line start; anything left over is the default
+    virtual auto UpdateLine(BufferLocation lineStart, BufferLocation lineEnd, SyntaxLineState state, SyntaxRuns& runs) -> SyntaxLineState;
+
+    // Color the text between the comments and strings on a line; the runs are from the line start
+    virtual void LexText(TextStorage<utf8>::const_iterator itrStart, TextStorage<utf8>::const_iterator itrEnd, BufferLocation lineStart, SyntaxRuns& runs);
+
 private:
     virtual void QueueUpdateSyntax(BufferLocation startLocation, BufferLocation endLocation);
+    void BeginEdit();
+    void UpdateLineStates(BufferLocation startLocation, BufferLocation endLocation);
+    auto EntryState(int32_t line) const -> SyntaxLineState;
+
+    using RegionStops = SpanFindSet<utf8, std::string::const_iterator>;
+    auto MatchRegionOpen(TextStorage<utf8>::const_iterator itr, TextStorage<utf8>::const_iterator itrLineEnd, TextStorage<utf8>::const_iterator& itrAfter, std::string& delimiter) const -> int32_t;
+    auto FindRegionEnd(int32_t region, TextStorage<utf8>::const_iterator itr, TextStorage<utf8>::const_iterator itrLineEnd, uint16_t& depth, const std::string& delimiter, bool& closed) const -> TextStorage<utf8>::const_iterator;
+    auto DelimiterId(const std::string& delimiter) -> uint32_t;
+    void GetDelimiter(uint32_t id, std::string& delimiter) const;
+
+    struct HighlightChunk;
+    struct ParallelHighlight;
+    auto UpdateParallel(std::unique_lock<std::shared_mutex>& lock, uint64_t generation) -> bool;
+    void UpdateChunk(HighlightChunk& chunk, uint64_t generation);
+    auto SliceDone() const -> bool;
+    void AssignSyntax(int32_t start, int32_t end, const SyntaxRuns& runs);
+    void Publish();
 
 protected:
     ZepBuffer& m_buffer;
-    std::vector<CommentEntry> m_commentEntries;
-    std::vector<SyntaxData> m_syntax;
+    SyntaxStore m_syntax; // This and the line states are only touched with the lex mutex held
+    std::shared_ptr<const SyntaxSnapshot> m_spSnapshot; // What the display sees; swapped atomically
     std::future<void> m_syntaxResult;
-    std::atomic<int32_t> m_targetChar = { 0 };
+    std::vector<std::future<void>> m_staleResults; // Lexes an edit overtook; they stop by themselves, so only Interrupt waits for them
     std::atomic<int32_t> m_processedChar = { 0 };
-    std::vector<uint32_t> m_multiCommentStarts;
-    std::vector<uint32_t> m_multiCommentEnds;
-    std::set<std::string_view> m_keywords;
-    std::set<std::string_view> m_identifiers;
-    std::atomic<bool> m_stop;
+    std::vector<SyntaxLineState> m_lineStates; // The lexer state at the end of each line
+    std::map<int32_t, int32_t> m_pendingLines; // Lines to lex from, and the last line of the edit which needs them
+    std::atomic<uint64_t> m_lexedLines = { 0 };
+    KeywordTable m_keywords;
+    KeywordTable m_identifiers;
+    std::shared_ptr<const KeywordSet> m_spKeywordSet; // Only for word lists given at run time; the tables point into these
+    std::shared_ptr<const KeywordSet> m_spIdentifierSet;
+    std::vector<int32_t> m_priorityLines; // Lines the windows have their cursors on, which are lexed first
+    int32_t m_parallelChunkSize = 0;
+    bool m_lazy = false; // Lex on the editor tick, and for the windows, instead of on the thread pool
+    std::map<int32_t, int32_t> m_aheadRanges; // Text lexed for the windows, ahead of the pending lines, so they don't ask twice; start to end offset
+    timer m_sliceTimer;
+    std::atomic<bool> m_stop; // Interrupt
+
+    // Every edit bumps the generation, and a lex stops at the end of the line it is on when it sees that.
+    // The lex holds the mutex while it reads the text or changes the state, the chunks of a parallel lex share it, and an
+    // edit holds it from the message before the change until the one after; so it waits for a line, not the whole lex
+    std::atomic<uint64_t> m_generation = { 0 };
+    mutable std::shared_mutex m_lexMutex;
+    std::unique_lock<std::shared_mutex> m_editLock;
+    std::mutex m_taskMutex; // One lex at a time; a new one waits for the old one to stop, off the UI thread
+    int32_t m_editLine = 0; // The first line edited while a parallel lex had the lock off
     std::vector<std::shared_ptr<ZepSyntaxAdorn>> m_adornments;
     uint32_t m_flags;
+
+    SyntaxRules m_rules;
+    std::string m_openChars; // The first character of every open in the rules
+    std::vector<std::string> m_stopChars; // For each region, the characters which might close it
+    std::unique_ptr<RegionStops> m_spOpenSet;
+    std::vector<RegionStops> m_stopSets;
+    mutable std::mutex m_delimiterMutex;
+    std::vector<std::string> m_delimiters; // Raw string delimiters which run over a line end; the state holds one more than the index
 };
 
 class ZepSyntaxAdorn : public ZepComponent
@@ -92,6 +220,22 @@ public:
 
     virtual auto GetSyntaxAt(int32_t offset, bool& found) const -> SyntaxData = 0;
 
+    // The syntax passes on each edit, and each range of text it lexes, with the lex mutex held.
+    // So an adornment's data moves with the text, and it can do its work on the lex thread instead of the UI thread
+    virtual void Clear(int32_t /*start*/, int32_t /*end*/)
+    {
+    }
+    virtual void Insert(int32_t /*start*/, int32_t /*end*/)
+    {
+    }
+    virtual void Update(int32_t /*start*/, int32_t /*end*/)
+    {
+    }
+
+    void Notify(std::shared_ptr<ZepMessage> /*message*/) override
+    {
+    }
+
 protected:
     ZepBuffer& m_buffer;
     ZepSyntax& m_syntax;
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "zep/syntax.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cpptoml
+{
+class table;
+}
+
+namespace Zep
+{
+
+// A language described in a TOML file instead of C++; the editor loads them from the 'syntax' folder next to zep.cfg.
+//
+//   name = "ini"
+//   extensions = [".ini"]
+//   case_insensitive = true
+//   keywords = ["true", "false"]            # Whole tokens, colored as keywords; 'identifiers' works the same way
+//
+//   [[region]]                              # Comments and strings, as in SyntaxRegion; these can run over line ends
+//   open = ";"                              # No close, so it ends with the line
+//   color = "comment"
+//
+//   [[token]]                               # Everything else, tried at each place; the longest match wins,
+//   pattern = "[A-Za-z_][A-Za-z0-9_]*"      # and the first rule when two are the same length
+//   color = "identifier"
+//
+// Patterns have literals, '.', [classes], [^negated], (groups), '|', '*', '+', '?' and the escapes \d \w \s \n \t.
+// The keywords go before the tokens, so a word matches them; but a keyword inside a longer word won't, as long as
+// a token matches the whole word.
+//
+// The patterns are compiled together into one DFA when the grammar is loaded, so lexing a token is one table lookup per character
+class SyntaxGrammar
+{
+public:
+    // Returns nullptr if the grammar is bad, and says why in the error
+    static auto Compile(const std::shared_ptr<cpptoml::table>& spTable, std::string& error) -> std::shared_ptr<SyntaxGrammar>;
+
+    // The token at the start of the text; the longest one, and the first rule if two are as long.
+    // Returns the rule, or -1 if nothing matches
+    auto Match(std::string_view text, size_t& length) const -> int32_t
+    {
+        uint32_t state = StartState;
+        int32_t token = -1;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            state = m_next[state * m_classCount + m_classes[uint8_t(text[i])]];
+            if (state == DeadState)
+            {
+                break;
+            }
+            if (m_accept[state] >= 0)
+            {
+                token = m_accept[state];
+                length = i + 1;
+            }
+        }
+        return token;
+    }
+
+    auto TokenColor(int32_t token) const -> ThemeColor
+    {
+        return m_colors[token];
+    }
+
+    auto GetName() const -> const std::string&
+    {
+        return m_name;
+    }
+
+    auto GetExtensions() const -> const std::vector<std::string>&
+    {
+        return m_extensions;
+    }
+
+    auto GetFlags() const -> uint32_t
+    {
+        return m_flags;
+    }
+
+    auto GetRules() const -> const SyntaxRules&
+    {
+        return m_rules;
+    }
+
+    auto StateCount() const -> size_t
+    {
+        return m_accept.size();
+    }
+
+private:
+    struct Nfa;
+    auto Build(const std::vector<std::string>& patterns, std::string& error) -> bool;
+
+    static constexpr uint32_t DeadState = 0;
+    static constexpr uint32_t StartState = 1;
+
+private:
+    std::string m_name;
+    std::vector<std::string> m_extensions;
+    uint32_t m_flags = 0;
+    SyntaxRules m_rules;
+    std::vector<ThemeColor> m_colors; // For each token rule
+
+    // Characters which no pattern tells apart share a class, which keeps the table small
+    std::array<uint8_t, 256> m_classes{};
+    uint32_t m_classCount = 1;
+    std::vector<uint16_t> m_next; // The next state, for each state and class
+    std::vector<int16_t> m_accept; // The token rule a state matches, or -1
+};
+
+// Colors a buffer with a grammar
+class ZepGrammarSyntax : public ZepSyntax
+{
+public:
+    ZepGrammarSyntax(ZepBuffer& buffer, std::shared_ptr<const SyntaxGrammar> spGrammar);
+    ~ZepGrammarSyntax() override;
+
+protected:
+    void LexText(TextStorage<utf8>::const_iterator itrStart, TextStorage<utf8>::const_iterator itrEnd, BufferLocation lineStart, SyntaxRuns& runs) override;
+
+private:
+    std::shared_ptr<const SyntaxGrammar> m_spGrammar;
+};
+
+} // namespace Zep
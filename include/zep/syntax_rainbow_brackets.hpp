@@ -1,12 +1,15 @@
 #pragma once
+#include "zep/bracket_index.hpp"
 #include "zep/syntax.hpp"
-#include <list>
+
+#include <mutex>
 #include <string>
-#include <unordered_map>
 
 namespace Zep
 {
 
+// Colors each pair of brackets by how deeply it is nested, and shows the ones which don't pair up.
+// The brackets are found as the syntax lexes the text, off the UI thread; an edit only moves the ones after it
 class ZepSyntaxAdorn_RainbowBrackets : public ZepSyntaxAdorn
 {
 public:
@@ -14,15 +17,13 @@ public:
     ZepSyntaxAdorn_RainbowBrackets(ZepSyntax& syntax, ZepBuffer& buffer);
     ~ZepSyntaxAdorn_RainbowBrackets() override;
 
-    void Notify(std::shared_ptr<ZepMessage> message) override;
     auto GetSyntaxAt(int32_t offset, bool& found) const -> SyntaxData override;
 
-    virtual void Clear(int32_t start, int32_t end);
-    virtual void Insert(int32_t start, int32_t end);
-    virtual void Update(int32_t start, int32_t end);
+    void Clear(int32_t start, int32_t end) override;
+    void Insert(int32_t start, int32_t end) override;
+    void Update(int32_t start, int32_t end) override;
 
 private:
-    void RefreshBrackets();
     enum class BracketType
     {
         Bracket = 0,
@@ -31,14 +32,10 @@ private:
         Max = 3
     };
 
-    struct Bracket
-    {
-        int32_t indent{};
-        BracketType type{};
-        bool is_open{};
-        bool valid = true;
-    };
-    std::map<BufferLocation, Bracket> m_brackets;
+    mutable std::mutex m_mutex; // The display reads the brackets while the lex finds them
+    BracketIndex m_brackets;
+    std::vector<BracketMark> m_found;
+    std::string m_scratch;
 };
 
 } // namespace Zep
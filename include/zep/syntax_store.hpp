@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "zep/theme.hpp"
+
+namespace Zep
+{
+
+struct SyntaxData
+{
+    ThemeColor foreground = ThemeColor::Normal;
+    ThemeColor background = ThemeColor::None;
+    bool underline = false;
+};
+
+inline auto operator==(const SyntaxData& lhs, const SyntaxData& rhs) -> bool
+{
+    return lhs.foreground == rhs.foreground && lhs.background == rhs.background && lhs.underline == rhs.underline;
+}
+
+inline auto operator!=(const SyntaxData& lhs, const SyntaxData& rhs) -> bool
+{
+    return !(lhs == rhs);
+}
+
+// Characters in the same colors, up to the end offset; the offset is from the start of the list the run is in
+struct SyntaxRun
+{
+    int32_t end;
+    SyntaxData data;
+};
+using SyntaxRuns = std::vector<SyntaxRun>;
+
+// Color part of a run list, which starts at 0.  Anything not colored yet is the default.
+// Marking on from the end, as a lexer does, is just an append
+void MarkSyntaxRuns(SyntaxRuns& runs, int32_t start, int32_t end, const SyntaxData& data);
+
+// Add a run list which starts at start, after everything already in the list, and pad it with the default to end
+void AppendSyntaxRuns(SyntaxRuns& runs, int32_t start, const SyntaxRuns& more, int32_t end);
+
+// One version of the colors for a buffer.
+// Once it is published it never changes, so the display can read it without waiting on the highlighter, which is free to
+// carry on with the next version.  Blocks nobody changed are shared between versions
+class SyntaxSnapshot
+{
+public:
+    // Default colors past the end
+    auto Get(int32_t offset) const -> SyntaxData;
+
+    auto size() const -> int32_t
+    {
+        return m_blockEnds.empty() ? 0 : m_blockEnds.back();
+    }
+
+    auto Version() const -> uint64_t
+    {
+        return m_version;
+    }
+
+private:
+    friend class SyntaxStore;
+    std::vector<std::shared_ptr<const SyntaxRuns>> m_blocks;
+    std::vector<int32_t> m_blockEnds; // The offset just after each block
+    uint64_t m_version = 0;
+};
+
+// The highlighter's copy of the colors, which it changes in place and publishes when it wants them shown.
+// The colors are kept as runs, so the size follows the number of tokens, not the number of characters; and the runs are kept
+// in blocks of a few hundred, so an edit only moves the runs in one block.  A block a snapshot can see is copied before it
+// is changed; so publishing only costs a copy of the block list, and the next version copies just the blocks it touches
+class SyntaxStore
+{
+public:
+    auto size() const -> int32_t
+    {
+        return m_blockEnds.empty() ? 0 : m_blockEnds.back();
+    }
+
+    void Resize(int32_t size);
+
+    // Text was added or removed; new text gets the default colors
+    void Insert(int32_t offset, int32_t count);
+    void Erase(int32_t start, int32_t end);
+
+    void Fill(int32_t start, int32_t end, const SyntaxData& data);
+
+    // Color the text from start to end with a run list which starts there, such as a lexed line; past its last run is the default.
+    // Colors which are already right are left alone, so re-lexing unchanged lines doesn't copy shared blocks
+    void Assign(int32_t start, int32_t end, const SyntaxRuns& runs);
+
+    auto Get(int32_t offset) const -> SyntaxData;
+
+    auto Publish() -> std::shared_ptr<const SyntaxSnapshot>;
+
+    auto BlockCount() const -> size_t
+    {
+        return m_blocks.size();
+    }
+
+    auto RunCount() const -> size_t;
+
+private:
+    void Replace(int32_t start, int32_t end, const SyntaxRuns& runs, int32_t length);
+    auto Matches(int32_t start, const SyntaxRuns& runs, int32_t length) const -> bool;
+    void ReplaceInBlock(size_t block, int32_t start, int32_t end, const SyntaxRuns& runs, int32_t length);
+    void Rebalance(size_t block);
+
+    auto FindBlock(int32_t offset) const -> size_t;
+    auto BlockStart(size_t block) const -> int32_t;
+    auto WritableBlock(size_t block) -> SyntaxRuns&;
+    void ReplaceBlocks(size_t first, size_t last, std::vector<SyntaxRuns>&& blocks);
+    void ShiftEnds(size_t first, int32_t delta);
+
+private:
+    std::vector<std::shared_ptr<SyntaxRuns>> m_blocks;
+    std::vector<int32_t> m_blockEnds;
+    std::vector<uint8_t> m_published; // The block is in a snapshot, so must be copied before it changes
+    uint64_t m_version = 0;
+};
+
+} // namespace Zep
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "zep/gap_buffer.hpp"
+#include "zep/piece_table.hpp"
+
+// How a buffer stores its text.
+// The gap buffer is the default, and is fastest when edits are local to each other, as they are when typing.
+// The piece table costs a little more per character read, but the cost of an edit is the same anywhere in the text;
+// so it is a better choice for very big files where the edits jump around.
+enum class TextStorageType
+{
+    GapBuffer,
+    PieceTable
+};
+
+// Text storage with a choice of backend, chosen per buffer.
+// This presents the same (read only) iterator, insert and erase surface as the GapBuffer, and
+// forwards to whichever container is active.
+template <class T>
+class TextStorage
+{
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = const T&;
+    using const_reference = const T&;
+
+    class const_iterator
+    {
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = T;
+        using pointer = const T*;
+        using reference = const T&;
+        using iterator_category = std::random_access_iterator_tag;
+
+        size_t p = 0;
+        const TextStorage<T>* pStorage = nullptr;
+
+        const_iterator(const TextStorage<T>& storage, size_t ptr) : p(ptr), pStorage(&storage) { }
+
+        auto operator==(const const_iterator& rhs) const -> bool { return (p == rhs.p); }
+        auto operator!=(const const_iterator& rhs) const -> bool { return (p != rhs.p); }
+        auto operator<(const const_iterator& rhs) const -> bool { return (p < rhs.p); }
+        auto operator>(const const_iterator& rhs) const -> bool { return (p > rhs.p); }
+        auto operator<=(const const_iterator& rhs) const -> bool { return (p <= rhs.p); }
+        auto operator>=(const const_iterator& rhs) const -> bool { return (p >= rhs.p); }
+
+        auto operator++() -> const_iterator& { p++; return *this; }
+        auto operator++(int) -> const_iterator { auto pOld = p; p++; return const_iterator(*pStorage, pOld); }
+        auto operator--() -> const_iterator& { p--; return *this; }
+        auto operator--(int) -> const_iterator { auto pOld = p; p--; return const_iterator(*pStorage, pOld); }
+
+        auto operator+=(difference_type rhs) -> const_iterator& { p += rhs; return *this; }
+        auto operator+(difference_type rhs) const -> const_iterator { return const_iterator(*pStorage, p + rhs); }
+        auto operator-=(difference_type rhs) -> const_iterator& { p -= rhs; return *this; }
+        auto operator-(difference_type rhs) const -> const_iterator { return const_iterator(*pStorage, p - rhs); }
+        auto operator-(const const_iterator& itr) const -> difference_type { return difference_type(p) - difference_type(itr.p); }
+
+        auto operator*() const -> reference { return (*pStorage)[p]; }
+        auto operator->() const -> pointer { return &(*pStorage)[p]; }
+        auto operator[](difference_type distance) const -> reference { return (*pStorage)[p + distance]; }
+    };
+
+    // Text is read through iterators, and changed with insert/erase/replace
+    using iterator = const_iterator;
+
+public:
+    TextStorage() = default;
+
+    // No copy constructor yet
+    TextStorage(const TextStorage& copy) = delete;
+    auto operator=(const TextStorage& copy) -> TextStorage& = delete;
+
+    auto GetType() const -> TextStorageType
+    {
+        return m_type;
+    }
+
+    // Switch the backend, moving the current text into it
+    void SetType(TextStorageType type)
+    {
+        if (type == m_type)
+        {
+            return;
+        }
+
+        if (type == TextStorageType::PieceTable)
+        {
+            m_pieceTable.assign(m_gapBuffer.begin(), m_gapBuffer.end());
+            m_gapBuffer.clear();
+        }
+        else
+        {
+            m_gapBuffer.assign(m_pieceTable.begin(), m_pieceTable.end());
+            m_pieceTable.clear();
+        }
+        m_type = type;
+    }
+
+    auto begin() const -> const_iterator { return const_iterator(*this, 0); }
+    auto cbegin() const -> const_iterator { return const_iterator(*this, 0); }
+    auto end() const -> const_iterator { return const_iterator(*this, size()); }
+    auto cend() const -> const_iterator { return const_iterator(*this, size()); }
+
+    inline auto size() const -> size_type
+    {
+        return m_type == TextStorageType::GapBuffer ? m_gapBuffer.size() : m_pieceTable.size();
+    }
+
+    [[nodiscard]] inline auto empty() const -> bool { return size() == 0; }
+
+    inline auto operator[](size_type pos) const -> const_reference
+    {
+        return m_type == TextStorageType::GapBuffer ? m_gapBuffer[pos] : m_pieceTable[pos];
+    }
+
+    void clear()
+    {
+        m_gapBuffer.clear();
+        m_pieceTable.clear();
+    }
+
+    template <class iter>
+    void assign(iter srcBegin, iter srcEnd)
+    {
+        if (m_type == TextStorageType::GapBuffer)
+        {
+            m_gapBuffer.assign(srcBegin, srcEnd);
+        }
+        else
+        {
+            m_pieceTable.assign(srcBegin, srcEnd);
+        }
+    }
+
+    // Assign to memory owned by someone else, without copying it.
+    // Only the piece table can do this, so the storage switches to it
+    void assign_view(const T* pBegin, const T* pEnd, std::shared_ptr<const void> spOwner)
+    {
+        m_gapBuffer.clear();
+        m_type = TextStorageType::PieceTable;
+        m_pieceTable.assign_view(pBegin, pEnd, std::move(spOwner));
+    }
+
+    // Stop using memory owned by someone else; whatever is still used from it is copied
+    void own_view()
+    {
+        m_pieceTable.own_original();
+    }
+
+    template <class iter>
+    auto insert(const_iterator pt, iter srcStart, iter srcEnd) -> iterator
+    {
+        if (m_type == TextStorageType::GapBuffer)
+        {
+            m_gapBuffer.insert(m_gapBuffer.begin() + pt.p, srcStart, srcEnd);
+        }
+        else
+        {
+            m_pieceTable.insert(m_pieceTable.begin() + pt.p, srcStart, srcEnd);
+        }
+        return iterator(*this, pt.p);
+    }
+
+    auto erase(const_iterator start, const_iterator end) -> iterator
+    {
+        if (m_type == TextStorageType::GapBuffer)
+        {
+            m_gapBuffer.erase(m_gapBuffer.begin() + start.p, m_gapBuffer.begin() + end.p);
+        }
+        else
+        {
+            m_pieceTable.erase(m_pieceTable.begin() + start.p, m_pieceTable.begin() + end.p);
+        }
+        return iterator(*this, start.p);
+    }
+
+    auto erase(const_iterator start) -> iterator
+    {
+        return erase(start, start + 1);
+    }
+
+    // Overwrite a range with a single value
+    void replace(const_iterator start, const_iterator end, const T& value)
+    {
+        if (m_type == TextStorageType::GapBuffer)
+        {
+            for (auto pos = start.p; pos < end.p; pos++)
+            {
+                m_gapBuffer[pos] = value;
+            }
+        }
+        else if (start.p < end.p)
+        {
+            // The original text is read only; replace the range with new text
+            std::basic_string<T> values(end.p - start.p, value);
+            m_pieceTable.erase(m_pieceTable.begin() + start.p, m_pieceTable.begin() + end.p);
+            m_pieceTable.insert(m_pieceTable.begin() + start.p, values.begin(), values.end());
+        }
+    }
+
+    void push_back(const T& v)
+    {
+        if (m_type == TextStorageType::GapBuffer)
+        {
+            m_gapBuffer.push_back(v);
+        }
+        else
+        {
+            m_pieceTable.push_back(v);
+        }
+    }
+
+    // Return a string version of the text, optionally showing the gap (if there is one)
+    [[nodiscard]] auto string(bool showGap = false) const -> std::string
+    {
+        return m_type == TextStorageType::GapBuffer ? m_gapBuffer.string(showGap) : m_pieceTable.string();
+    }
+
+    // A copy of part of the text, made a segment at a time
+    [[nodiscard]] auto string(const_iterator first, const_iterator last) const -> std::string
+    {
+        std::string str;
+        str.reserve(last.p - first.p);
+        ForEachSegment(first, last, [&](const T* pBegin, const T* pEnd) {
+            str.append((const char*)pBegin, (const char*)pEnd);
+            return true;
+        });
+        return str;
+    }
+
+    // A view of part of the text, pointing straight into the storage when it lies in one segment.
+    // Only text which spans the gap or a piece boundary is copied, into the scratch string, which can be reused from call to call.
+    // The view is good until the text or the scratch string changes
+    [[nodiscard]] auto view(const_iterator first, const_iterator last, std::string& scratch) const -> std::string_view
+    {
+        auto size = size_t(last.p - first.p);
+        std::string_view result;
+        scratch.clear();
+        ForEachSegment(first, last, [&](const T* pBegin, const T* pEnd) {
+            if (size_t(pEnd - pBegin) == size)
+            {
+                result = std::string_view((const char*)pBegin, size);
+                return false;
+            }
+            scratch.append((const char*)pBegin, (const char*)pEnd);
+            result = scratch;
+            return true;
+        });
+        return result;
+    }
+
+    // Visit the contiguous runs of text covering [first, last), in order, without copying them.
+    // For the gap buffer that is the text either side of the gap; for the piece table, one run per piece.
+    // The callback gets a begin/end pointer pair, and returns false to stop the walk.
+    template <class F>
+    void ForEachSegment(const_iterator first, const_iterator last, F&& fn) const
+    {
+        if (m_type == TextStorageType::GapBuffer)
+        {
+            m_gapBuffer.ForEachSegment(first.p, last.p, fn);
+        }
+        else
+        {
+            m_pieceTable.ForEachSegment(first.p, last.p, fn);
+        }
+    }
+
+    // The find_* functions return end() if they don't find a match, as the GapBuffer ones do.
+    // They search a segment at a time, with memchr or a table lookup, rather than going through the iterators
+    auto find(const_iterator first, const_iterator last, const T& value) const -> const_iterator
+    {
+        return FindInSegments(first, last, [&](const T* pBegin, const T* pEnd) {
+            return SpanFind(pBegin, pEnd, value);
+        });
+    }
+
+    template <class ForwardIt>
+    auto find_first_of(const_iterator first, const_iterator last, ForwardIt s_first, ForwardIt s_last) const -> const_iterator
+    {
+        return find_first_of(first, last, MakeSpanFindSet<T>(s_first, s_last));
+    }
+
+    template <class ForwardIt>
+    auto find_first_not_of(const_iterator first, const_iterator last, ForwardIt s_first, ForwardIt s_last) const -> const_iterator
+    {
+        return find_first_not_of(first, last, MakeSpanFindSet<T>(s_first, s_last));
+    }
+
+    // With a set made by MakeSpanFindSet, for searches in a loop
+    template <class ForwardIt>
+    auto find_first_of(const_iterator first, const_iterator last, const SpanFindSet<T, ForwardIt>& set) const -> const_iterator
+    {
+        return FindInSegments(first, last, [&](const T* pBegin, const T* pEnd) {
+            return SpanFindFirstOf(pBegin, pEnd, set);
+        });
+    }
+
+    template <class ForwardIt>
+    auto find_first_not_of(const_iterator first, const_iterator last, const SpanFindSet<T, ForwardIt>& set) const -> const_iterator
+    {
+        return FindInSegments(first, last, [&](const T* pBegin, const T* pEnd) {
+            return SpanFindFirstNotOf(pBegin, pEnd, set);
+        });
+    }
+
+    auto GetGapBuffer() const -> const GapBuffer<T>&
+    {
+        return m_gapBuffer;
+    }
+
+    // How the gap buffer grows; GetGapBuffer().GetStats() shows how often it has had to
+    void SetGapGrowth(const GapBufferGrowth& growth)
+    {
+        m_gapBuffer.SetGrowth(growth);
+    }
+
+    auto GetPieceTable() const -> const PieceTable<T>&
+    {
+        return m_pieceTable;
+    }
+
+private:
+    // fn returns the match in a segment, or the end of it
+    template <class F>
+    auto FindInSegments(const_iterator first, const_iterator last, F&& fn) const -> const_iterator
+    {
+        assert(first <= last);
+        auto found = last.p;
+        auto pos = first.p;
+        ForEachSegment(first, last, [&](const T* pBegin, const T* pEnd) {
+            auto pFound = fn(pBegin, pEnd);
+            if (pFound != pEnd)
+            {
+                found = pos + (pFound - pBegin);
+                return false;
+            }
+            pos += pEnd - pBegin;
+            return true;
+        });
+        return found == last.p ? end() : const_iterator(*this, found);
+    }
+
+private:
+    TextStorageType m_type = TextStorageType::GapBuffer;
+    GapBuffer<T> m_gapBuffer;
+    PieceTable<T> m_pieceTable;
+};
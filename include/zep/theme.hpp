@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <vector>
 
@@ -8,7 +9,7 @@
 namespace Zep
 {
 
-enum class ThemeColor
+enum class ThemeColor : uint8_t
 {
     None,
     TabBorder,
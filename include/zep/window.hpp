@@ -1,10 +1,13 @@
 #pragma once
 
 #include <cstdlib>
+#include <limits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "zep/buffer.hpp"
+#include "zep/wrap_index.hpp"
 
 namespace Zep
 {
@@ -141,6 +144,10 @@ public:
     [[nodiscard]] auto GetWindowFlags() const -> uint32_t;
     void ToggleFlag(uint32_t flag);
 
+    // Without wrapping, each buffer line is one line on the screen, and the window scrolls sideways to the cursor
+    void SetWrap(bool wrap);
+    [[nodiscard]] auto GetWrap() const -> bool;
+
     auto GetMaxDisplayLines() -> int32_t;
     auto GetNumDisplayedLines() -> int32_t;
 
@@ -177,6 +184,14 @@ private:
 
 private:
     void UpdateLineSpans();
+    void UpdateLineEstimates();
+    auto EstimateLine(int32_t length) const -> LineSize;
+    void LayoutLines();
+    void MeasureLine(int32_t line, std::vector<SpanInfo>& spans);
+    void WrapLine(int32_t bufferLine, int32_t& spanLine, float& bufferPosYPx, std::vector<SpanInfo>& spans);
+    auto GetLineSpans(int32_t line) -> std::pair<SpanInfo*, SpanInfo*>;
+    auto GetSpan(int32_t span) -> SpanInfo&;
+    void MarkLinesChanged(BufferLocation start, BufferLocation end);
     void ScrollToCursor();
     void EnsureCursorVisible();
     void UpdateVisibleLineRange();
@@ -207,9 +222,6 @@ private:
     std::shared_ptr<Region> m_indicatorRegion; // Indicators
     std::shared_ptr<Region> m_vScrollRegion; // Vertical scroller
 
-    // Wrap ; need horizontal offset for this to be turned on.
-    // This will indeed stop lines wrapping though!  You just can't move to the far right and have
-    // the text scroll; which isn't a big deal, but a work item.
     bool m_wrap = true;
 
     // The buffer offset is where we are looking, but the cursor is only what you see on the screen
@@ -220,10 +232,15 @@ private:
     std::vector<std::string> m_statusLines; // Status information, shown under the buffer
 
     float m_bufferOffsetYPx = 0.0F;
+    float m_bufferOffsetXPx = 0.0F; // Only when not wrapping
     float m_bufferSizeYPx = 0.0F;
     NVec2i m_visibleLineRange = { 0, 0 }; // Offset of the displayed area into the text
 
-    std::vector<SpanInfo*> m_windowLines; // Information about the currently displayed lines
+    std::vector<SpanInfo> m_windowLines; // Information about the lines around the view
+    NVec2i m_laidOutLines = { 0, 0 }; // The buffer lines in the window lines
+    WrapIndex m_lineSizes; // How big every buffer line is, or a guess
+    std::vector<SpanInfo> m_measuredSpans; // A line away from the view, which something asked about
+    int32_t m_measuredLine = -1;
 
     ZepTabWindow& m_tabWindow;
 
@@ -239,6 +256,16 @@ private:
     Airline m_airline;
 
     bool m_layoutDirty = true;
+
+    // Only the sizes of the buffer lines which changed are guessed again, unless the wrapping has
+    bool m_spansDirty = true; // Guess every line again
+    NVec2i m_dirtyLines = { std::numeric_limits<int32_t>::max(), -1 }; // First and last buffer line to guess again, as the buffer is now
+    int32_t m_notifiedLineCount = 0; // Buffer lines at the last buffer message
+    NVec2f m_wrapExtentPx; // Left and right of the text the lines were wrapped to
+    float m_wrapTextHeight = 0.0F;
+    int32_t m_spanCapacity = 1; // For the guesses; characters on a span, and how tall they are
+    float m_firstSpanHeightPx = 0.0F;
+    float m_spanHeightPx = 0.0F;
     bool m_scrollVisibilityChanged = true;
     bool m_cursorMoved = true;
 
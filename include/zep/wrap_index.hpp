@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "zep/line_index.hpp"
+
+namespace Zep
+{
+
+// How much of the screen a buffer line takes: the spans it wraps to, and their height
+struct LineSize
+{
+    int32_t spans = 1;
+    float height = 0.0F;
+};
+
+// The size of every line in a window, so the line at a span or a height can be found without wrapping all the lines before it.
+// Until a line is wrapped its size is only a guess, from its length.
+// Like the line index, the sizes are kept in chunks of a few hundred lines, with prefix sum trees over the chunk totals; so lines
+// can come and go without moving the rest of the file, and the lookups are O(log n)
+class WrapIndex
+{
+public:
+    WrapIndex();
+
+    void Assign(const std::vector<LineSize>& lines);
+
+    // The lines from first up to last are now these; there can be more or less of them
+    void Replace(int32_t first, int32_t last, const std::vector<LineSize>& lines);
+    void Set(int32_t line, const LineSize& size);
+    auto Get(int32_t line) const -> LineSize;
+
+    auto size() const -> int32_t
+    {
+        return m_lineCount;
+    }
+
+    // Totals for all the lines
+    auto SpanCount() const -> int32_t;
+    auto Height() const -> float;
+
+    // Totals for the lines before this one
+    auto SpansBefore(int32_t line) const -> int32_t;
+    auto HeightBefore(int32_t line) const -> float;
+
+    // The line with this span, or at this height; the first or last line if it is off either end
+    auto LineFromSpan(int32_t span) const -> int32_t;
+    auto LineFromHeight(float height) const -> int32_t;
+
+    auto ToVector() const -> std::vector<LineSize>;
+
+private:
+    struct Chunk
+    {
+        std::vector<LineSize> lines;
+        int32_t spans = 0;
+        double height = 0.0;
+    };
+
+    void Total(Chunk& chunk);
+    void Rebuild(size_t first, size_t last, const std::vector<LineSize>& lines);
+    void UpdateTrees();
+    auto FindChunk(int32_t line) const -> size_t;
+
+private:
+    std::vector<Chunk> m_chunks;
+    PrefixSumTree m_chunkLines;
+    PrefixSumTree m_chunkSpans;
+    BasicPrefixSumTree<double> m_chunkHeights; // Doubles, so a few million lines still add up exactly
+    int32_t m_lineCount = 0;
+};
+
+} // namespace Zep
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cassert>
+
+#include "zep/bracket_index.hpp"
+
+namespace Zep
+{
+
+namespace
+{
+// Chunks are built this size, and split when they get too big
+const size_t ChunkBrackets = 256;
+const size_t MaxChunkBrackets = ChunkBrackets * 4;
+} // namespace
+
+auto BracketIndex::Summary::Then(const Summary& next) const -> Summary
+{
+    Summary result;
+    for (uint8_t kind = 0; kind < MaxKinds; kind++)
+    {
+        result.steps[kind] = steps[kind].Then(next.steps[kind]);
+        result.counts[kind] = counts[kind] + next.counts[kind];
+    }
+    return result;
+}
+
+BracketIndex::BracketIndex()
+{
+    Clear();
+}
+
+void BracketIndex::Clear()
+{
+    m_chunks.assign(1, Chunk{});
+    UpdateTrees();
+}
+
+void BracketIndex::Insert(int32_t offset, int32_t length)
+{
+    Replace(offset, offset, length, {});
+}
+
+void BracketIndex::Erase(int32_t start, int32_t end)
+{
+    Replace(start, end, 0, {});
+}
+
+void BracketIndex::Assign(int32_t start, int32_t end, const std::vector<BracketMark>& brackets)
+{
+    Replace(start, end, end - start, brackets);
+}
+
+// The text from start to end is now length long, and has these brackets in it
+void BracketIndex::Replace(int32_t start, int32_t end, int32_t length, const std::vector<BracketMark>& brackets)
+{
+    assert(start <= end);
+    auto diff = length - (end - start);
+
+    // The text may have grown without telling us; brackets can't be past the end
+    auto textSize = m_chunkSizes.Sum(m_chunks.size());
+    if (end > textSize)
+    {
+        m_chunks.back().size += end - textSize;
+        m_chunkSizes.Add(m_chunks.size() - 1, end - textSize);
+    }
+
+    auto firstChunk = std::min(FindChunk(start), m_chunks.size() - 1);
+    auto lastChunk = end > start ? std::min(FindChunk(end - 1), m_chunks.size() - 1) : firstChunk;
+    auto chunkStart = ChunkStart(firstChunk);
+
+    // Mostly an edit is inside one chunk, and only the brackets after it in the chunk move
+    if (firstChunk == lastChunk)
+    {
+        auto& chunk = m_chunks[firstChunk];
+        auto byOffset = [](const BracketMark& bracket, int32_t offset) {
+            return bracket.offset < offset;
+        };
+        auto itrFirst = std::lower_bound(chunk.brackets.begin(), chunk.brackets.end(), start - chunkStart, byOffset);
+        auto itrLast = std::lower_bound(itrFirst, chunk.brackets.end(), end - chunkStart, byOffset);
+        auto removed = size_t(itrLast - itrFirst);
+        if (chunk.brackets.size() - removed + brackets.size() <= MaxChunkBrackets && (chunk.size + diff > 0 || m_chunks.size() == 1))
+        {
+            for (auto itr = itrLast; itr != chunk.brackets.end(); itr++)
+            {
+                itr->offset += diff;
+            }
+
+            auto itr = chunk.brackets.erase(itrFirst, itrLast);
+            itr = chunk.brackets.insert(itr, brackets.begin(), brackets.end());
+            for (size_t i = 0; i < brackets.size(); i++, itr++)
+            {
+                itr->offset -= chunkStart;
+            }
+            chunk.size += diff;
+            m_chunkSizes.Add(firstChunk, diff);
+
+            // The depths only change if the brackets did
+            if (removed != 0 || !brackets.empty())
+            {
+                Summarize(chunk);
+                UpdateSummary(firstChunk);
+            }
+            return;
+        }
+    }
+
+    // Otherwise the chunks it touches are made again
+    std::vector<BracketMark> merged;
+    auto size = diff;
+    auto base = chunkStart;
+    for (auto chunk = firstChunk; chunk <= lastChunk; chunk++)
+    {
+        for (auto bracket : m_chunks[chunk].brackets)
+        {
+            bracket.offset += base;
+            if (bracket.offset < start)
+            {
+                merged.push_back(bracket);
+            }
+            else if (bracket.offset >= end)
+            {
+                bracket.offset += diff;
+                merged.push_back(bracket);
+            }
+        }
+        base += m_chunks[chunk].size;
+        size += m_chunks[chunk].size;
+    }
+
+    auto itr = std::lower_bound(merged.begin(), merged.end(), start, [](const BracketMark& bracket, int32_t offset) {
+        return bracket.offset < offset;
+    });
+    merged.insert(itr, brackets.begin(), brackets.end());
+
+    Rebuild(firstChunk, lastChunk + 1, merged, chunkStart, size);
+    UpdateTrees();
+}
+
+auto BracketIndex::Find(int32_t offset, int32_t& depth, bool& valid) const -> bool
+{
+    if (offset < 0 || offset >= m_chunkSizes.Sum(m_chunks.size()))
+    {
+        return false;
+    }
+
+    auto chunkIndex = FindChunk(offset);
+    auto& chunk = m_chunks[chunkIndex];
+    auto itr = std::lower_bound(chunk.brackets.begin(), chunk.brackets.end(), offset - ChunkStart(chunkIndex), [](const BracketMark& bracket, int32_t relative) {
+        return bracket.offset < relative;
+    });
+    if (itr == chunk.brackets.end() || itr->offset != offset - ChunkStart(chunkIndex))
+    {
+        return false;
+    }
+
+    auto index = size_t(itr - chunk.brackets.begin());
+    auto kind = itr->kind;
+    auto before = SummaryBefore(chunkIndex);
+    auto entry = before.steps[kind].Then(chunk.before[index]).Apply(0);
+    if (itr->open)
+    {
+        depth = entry;
+        valid = true;
+    }
+    else
+    {
+        depth = entry - 1;
+        valid = entry > 0;
+    }
+
+    // Opens which are never closed have to show somewhere; the first bracket of the kind takes the blame
+    if (valid && m_summaries[1].steps[kind].Apply(0) > 0 && before.counts[kind] == 0)
+    {
+        valid = std::any_of(chunk.brackets.begin(), itr, [&](const BracketMark& bracket) {
+            return bracket.kind == kind;
+        });
+    }
+    return true;
+}
+
+auto BracketIndex::size() const -> size_t
+{
+    size_t count = 0;
+    for (auto& chunk : m_chunks)
+    {
+        count += chunk.brackets.size();
+    }
+    return count;
+}
+
+auto BracketIndex::ToVector() const -> std::vector<BracketMark>
+{
+    std::vector<BracketMark> brackets;
+    int32_t chunkStart = 0;
+    for (auto& chunk : m_chunks)
+    {
+        for (auto bracket : chunk.brackets)
+        {
+            bracket.offset += chunkStart;
+            brackets.push_back(bracket);
+        }
+        chunkStart += chunk.size;
+    }
+    return brackets;
+}
+
+// Work out what each bracket's kind does up to it, and what the whole chunk does
+void BracketIndex::Summarize(Chunk& chunk)
+{
+    chunk.summary = Summary{};
+    chunk.before.resize(chunk.brackets.size());
+    for (size_t i = 0; i < chunk.brackets.size(); i++)
+    {
+        auto& bracket = chunk.brackets[i];
+        auto& step = chunk.summary.steps[bracket.kind];
+        chunk.before[i] = step;
+        step = step.Then(DepthStep{ bracket.open ? 1 : -1, 0 });
+        chunk.summary.counts[bracket.kind]++;
+    }
+}
+
+// Replace a range of chunks with new ones holding these brackets, covering size characters from the chunk start.
+// Each chunk but the last ends just after its last bracket
+void BracketIndex::Rebuild(size_t first, size_t last, const std::vector<BracketMark>& brackets, int32_t chunkStart, int32_t size)
+{
+    auto textEnd = chunkStart + size;
+    std::vector<Chunk> chunks;
+    chunks.reserve(brackets.size() / ChunkBrackets + 1);
+    size_t bracket = 0;
+    do
+    {
+        auto lastBracket = std::min(bracket + ChunkBrackets, brackets.size());
+        auto chunkEnd = lastBracket == brackets.size() ? textEnd : brackets[lastBracket - 1].offset + 1;
+
+        Chunk chunk;
+        chunk.size = chunkEnd - chunkStart;
+        chunk.brackets.reserve(lastBracket - bracket);
+        for (auto i = bracket; i < lastBracket; i++)
+        {
+            chunk.brackets.push_back(brackets[i]);
+            chunk.brackets.back().offset -= chunkStart;
+        }
+        Summarize(chunk);
+        chunks.push_back(std::move(chunk));
+
+        chunkStart = chunkEnd;
+        bracket = lastBracket;
+    } while (bracket < brackets.size());
+
+    // An empty chunk is only needed if there is nothing else
+    if (chunks.size() == 1 && chunks[0].size == 0 && m_chunks.size() > last - first)
+    {
+        chunks.clear();
+    }
+
+    auto itr = m_chunks.erase(m_chunks.begin() + first, m_chunks.begin() + last);
+    m_chunks.insert(itr, std::make_move_iterator(chunks.begin()), std::make_move_iterator(chunks.end()));
+}
+
+void BracketIndex::UpdateTrees()
+{
+    std::vector<int32_t> sizes;
+    sizes.reserve(m_chunks.size());
+    for (auto& chunk : m_chunks)
+    {
+        sizes.push_back(chunk.size);
+    }
+    m_chunkSizes.Build(sizes);
+
+    m_leaves = 1;
+    while (m_leaves < m_chunks.size())
+    {
+        m_leaves <<= 1;
+    }
+    m_summaries.assign(m_leaves * 2, Summary{});
+    for (size_t chunk = 0; chunk < m_chunks.size(); chunk++)
+    {
+        m_summaries[m_leaves + chunk] = m_chunks[chunk].summary;
+    }
+    for (auto node = m_leaves - 1; node > 0; node--)
+    {
+        m_summaries[node] = m_summaries[node * 2].Then(m_summaries[node * 2 + 1]);
+    }
+}
+
+void BracketIndex::UpdateSummary(size_t chunk)
+{
+    auto node = m_leaves + chunk;
+    m_summaries[node] = m_chunks[chunk].summary;
+    for (node /= 2; node > 0; node /= 2)
+    {
+        m_summaries[node] = m_summaries[node * 2].Then(m_summaries[node * 2 + 1]);
+    }
+}
+
+// What all the chunks before this one do; the order matters, so the left and right sides are kept apart on the way up
+auto BracketIndex::SummaryBefore(size_t chunk) const -> Summary
+{
+    Summary left;
+    Summary right;
+    for (auto first = m_leaves, last = m_leaves + chunk; first < last; first /= 2, last /= 2)
+    {
+        if (first & 1)
+        {
+            left = left.Then(m_summaries[first++]);
+        }
+        if (last & 1)
+        {
+            right = m_summaries[--last].Then(right);
+        }
+    }
+    return left.Then(right);
+}
+
+auto BracketIndex::ChunkStart(size_t chunk) const -> int32_t
+{
+    return m_chunkSizes.Sum(chunk);
+}
+
+// The chunk the offset is in; or the number of chunks, if it is past the end
+auto BracketIndex::FindChunk(int32_t offset) const -> size_t
+{
+    return m_chunkSizes.Count(offset);
+}
+
+} // namespace Zep
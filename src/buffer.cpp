@@ -1,7 +1,14 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cctype>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
 #include <regex>
 #include <utility>
 
@@ -11,6 +18,7 @@
 
 #include "zep/mcommon/file/path.hpp"
 #include "zep/mcommon/string/stringutils.hpp"
+#include "zep/mcommon/string/text_scan.hpp"
 
 #include "zep/mcommon/logger.hpp"
 
@@ -66,7 +74,214 @@ inline auto IsNewlineOrEnd(const char c) -> bool
 
 using fnMatch = std::function<bool>(const char);
 
+// Big files are loaded in chunks of this size, each on its own thread
+const size_t LoadChunkSize = 4 * 1024 * 1024;
+
+// A piece of a file being loaded
+struct LoadChunk
+{
+    const utf8* pBegin = nullptr;
+    const utf8* pEnd = nullptr;
+    std::vector<size_t> offsets; // The \n, \r and \t in the chunk
+    LineCharCounts counts;
+    size_t textStart = 0; // Where the chunk's text goes in the buffer
+    size_t textSize = 0; // How big it is after fixing tabs and CRs
+    size_t lineStart = 0; // The index of the chunk's first line end
+};
+
+// Run a function over all the chunks on the thread pool, and wait for them to finish.
+// This thread takes chunks as well, so it never waits on a pool which is busy with something else; the helpers only speed it up.
+// A helper which starts late finds nothing left to do, and never touches the chunks
+template <class F>
+void ForEachChunk(ThreadPool& pool, std::vector<LoadChunk>& chunks, F fn)
+{
+    // Most text is less than a chunk; a paste, or a small file.  That is just done here, without handing anything to the pool
+    if (chunks.size() <= 1 || pool.size() == 0)
+    {
+        for (auto& chunk : chunks)
+        {
+            fn(chunk);
+        }
+        return;
+    }
+
+    struct Job
+    {
+        size_t count = 0;
+        std::atomic<size_t> next{ 0 };
+        size_t finished = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    auto spJob = std::make_shared<Job>();
+    spJob->count = chunks.size();
+    auto pChunks = &chunks;
+    auto pFn = &fn;
+    auto work = [spJob, pChunks, pFn]() {
+        for (auto index = spJob->next++; index < spJob->count; index = spJob->next++)
+        {
+            (*pFn)((*pChunks)[index]);
+
+            std::lock_guard<std::mutex> lock(spJob->mutex);
+            if (++spJob->finished == spJob->count)
+            {
+                spJob->done.notify_all();
+            }
+        }
+    };
+
+    auto helpers = std::min(pool.size(), chunks.size() - 1);
+    for (size_t i = 0; i < helpers; i++)
+    {
+        pool.enqueue(work);
+    }
+
+    work();
+    std::unique_lock<std::mutex> lock(spJob->mutex);
+    spJob->done.wait(lock, [&]() { return spJob->finished == spJob->count; });
+}
+
+// Find the interesting characters in a chunk, and how big it will be when they are fixed up
+void ScanChunk(LoadChunk& chunk)
+{
+    chunk.counts = ScanLineChars(chunk.pBegin, chunk.pEnd, chunk.offsets);
+    chunk.textSize = size_t(chunk.pEnd - chunk.pBegin) - chunk.counts.carriageReturns + chunk.counts.tabs * 3;
+}
+
+// Split the text into chunks and find the interesting characters in each one.
+// Afterwards every chunk knows where its text and line ends will go in the buffer
+auto ScanChunks(ThreadPool& pool, const utf8* pBegin, const utf8* pEnd) -> std::vector<LoadChunk>
+{
+    std::vector<LoadChunk> chunks;
+    for (auto p = pBegin; p < pEnd; p += std::min(LoadChunkSize, size_t(pEnd - p)))
+    {
+        LoadChunk chunk;
+        chunk.pBegin = p;
+        chunk.pEnd = p + std::min(LoadChunkSize, size_t(pEnd - p));
+        chunks.push_back(std::move(chunk));
+    }
+
+    ForEachChunk(pool, chunks, ScanChunk);
+
+    size_t textStart = 0;
+    size_t lineStart = 0;
+    for (auto& chunk : chunks)
+    {
+        chunk.textStart = textStart;
+        chunk.lineStart = lineStart;
+        textStart += chunk.textSize;
+        lineStart += chunk.counts.lineFeeds;
+    }
+    return chunks;
+}
+
+// Copy a chunk's text into place, removing \r and expanding tabs, and fill in its line ends.
+// If there is no text to write, the text is being used as it is, and only the line ends are needed.
+// If there are no line ends to write, the caller will find them later
+void FillChunk(const LoadChunk& chunk, utf8* pText, int32_t* pLineEnds)
+{
+    auto pLine = pLineEnds ? pLineEnds + chunk.lineStart : nullptr;
+    if (pText == nullptr)
+    {
+        for (auto& offset : chunk.offsets)
+        {
+            *pLine++ = int32_t(chunk.textStart + offset + 1);
+        }
+        return;
+    }
+
+    auto pOut = pText + chunk.textStart;
+    auto pRun = chunk.pBegin;
+    for (auto& offset : chunk.offsets)
+    {
+        auto p = chunk.pBegin + offset;
+        pOut = std::copy(pRun, p, pOut);
+        pRun = p + 1;
+
+        if (*p == '\t')
+        {
+            pOut = std::fill_n(pOut, 4, ' ');
+        }
+        else if (*p == '\n')
+        {
+            *pOut++ = '\n';
+            if (pLine)
+            {
+                *pLine++ = int32_t(pOut - pText);
+            }
+        }
+    }
+    std::copy(pRun, chunk.pEnd, pOut);
+}
+
+// When a big file streams in, the first block is shown straight away, and the rest follows in bigger blocks
+const size_t StreamFirstBlockSize = 256 * 1024;
+const size_t StreamBlockSize = LoadChunkSize;
+
+// The worker stops when this many blocks are waiting, so a file arriving faster than the ticks take it isn't all held twice
+const size_t StreamMaxQueuedBlocks = 4;
+
+struct StreamBlock
+{
+    std::vector<utf8> text; // Ready to go in the buffer
+    size_t sourceSize = 0; // How much of the file this was
+    bool strippedCR = false;
+};
+
+// Saves go out in blocks this size when the \r's are put back, so that never needs more memory than this
+const size_t SaveBlockSize = 256 * 1024;
+
 } // namespace
+
+// A big file arriving in blocks.
+// A worker on the thread pool fixes up each block (tabs, CRs) and queues it, and the buffer appends whatever is ready on each tick.
+// The worker gives up its thread when the queue is full, rather than waiting on it, and the tick starts it again
+struct ZepBuffer::StreamLoad
+{
+    std::shared_ptr<IZepMappedFile> spFile; // The file is either mapped, or read into the text
+    std::string text;
+    const utf8* pBegin = nullptr;
+    const utf8* pEnd = nullptr;
+    const utf8* pNext = nullptr; // Where the worker carries on from; only read when it isn't running
+
+    std::mutex blockLock;
+    std::deque<StreamBlock> blocks;
+    std::atomic<bool> cancel{ false };
+    std::future<void> worker;
+
+    size_t appended = 0; // How much of the file is in the buffer
+
+    void Run()
+    {
+        while (pNext < pEnd && !cancel)
+        {
+            {
+                std::lock_guard<std::mutex> lock(blockLock);
+                if (blocks.size() >= StreamMaxQueuedBlocks)
+                {
+                    return;
+                }
+            }
+
+            LoadChunk chunk;
+            chunk.pBegin = pNext;
+            chunk.pEnd = pNext + std::min(StreamBlockSize, size_t(pEnd - pNext));
+            ScanChunk(chunk);
+
+            StreamBlock block;
+            block.text.resize(chunk.textSize);
+            block.sourceSize = size_t(chunk.pEnd - chunk.pBegin);
+            block.strippedCR = chunk.counts.carriageReturns != 0;
+            FillChunk(chunk, block.text.data(), nullptr);
+            pNext = chunk.pEnd;
+
+            std::lock_guard<std::mutex> lock(blockLock);
+            blocks.push_back(std::move(block));
+        }
+    }
+};
+
 ZepBuffer::ZepBuffer(ZepEditor& editor, std::string strName)
     : ZepComponent(editor)
     , m_strName(std::move(strName))
@@ -80,10 +295,21 @@ ZepBuffer::ZepBuffer(ZepEditor& editor, const ZepPath& path)
     Load(path);
 }
 
-ZepBuffer::~ZepBuffer() = default;
+ZepBuffer::~ZepBuffer()
+{
+    // The worker holds on to the stream, so it just needs telling to stop
+    if (m_spStreamLoad)
+    {
+        m_spStreamLoad->cancel = true;
+    }
+}
 
 void ZepBuffer::Notify(std::shared_ptr<ZepMessage> message)
 {
+    if (message->messageId == Msg::Tick && m_spStreamLoad)
+    {
+        UpdateStreamText();
+    }
 }
 
 auto ZepBuffer::GetBufferColumn(BufferLocation location) const -> int32_t
@@ -92,15 +318,17 @@ auto ZepBuffer::GetBufferColumn(BufferLocation location) const -> int32_t
     return location - lineStart;
 }
 
+void ZepBuffer::ForEachSegment(BufferLocation start, BufferLocation end, const std::function<bool(std::string_view)>& fn) const
+{
+    m_text.ForEachSegment(m_text.begin() + start, m_text.begin() + end, [&](const utf8* pBegin, const utf8* pEnd) {
+        return fn(std::string_view(reinterpret_cast<const char*>(pBegin), size_t(pEnd - pBegin)));
+    });
+}
+
 auto ZepBuffer::GetBufferLine(BufferLocation location) const -> int32_t
 {
-    auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), location);
-    if (itrLine != m_lineEnds.end() && location >= *itrLine)
-    {
-        itrLine++;
-    }
-    int32_t line = int32_t(itrLine - m_lineEnds.begin());
-    line = std::min(std::max(0, line), int32_t(m_lineEnds.size() - 1));
+    auto line = m_lineIndex.LineFromOffset(location);
+    line = std::min(std::max(0, line), int32_t(m_lineIndex.size() - 1));
     return line;
 }
 
@@ -121,16 +349,16 @@ auto ZepBuffer::LocationFromOffsetByChars(const BufferLocation& location, int32_
             current += dir;
         }
 
-        if (current >= m_gapBuffer.size())
+        if (current >= m_text.size())
         {
             break;
         }
 
         current = std::max(0, current);
 
-        if (m_gapBuffer[current] == '\n')
+        if (m_text[current] == '\n')
         {
-            if ((current + dir) >= m_gapBuffer.size())
+            if ((current + dir) >= m_text.size())
             {
                 break;
             }
@@ -171,7 +399,7 @@ auto ZepBuffer::Search(const std::string& str, BufferLocation start, SearchDirec
 
 auto ZepBuffer::Valid(BufferLocation location) const -> bool
 {
-    return !(location < 0 || location >= (BufferLocation)m_gapBuffer.size());
+    return !(location < 0 || location >= (BufferLocation)m_text.size());
 }
 
 // Prepare for a motion
@@ -180,7 +408,7 @@ auto ZepBuffer::MotionBegin(BufferLocation& start) const -> bool
     BufferLocation newStart = start;
 
     // Clamp to sensible, begin
-    newStart = std::min(newStart, BufferLocation(m_gapBuffer.size() - 1));
+    newStart = std::min(newStart, BufferLocation(m_text.size() - 1));
     newStart = std::max(0, newStart);
 
     bool change = newStart != start;
@@ -212,7 +440,7 @@ auto ZepBuffer::Skip(const fnMatch& IsToken, BufferLocation& start, SearchDirect
     }
 
     bool moved = false;
-    while (Valid(start) && IsToken(m_gapBuffer[start]))
+    while (Valid(start) && IsToken(m_text[start]))
     {
         Move(start, dir);
         moved = true;
@@ -228,7 +456,7 @@ auto ZepBuffer::SkipOne(const fnMatch& IsToken, BufferLocation& start, SearchDir
     }
 
     bool moved = false;
-    if (Valid(start) && IsToken(m_gapBuffer[start]))
+    if (Valid(start) && IsToken(m_text[start]))
     {
         Move(start, dir);
         moved = true;
@@ -244,7 +472,7 @@ auto ZepBuffer::SkipNot(const fnMatch& IsToken, BufferLocation& start, SearchDir
     }
 
     bool moved = false;
-    while (Valid(start) && !IsToken(m_gapBuffer[start]))
+    while (Valid(start) && !IsToken(m_text[start]))
     {
         Move(start, dir);
         moved = true;
@@ -320,7 +548,7 @@ auto ZepBuffer::StandardCtrlMotion(BufferLocation cursor, SearchDirection search
     else
     {
         // If on the first char of a new word, skip back
-        if (current > 0 && IsWORDChar(m_gapBuffer[current]) && !IsWORDChar(m_gapBuffer[current - 1]))
+        if (current > 0 && IsWORDChar(m_text[current]) && !IsWORDChar(m_text[current - 1]))
         {
             current--;
         }
@@ -388,10 +616,22 @@ auto ZepBuffer::Find(BufferLocation start, const utf8* pBegin, const utf8* pEnd)
         }
     }
 
-    auto itrBuffer = m_gapBuffer.begin() + start;
-    auto itrEnd = m_gapBuffer.end();
+    if (pBegin == pEnd)
+    {
+        return start;
+    }
+
+    auto itrBuffer = m_text.begin() + start;
+    auto itrEnd = m_text.end();
     while (itrBuffer != itrEnd)
     {
+        // Jump straight to the next place the first character matches
+        itrBuffer = m_text.find(itrBuffer, itrEnd, *pBegin);
+        if (itrBuffer == itrEnd)
+        {
+            break;
+        }
+
         auto itrNext = itrBuffer;
 
         // Loop the string
@@ -409,7 +649,7 @@ auto ZepBuffer::Find(BufferLocation start, const utf8* pBegin, const utf8* pEnd)
         // We sucesfully got to the end
         if (pCurrent == pEnd)
         {
-            return (BufferLocation)(itrBuffer - m_gapBuffer.begin());
+            return (BufferLocation)(itrBuffer - m_text.begin());
         }
 
         itrBuffer++;
@@ -431,7 +671,7 @@ auto ZepBuffer::FindOnLineMotion(BufferLocation start, const utf8* pCh, SearchDi
     SkipOne(IsMatch, start, dir);
     Skip(NotMatchNotEnd, start, dir);
 
-    if (Valid(start) && *pCh == m_gapBuffer[start])
+    if (Valid(start) && *pCh == m_text[start])
     {
         return start;
     }
@@ -553,12 +793,12 @@ auto ZepBuffer::ChangeWordMotion(BufferLocation start, uint32_t searchType, Sear
 
 auto ZepBuffer::InsideBuffer(BufferLocation loc) const -> bool
 {
-    return loc >= 0 && loc < BufferLocation(m_gapBuffer.size());
+    return loc >= 0 && loc < BufferLocation(m_text.size());
 }
 
 auto ZepBuffer::Clamp(BufferLocation in) const -> BufferLocation
 {
-    in = std::min(in, BufferLocation(m_gapBuffer.size() - 1));
+    in = std::min(in, BufferLocation(m_text.size() - 1));
     in = std::max(in, BufferLocation(0));
     return in;
 }
@@ -575,7 +815,7 @@ auto ZepBuffer::ClampToVisibleLine(BufferLocation in) const -> BufferLocation
 auto ZepBuffer::GetLineOffsets(const int32_t line, int32_t& lineStart, int32_t& lineEnd) const -> bool
 {
     // Not valid
-    if (m_lineEnds.size() <= line)
+    if (m_lineIndex.size() <= line)
     {
         lineStart = 0;
         lineEnd = 0;
@@ -583,8 +823,8 @@ auto ZepBuffer::GetLineOffsets(const int32_t line, int32_t& lineStart, int32_t&
     }
 
     // Find the line bounds - we know the end, find the start from the previous
-    lineEnd = m_lineEnds[line];
-    lineStart = line == 0 ? 0 : m_lineEnds[line - 1];
+    lineEnd = m_lineIndex.LineEnd(line);
+    lineStart = line == 0 ? 0 : m_lineIndex.LineEnd(line - 1);
     return true;
 }
 
@@ -605,11 +845,41 @@ void ZepBuffer::Load(const ZepPath& path)
     // Must set the syntax before the first buffer change messages
     GetEditor().SetBufferSyntax(*this);
 
-    if (GetEditor().GetFileSystem().Exists(path))
+    auto& fileSystem = GetEditor().GetFileSystem();
+    if (fileSystem.Exists(path))
     {
-        m_filePath = GetEditor().GetFileSystem().Canonical(path);
-        auto read = GetEditor().GetFileSystem().Read(path);
-        if (!read.empty())
+        m_filePath = fileSystem.Canonical(path);
+
+        auto config = GetEditor().GetConfig();
+        auto threaded = (GetEditor().GetFlags() & ZepEditorFlags::DisableThreads) == 0;
+
+        // Big files are mapped straight into a piece table if we can, instead of being copied into memory.
+        // Smaller ones, which won't be streamed either, aren't worth a mapping, and are just read
+        auto mapSize = threaded ? std::min(config.pieceTableFileSize, config.streamFileSize) : config.pieceTableFileSize;
+        auto spMapped = fileSystem.Map(path, size_t(mapSize));
+        if (spMapped && spMapped->Size() >= config.pieceTableFileSize && SetMappedText(spMapped))
+        {
+            return;
+        }
+
+        // Really big files that still need work are shown while the rest of them arrives
+        if (spMapped && threaded && spMapped->Size() >= config.streamFileSize)
+        {
+            m_text.SetType(spMapped->Size() >= config.pieceTableFileSize ? TextStorageType::PieceTable : TextStorageType::GapBuffer);
+            StreamText(spMapped, std::string());
+            return;
+        }
+        spMapped.reset();
+
+        auto read = fileSystem.Read(path);
+
+        // Big files get a piece table, so that edits anywhere in them stay cheap
+        m_text.SetType(read.size() >= config.pieceTableFileSize ? TextStorageType::PieceTable : TextStorageType::GapBuffer);
+        if (threaded && read.size() >= config.streamFileSize)
+        {
+            StreamText(nullptr, std::move(read));
+        }
+        else if (!read.empty())
         {
             SetText(read, true);
         }
@@ -635,37 +905,158 @@ auto ZepBuffer::Save(int64_t& size) -> bool
         return false;
     }
 
-    auto str = GetText().string();
+    // Don't write out half a file
+    if (TestFlags(FileFlags::Loading))
+    {
+        return false;
+    }
 
-    // Put back /r/n if necessary while writing the file
-    // At the moment, Zep removes /r/n and just uses /n while modifying text.
-    // It replaces the /r on files that had it afterwards
-    // Alternatively we could manage them 'in place', but that would make parsing more complex.
-    // And then what do you do if there are 2 different styles in the file.
-    if ((m_fileFlags & FileFlags::StrippedCR) != 0)
+    // Stream the text straight out of the buffer where the file system can take it in blocks
+    auto& fileSystem = GetEditor().GetFileSystem();
+    auto spWriter = fileSystem.OpenWriter(m_filePath);
+
+    // Some file systems won't replace a file which is mapped, and without a writer the file is rewritten where it is, under the
+    // mapping; either way the text still in it is copied out first, and the mapping goes.
+    // The text is the same, but it moves, so the syntax has to let go of it first
+    auto spMapped = m_wpMappedFile.lock();
+    if (spMapped && (spMapped->LocksFile() || !spWriter))
     {
-        // TODO(unknown): faster way to replace newlines
-        string_replace_in_place(str, "\n", "\r\n");
+        spMapped.reset();
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, 0));
+        m_text.own_view();
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, 0, 0));
     }
 
-    // Remove the appended 0 if necessary
-    size = (int64_t)str.size();
-    if ((m_fileFlags & FileFlags::TerminatedWithZero) != 0)
+    if (spWriter)
     {
-        size--;
+        if (!WriteText(size, [&](const utf8* pData, size_t count) { return spWriter->Write(pData, count); }))
+        {
+            return false;
+        }
+
+        if (size <= 0)
+        {
+            return true;
+        }
+
+        if (!spWriter->Commit())
+        {
+            return false;
+        }
     }
+    else
+    {
+        std::string str;
+        WriteText(size, [&](const utf8* pData, size_t count) {
+            str.append((const char*)pData, count);
+            return true;
+        });
+
+        if (size <= 0)
+        {
+            return true;
+        }
 
-    if (size <= 0)
+        if (!fileSystem.Write(m_filePath, &str[0], (size_t)size))
+        {
+            return false;
+        }
+    }
+
+    ClearFlags(FileFlags::Dirty);
+    return true;
+}
+
+// Hand the text to fnWrite a piece at a time, as it should be on disk; returns false if fnWrite does
+auto ZepBuffer::WriteText(int64_t& size, const std::function<bool(const utf8*, size_t)>& fnWrite) const -> bool
+{
+    size = 0;
+
+    // Remove the appended 0 if necessary
+    auto end = m_text.end();
+    if ((m_fileFlags & FileFlags::TerminatedWithZero) != 0 && !m_text.empty())
     {
+        end--;
+    }
+
+    // Put back /r/n if necessary while writing the file
+    // At the moment, Zep removes /r/n and just uses /n while modifying text.
+    // It replaces the /r on files that had it afterwards
+    // Alternatively we could manage them 'in place', but that would make parsing more complex.
+    // And then what do you do if there are 2 different styles in the file.
+    auto crlf = (m_fileFlags & FileFlags::StrippedCR) != 0;
+
+    std::vector<utf8> block;
+    auto flush = [&]() {
+        size += int64_t(block.size());
+        auto ok = fnWrite(block.data(), block.size());
+        block.clear();
+        return ok;
+    };
+
+    auto ok = true;
+    m_text.ForEachSegment(m_text.begin(), end, [&](const utf8* pBegin, const utf8* pEnd) {
+        if (!crlf)
+        {
+            size += int64_t(pEnd - pBegin);
+            ok = fnWrite(pBegin, size_t(pEnd - pBegin));
+            return ok;
+        }
+
+        block.reserve(SaveBlockSize);
+        while (pBegin < pEnd)
+        {
+            // Copy up to the next line feed, then add the \r\n
+            auto pLineFeed = static_cast<const utf8*>(memchr(pBegin, '\n', size_t(pEnd - pBegin)));
+            auto pRunEnd = pLineFeed ? pLineFeed : pEnd;
+            while (pBegin < pRunEnd)
+            {
+                auto count = std::min(size_t(pRunEnd - pBegin), SaveBlockSize - block.size());
+                block.insert(block.end(), pBegin, pBegin + count);
+                pBegin += count;
+                if (block.size() == SaveBlockSize && !(ok = flush()))
+                {
+                    return false;
+                }
+            }
+
+            if (pLineFeed)
+            {
+                if (block.size() + 2 > SaveBlockSize && !(ok = flush()))
+                {
+                    return false;
+                }
+                block.push_back('\r');
+                block.push_back('\n');
+                pBegin++;
+            }
+        }
         return true;
+    });
+
+    if (ok && !block.empty())
+    {
+        ok = flush();
     }
+    return ok;
+}
 
-    if (GetEditor().GetFileSystem().Write(m_filePath, &str[0], (size_t)size))
+// Change the way the text is stored; the text itself is not changed, but clients will refresh
+void ZepBuffer::SetStorageType(TextStorageType type)
+{
+    if (type == m_text.GetType())
     {
-        ClearFlags(FileFlags::Dirty);
-        return true;
+        return;
     }
-    return false;
+
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, BufferLocation(m_text.size() - 1)));
+    m_text.SetType(type);
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, 0, BufferLocation(m_text.size() - 1)));
+}
+
+auto ZepBuffer::GetStorageType() const -> TextStorageType
+{
+    return m_text.GetType();
 }
 
 auto ZepBuffer::GetDisplayName() const -> std::string
@@ -711,93 +1102,262 @@ void ZepBuffer::MarkUpdate()
 // Otherwise it is just reset to default state.  A new buffer is always initially cleared.
 void ZepBuffer::Clear()
 {
-    bool changed = false;
-    if (m_gapBuffer.size() > 1)
+    // Inform clients we are about to change the buffer; even an empty one gets a new line index, which the syntax may be reading
+    bool changed = m_text.size() > 1;
+    auto oldEnd = BufferLocation(m_text.size() - 1);
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, oldEnd));
+
+    // Anything still streaming in belongs to the old text
+    if (m_spStreamLoad)
     {
-        // Inform clients we are about to change the buffer
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, BufferLocation(m_gapBuffer.size() - 1)));
-        changed = true;
+        m_spStreamLoad->cancel = true;
+        m_spStreamLoad.reset();
+        ClearFlags(FileFlags::Loading);
     }
 
-    m_gapBuffer.clear();
-    m_gapBuffer.push_back(0);
-    m_lineEnds.clear();
+    m_text.clear();
+    m_text.push_back(0);
+    m_lineIndex.Clear();
     SetFlags(FileFlags::TerminatedWithZero);
 
-    m_lineEnds.push_back(m_gapBuffer.size());
+    m_lineIndex.PushBack(m_text.size());
 
     if (changed)
     {
         MarkUpdate();
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextDeleted, 0, BufferLocation(m_gapBuffer.size() - 1)));
     }
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextDeleted, 0, oldEnd));
 }
 
 // Replace the buffer buffer with the text
 void ZepBuffer::SetText(const std::string& text, bool initFromFile)
 {
-    // First, clear it
-    Clear();
-
+    // The new text and its line ends are made before anyone is told about the change.
+    // The syntax stops for the change, and the pool can be busy with it until then; so nothing here may wait on the pool after that
+    std::vector<int32_t> lineEnds;
+    std::shared_ptr<utf8> spInput;
+    size_t textSize = 0;
+    auto strippedCR = false;
+    auto pBegin = reinterpret_cast<const utf8*>(text.data());
+    auto pEnd = pBegin + text.size();
     if (!text.empty())
     {
         // Since incremental insertion of a big file into a gap buffer gives us worst case performance,
         // We build the buffer in a seperate array and assign it.  Much faster.
         // This is because we remove \r and convert tabs. Tabs are considered 'always evil' and should be
         // 4 spaces.  Take it up with your local code police if you feel aggrieved.
-        std::vector<utf8> input;
 
-        m_lineEnds.clear();
+        // Big files are split up and handled on all the cores we have.
+        // First find all the \n, \r and \t, so we know how big everything will be
+        auto& pool = GetEditor().GetThreadPool();
+        auto chunks = ScanChunks(pool, pBegin, pEnd);
+
+        LineCharCounts counts;
+        for (auto& chunk : chunks)
+        {
+            counts.lineFeeds += chunk.counts.lineFeeds;
+            counts.carriageReturns += chunk.counts.carriageReturns;
+            counts.tabs += chunk.counts.tabs;
+        }
 
-        // Update the gap buffer with the text
         // We remove \r, we only care about \n
-        for (auto& ch : text)
+        strippedCR = counts.carriageReturns != 0;
+
+        lineEnds.resize(counts.lineFeeds);
+        if (counts.carriageReturns == 0 && counts.tabs == 0)
         {
-            if (ch == '\r')
-            {
-                m_fileFlags |= FileFlags::StrippedCR;
-            }
-            else if (ch == '\t')
-            {
-                input.push_back(' ');
-                input.push_back(' ');
-                input.push_back(' ');
-                input.push_back(' ');
-            }
-            else
-            {
-                input.push_back(ch);
-                if (ch == '\n')
-                {
-                    m_lineEnds.push_back(input.size());
-                }
-            }
+            // Nothing to fix up, so the text goes straight in
+            ForEachChunk(pool, chunks, [&](LoadChunk& chunk) {
+                FillChunk(chunk, nullptr, lineEnds.data());
+            });
+        }
+        else
+        {
+            // Each chunk writes its own part of the new text
+            textSize = chunks.back().textStart + chunks.back().textSize;
+            spInput.reset(new utf8[textSize], std::default_delete<utf8[]>());
+            ForEachChunk(pool, chunks, [&](LoadChunk& chunk) {
+                FillChunk(chunk, spInput.get(), lineEnds.data());
+            });
         }
-        m_gapBuffer.assign(input.begin(), input.end());
     }
 
-    if (m_gapBuffer[m_gapBuffer.size() - 1] != 0)
+    // First, clear it
+    Clear();
+
+    // Every change comes between a PreBufferChange and the message saying what changed; here, the one FinishSetText sends
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, 0));
+
+    if (strippedCR)
+    {
+        m_fileFlags |= FileFlags::StrippedCR;
+    }
+
+    if (!text.empty())
+    {
+        if (!spInput)
+        {
+            m_text.assign(pBegin, pEnd);
+        }
+        else if (m_text.GetType() == TextStorageType::PieceTable)
+        {
+            // The piece table can keep the new text instead of copying it
+            m_text.assign_view(spInput.get(), spInput.get() + textSize, spInput);
+        }
+        else
+        {
+            m_text.assign(spInput.get(), spInput.get() + textSize);
+        }
+        m_lineIndex.Assign(lineEnds);
+    }
+
+    FinishSetText(initFromFile);
+}
+
+// Use the mapped file as the text, without copying it; edits are layered on top in the piece table.
+// We can only do this if the text is already in the form we want, so it returns false if there are tabs or CRs to fix up
+auto ZepBuffer::SetMappedText(const std::shared_ptr<IZepMappedFile>& spFile) -> bool
+{
+    auto pBegin = spFile->Data();
+    auto pEnd = pBegin + spFile->Size();
+
+    // Walking the file to find the line ends is all the work we do; like SetText, it is all done before the change starts
+    auto& pool = GetEditor().GetThreadPool();
+    auto chunks = ScanChunks(pool, pBegin, pEnd);
+
+    size_t lineFeeds = 0;
+    for (auto& chunk : chunks)
+    {
+        if (chunk.counts.carriageReturns != 0 || chunk.counts.tabs != 0)
+        {
+            return false;
+        }
+        lineFeeds += chunk.counts.lineFeeds;
+    }
+
+    std::vector<int32_t> lineEnds(lineFeeds);
+    ForEachChunk(pool, chunks, [&](LoadChunk& chunk) {
+        FillChunk(chunk, nullptr, lineEnds.data());
+    });
+
+    Clear();
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, 0, 0));
+
+    m_lineIndex.Assign(lineEnds);
+    m_text.assign_view(pBegin, pEnd, spFile);
+    m_wpMappedFile = spFile;
+
+    FinishSetText(true);
+    return true;
+}
+
+// Show the start of a big file now, and stream the rest of it in the background.
+// The text comes from the mapped file if there is one, or the string
+void ZepBuffer::StreamText(const std::shared_ptr<IZepMappedFile>& spFile, std::string&& text)
+{
+    auto spLoad = std::make_shared<StreamLoad>();
+    spLoad->spFile = spFile;
+    spLoad->text = std::move(text);
+    spLoad->pBegin = spFile ? spFile->Data() : reinterpret_cast<const utf8*>(spLoad->text.data());
+    spLoad->pEnd = spLoad->pBegin + (spFile ? spFile->Size() : spLoad->text.size());
+
+    // The first screenful
+    auto pFirstEnd = spLoad->pBegin + std::min(StreamFirstBlockSize, size_t(spLoad->pEnd - spLoad->pBegin));
+    SetText(std::string(spLoad->pBegin, pFirstEnd), true);
+    spLoad->appended = size_t(pFirstEnd - spLoad->pBegin);
+    spLoad->pNext = pFirstEnd;
+
+    SetFlags(FileFlags::Loading);
+    m_spStreamLoad = spLoad;
+
+    spLoad->worker = GetEditor().GetThreadPool().enqueue([spLoad]() {
+        spLoad->Run();
+    });
+}
+
+// Add any blocks of a streaming file which are ready; called on the main thread
+void ZepBuffer::UpdateStreamText()
+{
+    std::deque<StreamBlock> blocks;
+    {
+        std::lock_guard<std::mutex> lock(m_spStreamLoad->blockLock);
+        blocks.swap(m_spStreamLoad->blocks);
+    }
+
+    // The queue has room again, so a worker which stopped on a full one can carry on
+    auto spLoad = m_spStreamLoad;
+    if (spLoad->worker.wait_for(std::chrono::seconds(0)) == std::future_status::ready && spLoad->pNext < spLoad->pEnd)
+    {
+        spLoad->worker = GetEditor().GetThreadPool().enqueue([spLoad]() {
+            spLoad->Run();
+        });
+    }
+
+    if (blocks.empty())
+    {
+        return;
+    }
+
+    // Arriving text isn't an edit
+    auto dirty = TestFlags(FileFlags::Dirty);
+    for (auto& block : blocks)
+    {
+        // Before the terminating 0
+        Insert(BufferLocation(m_text.size() - 1), std::string_view(reinterpret_cast<const char*>(block.text.data()), block.text.size()));
+        if (block.strippedCR)
+        {
+            SetFlags(FileFlags::StrippedCR);
+        }
+        m_spStreamLoad->appended += block.sourceSize;
+    }
+
+    if (!dirty)
+    {
+        ClearFlags(FileFlags::Dirty);
+    }
+
+    if (m_spStreamLoad->appended == size_t(m_spStreamLoad->pEnd - m_spStreamLoad->pBegin))
+    {
+        m_spStreamLoad.reset();
+        ClearFlags(FileFlags::Loading);
+    }
+    GetEditor().RequestRefresh();
+}
+
+auto ZepBuffer::GetLoadProgress() const -> float
+{
+    if (!m_spStreamLoad)
+    {
+        return 1.0F;
+    }
+    return float(double(m_spStreamLoad->appended) / double(m_spStreamLoad->pEnd - m_spStreamLoad->pBegin));
+}
+
+// Finish off new text; make sure it is terminated, and tell everyone about it
+void ZepBuffer::FinishSetText(bool initFromFile)
+{
+    if (m_text[m_text.size() - 1] != 0)
     {
         m_fileFlags |= FileFlags::TerminatedWithZero;
-        m_gapBuffer.push_back(0);
+        m_text.push_back(0);
     }
 
     // TODO(unknown): Why is a line end needed always?
-    m_lineEnds.push_back(m_gapBuffer.size());
+    m_lineIndex.PushBack(m_text.size());
 
     MarkUpdate();
 
     // When loading a file, send the Loaded message to distinguish it from adding to a buffer, and remember that the buffer is not dirty in this case
     if (initFromFile)
     {
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::Loaded, BufferLocation{ 0 }, BufferLocation{ static_cast<BufferLocation>(m_gapBuffer.size()) }));
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::Loaded, BufferLocation{ 0 }, BufferLocation{ static_cast<BufferLocation>(m_text.size()) }));
 
         // Doc is not dirty
         ClearFlags(FileFlags::Dirty);
     }
     else
     {
-        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextAdded, BufferLocation{ 0 }, BufferLocation{ static_cast<BufferLocation>(m_gapBuffer.size()) }));
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextAdded, BufferLocation{ 0 }, BufferLocation{ static_cast<BufferLocation>(m_text.size()) }));
     }
 }
 
@@ -813,19 +1373,19 @@ auto ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation lineLocat
     }
 
     bufferLocation = Clamp(bufferLocation);
-    if (m_gapBuffer.empty())
+    if (m_text.empty())
     {
         return bufferLocation;
     }
 
     // If we are on the CR, move back 1, unless the \n is all that is on the line
-    if (m_gapBuffer[bufferLocation] == '\n')
+    if (m_text[bufferLocation] == '\n')
     {
         bufferLocation--;
     }
 
     // Find the end of the previous line
-    while (bufferLocation >= 0 && m_gapBuffer[bufferLocation] != '\n')
+    while (bufferLocation >= 0 && m_text[bufferLocation] != '\n')
     {
         bufferLocation--;
     }
@@ -843,7 +1403,7 @@ auto ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation lineLocat
 
     // The point just after the line end
     case LineLocation::BeyondLineEnd: {
-        while (bufferLocation < m_gapBuffer.size() && m_gapBuffer[bufferLocation] != '\n' && m_gapBuffer[bufferLocation] != 0)
+        while (bufferLocation < m_text.size() && m_text[bufferLocation] != '\n' && m_text[bufferLocation] != 0)
         {
             bufferLocation++;
         }
@@ -853,9 +1413,9 @@ auto ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation lineLocat
     break;
 
     case LineLocation::LineCRBegin: {
-        while (bufferLocation < m_gapBuffer.size()
-            && m_gapBuffer[bufferLocation] != '\n'
-            && m_gapBuffer[bufferLocation] != 0)
+        while (bufferLocation < m_text.size()
+            && m_text[bufferLocation] != '\n'
+            && m_text[bufferLocation] != 0)
         {
             bufferLocation++;
         }
@@ -864,7 +1424,7 @@ auto ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation lineLocat
     break;
 
     case LineLocation::LineFirstGraphChar: {
-        while (bufferLocation < m_gapBuffer.size() && (std::isgraph(ToASCII(m_gapBuffer[bufferLocation])) == 0) && m_gapBuffer[bufferLocation] != '\n')
+        while (bufferLocation < m_text.size() && (std::isgraph(ToASCII(m_text[bufferLocation])) == 0) && m_text[bufferLocation] != '\n')
         {
             bufferLocation++;
         }
@@ -875,9 +1435,9 @@ auto ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation lineLocat
     case LineLocation::LineLastNonCR: {
         auto start = bufferLocation;
 
-        while (bufferLocation < m_gapBuffer.size()
-            && m_gapBuffer[bufferLocation] != '\n'
-            && m_gapBuffer[bufferLocation] != 0)
+        while (bufferLocation < m_text.size()
+            && m_text[bufferLocation] != '\n'
+            && m_text[bufferLocation] != 0)
         {
             bufferLocation++;
         }
@@ -892,14 +1452,14 @@ auto ZepBuffer::GetLinePos(BufferLocation bufferLocation, LineLocation lineLocat
     break;
 
     case LineLocation::LineLastGraphChar: {
-        while (bufferLocation < m_gapBuffer.size()
-            && m_gapBuffer[bufferLocation] != '\n'
-            && m_gapBuffer[bufferLocation] != 0)
+        while (bufferLocation < m_text.size()
+            && m_text[bufferLocation] != '\n'
+            && m_text[bufferLocation] != 0)
         {
             bufferLocation++;
         }
 
-        while (bufferLocation > 0 && bufferLocation < m_gapBuffer.size() && (std::isgraph(ToASCII(m_gapBuffer[bufferLocation])) == 0))
+        while (bufferLocation > 0 && bufferLocation < m_text.size() && (std::isgraph(ToASCII(m_text[bufferLocation])) == 0))
         {
             bufferLocation--;
         }
@@ -964,7 +1524,7 @@ void ZepBuffer::UpdateForDelete(const BufferLocation& startOffset, const BufferL
             auto pWidgets = m_lineWidgets[replace.first];
             m_lineWidgets.erase(replace.first);
 
-            if (replace.second >= 0 && replace.second < (m_gapBuffer.size() - 1))
+            if (replace.second >= 0 && replace.second < (m_text.size() - 1))
             {
                 m_lineWidgets[replace.second] = pWidgets;
             }
@@ -1016,7 +1576,7 @@ void ZepBuffer::UpdateForInsert(const BufferLocation& startOffset, const BufferL
         {
             auto pWidgets = m_lineWidgets[replace.first];
             m_lineWidgets.erase(replace.first);
-            if (replace.second >= 0 && replace.second < (m_gapBuffer.size() - 1))
+            if (replace.second >= 0 && replace.second < (m_text.size() - 1))
             {
                 m_lineWidgets[replace.second] = pWidgets;
             }
@@ -1026,7 +1586,7 @@ void ZepBuffer::UpdateForInsert(const BufferLocation& startOffset, const BufferL
 
 auto ZepBuffer::Insert(const BufferLocation& startOffset, const std::string_view& str) -> bool
 {
-    if (startOffset > m_gapBuffer.size())
+    if (startOffset > m_text.size())
     {
         return false;
     }
@@ -1038,52 +1598,14 @@ auto ZepBuffer::Insert(const BufferLocation& startOffset, const std::string_view
 
     UpdateForInsert(startOffset, startOffset + changeRange);
 
-    // abcdef\r\nabc<insert>dfdf\r\n
-    auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startOffset);
-    ;
-    if (itrLine != m_lineEnds.end() && *itrLine <= startOffset)
-    {
-        itrLine++;
-    }
-
-    auto itrEnd = str.end();
-    auto itrBegin = str.begin();
-    auto itr = str.begin();
-
-    // Make a list of lines to 'insert'
+    // Make a list of lines to 'insert'; the point just after each "\n"
+    // The line index moves the rest of the line ends along
     std::vector<int32_t> lines;
-    std::string_view lineEndSymbols("\n");
-    while (itr != itrEnd)
-    {
-        // Get to first point after "\n"
-        // That's the point just after the end of the current line
-        itr = std::find_first_of(itr, itrEnd, lineEndSymbols.begin(), lineEndSymbols.end());
-        if (itr != itrEnd)
-        {
-            if (itr != itrEnd && *itr == '\n')
-            {
-                itr++;
-            }
-            lines.push_back((itr - itrBegin) + startOffset);
-        }
-    }
-
-    // Increment the rest of the line ends
-    // We make all the remaning line ends bigger by the fixed_size of the insertion
-    auto itrAdd = itrLine;
-    while (itrAdd != m_lineEnds.end())
-    {
-        *itrAdd += str.length();
-        itrAdd++;
-    }
-
-    if (!lines.empty())
-    {
-        // Update the atomic line counter so clients can see where we are up to.
-        m_lineEnds.insert(itrLine, lines.begin(), lines.end());
-    }
+    auto pStr = reinterpret_cast<const utf8*>(str.data());
+    ScanLineEnds(pStr, pStr + str.size(), startOffset, lines);
+    m_lineIndex.Insert(startOffset, changeRange, lines);
 
-    m_gapBuffer.insert(m_gapBuffer.begin() + startOffset, str.begin(), str.end());
+    m_text.insert(m_text.begin() + startOffset, str.begin(), str.end());
 
     MarkUpdate();
 
@@ -1095,7 +1617,7 @@ auto ZepBuffer::Insert(const BufferLocation& startOffset, const std::string_view
 
 auto ZepBuffer::Replace(const BufferLocation& startOffset, const BufferLocation& endOffset, const std::string_view& str) -> bool
 {
-    if (startOffset > m_gapBuffer.size() || endOffset > m_gapBuffer.size())
+    if (startOffset > m_text.size() || endOffset > m_text.size())
     {
         return false;
     }
@@ -1104,11 +1626,8 @@ auto ZepBuffer::Replace(const BufferLocation& startOffset, const BufferLocation&
     GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startOffset, endOffset));
 
     // Perform a straight replace
-    for (auto loc = startOffset; loc < endOffset; loc++)
-    {
-        // Note we don't support utf8 yet
-        m_gapBuffer[loc] = str[0];
-    }
+    // Note we don't support utf8 yet
+    m_text.replace(m_text.begin() + startOffset, m_text.begin() + endOffset, str[0]);
 
     MarkUpdate();
 
@@ -1119,7 +1638,7 @@ auto ZepBuffer::Replace(const BufferLocation& startOffset, const BufferLocation&
 }
 // A fundamental operation - delete a range of characters
 // Need to update:
-// - m_lineEnds
+// - m_lineIndex
 // - m_processedLine
 // - m_pBuffer (i.e remove chars)
 // We also need to inform clients before we change the buffer, and after we delete text with the range we removed.
@@ -1128,40 +1647,18 @@ auto ZepBuffer::Replace(const BufferLocation& startOffset, const BufferLocation&
 // This makes a few things fall out more easily
 auto ZepBuffer::Delete(const BufferLocation& startOffset, const BufferLocation& endOffset) -> bool
 {
-    assert(startOffset >= 0 && endOffset <= (BufferLocation)(m_gapBuffer.size() - 1));
+    assert(startOffset >= 0 && endOffset <= (BufferLocation)(m_text.size() - 1));
 
     // We are about to modify this range
     GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::PreBufferChange, startOffset, endOffset));
 
     UpdateForDelete(startOffset, endOffset);
 
-    auto itrLine = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), startOffset);
-    if (itrLine == m_lineEnds.end())
-    {
-        return false;
-    }
-
-    auto itrLastLine = std::upper_bound(itrLine, m_lineEnds.end(), endOffset);
-    auto offsetDiff = endOffset - startOffset;
+    // Remove the lines in the range, and move the ones after it back
+    m_lineIndex.Erase(startOffset, endOffset);
 
-    if (*itrLine <= startOffset)
-    {
-        itrLine++;
-    }
-
-    // Adjust all line offsets beyond us
-    for (auto itr = itrLastLine; itr != m_lineEnds.end(); itr++)
-    {
-        *itr -= offsetDiff;
-    }
-
-    if (itrLine != itrLastLine)
-    {
-        m_lineEnds.erase(itrLine, itrLastLine);
-    }
-
-    m_gapBuffer.erase(m_gapBuffer.begin() + startOffset, m_gapBuffer.begin() + endOffset);
-    assert(m_gapBuffer.size() > 0 && m_gapBuffer[m_gapBuffer.size() - 1] == 0);
+    m_text.erase(m_text.begin() + startOffset, m_text.begin() + endOffset);
+    assert(m_text.size() > 0 && m_text[m_text.size() - 1] == 0);
 
     MarkUpdate();
 
@@ -1175,7 +1672,7 @@ auto ZepBuffer::EndLocation() const -> BufferLocation
 {
     // TODO(unknown): This isn't safe? What if the buffer is empty
     // I've clamped it for now
-    auto end = std::max((BufferLocation)0, (BufferLocation)m_gapBuffer.size() - 1);
+    auto end = std::max((BufferLocation)0, (BufferLocation)m_text.size() - 1);
     return LocationFromOffset(end);
 }
 
@@ -1220,7 +1717,7 @@ void ZepBuffer::SetSelection(const BufferRange& selection)
 void ZepBuffer::AddRangeMarker(const std::shared_ptr<RangeMarker>& spMarker)
 {
     m_rangeMarkers[spMarker->range.first].insert(spMarker);
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_gapBuffer.size() - 1)));
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_text.size() - 1)));
 }
 
 void ZepBuffer::ClearRangeMarker(const std::shared_ptr<RangeMarker>& spMarker)
@@ -1247,7 +1744,7 @@ void ZepBuffer::ClearRangeMarkers(const std::set<std::shared_ptr<RangeMarker>>&
     {
         ClearRangeMarker(marker);
     }
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_gapBuffer.size() - 1)));
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_text.size() - 1)));
 }
 
 void ZepBuffer::ClearRangeMarkers(uint32_t markerType)
@@ -1263,7 +1760,7 @@ void ZepBuffer::ClearRangeMarkers(uint32_t markerType)
         ClearRangeMarker(victim);
     }
 
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_gapBuffer.size() - 1)));
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::MarkersChanged, 0, BufferLocation(m_text.size() - 1)));
 }
 
 void ZepBuffer::ForEachMarker(uint32_t markerType, SearchDirection dir, BufferLocation begin, BufferLocation end, const std::function<bool(const std::shared_ptr<RangeMarker>&)>& fnCB) const
@@ -1424,13 +1921,12 @@ void ZepBuffer::SetMode(const std::shared_ptr<ZepMode>& spMode)
 
 void ZepBuffer::AddLineWidget(int32_t line, const std::shared_ptr<ILineWidget>& spWidget)
 {
-    // TODO(unknown): Add layout changed message
     int32_t start;
     int32_t end;
     GetLineOffsets(line, start, end);
 
     m_lineWidgets[start].push_back(spWidget);
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, 0, 0));
+    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::LineWidgetsChanged, start, start));
 }
 
 void ZepBuffer::ClearLineWidgets(int32_t line)
@@ -1441,16 +1937,26 @@ void ZepBuffer::ClearLineWidgets(int32_t line)
         int32_t end;
         GetLineOffsets(line, start, end);
         m_lineWidgets.erase(start);
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::LineWidgetsChanged, start, start));
     }
-    else
+    else if (!m_lineWidgets.empty())
     {
+        // Only the lines from the first widget to the last change size
+        auto start = m_lineWidgets.begin()->first;
+        auto end = m_lineWidgets.rbegin()->first;
         m_lineWidgets.clear();
+        GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::LineWidgetsChanged, start, end));
     }
-    GetEditor().Broadcast(std::make_shared<BufferMessage>(this, BufferMessageType::TextChanged, 0, 0));
 }
 
 auto ZepBuffer::GetLineWidgets(int32_t line) const -> const ZepBuffer::tLineWidgets*
 {
+    // The layout asks for every line, and mostly there are none
+    if (m_lineWidgets.empty())
+    {
+        return nullptr;
+    }
+
     int32_t start;
     int32_t end;
     GetLineOffsets(line, start, end);
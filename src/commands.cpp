@@ -26,7 +26,7 @@ void ZepCommand_DeleteRange::Redo()
 {
     if (m_startOffset != m_endOffset)
     {
-        m_deleted = std::string(m_buffer.GetText().begin() + m_startOffset, m_buffer.GetText().begin() + m_endOffset);
+        m_deleted = m_buffer.GetText().string(m_buffer.GetText().begin() + m_startOffset, m_buffer.GetText().begin() + m_endOffset);
 
         m_buffer.Delete(m_startOffset, m_endOffset);
     }
@@ -87,7 +87,7 @@ void ZepCommand_ReplaceRange::Redo()
 {
     if (m_startOffset != m_endOffset)
     {
-        m_strDeleted = std::string(m_buffer.GetText().begin() + m_startOffset, m_buffer.GetText().begin() + m_endOffset);
+        m_strDeleted = m_buffer.GetText().string(m_buffer.GetText().begin() + m_startOffset, m_buffer.GetText().begin() + m_endOffset);
         if (m_mode == ReplaceRangeMode::Fill)
         {
             m_buffer.Replace(m_startOffset, m_endOffset, m_strReplace);
@@ -7,6 +7,7 @@
 #include "zep/mode_standard.hpp"
 #include "zep/mode_vim.hpp"
 #include "zep/syntax.hpp"
+#include "zep/syntax_grammar.hpp"
 #include "zep/syntax_providers.hpp"
 #include "zep/tab_window.hpp"
 #include "zep/theme.hpp"
@@ -19,7 +20,9 @@
 #include "zep/mcommon/string/murmur_hash.hpp"
 #include "zep/mcommon/string/stringutils.hpp"
 
+#include <algorithm>
 #include <stdexcept>
+#include <thread>
 
 namespace Zep
 {
@@ -64,6 +67,10 @@ ZepEditor::ZepEditor(ZepDisplay* pDisplay, const ZepPath& root, uint32_t flags,
     {
         m_threadPool = std::make_unique<ThreadPool>(1);
     }
+    else if ((m_flags & ZepEditorFlags::WorkerThreads) != 0)
+    {
+        m_threadPool = std::make_unique<ThreadPool>(std::max(2U, std::thread::hardware_concurrency()));
+    }
     else
     {
         m_threadPool = std::make_unique<ThreadPool>();
@@ -84,6 +91,9 @@ ZepEditor::ZepEditor(ZepDisplay* pDisplay, const ZepPath& root, uint32_t flags,
 
     RegisterSyntaxProviders(*this);
 
+    // Grammars next to the config add languages, or replace the built in ones
+    LoadSyntaxGrammars(root / "syntax");
+
     m_editorRegion = std::make_shared<Region>();
     m_editorRegion->vertical = false;
 
@@ -117,6 +127,10 @@ void ZepEditor::OnFileChanged(const ZepPath& path)
         LoadConfig(path);
         Broadcast(std::make_shared<ZepMessage>(Msg::ConfigChanged));
     }
+    else if (path.extension() == ".toml" && path.parent_path().filename() == "syntax")
+    {
+        LoadSyntaxGrammar(path);
+    }
 }
 
 // If you pass a valid path to a 'zep.cfg' file, then editor settings will serialize from that
@@ -169,6 +183,9 @@ void ZepEditor::LoadConfig(const std::shared_ptr<cpptoml::table>& spConfig)
         m_config.widgetMargins.x = (float)spConfig->get_qualified_as<double>("editor.widget_margin_top").value_or(1);
         m_config.widgetMargins.y = (float)spConfig->get_qualified_as<double>("editor.widget_margin_bottom").value_or(1);
         m_config.shortTabNames = spConfig->get_qualified_as<bool>("editor.short_tab_names").value_or(false);
+        m_config.pieceTableFileSize = spConfig->get_qualified_as<uint64_t>("editor.piece_table_file_size").value_or(16 * 1024 * 1024);
+        m_config.streamFileSize = spConfig->get_qualified_as<uint64_t>("editor.stream_file_size").value_or(32 * 1024 * 1024);
+        m_config.lazySyntax = spConfig->get_qualified_as<bool>("editor.lazy_syntax").value_or(false);
         auto styleStr = string_tolower(spConfig->get_qualified_as<std::string>("editor.style").value_or("normal"));
         if (styleStr == "normal")
         {
@@ -201,6 +218,9 @@ void ZepEditor::SaveConfig(const std::shared_ptr<cpptoml::table>& spConfig)
     table->insert("background_fade_time", (double)m_config.backgroundFadeTime);
     table->insert("background_fade_wait", (double)m_config.backgroundFadeWait);
     table->insert("show_scrollbar", m_config.showScrollBar);
+    table->insert("piece_table_file_size", int64_t(m_config.pieceTableFileSize));
+    table->insert("stream_file_size", int64_t(m_config.streamFileSize));
+    table->insert("lazy_syntax", m_config.lazySyntax);
 
     table->insert("line_margin_top", m_config.lineMargins.x);
     table->insert("line_margin_bottom", m_config.lineMargins.y);
@@ -675,6 +695,50 @@ void ZepEditor::RegisterSyntaxFactory(const std::vector<std::string>& mappings,
     }
 }
 
+auto ZepEditor::LoadSyntaxGrammar(const ZepPath& path) -> bool
+{
+    std::string error;
+    try
+    {
+        std::istringstream stream(GetFileSystem().Read(path));
+        cpptoml::parser parser(stream);
+        auto spGrammar = SyntaxGrammar::Compile(parser.parse(), error);
+        if (spGrammar)
+        {
+            RegisterSyntaxFactory(spGrammar->GetExtensions(), SyntaxProvider{ spGrammar->GetName(), tSyntaxFactory([spGrammar](ZepBuffer* pBuffer) {
+                                                                                 return std::make_shared<ZepGrammarSyntax>(*pBuffer, spGrammar);
+                                                                             }) });
+            return true;
+        }
+    }
+    catch (cpptoml::parse_exception& ex)
+    {
+        error = ex.what();
+    }
+
+    std::ostringstream str;
+    str << path.filename().string() << " : Failed to load syntax. " << error;
+    SetCommandText(str.str());
+    return false;
+}
+
+void ZepEditor::LoadSyntaxGrammars(const ZepPath& dir)
+{
+    if (!GetFileSystem().Exists(dir) || !GetFileSystem().IsDirectory(dir))
+    {
+        return;
+    }
+
+    GetFileSystem().ScanDirectory(dir, [&](const ZepPath& path, bool& recurse) {
+        recurse = false;
+        if (path.extension() == ".toml")
+        {
+            LoadSyntaxGrammar(path);
+        }
+        return true;
+    });
+}
+
 // Inform clients of an event in the buffer
 auto ZepEditor::Broadcast(const std::shared_ptr<ZepMessage>& message) -> bool
 {
@@ -1,5 +1,6 @@
 #include "zep/filesystem.hpp"
 
+#include <cstdio>
 #include <fstream>
 
 #include "zep/mcommon/logger.hpp"
@@ -19,9 +20,223 @@ namespace cpp_fs = std::experimental::filesystem::v1;
 
 #endif
 
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#undef ERROR
+#else
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace Zep
 {
 
+namespace
+{
+
+// A file mapped read only into memory.
+// The pages are only read in from disk when they are touched, and are never copied.
+// Note that if another program truncates the file while it is mapped, reading the missing pages will fault;
+// we accept that for the big read-only files this is used for.
+class ZepMappedFileCPP : public IZepMappedFile
+{
+public:
+    ~ZepMappedFileCPP() override
+    {
+#if defined(_WIN32)
+        if (m_pData)
+        {
+            UnmapViewOfFile(m_pData);
+        }
+#else
+        if (m_pData)
+        {
+            munmap(const_cast<uint8_t*>(m_pData), m_size);
+        }
+#endif
+    }
+
+    auto Map(const ZepPath& fileName, size_t minSize) -> bool
+    {
+#if defined(_WIN32)
+        auto hFile = CreateFileA(fileName.string().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0 && uint64_t(size.QuadPart) >= minSize)
+        {
+            auto hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (hMapping)
+            {
+                m_pData = static_cast<const uint8_t*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+                m_size = size_t(size.QuadPart);
+
+                // The view keeps the mapping alive
+                CloseHandle(hMapping);
+            }
+        }
+        CloseHandle(hFile);
+#else
+        auto fd = open(fileName.string().c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && size_t(st.st_size) >= minSize)
+        {
+            auto pData = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (pData != MAP_FAILED)
+            {
+                // We are about to walk the whole file to find the lines
+                madvise(pData, size_t(st.st_size), MADV_SEQUENTIAL);
+                m_pData = static_cast<const uint8_t*>(pData);
+                m_size = size_t(st.st_size);
+            }
+        }
+
+        // The mapping keeps its own reference to the file
+        close(fd);
+#endif
+        return m_pData != nullptr;
+    }
+
+    auto Data() const -> const uint8_t* override
+    {
+        return m_pData;
+    }
+
+    auto Size() const -> size_t override
+    {
+        return m_size;
+    }
+
+    auto LocksFile() const -> bool override
+    {
+#if defined(_WIN32)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    const uint8_t* m_pData = nullptr;
+    size_t m_size = 0;
+};
+
+// Writes to a temporary file next to the real one, and renames it over the top when it is complete.
+// So a crash or a full disk part way through a save never leaves a half written file behind.
+class ZepFileWriterCPP : public IZepFileWriter
+{
+public:
+    ~ZepFileWriterCPP() override
+    {
+        if (m_pFile)
+        {
+            fclose(m_pFile);
+            std::remove(m_tempPath.c_str());
+        }
+    }
+
+    auto Open(const ZepPath& fileName) -> bool
+    {
+        m_path = fileName.string();
+#if defined(_WIN32)
+        m_tempPath = m_path + ".zep.tmp";
+        m_pFile = fopen(m_tempPath.c_str(), "wb");
+#else
+        // Write through a link to the file it points at, rather than replacing the link
+        char resolved[PATH_MAX];
+        if (realpath(m_path.c_str(), resolved))
+        {
+            m_path = resolved;
+        }
+
+        m_tempPath = m_path + ".XXXXXX";
+        auto fd = mkstemp(&m_tempPath[0]);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        // mkstemp makes the file private; give it the permissions the file had, or would have had
+        struct stat st;
+        if (stat(m_path.c_str(), &st) == 0)
+        {
+            fchmod(fd, st.st_mode & 07777);
+        }
+        else
+        {
+            auto mask = umask(0);
+            umask(mask);
+            fchmod(fd, 0666 & ~mask);
+        }
+
+        m_pFile = fdopen(fd, "wb");
+        if (!m_pFile)
+        {
+            close(fd);
+            std::remove(m_tempPath.c_str());
+        }
+#endif
+        return m_pFile != nullptr;
+    }
+
+    auto Write(const void* pData, size_t size) -> bool override
+    {
+        return m_pFile && fwrite(pData, sizeof(uint8_t), size, m_pFile) == size;
+    }
+
+    auto Commit() -> bool override
+    {
+        if (!m_pFile)
+        {
+            return false;
+        }
+
+        // Make sure it is all on the disk before it replaces the old one
+        auto ok = fflush(m_pFile) == 0;
+#if !defined(_WIN32)
+        ok = ok && fsync(fileno(m_pFile)) == 0;
+#endif
+        ok = (fclose(m_pFile) == 0) && ok;
+        m_pFile = nullptr;
+
+#if defined(_WIN32)
+        ok = ok && MoveFileExA(m_tempPath.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        ok = ok && rename(m_tempPath.c_str(), m_path.c_str()) == 0;
+#endif
+        if (!ok)
+        {
+            std::remove(m_tempPath.c_str());
+        }
+        return ok;
+    }
+
+private:
+    FILE* m_pFile = nullptr;
+    std::string m_path;
+    std::string m_tempPath;
+};
+
+} // namespace
+
 ZepFileSystemCPP::ZepFileSystemCPP()
 {
 #if defined(__APPLE__)
@@ -112,6 +327,16 @@ std::string ZepFileSystemCPP::Read(const ZepPath& fileName)
     return std::string();
 }
 
+std::shared_ptr<IZepMappedFile> ZepFileSystemCPP::Map(const ZepPath& fileName, size_t minSize)
+{
+    auto spFile = std::make_shared<ZepMappedFileCPP>();
+    if (!spFile->Map(fileName, minSize))
+    {
+        return nullptr;
+    }
+    return spFile;
+}
+
 bool ZepFileSystemCPP::Write(const ZepPath& fileName, const void* pData, size_t size)
 {
     FILE* pFile;
@@ -125,6 +350,16 @@ bool ZepFileSystemCPP::Write(const ZepPath& fileName, const void* pData, size_t
     return true;
 }
 
+std::shared_ptr<IZepFileWriter> ZepFileSystemCPP::OpenWriter(const ZepPath& fileName)
+{
+    auto spWriter = std::make_shared<ZepFileWriterCPP>();
+    if (!spWriter->Open(fileName))
+    {
+        return nullptr;
+    }
+    return spWriter;
+}
+
 void ZepFileSystemCPP::ScanDirectory(const ZepPath& path, std::function<bool(const ZepPath& path, bool& dont_recurse)> fnScan) const
 {
     // Not on apple yet!
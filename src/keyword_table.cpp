@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <numeric>
+
+#include "zep/keyword_table.hpp"
+
+namespace Zep
+{
+
+// The same hash and displace as KeywordTableStorage, except the buckets can be any size, since the words could be anything
+KeywordSet::KeywordSet(const std::set<std::string_view>& words)
+{
+    for (auto& word : words)
+    {
+        if (!word.empty())
+        {
+            m_words.emplace_back(word);
+            m_maxLength = std::max(m_maxLength, word.size());
+        }
+    }
+
+    // At most half full, so the seeds are quick to find
+    uint32_t slotCount = 1;
+    while (slotCount < m_words.size() * 2)
+    {
+        slotCount <<= 1;
+    }
+    auto bucketCount = uint32_t(m_words.size() / 2 + 1);
+    m_slots.resize(slotCount);
+    m_seeds.assign(bucketCount, 0);
+
+    std::vector<std::vector<uint32_t>> buckets(bucketCount);
+    for (uint32_t i = 0; i < uint32_t(m_words.size()); i++)
+    {
+        buckets[KeywordHash(m_words[i]) % bucketCount].push_back(i);
+    }
+
+    // Place the biggest buckets first, while there is the most room
+    std::vector<uint32_t> order(bucketCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    std::vector<bool> used(slotCount);
+    std::vector<uint32_t> slots;
+    for (auto b : order)
+    {
+        auto& bucket = buckets[b];
+        if (bucket.empty())
+        {
+            break;
+        }
+
+        // Find a seed which puts every word in the bucket in a free slot of its own
+        for (uint32_t seed = 1;; seed++)
+        {
+            slots.clear();
+            for (auto word : bucket)
+            {
+                auto slot = KeywordSlot(KeywordHash(m_words[word]), seed, slotCount - 1);
+                if (used[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+                {
+                    break;
+                }
+                slots.push_back(slot);
+            }
+
+            if (slots.size() == bucket.size())
+            {
+                m_seeds[b] = seed;
+                for (size_t m = 0; m < bucket.size(); m++)
+                {
+                    used[slots[m]] = true;
+                    m_slots[slots[m]] = m_words[bucket[m]];
+                }
+                break;
+            }
+        }
+    }
+}
+
+} // namespace Zep
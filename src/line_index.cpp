@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "zep/line_index.hpp"
+
+namespace Zep
+{
+
+namespace
+{
+// Chunks are built this size, and split/merged when they drift too far from it
+const size_t ChunkLines = 256;
+const size_t MaxChunkLines = ChunkLines * 4;
+const size_t MinChunkLines = ChunkLines / 4;
+} // namespace
+
+LineIndex::LineIndex()
+{
+    UpdateTrees();
+}
+
+void LineIndex::Clear()
+{
+    m_chunks.clear();
+    UpdateTrees();
+}
+
+void LineIndex::Assign(const std::vector<int32_t>& lineEnds)
+{
+    m_chunks.clear();
+    Rebuild(m_chunks.begin(), m_chunks.end(), lineEnds, 0);
+    UpdateTrees();
+}
+
+void LineIndex::PushBack(int32_t lineEnd)
+{
+    if (m_chunks.empty() || m_chunks.back().ends.size() >= ChunkLines)
+    {
+        auto chunkStart = m_chunkSizes.Sum(m_chunks.size());
+        m_chunks.push_back(Chunk{ { lineEnd - chunkStart } });
+        UpdateTrees();
+        return;
+    }
+
+    auto chunk = m_chunks.size() - 1;
+    auto& ends = m_chunks[chunk].ends;
+    auto oldSize = ends.back();
+    ends.push_back(lineEnd - ChunkStart(chunk));
+
+    m_chunkSizes.Add(chunk, ends.back() - oldSize);
+    m_chunkLines.Add(chunk, 1);
+    m_lineCount++;
+}
+
+auto LineIndex::LineEnd(int32_t line) const -> int32_t
+{
+    assert(line >= 0 && line < m_lineCount);
+    auto chunk = m_chunkLines.Count(line);
+    return ChunkStart(chunk) + m_chunks[chunk].ends[line - m_chunkLines.Sum(chunk)];
+}
+
+auto LineIndex::LineFromOffset(int32_t offset) const -> int32_t
+{
+    auto chunk = FindChunk(offset);
+    if (chunk == m_chunks.size())
+    {
+        return m_lineCount;
+    }
+
+    auto& ends = m_chunks[chunk].ends;
+    auto itr = std::upper_bound(ends.begin(), ends.end(), offset - ChunkStart(chunk));
+    return m_chunkLines.Sum(chunk) + int32_t(itr - ends.begin());
+}
+
+void LineIndex::Insert(int32_t offset, int32_t length, const std::vector<int32_t>& newLineEnds)
+{
+    if (m_chunks.empty())
+    {
+        Assign(newLineEnds);
+        return;
+    }
+
+    // Past the last line, it goes on the end of the last chunk
+    auto chunk = std::min(FindChunk(offset), m_chunks.size() - 1);
+    auto chunkStart = ChunkStart(chunk);
+    auto& ends = m_chunks[chunk].ends;
+    auto oldSize = ends.back();
+
+    // Only the rest of this chunk moves; the chunks after it are relative to it
+    auto itr = std::upper_bound(ends.begin(), ends.end(), offset - chunkStart);
+    for (auto itrShift = itr; itrShift != ends.end(); itrShift++)
+    {
+        *itrShift += length;
+    }
+
+    if (!newLineEnds.empty())
+    {
+        itr = ends.insert(itr, newLineEnds.size(), 0);
+        for (auto& lineEnd : newLineEnds)
+        {
+            *itr++ = lineEnd - chunkStart;
+        }
+    }
+
+    if (ends.size() > MaxChunkLines)
+    {
+        std::vector<int32_t> lineEnds;
+        lineEnds.reserve(ends.size());
+        std::transform(ends.begin(), ends.end(), std::back_inserter(lineEnds), [&](int32_t end) { return end + chunkStart; });
+        Rebuild(m_chunks.begin() + chunk, m_chunks.begin() + chunk + 1, lineEnds, chunkStart);
+        UpdateTrees();
+        return;
+    }
+
+    m_chunkSizes.Add(chunk, ends.back() - oldSize);
+    m_chunkLines.Add(chunk, int32_t(newLineEnds.size()));
+    m_lineCount += int32_t(newLineEnds.size());
+}
+
+void LineIndex::Erase(int32_t startOffset, int32_t endOffset)
+{
+    if (startOffset >= endOffset)
+    {
+        return;
+    }
+
+    auto firstChunk = FindChunk(startOffset);
+    if (firstChunk == m_chunks.size())
+    {
+        return;
+    }
+
+    // Lines ending inside the range go, and the ones after it move back
+    auto diff = endOffset - startOffset;
+    auto lastChunk = FindChunk(endOffset);
+    auto chunkStart = ChunkStart(firstChunk);
+    auto fixedUp = false;
+    if (firstChunk == lastChunk)
+    {
+        auto& ends = m_chunks[firstChunk].ends;
+        auto itrFirst = std::upper_bound(ends.begin(), ends.end(), startOffset - chunkStart);
+        auto itrLast = std::upper_bound(itrFirst, ends.end(), endOffset - chunkStart);
+        for (auto itr = itrLast; itr != ends.end(); itr++)
+        {
+            *itr -= diff;
+        }
+
+        auto removed = int32_t(itrLast - itrFirst);
+        ends.erase(itrFirst, itrLast);
+
+        // There is always a line left, since the range ends inside this chunk
+        if (ends.size() >= MinChunkLines || m_chunks.size() == 1)
+        {
+            m_chunkSizes.Add(firstChunk, -diff);
+            m_chunkLines.Add(firstChunk, -removed);
+            m_lineCount -= removed;
+            return;
+        }
+
+        // Too small; merge it with the next one
+        fixedUp = true;
+        lastChunk = std::min(firstChunk + 1, m_chunks.size() - 1);
+        if (lastChunk == firstChunk)
+        {
+            firstChunk--;
+            chunkStart = ChunkStart(firstChunk);
+        }
+    }
+
+    // Rebuild all the chunks the range touches
+    auto endChunk = std::min(lastChunk + 1, m_chunks.size());
+    std::vector<int32_t> lineEnds;
+    auto base = chunkStart;
+    for (auto chunk = firstChunk; chunk < endChunk; chunk++)
+    {
+        for (auto& end : m_chunks[chunk].ends)
+        {
+            auto lineEnd = end + base;
+
+            if (fixedUp || lineEnd <= startOffset)
+            {
+                lineEnds.push_back(lineEnd);
+            }
+            else if (lineEnd > endOffset)
+            {
+                lineEnds.push_back(lineEnd - diff);
+            }
+        }
+        base += m_chunks[chunk].ends.back();
+    }
+
+    Rebuild(m_chunks.begin() + firstChunk, m_chunks.begin() + endChunk, lineEnds, chunkStart);
+    UpdateTrees();
+}
+
+auto LineIndex::ToVector() const -> std::vector<int32_t>
+{
+    std::vector<int32_t> lineEnds;
+    lineEnds.reserve(m_lineCount);
+
+    int32_t chunkStart = 0;
+    for (auto& chunk : m_chunks)
+    {
+        for (auto& end : chunk.ends)
+        {
+            lineEnds.push_back(end + chunkStart);
+        }
+        chunkStart += chunk.ends.back();
+    }
+    return lineEnds;
+}
+
+auto LineIndex::ChunkStart(size_t chunk) const -> int32_t
+{
+    return m_chunkSizes.Sum(chunk);
+}
+
+// The first chunk with a line ending after the offset
+auto LineIndex::FindChunk(int32_t offset) const -> size_t
+{
+    return m_chunkSizes.Count(offset);
+}
+
+// Replace a range of chunks with new ones holding these line ends
+void LineIndex::Rebuild(std::vector<Chunk>::iterator itrFirst, std::vector<Chunk>::iterator itrLast, const std::vector<int32_t>& lineEnds, int32_t chunkStart)
+{
+    std::vector<Chunk> chunks;
+    chunks.reserve(lineEnds.size() / ChunkLines + 1);
+    size_t line = 0;
+    while (line < lineEnds.size())
+    {
+        // Don't leave a tiny chunk on the end; the next edit in it would have to merge it straight away
+        auto lastLine = lineEnds.size() - line < ChunkLines + MinChunkLines ? lineEnds.size() : line + ChunkLines;
+
+        Chunk chunk;
+        chunk.ends.reserve(lastLine - line);
+        for (auto i = line; i < lastLine; i++)
+        {
+            chunk.ends.push_back(lineEnds[i] - chunkStart);
+        }
+        chunkStart = lineEnds[lastLine - 1];
+        chunks.push_back(std::move(chunk));
+        line = lastLine;
+    }
+
+    auto itr = m_chunks.erase(itrFirst, itrLast);
+    m_chunks.insert(itr, std::make_move_iterator(chunks.begin()), std::make_move_iterator(chunks.end()));
+}
+
+void LineIndex::UpdateTrees()
+{
+    std::vector<int32_t> sizes;
+    std::vector<int32_t> lines;
+    sizes.reserve(m_chunks.size());
+    lines.reserve(m_chunks.size());
+
+    m_lineCount = 0;
+    for (auto& chunk : m_chunks)
+    {
+        sizes.push_back(chunk.ends.back());
+        lines.push_back(int32_t(chunk.ends.size()));
+        m_lineCount += int32_t(chunk.ends.size());
+    }
+    m_chunkSizes.Build(sizes);
+    m_chunkLines.Build(lines);
+}
+
+} // namespace Zep
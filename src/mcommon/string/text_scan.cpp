@@ -0,0 +1,215 @@
+#include <algorithm>
+
+#include "zep/mcommon/string/text_scan.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ZEP_TEXT_SCAN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang need to be told a function may use AVX2; MSVC will emit it anywhere
+#if defined(ZEP_TEXT_SCAN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define ZEP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define ZEP_TARGET_AVX2
+#endif
+
+namespace Zep
+{
+
+namespace
+{
+
+inline auto CountTrailingZeros(uint32_t mask) -> uint32_t
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return uint32_t(index);
+#else
+    return uint32_t(__builtin_ctz(mask));
+#endif
+}
+
+// Call fn with the offset of every set bit in the mask
+template <class F>
+inline void ForEachBit(uint32_t mask, size_t offset, F& fn)
+{
+    while (mask != 0)
+    {
+        fn(offset + CountTrailingZeros(mask));
+        mask &= mask - 1;
+    }
+}
+
+// Characters to look for; a set of up to 3, repeated to fill
+struct ScanChars
+{
+    uint8_t c0;
+    uint8_t c1;
+    uint8_t c2;
+};
+
+template <class F>
+void ScanScalar(const uint8_t* pBegin, const uint8_t* p, const uint8_t* pEnd, ScanChars chars, F& fn)
+{
+    for (; p < pEnd; p++)
+    {
+        if (*p == chars.c0 || *p == chars.c1 || *p == chars.c2)
+        {
+            fn(size_t(p - pBegin));
+        }
+    }
+}
+
+#if defined(ZEP_TEXT_SCAN_X86)
+template <class F>
+void ScanSSE2(const uint8_t* pBegin, const uint8_t* pEnd, ScanChars chars, F& fn)
+{
+    auto c0 = _mm_set1_epi8(char(chars.c0));
+    auto c1 = _mm_set1_epi8(char(chars.c1));
+    auto c2 = _mm_set1_epi8(char(chars.c2));
+
+    auto p = pBegin;
+    for (; p + 16 <= pEnd; p += 16)
+    {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, c0), _mm_cmpeq_epi8(block, c1)), _mm_cmpeq_epi8(block, c2));
+        ForEachBit(uint32_t(_mm_movemask_epi8(found)), size_t(p - pBegin), fn);
+    }
+    ScanScalar(pBegin, p, pEnd, chars, fn);
+}
+
+template <class F>
+ZEP_TARGET_AVX2 void ScanAVX2(const uint8_t* pBegin, const uint8_t* pEnd, ScanChars chars, F& fn)
+{
+    auto c0 = _mm256_set1_epi8(char(chars.c0));
+    auto c1 = _mm256_set1_epi8(char(chars.c1));
+    auto c2 = _mm256_set1_epi8(char(chars.c2));
+
+    auto p = pBegin;
+    for (; p + 32 <= pEnd; p += 32)
+    {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        auto found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, c0), _mm256_cmpeq_epi8(block, c1)), _mm256_cmpeq_epi8(block, c2));
+        ForEachBit(uint32_t(_mm256_movemask_epi8(found)), size_t(p - pBegin), fn);
+    }
+    ScanScalar(pBegin, p, pEnd, chars, fn);
+}
+
+auto CPUHasAVX2() -> bool
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // The OS must save the AVX registers too
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+template <class F>
+void Scan(const uint8_t* pBegin, const uint8_t* pEnd, ScanChars chars, TextScanLevel level, F& fn)
+{
+    // Never go above what the CPU can do
+    level = std::min(level, GetTextScanLevel());
+
+#if defined(ZEP_TEXT_SCAN_X86)
+    if (level == TextScanLevel::AVX2)
+    {
+        ScanAVX2(pBegin, pEnd, chars, fn);
+        return;
+    }
+    if (level == TextScanLevel::SSE2)
+    {
+        ScanSSE2(pBegin, pEnd, chars, fn);
+        return;
+    }
+#endif
+    ScanScalar(pBegin, pBegin, pEnd, chars, fn);
+}
+
+} // namespace
+
+auto GetTextScanLevel() -> TextScanLevel
+{
+#if defined(ZEP_TEXT_SCAN_X86)
+    // SSE2 is always there on x64, and is the only thing we use before AVX2
+    static const auto level = CPUHasAVX2() ? TextScanLevel::AVX2 : TextScanLevel::SSE2;
+    return level;
+#else
+    return TextScanLevel::Scalar;
+#endif
+}
+
+auto GetTextScanLevelName(TextScanLevel level) -> const char*
+{
+    switch (level)
+    {
+    case TextScanLevel::AVX2:
+        return "AVX2";
+    case TextScanLevel::SSE2:
+        return "SSE2";
+    default:
+        return "Scalar";
+    }
+}
+
+auto ScanLineChars(const uint8_t* pBegin, const uint8_t* pEnd, std::vector<size_t>& offsets, TextScanLevel level) -> LineCharCounts
+{
+    // Guess at an average line length, to save a few reallocations
+    offsets.reserve(offsets.size() + size_t(pEnd - pBegin) / 32);
+
+    auto fn = [&](size_t offset) {
+        offsets.push_back(offset);
+    };
+    auto start = offsets.size();
+    Scan(pBegin, pEnd, ScanChars{ '\n', '\r', '\t' }, level, fn);
+
+    LineCharCounts counts;
+    for (auto itr = offsets.begin() + start; itr != offsets.end(); itr++)
+    {
+        switch (pBegin[*itr])
+        {
+        case '\n':
+            counts.lineFeeds++;
+            break;
+        case '\r':
+            counts.carriageReturns++;
+            break;
+        default:
+            counts.tabs++;
+            break;
+        }
+    }
+    return counts;
+}
+
+void ScanLineEnds(const uint8_t* pBegin, const uint8_t* pEnd, int32_t base, std::vector<int32_t>& lineEnds, TextScanLevel level)
+{
+    auto fn = [&](size_t offset) {
+        lineEnds.push_back(base + int32_t(offset) + 1);
+    };
+    Scan(pBegin, pEnd, ScanChars{ '\n', '\n', '\n' }, level, fn);
+}
+
+} // namespace Zep
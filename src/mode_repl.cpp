@@ -71,7 +71,7 @@ void ZepMode_Repl::AddKeyPress(uint32_t key, uint32_t modifiers)
     if (key == ExtKeys::RETURN)
     {
         auto& buffer = m_replWindow.GetBuffer();
-        std::string str = std::string(buffer.GetText().begin() + m_startLocation, buffer.GetText().end());
+        std::string str = buffer.GetText().string(buffer.GetText().begin() + m_startLocation, buffer.GetText().end());
         buffer.Insert(buffer.EndLocation(), "\n");
 
         auto stripLineStarts = [](std::string& str) {
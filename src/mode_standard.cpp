@@ -333,7 +333,7 @@ void ZepMode_Standard::AddKeyPress(uint32_t key, uint32_t modifierKeys)
     if (copyRegion || op == CommandOperation::Copy)
     {
         // Grab it
-        std::string str = std::string(buffer.GetText().begin() + startOffset, buffer.GetText().begin() + endOffset);
+        std::string str = buffer.GetText().string(buffer.GetText().begin() + startOffset, buffer.GetText().begin() + endOffset);
         GetEditor().GetRegister('"').text = str;
         GetEditor().GetRegister('"').lineWise = lineWise;
         GetEditor().GetRegister('0').text = str;
@@ -102,7 +102,7 @@ void CommandContext::UpdateRegisters()
             std::swap(beginRange, endRange);
         }
 
-        std::string str = std::string(buffer.GetText().begin() + beginRange, buffer.GetText().begin() + endRange);
+        std::string str = buffer.GetText().string(buffer.GetText().begin() + beginRange, buffer.GetText().begin() + endRange);
 
         // Delete commands fill up 1-9 registers
         if (command[0] == 'd' || command[0] == 'D')
@@ -130,7 +130,7 @@ void CommandContext::UpdateRegisters()
             std::swap(beginRange, endRange);
         }
 
-        std::string str = std::string(buffer.GetText().begin() + beginRange, buffer.GetText().begin() + endRange);
+        std::string str = buffer.GetText().string(buffer.GetText().begin() + beginRange, buffer.GetText().begin() + endRange);
         while (!registers.empty())
         {
             auto& ed = owner.GetEditor();
@@ -676,6 +676,14 @@ auto ZepMode_Vim::HandleExCommand(std::string strCommand, const char key) -> boo
             buffer.AddRangeMarker(spMarker);
             SwitchMode(EditorMode::Normal);
         }
+        else if (strCommand == ":set wrap")
+        {
+            pWindow->SetWrap(true);
+        }
+        else if (strCommand == ":set nowrap")
+        {
+            pWindow->SetWrap(false);
+        }
         else if (strCommand == ":ZShowCR")
         {
             pWindow->ToggleFlag(WindowFlags::ShowCR);
@@ -1906,7 +1914,7 @@ void ZepMode_Vim::HandleInsert(uint32_t key)
         if (insertEnd > m_insertBegin)
         {
             // Get the string we inserted
-            auto strInserted = std::string(buffer.GetText().begin() + m_insertBegin, buffer.GetText().begin() + insertEnd);
+            auto strInserted = buffer.GetText().string(buffer.GetText().begin() + m_insertBegin, buffer.GetText().begin() + insertEnd);
 
             // Remember the inserted string for repeating the command
             m_lastInsertString = strInserted;
@@ -2,10 +2,15 @@
 #include "zep/editor.hpp"
 #include "zep/syntax_rainbow_brackets.hpp"
 #include "zep/theme.hpp"
+#include "zep/window.hpp"
 
 #include "zep/mcommon/logger.hpp"
 #include "zep/mcommon/string/stringutils.hpp"
 
+#include <algorithm>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -13,20 +18,127 @@
 namespace Zep
 {
 
+namespace
+{
+// Big enough that the cost of guessing a chunk's starting state wrong is small next to lexing it
+const int32_t ParallelChunkSize = 1024 * 1024;
+
+// How long lazy syntax can run on each editor tick
+const double LazySliceSeconds = 0.004;
+
+// A long lex shows what it has done every time it gets this much further
+const int32_t PublishChars = 1024 * 1024;
+
+// How much the serial lex gathers before it puts the colors in the store
+const int32_t BatchChars = 64 * 1024;
+
+// The longest raw string delimiter; C++ allows 16 characters
+const size_t MaxDelimiterSize = 16;
+
+auto MatchText(TextStorage<utf8>::const_iterator itr, TextStorage<utf8>::const_iterator itrLineEnd, const std::string& text) -> bool
+{
+    for (auto ch : text)
+    {
+        if (itr >= itrLineEnd || char(*itr) != ch)
+        {
+            return false;
+        }
+        itr++;
+    }
+    return true;
+}
+
+auto IsDelimiterChar(const SyntaxRegion& rule, char ch) -> bool
+{
+    if (!rule.delimiterChars.empty())
+    {
+        return rule.delimiterChars.find(ch) != std::string::npos;
+    }
+    return ch != ' ' && ch != '\t' && ch != '\n' && ch != '(' && ch != ')' && ch != '\\';
+}
+} // namespace
+
+// A run of lines lexed by one thread, from a guessed starting state
+struct ZepSyntax::HighlightChunk
+{
+    int32_t firstLine = 0;
+    int32_t lastLine = 0;
+    int32_t nextLine = 0; // Where it got to, if it was stopped
+    int32_t start = 0; // Where its text starts; found while the chunks are made, since the line ends can change as soon as they run
+    SyntaxLineState entry = SyntaxLineState::Normal();
+    SyntaxRuns runs; // The colors from the first line on; the store is only changed on one thread, once they are all done
+    std::vector<SyntaxLineState> states; // And the state at the end of each line
+};
+
+// The chunks of one parallel lex; shared with the helper tasks, since some of them may not start until the lex is over
+struct ZepSyntax::ParallelHighlight
+{
+    std::vector<HighlightChunk*> order; // Claimed in this order
+    std::atomic<size_t> next = { 0 };
+    size_t finished = 0;
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
 ZepSyntax::ZepSyntax(
     ZepBuffer& buffer,
-    std::set<std::string_view> keywords,
-    std::set<std::string_view> identifiers,
-    uint32_t flags)
+    KeywordTable keywords,
+    KeywordTable identifiers,
+    uint32_t flags,
+    SyntaxRules rules)
     : ZepComponent(buffer.GetEditor())
     , m_buffer(buffer)
-    , m_keywords(std::move(keywords))
-    , m_identifiers(std::move(identifiers))
+    , m_keywords(keywords)
+    , m_identifiers(identifiers)
     , m_stop(false)
     , m_flags(flags)
+    , m_rules(std::move(rules))
 {
-    m_syntax.resize(m_buffer.GetText().size());
+    // The sets of characters to look for; the rules don't change after this
+    assert(m_rules.size() < 256);
+    for (auto& rule : m_rules)
+    {
+        m_openChars.push_back(rule.open[0]);
+
+        std::string stops;
+        stops.push_back(rule.delimiterClose != 0 ? rule.delimiterClose : rule.close.empty() ? '\n' : rule.close[0]);
+        if (rule.escape != 0)
+        {
+            stops.push_back(rule.escape);
+        }
+        if (rule.nested)
+        {
+            stops.push_back(rule.open[0]);
+        }
+        m_stopChars.push_back(stops);
+    }
+    m_spOpenSet = std::make_unique<RegionStops>(m_openChars.begin(), m_openChars.end());
+    m_stopSets.reserve(m_stopChars.size());
+    for (auto& stops : m_stopChars)
+    {
+        m_stopSets.emplace_back(stops.begin(), stops.end());
+    }
+
+    m_syntax.Resize(int32_t(m_buffer.GetText().size()));
+    m_lineStates.resize(m_buffer.GetLineCount(), SyntaxLineState{});
+    m_parallelChunkSize = GetEditor().GetThreadPool().size() > 1 ? ParallelChunkSize : 0;
+    m_lazy = GetEditor().GetConfig().lazySyntax;
     m_adornments.push_back(std::make_shared<ZepSyntaxAdorn_RainbowBrackets>(*this, m_buffer));
+    Publish();
+}
+
+ZepSyntax::ZepSyntax(
+    ZepBuffer& buffer,
+    const std::set<std::string_view>& keywords,
+    const std::set<std::string_view>& identifiers,
+    uint32_t flags,
+    SyntaxRules rules)
+    : ZepSyntax(buffer, KeywordTable{}, KeywordTable{}, flags, std::move(rules))
+{
+    m_spKeywordSet = std::make_shared<KeywordSet>(keywords);
+    m_spIdentifierSet = std::make_shared<KeywordSet>(identifiers);
+    m_keywords = m_spKeywordSet->Table();
+    m_identifiers = m_spIdentifierSet->Table();
 }
 
 ZepSyntax::~ZepSyntax()
@@ -36,8 +148,12 @@ ZepSyntax::~ZepSyntax()
 
 auto ZepSyntax::GetSyntaxAt(int32_t offset) const -> SyntaxData
 {
-    Wait();
-    if (m_processedChar < offset || m_syntax.size() <= offset)
+    return GetSyntaxAt(*GetSnapshot(), offset);
+}
+
+auto ZepSyntax::GetSyntaxAt(const SyntaxSnapshot& snapshot, int32_t offset) const -> SyntaxData
+{
+    if (snapshot.size() <= offset)
     {
         return SyntaxData{};
     }
@@ -51,11 +167,15 @@ auto ZepSyntax::GetSyntaxAt(int32_t offset) const -> SyntaxData
             return data;
         }
     }
-    return m_syntax[offset];
+    return snapshot.Get(offset);
 }
 
 void ZepSyntax::Wait() const
 {
+    for (auto& result : m_staleResults)
+    {
+        result.wait();
+    }
     if (m_syntaxResult.valid())
     {
         m_syntaxResult.wait();
@@ -64,42 +184,208 @@ void ZepSyntax::Wait() const
 
 void ZepSyntax::Interrupt()
 {
-    // Stop the thread, wait for it
     m_stop = true;
-    if (m_syntaxResult.valid())
+    Wait();
+    m_staleResults.clear();
+    m_stop = false;
+}
+
+// Stop the lex where it is, and keep it off the text and state until the edit is done.
+// It stops at the end of the line it is on, leaving the rest of its work pending; the edit moves that along with the text
+void ZepSyntax::BeginEdit()
+{
+    if (!m_editLock.owns_lock())
     {
-        m_syntaxResult.get();
+        m_generation++;
+        m_editLock = std::unique_lock<std::shared_mutex>(m_lexMutex);
     }
-    m_stop = false;
 }
 
 void ZepSyntax::QueueUpdateSyntax(BufferLocation startLocation, BufferLocation endLocation)
 {
     assert(startLocation >= 0);
     assert(endLocation >= startLocation);
-    // Record the max location the syntax is valid up to.  This will
-    // ensure that multiple calls to restart the thread keep track of where to start
-    // This means a small edit at the end of a big file, followed by a small edit at the top
-    // is the worst case scenario, because
-    m_processedChar = std::min(startLocation, int32_t(m_processedChar));
-    m_targetChar = std::max(endLocation, int32_t(m_targetChar));
 
     // Make sure the syntax buffer is big enough - adding normal syntax to the end
     // This may also 'chop'
-    m_syntax.resize(m_buffer.GetText().size(), SyntaxData{});
+    m_syntax.Resize(int32_t(m_buffer.GetText().size()));
 
-    m_processedChar = std::min(int32_t(m_processedChar), int32_t(m_buffer.GetText().size() - 1));
-    m_targetChar = std::min(int32_t(m_targetChar), int32_t(m_buffer.GetText().size() - 1));
+    // Only the lines from the edit on need looking at; and only until they end the way they did before
+    UpdateLineStates(startLocation, endLocation);
+
+    int32_t lineStart;
+    int32_t lineEnd;
+    m_buffer.GetLineOffsets(m_pendingLines.begin()->first, lineStart, lineEnd);
+    m_processedChar = lineStart;
+
+    // The display sees the old colors move with the text, until the new ones are ready
+    Publish();
+
+    // Anything lexed for the windows has moved; they will ask again
+    m_aheadRanges.clear();
+    if (m_lazy)
+    {
+        m_editLock.unlock();
+        return;
+    }
+
+    // What the windows are looking at gets done first
+    m_priorityLines.clear();
+    for (auto pWindow : GetEditor().FindBufferWindows(&m_buffer))
+    {
+        m_priorityLines.push_back(m_buffer.GetBufferLine(pWindow->GetBufferCursor()));
+    }
 
     // Have the thread update the syntax in the new region
-    // If the pool has no threads, this will end up serial
+    // If the pool has no threads, this will end up serial, so the lock has to be free first
+    m_editLock.unlock();
+    m_staleResults.erase(std::remove_if(m_staleResults.begin(), m_staleResults.end(), [](const std::future<void>& result) {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }),
+        m_staleResults.end());
+    if (m_syntaxResult.valid())
+    {
+        m_staleResults.push_back(std::move(m_syntaxResult));
+    }
     m_syntaxResult = GetEditor().GetThreadPool().enqueue([=]() {
         UpdateSyntax();
     });
 }
 
+// Keep a state for every line, and remember the lines this edit touched.
+// Called after the edit, so the range is where the new text is now
+void ZepSyntax::UpdateLineStates(BufferLocation startLocation, BufferLocation endLocation)
+{
+    auto lineCount = m_buffer.GetLineCount();
+    auto startLine = std::min(m_buffer.GetBufferLine(startLocation), int32_t(m_lineStates.size()));
+    auto endLine = std::min(m_buffer.GetBufferLine(endLocation), lineCount - 1);
+
+    // Lines came or went at the edit.  The line the edit ended on keeps its old state, since it ends where it did
+    auto diff = lineCount - int32_t(m_lineStates.size());
+    if (diff > 0)
+    {
+        m_lineStates.insert(m_lineStates.begin() + startLine, diff, SyntaxLineState{});
+    }
+    else if (diff < 0)
+    {
+        m_lineStates.erase(m_lineStates.begin() + startLine, m_lineStates.begin() + startLine - diff);
+    }
+
+    // ... and the work still to do after it moves with them
+    if (diff != 0)
+    {
+        auto shift = [&](int32_t line) {
+            return line > startLine ? std::min(std::max(startLine, line + diff), lineCount - 1) : line;
+        };
+
+        std::map<int32_t, int32_t> pendingLines;
+        for (auto& [line, lastLine] : m_pendingLines)
+        {
+            auto& last = pendingLines[shift(line)];
+            last = std::max(last, shift(lastLine));
+        }
+        std::swap(pendingLines, m_pendingLines);
+    }
+
+    auto& last = m_pendingLines[startLine];
+    last = std::max(last, endLine);
+    m_editLine = std::min(m_editLine, startLine);
+}
+
+// The state a line starts in, as far as we know; lines which haven't been lexed yet are taken to end in normal text
+auto ZepSyntax::EntryState(int32_t line) const -> SyntaxLineState
+{
+    if (line == 0 || !m_lineStates[line - 1].lexed)
+    {
+        return SyntaxLineState::Normal();
+    }
+    return m_lineStates[line - 1];
+}
+
+// Lazy syntax colors what the windows show straight away, from a guess at the state the first line starts in.
+// Then it makes sure the pending lines get there: from the real state, to fix up a wrong guess, and after the last line
+// in case its new state changes what follows
+void ZepSyntax::ShowLines(int32_t firstLine, int32_t lastLine)
+{
+    if (!m_lazy)
+    {
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_lexMutex);
+    if (m_pendingLines.empty())
+    {
+        return;
+    }
+
+    // Everything before the first pending line is done
+    auto& lineEnds = m_buffer.GetLineEnds();
+    auto lineCount = int32_t(m_lineStates.size());
+    firstLine = std::max(firstLine, m_pendingLines.begin()->first);
+    lastLine = std::min(lastLine, lineCount - 1);
+    if (firstLine > lastLine)
+    {
+        return;
+    }
+
+    auto start = firstLine > 0 ? lineEnds[firstLine - 1] : 0;
+    auto end = lineEnds[lastLine];
+    auto itr = m_aheadRanges.upper_bound(start);
+    if (itr != m_aheadRanges.begin() && std::prev(itr)->second >= end)
+    {
+        return;
+    }
+
+    auto state = EntryState(firstLine);
+
+    auto lineStart = start;
+    SyntaxRuns runs;
+    SyntaxRuns lineRuns;
+    for (auto line = firstLine; line <= lastLine; line++)
+    {
+        auto lineEnd = lineEnds[line];
+        lineRuns.clear();
+        state = UpdateLine(lineStart, lineEnd, state, lineRuns);
+        AppendSyntaxRuns(runs, lineStart - start, lineRuns, lineEnd - start);
+        m_lineStates[line] = state;
+        lineStart = lineEnd;
+        m_lexedLines++;
+    }
+    AssignSyntax(start, end, runs);
+    m_aheadRanges[start] = std::max(m_aheadRanges[start], end);
+    Publish();
+
+    auto& first = m_pendingLines[firstLine];
+    first = std::max(first, firstLine);
+    if (lastLine + 1 < lineCount)
+    {
+        auto& next = m_pendingLines[lastLine + 1];
+        next = std::max(next, lastLine + 1);
+    }
+}
+
+auto ZepSyntax::SliceDone() const -> bool
+{
+    return m_lazy && timer_get_elapsed_seconds(m_sliceTimer) > LazySliceSeconds;
+}
+
 void ZepSyntax::Notify(std::shared_ptr<ZepMessage> message)
 {
+    // Lazy syntax does the lines nobody is looking at a slice at a time, when the editor ticks
+    if (message->messageId == Msg::Tick)
+    {
+        if (m_lazy && !m_pendingLines.empty())
+        {
+            timer_restart(m_sliceTimer);
+            UpdateSyntax();
+            if (m_pendingLines.empty())
+            {
+                GetEditor().RequestRefresh();
+            }
+        }
+        return;
+    }
+
     // Handle any interesting buffer messages
     if (message->messageId == Msg::Buffer)
     {
@@ -110,90 +396,427 @@ void ZepSyntax::Notify(std::shared_ptr<ZepMessage> message)
         }
         if (spBufferMsg->type == BufferMessageType::PreBufferChange)
         {
-            Interrupt();
+            BeginEdit();
         }
         else if (spBufferMsg->type == BufferMessageType::TextDeleted)
         {
-            Interrupt();
-            m_syntax.erase(m_syntax.begin() + spBufferMsg->startLocation, m_syntax.begin() + spBufferMsg->endLocation);
-            QueueUpdateSyntax(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            BeginEdit();
+            m_syntax.Erase(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            for (auto& adorn : m_adornments)
+            {
+                adorn->Clear(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            }
+            QueueUpdateSyntax(spBufferMsg->startLocation, spBufferMsg->startLocation);
         }
         else if (spBufferMsg->type == BufferMessageType::TextAdded || spBufferMsg->type == BufferMessageType::Loaded)
         {
-            Interrupt();
-            m_syntax.insert(m_syntax.begin() + spBufferMsg->startLocation, spBufferMsg->endLocation - spBufferMsg->startLocation, SyntaxData{});
+            BeginEdit();
+            m_syntax.Insert(spBufferMsg->startLocation, spBufferMsg->endLocation - spBufferMsg->startLocation);
+            for (auto& adorn : m_adornments)
+            {
+                adorn->Insert(spBufferMsg->startLocation, spBufferMsg->endLocation);
+            }
             QueueUpdateSyntax(spBufferMsg->startLocation, spBufferMsg->endLocation);
         }
         else if (spBufferMsg->type == BufferMessageType::TextChanged)
         {
-            Interrupt();
+            BeginEdit();
             QueueUpdateSyntax(spBufferMsg->startLocation, spBufferMsg->endLocation);
         }
     }
 }
 
-// TODO(unknown): Multiline comments
+// Lex from each edit until the lines end in the state they did before; after that nothing can have changed.
+// So an edit at the bottom and another at the top only costs the lines around each of them.
 void ZepSyntax::UpdateSyntax()
 {
-    auto& buffer = m_buffer.GetText();
-    auto itrCurrent = buffer.begin() + m_processedChar;
-    auto itrEnd = buffer.begin() + m_targetChar;
+    // An older lex which an edit overtook stops at the end of its line, and this one carries on from where it got to
+    std::lock_guard<std::mutex> task(m_taskMutex);
+    std::unique_lock<std::shared_mutex> lock(m_lexMutex);
+    auto generation = m_generation.load();
 
-    assert(std::distance(itrCurrent, itrEnd) < int(m_syntax.size()));
-    assert(m_syntax.size() == buffer.size());
+    // A big run of lines gets a first pass on all the threads, leaving this loop to fix up the chunks which started in the wrong state
+    if (!UpdateParallel(lock, generation))
+    {
+        Publish();
+        return;
+    }
+
+    auto& lineEnds = m_buffer.GetLineEnds();
+    auto lineCount = int32_t(m_lineStates.size());
+    auto publishedChar = int32_t(m_processedChar);
 
-    std::string delim(" \t.\n;(){}=:");
-    std::string lineEnd("\n");
+    // The lines go into the store a batch at a time; rebuilding its blocks once is much cheaper than doing it for every line
+    SyntaxRuns runs;
+    SyntaxRuns lineRuns;
+    int32_t batchStart = 0;
+    auto flush = [&](int32_t end) {
+        AssignSyntax(batchStart, end, runs);
+        runs.clear();
+        batchStart = end;
+    };
 
-    // Walk backwards to previous delimiter
-    while (itrCurrent > buffer.begin())
+    while (!m_pendingLines.empty())
     {
-        if (std::find(delim.begin(), delim.end(), *itrCurrent) == delim.end())
+        auto line = m_pendingLines.begin()->first;
+        auto lastLine = m_pendingLines.begin()->second;
+        m_pendingLines.erase(m_pendingLines.begin());
+
+        // Carry on from the end of the line before
+        auto state = EntryState(line);
+
+        auto lineStart = line > 0 ? lineEnds[line - 1] : 0;
+        batchStart = lineStart;
+        for (; line < lineCount; line++)
         {
-            itrCurrent--;
+            if (m_stop == true || m_generation != generation || SliceDone())
+            {
+                // Pick up from here next time
+                auto& last = m_pendingLines[line];
+                last = std::max(last, lastLine);
+                m_processedChar = lineStart;
+                flush(lineStart);
+                Publish();
+                return;
+            }
+
+            auto lineEnd = lineEnds[line];
+            lineRuns.clear();
+            state = UpdateLine(lineStart, lineEnd, state, lineRuns);
+            AppendSyntaxRuns(runs, lineStart - batchStart, lineRuns, lineEnd - batchStart);
+            lineStart = lineEnd;
+            m_lexedLines++;
+
+            if (lineEnd - publishedChar >= PublishChars)
+            {
+                m_processedChar = lineEnd;
+                publishedChar = lineEnd;
+                flush(lineEnd);
+                Publish();
+            }
+            else if (lineEnd - batchStart >= BatchChars)
+            {
+                flush(lineEnd);
+            }
+
+            auto converged = line >= lastLine && m_lineStates[line] == state;
+            m_lineStates[line] = state;
+            if (converged)
+            {
+                break;
+            }
+
+            // Ran into the next edit, so do that one too
+            if (!m_pendingLines.empty() && m_pendingLines.begin()->first <= line + 1)
+            {
+                lastLine = std::max(lastLine, m_pendingLines.begin()->second);
+                m_pendingLines.erase(m_pendingLines.begin());
+            }
         }
-        else
+        flush(lineStart);
+    }
+
+    // If we got here, we sucessfully completed
+    m_processedChar = int32_t(m_buffer.GetText().size() - 1);
+    Publish();
+}
+
+// Lexed text goes in the store, and the adornments get to look at it while it can't change
+void ZepSyntax::AssignSyntax(int32_t start, int32_t end, const SyntaxRuns& runs)
+{
+    m_syntax.Assign(start, end, runs);
+    for (auto& adorn : m_adornments)
+    {
+        adorn->Update(start, end);
+    }
+}
+
+// Show the display what we have so far.  The blocks it can now see are copied before we change them again
+void ZepSyntax::Publish()
+{
+    std::atomic_store(&m_spSnapshot, m_syntax.Publish());
+    GetEditor().RequestRefresh();
+}
+
+// Split the first pending run into chunks and lex them at the same time.
+// Only the first chunk knows the state it starts in; the rest guess it from the state the last lex left, or Normal.
+// Mostly the guess is right, since strings and comments rarely run for long, and the chunk's lines are done.  When it is wrong,
+// the chunk start goes back on the pending list, and the serial lex redoes it until the states agree again.
+// The chunks only share the lock, a line at a time, so an edit can get in while they run; then they stop, and everything
+// from the first edited line on is thrown away.  Returns false if it was stopped
+auto ZepSyntax::UpdateParallel(std::unique_lock<std::shared_mutex>& lock, uint64_t generation) -> bool
+{
+    if (m_lazy || m_parallelChunkSize <= 0 || m_pendingLines.empty())
+    {
+        return true;
+    }
+
+    auto& lineEnds = m_buffer.GetLineEnds();
+    auto firstLine = m_pendingLines.begin()->first;
+    auto line = firstLine;
+    auto lastLine = m_pendingLines.begin()->second;
+    auto textStart = line > 0 ? lineEnds[line - 1] : 0;
+    if (lineEnds[lastLine] - textStart < m_parallelChunkSize * 2)
+    {
+        return true;
+    }
+
+    // The run stays pending while the chunks work on it, so an edit moves it along with the other lines
+    m_editLine = std::numeric_limits<int32_t>::max();
+
+    // Line aligned chunks
+    std::vector<HighlightChunk> chunks;
+    while (line <= lastLine)
+    {
+        HighlightChunk chunk;
+        chunk.firstLine = line;
+        chunk.nextLine = line;
+        chunk.lastLine = std::min(lastLine, lineEnds.LineFromOffset(textStart + m_parallelChunkSize));
+        chunk.entry = EntryState(line);
+        chunk.start = textStart;
+        chunks.push_back(chunk);
+
+        textStart = lineEnds[chunk.lastLine];
+        line = chunk.lastLine + 1;
+    }
+
+    // The chunks under the cursors first, then the rest from the top
+    auto spJob = std::make_shared<ParallelHighlight>();
+    for (auto& chunk : chunks)
+    {
+        spJob->order.push_back(&chunk);
+    }
+    std::stable_partition(spJob->order.begin(), spJob->order.end(), [&](HighlightChunk* pChunk) {
+        return std::any_of(m_priorityLines.begin(), m_priorityLines.end(), [&](int32_t priorityLine) {
+            return priorityLine >= pChunk->firstLine && priorityLine <= pChunk->lastLine;
+        });
+    });
+
+    // Every thread takes chunks until there are none left.  A helper which starts late finds nothing to do, and never touches
+    // this object; so we only wait for the chunks, not the helpers
+    auto work = [this, generation](ParallelHighlight& job) {
+        for (auto index = job.next++; index < job.order.size(); index = job.next++)
+        {
+            UpdateChunk(*job.order[index], generation);
+
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (++job.finished == job.order.size())
+            {
+                job.done.notify_all();
+            }
+        }
+    };
+
+    lock.unlock();
+
+    auto& pool = GetEditor().GetThreadPool();
+    auto helpers = std::min(pool.size(), chunks.size() - 1);
+    for (size_t i = 0; i < helpers; i++)
+    {
+        pool.enqueue([spJob, work]() {
+            work(*spJob);
+        });
+    }
+
+    work(*spJob);
+    {
+        std::unique_lock<std::mutex> jobLock(spJob->mutex);
+        spJob->done.wait(jobLock, [&]() { return spJob->finished == spJob->order.size(); });
+    }
+
+    lock.lock();
+
+    // Nothing before the first edited line moved, so the chunks up to there are still good
+    auto editLine = m_generation != generation ? m_editLine : std::numeric_limits<int32_t>::max();
+    auto itrPending = m_pendingLines.find(firstLine);
+    if (editLine <= firstLine || itrPending == m_pendingLines.end())
+    {
+        return false;
+    }
+    auto pendingLast = itrPending->second;
+    m_pendingLines.erase(itrPending);
+
+    // Chunks which were stopped carry on next time, and the ones which guessed wrong get lexed again.
+    // An edit which comes along now waits for the chunk going in, not the whole run; the rest of the run is left for next time
+    auto mergeGeneration = m_generation.load();
+    auto stopped = false;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        auto& chunk = chunks[i];
+        if (chunk.nextLine > editLine || (i > 0 && (m_stop == true || m_generation != mergeGeneration)))
         {
+            auto& last = m_pendingLines[chunk.firstLine];
+            last = std::max(last, pendingLast);
+            stopped = true;
             break;
         }
+
+        auto chunkStart = chunk.firstLine > 0 ? lineEnds[chunk.firstLine - 1] : 0;
+        AssignSyntax(chunkStart, chunk.nextLine > 0 ? lineEnds[chunk.nextLine - 1] : 0, chunk.runs);
+        chunk.runs = SyntaxRuns();
+        std::copy(chunk.states.begin(), chunk.states.end(), m_lineStates.begin() + chunk.firstLine);
+
+        if (chunk.nextLine <= chunk.lastLine)
+        {
+            auto& last = m_pendingLines[chunk.nextLine];
+            stopped = true;
+            if (editLine != std::numeric_limits<int32_t>::max())
+            {
+                // The rest of the run is after the edit, so it ends where the edit moved it to
+                last = std::max(last, pendingLast);
+                break;
+            }
+            last = std::max(last, chunk.lastLine);
+        }
+        else if (i > 0 && chunk.entry != m_lineStates[chunk.firstLine - 1])
+        {
+            auto& last = m_pendingLines[chunk.firstLine];
+            last = std::max(last, chunk.firstLine);
+        }
+    }
+
+    if (stopped || m_generation != generation)
+    {
+        if (!m_pendingLines.empty())
+        {
+            auto pendingLine = m_pendingLines.begin()->first;
+            m_processedChar = pendingLine > 0 ? lineEnds[pendingLine - 1] : 0;
+        }
+        return false;
     }
+    return true;
+}
 
-    // Back to the previous line
-    while (itrCurrent > buffer.begin() && *itrCurrent != '\n')
+void ZepSyntax::UpdateChunk(HighlightChunk& chunk, uint64_t generation)
+{
+    auto& lineEnds = m_buffer.GetLineEnds();
+    auto state = chunk.entry;
+    auto chunkStart = chunk.start;
+    auto lineStart = chunkStart;
+    static thread_local SyntaxRuns lineRuns;
+    for (auto line = chunk.firstLine; line <= chunk.lastLine; line++)
     {
-        itrCurrent--;
+        // An edit waits for the line we are on, then we see it and stop
+        std::shared_lock<std::shared_mutex> lock(m_lexMutex);
+        if (m_stop == true || m_generation != generation)
+        {
+            return;
+        }
+
+        auto lineEnd = lineEnds[line];
+        lineRuns.clear();
+        state = UpdateLine(lineStart, lineEnd, state, lineRuns);
+        AppendSyntaxRuns(chunk.runs, lineStart - chunkStart, lineRuns, lineEnd - chunkStart);
+        chunk.states.push_back(state);
+        lineStart = lineEnd;
+        chunk.nextLine = line + 1;
+        m_lexedLines++;
     }
-    itrEnd = buffer.find_first_of(itrEnd, buffer.end(), lineEnd.begin(), lineEnd.end());
+}
 
-    // Mark a region of the syntax buffer with the correct marker
-    auto mark = [&](const GapBuffer<utf8>::const_iterator& itrA, const GapBuffer<utf8>::const_iterator& itrB, ThemeColor type, ThemeColor background) {
-        std::fill(m_syntax.begin() + (itrA - buffer.begin()), m_syntax.begin() + (itrB - buffer.begin()), SyntaxData{ type, background });
+auto ZepSyntax::UpdateLine(BufferLocation lineStart, BufferLocation lineEnd, SyntaxLineState state, SyntaxRuns& runs) -> SyntaxLineState
+{
+    using const_iterator = TextStorage<utf8>::const_iterator;
+    auto& buffer = m_buffer.GetText();
+    auto itrLineEnd = buffer.begin() + lineEnd;
+
+    // Lines can be lexed on more than one thread at once
+    static thread_local std::string delimiter;
+
+    // Mark a region of the line with the correct marker
+    auto mark = [&](const const_iterator& itrA, const const_iterator& itrB, ThemeColor type, ThemeColor background) {
+        MarkSyntaxRuns(runs, int32_t(itrA - buffer.begin()) - lineStart, int32_t(itrB - buffer.begin()) - lineStart, SyntaxData{ type, background });
     };
 
-    // Update start location
-    m_processedChar = int32_t(itrCurrent - buffer.begin());
+    // The finds return end() when there is no match; keep them in range
+    auto clamp = [&](const const_iterator& itr, const const_iterator& itrLimit) {
+        return itr < itrLimit ? itr : itrLimit;
+    };
 
-    LOG(DEBUG) << "Updating Syntax: Start=" << m_processedChar << ", End=" << std::distance(buffer.begin(), itrEnd);
+    // Walk a comment or string to its close; if it doesn't close on this line, the state says where the next line starts
+    auto lexRegion = [&](int32_t region, const_iterator itrStart, const_iterator itrAfterOpen, uint16_t depth) {
+        bool closed;
+        auto itrEnd = FindRegionEnd(region, itrAfterOpen, itrLineEnd, depth, delimiter, closed);
+        mark(itrStart, itrEnd, m_rules[region].color, ThemeColor::None);
+        if (closed || !m_rules[region].multiLine)
+        {
+            return std::make_pair(itrEnd, SyntaxLineState::Normal());
+        }
+        return std::make_pair(itrEnd, SyntaxLineState{ true, uint8_t(region + 1), depth, DelimiterId(delimiter) });
+    };
 
-    // Walk the buffer updating information about syntax coloring
-    while (itrCurrent != itrEnd)
+    // Still inside a comment or string from the line before
+    auto itrCurrent = buffer.begin() + lineStart;
+    if (state.region != 0)
     {
-        if (m_stop == true)
+        GetDelimiter(state.delimiter, delimiter);
+        auto [itrEnd, endState] = lexRegion(state.region - 1, itrCurrent, itrCurrent, state.depth);
+        if (endState.region != 0)
         {
-            return;
+            return endState;
+        }
+        itrCurrent = itrEnd;
+    }
+
+    // Walk the line updating information about syntax coloring
+    while (itrCurrent < itrLineEnd)
+    {
+        // The next comment or string, and the text before it
+        auto itrOpen = itrCurrent;
+        auto itrAfterOpen = itrLineEnd;
+        int32_t region = -1;
+        while (itrOpen < itrLineEnd)
+        {
+            itrOpen = clamp(buffer.find_first_of(itrOpen, itrLineEnd, *m_spOpenSet), itrLineEnd);
+            if (itrOpen == itrLineEnd || (region = MatchRegionOpen(itrOpen, itrLineEnd, itrAfterOpen, delimiter)) >= 0)
+            {
+                break;
+            }
+            itrOpen++;
         }
 
-        // Find a token, skipping delim <itrFirst, itrLast>
-        auto itrFirst = buffer.find_first_not_of(itrCurrent, buffer.end(), delim.begin(), delim.end());
-        if (itrFirst == buffer.end())
+        LexText(itrCurrent, itrOpen, lineStart, runs);
+        if (region < 0)
         {
             break;
         }
 
-        auto itrLast = buffer.find_first_of(itrFirst, buffer.end(), delim.begin(), delim.end());
+        auto [itrEnd, endState] = lexRegion(region, itrOpen, itrAfterOpen, 0);
+        if (endState.region != 0)
+        {
+            return endState;
+        }
+        itrCurrent = itrEnd;
+    }
+    return SyntaxLineState::Normal();
+}
+
+// The text between the comments and strings, a token at a time
+void ZepSyntax::LexText(TextStorage<utf8>::const_iterator itrCurrent, TextStorage<utf8>::const_iterator itrEnd, BufferLocation lineStart, SyntaxRuns& runs)
+{
+    using const_iterator = TextStorage<utf8>::const_iterator;
+    auto& buffer = m_buffer.GetText();
 
-        // Ensure we found a token
-        assert(itrLast >= itrFirst);
+    // The buffer ends in a 0, which shouldn't stick to the last token
+    static const std::string delim(" \t.\n;(){}=:\0", 12);
+    static const auto delimSet = MakeSpanFindSet<utf8>(delim.begin(), delim.end());
+    auto caseInsensitive = (m_flags & ZepSyntaxFlags::CaseInsensitive) != 0;
+
+    // Lines can be lexed on more than one thread at once
+    static thread_local std::string tokenScratch;
+
+    auto mark = [&](const const_iterator& itrA, const const_iterator& itrB, ThemeColor type, ThemeColor background) {
+        MarkSyntaxRuns(runs, int32_t(itrA - buffer.begin()) - lineStart, int32_t(itrB - buffer.begin()) - lineStart, SyntaxData{ type, background });
+    };
+
+    auto clamp = [&](const const_iterator& itr, const const_iterator& itrLimit) {
+        return itr < itrLimit ? itr : itrLimit;
+    };
+
+    while (itrCurrent < itrEnd)
+    {
+        // Find a token, skipping delim <itrFirst, itrLast>
+        auto itrFirst = clamp(buffer.find_first_not_of(itrCurrent, itrEnd, delimSet), itrEnd);
 
         // Mark whitespace
         for (auto& itr = itrCurrent; itr < itrFirst; itr++)
@@ -204,26 +827,31 @@ void ZepSyntax::UpdateSyntax()
             }
         }
 
-        // Do I need to make a string here?
-        auto token = std::string(itrFirst, itrLast);
-        if ((m_flags & ZepSyntaxFlags::CaseInsensitive) != 0)
+        if (itrFirst == itrEnd)
         {
-            token = string_tolower(token);
+            break;
         }
 
-        if (m_keywords.find(token) != m_keywords.end())
+        auto itrLast = clamp(buffer.find_first_of(itrFirst, itrEnd, delimSet), itrEnd);
+
+        // Ensure we found a token
+        assert(itrLast >= itrFirst);
+
+        // A view of the token; only copied if it crosses the gap
+        auto token = buffer.view(itrFirst, itrLast, tokenScratch);
+        if (m_keywords.Contains(token, caseInsensitive))
         {
             mark(itrFirst, itrLast, ThemeColor::Keyword, ThemeColor::None);
         }
-        else if (m_identifiers.find(token) != m_identifiers.end())
+        else if (m_identifiers.Contains(token, caseInsensitive))
         {
             mark(itrFirst, itrLast, ThemeColor::Identifier, ThemeColor::None);
         }
-        else if (token.find_first_not_of("0123456789") == std::string::npos)
+        else if (token.find_first_not_of("0123456789") == std::string_view::npos)
         {
             mark(itrFirst, itrLast, ThemeColor::Number, ThemeColor::None);
         }
-        else if (token.find_first_not_of("{}()[]") == std::string::npos)
+        else if (token.find_first_not_of("{}()[]") == std::string_view::npos)
         {
             mark(itrFirst, itrLast, ThemeColor::Parenthesis, ThemeColor::None);
         }
@@ -232,63 +860,178 @@ void ZepSyntax::UpdateSyntax()
             mark(itrFirst, itrLast, ThemeColor::Normal, ThemeColor::None);
         }
 
-        // Find String
-        auto findString = [&](utf8 ch) {
-            auto itrString = itrFirst;
-            if (*itrString == ch)
+        itrCurrent = itrLast;
+    }
+}
+
+// The rule whose open is here, if any; and where the region starts after it.  A raw string's delimiter is read too
+auto ZepSyntax::MatchRegionOpen(TextStorage<utf8>::const_iterator itr, TextStorage<utf8>::const_iterator itrLineEnd, TextStorage<utf8>::const_iterator& itrAfter, std::string& delimiter) const -> int32_t
+{
+    for (size_t index = 0; index < m_rules.size(); index++)
+    {
+        auto& rule = m_rules[index];
+        if (!MatchText(itr, itrLineEnd, rule.open))
+        {
+            continue;
+        }
+
+        itrAfter = itr + rule.open.size();
+        if (rule.delimiterOpen == 0)
+        {
+            return int32_t(index);
+        }
+
+        delimiter.clear();
+        while (itrAfter < itrLineEnd && char(*itrAfter) != rule.delimiterOpen && delimiter.size() < MaxDelimiterSize && IsDelimiterChar(rule, char(*itrAfter)))
+        {
+            delimiter.push_back(char(*itrAfter++));
+        }
+
+        if (itrAfter < itrLineEnd && char(*itrAfter) == rule.delimiterOpen)
+        {
+            itrAfter++;
+            return int32_t(index);
+        }
+    }
+    return -1;
+}
+
+// Where a region ends on this line, after its close; or the line end, if it doesn't close.
+// Nested regions count the opens inside them, and need a close for each one
+auto ZepSyntax::FindRegionEnd(int32_t region, TextStorage<utf8>::const_iterator itr, TextStorage<utf8>::const_iterator itrLineEnd, uint16_t& depth, const std::string& delimiter, bool& closed) const -> TextStorage<utf8>::const_iterator
+{
+    auto& buffer = m_buffer.GetText();
+    auto& rule = m_rules[region];
+
+    // Line comments just stop at the end of it
+    closed = rule.close.empty() && rule.delimiterClose == 0;
+    if (closed)
+    {
+        return itrLineEnd;
+    }
+
+    while (itr < itrLineEnd)
+    {
+        itr = buffer.find_first_of(itr, itrLineEnd, m_stopSets[region]);
+        if (itr >= itrLineEnd)
+        {
+            break;
+        }
+
+        auto ch = char(*itr);
+        if (rule.escape != 0 && ch == rule.escape)
+        {
+            itr = itr + 1 < itrLineEnd ? itr + 2 : itrLineEnd;
+            continue;
+        }
+
+        if (rule.delimiterClose != 0)
+        {
+            if (ch == rule.delimiterClose && MatchText(itr + 1, itrLineEnd, delimiter) && MatchText(itr + 1 + delimiter.size(), itrLineEnd, rule.close))
             {
-                itrString++;
-
-                while (itrString < buffer.end())
-                {
-                    // handle end of string
-                    if (*itrString == ch)
-                    {
-                        itrString++;
-                        mark(itrFirst, itrString, ThemeColor::String, ThemeColor::None);
-                        itrLast = itrString + 1;
-                        break;
-                    }
-
-                    if (itrString < (buffer.end() - 1))
-                    {
-                        auto itrNext = itrString + 1;
-                        // Ignore quoted
-                        if (*itrString == '\\' && *itrNext == ch)
-                        {
-                            itrString++;
-                        }
-                    }
-
-                    itrString++;
-                }
+                closed = true;
+                return itr + 1 + delimiter.size() + rule.close.size();
             }
-        };
-        findString('\"');
-        findString('\'');
-
-        std::string commentStr = "/";
-        auto itrComment = buffer.find_first_of(itrFirst, itrLast, commentStr.begin(), commentStr.end());
-        if (itrComment != buffer.end())
+        }
+        else if (MatchText(itr, itrLineEnd, rule.close))
         {
-            auto itrCommentStart = itrComment++;
-            if (itrComment < buffer.end())
+            itr += rule.close.size();
+            if (depth == 0)
             {
-                if (*itrComment == '/')
-                {
-                    itrLast = buffer.find_first_of(itrCommentStart, buffer.end(), lineEnd.begin(), lineEnd.end());
-                    mark(itrCommentStart, itrLast, ThemeColor::Comment, ThemeColor::None);
-                }
+                closed = true;
+                return itr;
             }
+            depth--;
+            continue;
         }
 
-        itrCurrent = itrLast;
+        if (rule.nested && MatchText(itr, itrLineEnd, rule.open))
+        {
+            itr += rule.open.size();
+            depth++;
+            continue;
+        }
+        itr++;
     }
+    return itrLineEnd;
+}
 
-    // If we got here, we sucessfully completed
-    // Reset the target to the beginning
-    m_targetChar = 0;
-    m_processedChar = buffer.size() - 1;
+// Raw string delimiters are kept in a list, so a line state can hold one as a number
+auto ZepSyntax::DelimiterId(const std::string& delimiter) -> uint32_t
+{
+    if (delimiter.empty())
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_delimiterMutex);
+    auto itr = std::find(m_delimiters.begin(), m_delimiters.end(), delimiter);
+    if (itr == m_delimiters.end())
+    {
+        itr = m_delimiters.insert(m_delimiters.end(), delimiter);
+    }
+    return uint32_t(itr - m_delimiters.begin()) + 1;
+}
+
+void ZepSyntax::GetDelimiter(uint32_t id, std::string& delimiter) const
+{
+    delimiter.clear();
+    if (id != 0)
+    {
+        std::lock_guard<std::mutex> lock(m_delimiterMutex);
+        delimiter = m_delimiters[id - 1];
+    }
+}
+
+auto SyntaxRegion::LineComment(const std::string& open) -> SyntaxRegion
+{
+    SyntaxRegion region;
+    region.open = open;
+    region.color = ThemeColor::Comment;
+    region.multiLine = false;
+    return region;
+}
+
+auto SyntaxRegion::BlockComment(const std::string& open, const std::string& close, bool nested) -> SyntaxRegion
+{
+    SyntaxRegion region;
+    region.open = open;
+    region.close = close;
+    region.color = ThemeColor::Comment;
+    region.nested = nested;
+    return region;
+}
+
+auto SyntaxRegion::String(const std::string& quote, char escape, bool multiLine) -> SyntaxRegion
+{
+    SyntaxRegion region;
+    region.open = quote;
+    region.close = quote;
+    region.escape = escape;
+    region.multiLine = multiLine;
+    return region;
+}
+
+auto SyntaxRegion::RawString(const std::string& open, char delimiterOpen, char delimiterClose, const std::string& close, const std::string& delimiterChars, ThemeColor color) -> SyntaxRegion
+{
+    SyntaxRegion region;
+    region.open = open;
+    region.close = close;
+    region.color = color;
+    region.delimiterOpen = delimiterOpen;
+    region.delimiterClose = delimiterClose;
+    region.delimiterChars = delimiterChars;
+    return region;
+}
+
+auto CSyntaxRules() -> SyntaxRules
+{
+    return SyntaxRules{
+        SyntaxRegion::LineComment("//"),
+        SyntaxRegion::BlockComment("/*", "*/"),
+        SyntaxRegion::String("\""),
+        SyntaxRegion::String("'")
+    };
 }
 
 } // namespace Zep
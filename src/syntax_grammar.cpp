@@ -0,0 +1,626 @@
+#include "zep/syntax_grammar.hpp"
+#include "zep/theme.hpp"
+
+#include "zep/mcommon/file/cpptoml.hpp"
+#include "zep/mcommon/string/stringutils.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <utility>
+
+namespace Zep
+{
+
+namespace
+{
+// A grammar that needs more than this is almost certainly a mistake, and the table would be huge
+const size_t MaxStates = 4096;
+
+// The token rules fit in the accept table, and the regions in a line state
+const size_t MaxTokens = 32000;
+const size_t MaxRegions = 255;
+
+using CharSet = std::bitset<256>;
+
+const std::pair<const char*, ThemeColor> ColorNames[] = {
+    { "normal", ThemeColor::Normal },
+    { "keyword", ThemeColor::Keyword },
+    { "identifier", ThemeColor::Identifier },
+    { "number", ThemeColor::Number },
+    { "string", ThemeColor::String },
+    { "comment", ThemeColor::Comment },
+    { "whitespace", ThemeColor::Whitespace },
+    { "parenthesis", ThemeColor::Parenthesis },
+    { "error", ThemeColor::Error },
+    { "warning", ThemeColor::Warning },
+    { "info", ThemeColor::Info }
+};
+
+auto FindColor(const std::string& name, ThemeColor& color) -> bool
+{
+    auto lower = string_tolower(name);
+    for (auto& entry : ColorNames)
+    {
+        if (lower == entry.first)
+        {
+            color = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+// A word from a keyword list, as a pattern which matches just that
+auto LiteralPattern(const std::string& word) -> std::string
+{
+    std::string pattern;
+    for (auto ch : word)
+    {
+        if (std::string("\\.[]()|*+?").find(ch) != std::string::npos)
+        {
+            pattern.push_back('\\');
+        }
+        pattern.push_back(ch);
+    }
+    return pattern;
+}
+
+auto RangeSet(int from, int to) -> CharSet
+{
+    CharSet set;
+    for (auto ch = from; ch <= to; ch++)
+    {
+        set.set(ch);
+    }
+    return set;
+}
+
+auto WordSet() -> CharSet
+{
+    auto set = RangeSet('a', 'z') | RangeSet('A', 'Z') | RangeSet('0', '9');
+    set.set('_');
+    return set;
+}
+
+auto SpaceSet() -> CharSet
+{
+    CharSet set;
+    for (auto ch : std::string(" \t\r\n\f\v"))
+    {
+        set.set(uint8_t(ch));
+    }
+    return set;
+}
+} // namespace
+
+// The patterns, parsed into one automaton with a choice of paths (Thompson's construction); the DFA is built from this
+struct SyntaxGrammar::Nfa
+{
+    struct State
+    {
+        CharSet chars; // A state either moves to next on one of these characters,
+        int32_t next = -1;
+        std::vector<int32_t> epsilon; // or to any of these on nothing
+        int32_t accept = -1;
+    };
+
+    // A piece of pattern; the end state has no way out yet
+    struct Fragment
+    {
+        int32_t start;
+        int32_t end;
+    };
+
+    std::vector<State> states;
+    bool caseInsensitive = false;
+
+    std::string pattern;
+    size_t pos = 0;
+    std::string error;
+
+    auto Add() -> int32_t
+    {
+        states.emplace_back();
+        return int32_t(states.size() - 1);
+    }
+
+    void Link(int32_t from, int32_t to)
+    {
+        states[from].epsilon.push_back(to);
+    }
+
+    auto Chars(CharSet chars) -> Fragment
+    {
+        if (caseInsensitive)
+        {
+            for (int ch = 'a'; ch <= 'z'; ch++)
+            {
+                if (chars[ch] || chars[ch - 'a' + 'A'])
+                {
+                    chars.set(ch);
+                    chars.set(ch - 'a' + 'A');
+                }
+            }
+        }
+
+        Fragment fragment{ Add(), Add() };
+        states[fragment.start].chars = chars;
+        states[fragment.start].next = fragment.end;
+        return fragment;
+    }
+
+    auto Parse(const std::string& text) -> Fragment
+    {
+        pattern = text;
+        pos = 0;
+        auto fragment = ParseAlternation();
+        if (error.empty() && pos < pattern.size())
+        {
+            error = "unmatched )";
+        }
+        return fragment;
+    }
+
+    auto ParseAlternation() -> Fragment
+    {
+        auto fragment = ParseSequence();
+        while (error.empty() && pos < pattern.size() && pattern[pos] == '|')
+        {
+            pos++;
+            auto other = ParseSequence();
+            Fragment either{ Add(), Add() };
+            Link(either.start, fragment.start);
+            Link(either.start, other.start);
+            Link(fragment.end, either.end);
+            Link(other.end, either.end);
+            fragment = either;
+        }
+        return fragment;
+    }
+
+    auto ParseSequence() -> Fragment
+    {
+        auto start = Add();
+        Fragment fragment{ start, start };
+        while (error.empty() && pos < pattern.size() && pattern[pos] != '|' && pattern[pos] != ')')
+        {
+            auto next = ParseRepeat();
+            Link(fragment.end, next.start);
+            fragment.end = next.end;
+        }
+        return fragment;
+    }
+
+    auto ParseRepeat() -> Fragment
+    {
+        auto fragment = ParseAtom();
+        while (error.empty() && pos < pattern.size() && std::string("*+?").find(pattern[pos]) != std::string::npos)
+        {
+            auto op = pattern[pos++];
+            Fragment repeat{ Add(), Add() };
+            Link(repeat.start, fragment.start);
+            if (op != '+')
+            {
+                Link(repeat.start, repeat.end);
+            }
+            if (op != '?')
+            {
+                Link(fragment.end, fragment.start);
+            }
+            Link(fragment.end, repeat.end);
+            fragment = repeat;
+        }
+        return fragment;
+    }
+
+    auto ParseAtom() -> Fragment
+    {
+        auto ch = pattern[pos++];
+        switch (ch)
+        {
+        case '(':
+        {
+            auto fragment = ParseAlternation();
+            if (error.empty() && (pos >= pattern.size() || pattern[pos] != ')'))
+            {
+                error = "missing )";
+            }
+            pos++;
+            return fragment;
+        }
+        case '[':
+            return Chars(ParseClass());
+        case '.':
+        {
+            CharSet any;
+            any.set();
+            any.reset('\n');
+            return Chars(any);
+        }
+        case '\\':
+            return Chars(ParseEscape());
+        case '*':
+        case '+':
+        case '?':
+            error = std::string("nothing to repeat before ") + ch;
+            return Chars(CharSet());
+        default:
+            return Chars(CharSet().set(uint8_t(ch)));
+        }
+    }
+
+    // After a backslash
+    auto ParseEscape() -> CharSet
+    {
+        if (pos >= pattern.size())
+        {
+            error = "pattern ends in \\";
+            return CharSet();
+        }
+
+        auto ch = pattern[pos++];
+        switch (ch)
+        {
+        case 'd':
+            return RangeSet('0', '9');
+        case 'D':
+            return ~RangeSet('0', '9');
+        case 'w':
+            return WordSet();
+        case 'W':
+            return ~WordSet();
+        case 's':
+            return SpaceSet();
+        case 'S':
+            return ~SpaceSet();
+        case 'n':
+            return CharSet().set('\n');
+        case 'r':
+            return CharSet().set('\r');
+        case 't':
+            return CharSet().set('\t');
+        default:
+            return CharSet().set(uint8_t(ch));
+        }
+    }
+
+    // After a [; a ] straight after it is just a ]
+    auto ParseClass() -> CharSet
+    {
+        CharSet set;
+        auto negate = pos < pattern.size() && pattern[pos] == '^';
+        if (negate)
+        {
+            pos++;
+        }
+
+        auto first = true;
+        while (pos < pattern.size() && (first || pattern[pos] != ']'))
+        {
+            first = false;
+            auto ch = pattern[pos++];
+            if (ch == '\\')
+            {
+                set |= ParseEscape();
+                continue;
+            }
+
+            if (pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']')
+            {
+                auto last = pattern[pos + 1];
+                pos += 2;
+                if (uint8_t(last) < uint8_t(ch))
+                {
+                    error = std::string("bad range ") + ch + "-" + last;
+                }
+                set |= RangeSet(uint8_t(ch), uint8_t(last));
+                continue;
+            }
+            set.set(uint8_t(ch));
+        }
+
+        if (pos >= pattern.size())
+        {
+            error = "missing ]";
+        }
+        pos++;
+        return negate ? ~set : set;
+    }
+
+    // Everywhere the states can get to without reading a character
+    void Closure(std::vector<int32_t>& set) const
+    {
+        std::vector<int32_t> stack = set;
+        std::vector<bool> seen(states.size());
+        for (auto state : set)
+        {
+            seen[state] = true;
+        }
+
+        while (!stack.empty())
+        {
+            auto state = stack.back();
+            stack.pop_back();
+            for (auto next : states[state].epsilon)
+            {
+                if (!seen[next])
+                {
+                    seen[next] = true;
+                    set.push_back(next);
+                    stack.push_back(next);
+                }
+            }
+        }
+        std::sort(set.begin(), set.end());
+    }
+};
+
+auto SyntaxGrammar::Build(const std::vector<std::string>& patterns, std::string& error) -> bool
+{
+    Nfa nfa;
+    nfa.caseInsensitive = (m_flags & ZepSyntaxFlags::CaseInsensitive) != 0;
+
+    auto start = nfa.Add();
+    for (size_t index = 0; index < patterns.size(); index++)
+    {
+        if (patterns[index].empty())
+        {
+            error = "token " + std::to_string(index + 1) + ": empty pattern";
+            return false;
+        }
+
+        auto fragment = nfa.Parse(patterns[index]);
+        if (!nfa.error.empty())
+        {
+            error = "token " + std::to_string(index + 1) + ": " + nfa.error + " in '" + patterns[index] + "'";
+            return false;
+        }
+        nfa.states[fragment.end].accept = int32_t(index);
+        nfa.Link(start, fragment.start);
+    }
+
+    // Split the characters into classes which every pattern treats the same; usually a few dozen instead of 256
+    std::array<uint32_t, 256> classOf{};
+    m_classCount = 1;
+    for (auto& state : nfa.states)
+    {
+        if (state.next < 0)
+        {
+            continue;
+        }
+
+        std::map<std::pair<uint32_t, bool>, uint32_t> split;
+        for (int ch = 0; ch < 256; ch++)
+        {
+            auto itr = split.emplace(std::make_pair(classOf[ch], bool(state.chars[ch])), uint32_t(split.size())).first;
+            classOf[ch] = itr->second;
+        }
+        m_classCount = uint32_t(split.size());
+    }
+
+    std::vector<uint8_t> sample(m_classCount);
+    for (int ch = 255; ch >= 0; ch--)
+    {
+        m_classes[ch] = uint8_t(classOf[ch]);
+        sample[classOf[ch]] = uint8_t(ch);
+    }
+
+    // Each DFA state is a set of NFA states; the dead state is the empty set
+    std::vector<std::vector<int32_t>> sets(1);
+    std::map<std::vector<int32_t>, uint32_t> lookup{ { sets[0], DeadState } };
+    auto stateFor = [&](std::vector<int32_t>& set) {
+        nfa.Closure(set);
+        auto itr = lookup.find(set);
+        if (itr != lookup.end())
+        {
+            return itr->second;
+        }
+        auto state = uint32_t(sets.size());
+        lookup[set] = state;
+        sets.push_back(set);
+        return state;
+    };
+
+    std::vector<int32_t> startSet{ start };
+    stateFor(startSet);
+
+    m_next.clear();
+    m_accept.clear();
+    for (size_t state = 0; state < sets.size(); state++)
+    {
+        if (sets.size() > MaxStates)
+        {
+            error = "the tokens need more than " + std::to_string(MaxStates) + " states";
+            return false;
+        }
+
+        // The first rule wins a tie
+        int32_t accept = -1;
+        for (auto nfaState : sets[state])
+        {
+            auto rule = nfa.states[nfaState].accept;
+            if (rule >= 0 && (accept < 0 || rule < accept))
+            {
+                accept = rule;
+            }
+        }
+        m_accept.push_back(int16_t(accept));
+
+        for (uint32_t charClass = 0; charClass < m_classCount; charClass++)
+        {
+            std::vector<int32_t> next;
+            for (auto nfaState : sets[state])
+            {
+                auto& from = nfa.states[nfaState];
+                if (from.next >= 0 && from.chars[sample[charClass]])
+                {
+                    next.push_back(from.next);
+                }
+            }
+            auto target = next.empty() ? DeadState : stateFor(next);
+            m_next.push_back(uint16_t(target));
+        }
+    }
+    return true;
+}
+
+auto SyntaxGrammar::Compile(const std::shared_ptr<cpptoml::table>& spTable, std::string& error) -> std::shared_ptr<SyntaxGrammar>
+{
+    auto spGrammar = std::make_shared<SyntaxGrammar>();
+    spGrammar->m_name = spTable->get_as<std::string>("name").value_or("");
+    if (spGrammar->m_name.empty())
+    {
+        error = "no name";
+        return nullptr;
+    }
+
+    auto fail = [&](const std::string& message) {
+        error = spGrammar->m_name + ": " + message;
+        return nullptr;
+    };
+
+    spGrammar->m_extensions = spTable->get_array_of<std::string>("extensions").value_or(std::vector<std::string>{});
+    if (spGrammar->m_extensions.empty())
+    {
+        return fail("no extensions");
+    }
+
+    if (spTable->get_as<bool>("case_insensitive").value_or(false))
+    {
+        spGrammar->m_flags |= ZepSyntaxFlags::CaseInsensitive;
+    }
+
+    // The word lists first, so they win over a token of the same length
+    std::vector<std::string> patterns;
+    auto addWords = [&](const char* key, ThemeColor color) {
+        for (auto& word : spTable->get_array_of<std::string>(key).value_or(std::vector<std::string>{}))
+        {
+            if (!word.empty())
+            {
+                patterns.push_back(LiteralPattern(word));
+                spGrammar->m_colors.push_back(color);
+            }
+        }
+    };
+    addWords("keywords", ThemeColor::Keyword);
+    addWords("identifiers", ThemeColor::Identifier);
+
+    if (auto spTokens = spTable->get_table_array("token"))
+    {
+        for (auto& spToken : *spTokens)
+        {
+            auto pattern = spToken->get_as<std::string>("pattern");
+            auto colorName = spToken->get_as<std::string>("color").value_or("normal");
+            ThemeColor color;
+            if (!pattern)
+            {
+                return fail("token " + std::to_string(patterns.size() + 1) + " has no pattern");
+            }
+            if (!FindColor(colorName, color))
+            {
+                return fail("unknown color '" + colorName + "'");
+            }
+            patterns.push_back(*pattern);
+            spGrammar->m_colors.push_back(color);
+        }
+    }
+
+    if (patterns.size() > MaxTokens)
+    {
+        return fail("too many tokens");
+    }
+
+    if (auto spRegions = spTable->get_table_array("region"))
+    {
+        for (auto& spRegion : *spRegions)
+        {
+            auto charOf = [&](const char* key) {
+                auto value = spRegion->get_as<std::string>(key).value_or("");
+                return value.empty() ? char(0) : value[0];
+            };
+
+            SyntaxRegion region;
+            region.open = spRegion->get_as<std::string>("open").value_or("");
+            region.close = spRegion->get_as<std::string>("close").value_or("");
+            region.escape = charOf("escape");
+            region.multiLine = spRegion->get_as<bool>("multi_line").value_or(!region.close.empty());
+            region.nested = spRegion->get_as<bool>("nested").value_or(false);
+            region.delimiterOpen = charOf("delimiter_open");
+            region.delimiterClose = charOf("delimiter_close");
+            region.delimiterChars = spRegion->get_as<std::string>("delimiter_chars").value_or("");
+
+            auto colorName = spRegion->get_as<std::string>("color").value_or("string");
+            if (region.open.empty())
+            {
+                return fail("region " + std::to_string(spGrammar->m_rules.size() + 1) + " has no open");
+            }
+            if (!FindColor(colorName, region.color))
+            {
+                return fail("unknown color '" + colorName + "'");
+            }
+            spGrammar->m_rules.push_back(region);
+        }
+    }
+
+    if (spGrammar->m_rules.size() > MaxRegions)
+    {
+        return fail("too many regions");
+    }
+
+    std::string buildError;
+    if (!spGrammar->Build(patterns, buildError))
+    {
+        return fail(buildError);
+    }
+    return spGrammar;
+}
+
+ZepGrammarSyntax::ZepGrammarSyntax(ZepBuffer& buffer, std::shared_ptr<const SyntaxGrammar> spGrammar)
+    : ZepSyntax(buffer, KeywordTable{}, KeywordTable{}, spGrammar->GetFlags(), spGrammar->GetRules())
+    , m_spGrammar(std::move(spGrammar))
+{
+}
+
+// The lex may still be calling LexText; stop it before the grammar goes
+ZepGrammarSyntax::~ZepGrammarSyntax()
+{
+    Interrupt();
+}
+
+void ZepGrammarSyntax::LexText(TextStorage<utf8>::const_iterator itrStart, TextStorage<utf8>::const_iterator itrEnd, BufferLocation lineStart, SyntaxRuns& runs)
+{
+    auto& buffer = m_buffer.GetText();
+
+    // Lines can be lexed on more than one thread at once
+    static thread_local std::string scratch;
+    auto text = buffer.view(itrStart, itrEnd, scratch);
+
+    // The buffer ends in a 0, which no token should take
+    if (!text.empty() && text.back() == 0)
+    {
+        text.remove_suffix(1);
+    }
+
+    auto start = int32_t(itrStart - buffer.begin()) - lineStart;
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t length = 0;
+        auto token = m_spGrammar->Match(text.substr(pos), length);
+        if (token < 0)
+        {
+            if (text[pos] == ' ')
+            {
+                MarkSyntaxRuns(runs, start + int32_t(pos), start + int32_t(pos) + 1, SyntaxData{ ThemeColor::Whitespace, ThemeColor::None });
+            }
+            pos++;
+            continue;
+        }
+
+        MarkSyntaxRuns(runs, start + int32_t(pos), start + int32_t(pos + length), SyntaxData{ m_spGrammar->TokenColor(token), ThemeColor::None });
+        pos += length;
+    }
+}
+
+} // namespace Zep
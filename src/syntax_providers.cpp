@@ -9,25 +9,24 @@ namespace Zep
 // Most of these keyword values taken from : https://github.com/BalazsJako/ImGuiColorTextEdit
 // another great ImGui based text editor.
 // I'll fill these out when I get time.  At the moment the syntax code matches on these, comments and numbers.
-static std::set<std::string_view> cpp_keywords = {
+// The tables are perfect hashed at compile time, see keyword_table.hpp
+static constexpr auto cpp_keywords = MakeKeywordTable(
     "alignas", "alignof", "and", "and_eq", "asm", "atomic_cancel", "atomic_commit", "atomic_noexcept", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char", "char16_t", "char32_t", "class",
     "compl", "concept", "const", "constexpr", "const_cast", "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float",
     "for", "friend", "goto", "if", "import", "inline", "int", "long", "module", "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public",
     "register", "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct", "switch", "synchronized", "template", "this", "thread_local",
     "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq", "#define", "#include",
-    "uint32_t", "int32_t", "uint64_t", "int64_t", "size_t", "uint8_t", "int8_t", "int16_t", "uint16_t"
-};
+    "uint32_t", "int32_t", "uint64_t", "int64_t", "size_t", "uint8_t", "int8_t", "int16_t", "uint16_t");
 
-static std::set<std::string_view> cpp_identifiers = {
+static constexpr auto cpp_identifiers = MakeKeywordTable(
     "abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
     "ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "printf", "sprintf", "snprintf", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper",
-    "std", "string", "vector", "map", "unordered_map", "set", "unordered_set", "min", "max"
-};
+    "std", "string", "vector", "map", "unordered_map", "set", "unordered_set", "min", "max");
 
-static std::set<std::string_view> toml_keywords = {};
-static std::set<std::string_view> toml_identifiers = {};
+static constexpr auto toml_keywords = MakeKeywordTable();
+static constexpr auto toml_identifiers = MakeKeywordTable();
 
-static std::set<std::string_view> hlsl_keywords = {
+static constexpr auto hlsl_keywords = MakeKeywordTable(
     "CompileShader",
     "const",
     "continue",
@@ -199,10 +198,9 @@ static std::set<std::string_view> hlsl_keywords = {
     "half1x4",
     "half2x4",
     "half3x4",
-    "half4x4",
-};
+    "half4x4");
 
-static std::set<std::string_view> hlsl_identifiers = {
+static constexpr auto hlsl_identifiers = MakeKeywordTable(
     "abort", "abs", "acos", "all", "AllMemoryBarrier", "AllMemoryBarrierWithGroupSync", "any", "asdouble", "asfloat", "asin", "asint", "asint", "asuint",
     "asuint", "atan", "atan2", "ceil", "CheckAccessFullyMapped", "clamp", "clip", "cos", "cosh", "countbits", "cross", "D3DCOLORtoUBYTE4", "ddx",
     "ddx_coarse", "ddx_fine", "ddy", "ddy_coarse", "ddy_fine", "degrees", "determinant", "DeviceMemoryBarrier", "DeviceMemoryBarrierWithGroupSync",
@@ -215,37 +213,32 @@ static std::set<std::string_view> hlsl_identifiers = {
     "ProcessQuadTessFactorsMax", "ProcessQuadTessFactorsMin", "ProcessTriTessFactorsAvg", "ProcessTriTessFactorsMax", "ProcessTriTessFactorsMin",
     "radians", "rcp", "reflect", "refract", "reversebits", "round", "rsqrt", "saturate", "sign", "sin", "sincos", "sinh", "smoothstep", "sqrt", "step",
     "tan", "tanh", "tex1D", "tex1D", "tex1Dbias", "tex1Dgrad", "tex1Dlod", "tex1Dproj", "tex2D", "tex2D", "tex2Dbias", "tex2Dgrad", "tex2Dlod", "tex2Dproj",
-    "tex3D", "tex3D", "tex3Dbias", "tex3Dgrad", "tex3Dlod", "tex3Dproj", "texCUBE", "texCUBE", "texCUBEbias", "texCUBEgrad", "texCUBElod", "texCUBEproj", "transpose", "trunc"
-};
+    "tex3D", "tex3D", "tex3Dbias", "tex3Dgrad", "tex3Dlod", "tex3Dproj", "texCUBE", "texCUBE", "texCUBEbias", "texCUBEgrad", "texCUBElod", "texCUBEproj", "transpose", "trunc");
 
 // From here: https://stackoverflow.com/a/6232367/18942
-static std::set<std::string_view> glsl_keywords{
+static constexpr auto glsl_keywords = MakeKeywordTable(
     "void", "#version", "attribute", "uniform", "varying", "layout", "centroid", "flat", "smooth", "noperspective", "patch", "sample", "subroutine", "in", "out", "inout", "invariant", "discard", "mat2", "mat3", "mat4", "dmat2", "dmat3", "dmat4",
     "mat2x2", "mat2x3", "mat2x4", "dmat2x2", "dmat2x3", "dmat2x4", "mat3x2", "mat3x3", "mat3x4", "dmat3x2", "dmat3x3", "dmat3x4", "mat4x2", "mat4x3", "mat4x4", "dmat4x2", "dmat4x3", "dmat4x4", "vec2", "vec3",
     "vec4", "ivec2", "ivec3", "ivec4", "bvec2", "bvec3", "bvec4", "dvec2", "dvec3", "dvec4", "uvec2", "uvec3", "uvec4", "lowp", "mediump", "highp", "precision", "sampler1D", "sampler2D", "sampler3D",
     "samplerCube", "sampler1DShadow", "sampler2DShadow", "samplerCubeShadow", "sampler1DArray", "sampler2DArray", "sampler1DArrayShadow", "sampler2DArrayShadow", "isampler1D", "isampler2D",
     "isampler3D", "isamplerCube", "isampler1DArray", "isampler2DArray", "usampler1D", "usampler2D", "usampler3D", "usamplerCube", "usampler1DArray", "usampler2DArray",
     "sampler2DRect", "sampler2DRectShadow", "isampler2DRect", "usampler2DRect", "samplerBuffer", "isamplerBuffer", "usamplerBuffer", "sampler2DMS", "isampler2DMS",
-    "usampler2DMS", "sampler2DMSArray", "isampler2DMSArray", "usampler2DMSArray", "samplerCubeArray", "samplerCubeArrayShadow", "isamplerCubeArray", "usamplerCubeArray"
-};
+    "usampler2DMS", "sampler2DMSArray", "isampler2DMSArray", "usampler2DMSArray", "samplerCubeArray", "samplerCubeArrayShadow", "isamplerCubeArray", "usamplerCubeArray");
 
-static std::set<std::string_view> glsl_identifiers = {
+static constexpr auto glsl_identifiers = MakeKeywordTable(
     "abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
     "ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper",
-    "gl_Position"
-};
+    "gl_Position");
 
-static std::set<std::string_view> c_keywords = {
+static constexpr auto c_keywords = MakeKeywordTable(
     "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short",
     "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while", "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic", "_Imaginary",
-    "_Noreturn", "_Static_assert", "_Thread_local"
-};
+    "_Noreturn", "_Static_assert", "_Thread_local");
 
-static std::set<std::string_view> c_identifiers = {
+static constexpr auto c_identifiers = MakeKeywordTable(
     "abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
-    "ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper"
-};
-static std::set<std::string_view> sql_keywords = {
+    "ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper");
+static constexpr auto sql_keywords = MakeKeywordTable(
     "ADD", "EXCEPT", "PERCENT", "ALL", "EXEC", "PLAN", "ALTER", "EXECUTE", "PRECISION", "AND", "EXISTS", "PRIMARY", "ANY", "EXIT", "PRINT", "AS", "FETCH", "PROC", "ASC", "FILE", "PROCEDURE",
     "AUTHORIZATION", "FILLFACTOR", "PUBLIC", "BACKUP", "FOR", "RAISERROR", "BEGIN", "FOREIGN", "READ", "BETWEEN", "FREETEXT", "READTEXT", "BREAK", "FREETEXTTABLE", "RECONFIGURE",
     "BROWSE", "FROM", "REFERENCES", "BULK", "FULL", "REPLICATION", "BY", "FUNCTION", "RESTORE", "CASCADE", "GOTO", "RESTRICT", "CASE", "GRANT", "RETURN", "CHECK", "GROUP", "REVOKE",
@@ -255,20 +248,17 @@ static std::set<std::string_view> sql_keywords = {
     "CURRENT_TIME", "LIKE", "THEN", "CURRENT_TIMESTAMP", "LINENO", "TO", "CURRENT_USER", "LOAD", "TOP", "CURSOR", "NATIONAL", "TRAN", "DATABASE", "NOCHECK", "TRANSACTION",
     "DBCC", "NONCLUSTERED", "TRIGGER", "DEALLOCATE", "NOT", "TRUNCATE", "DECLARE", "NULL", "TSEQUAL", "DEFAULT", "NULLIF", "UNION", "DELETE", "OF", "UNIQUE", "DENY", "OFF", "UPDATE",
     "DESC", "OFFSETS", "UPDATETEXT", "DISK", "ON", "USE", "DISTINCT", "OPEN", "USER", "DISTRIBUTED", "OPENDATASOURCE", "VALUES", "DOUBLE", "OPENQUERY", "VARYING", "DROP", "OPENROWSET", "VIEW",
-    "DUMMY", "OPENXML", "WAITFOR", "DUMP", "OPTION", "WHEN", "ELSE", "OR", "WHERE", "END", "ORDER", "WHILE", "ERRLVL", "OUTER", "WITH", "ESCAPE", "OVER", "WRITETEXT"
-};
+    "DUMMY", "OPENXML", "WAITFOR", "DUMP", "OPTION", "WHEN", "ELSE", "OR", "WHERE", "END", "ORDER", "WHILE", "ERRLVL", "OUTER", "WITH", "ESCAPE", "OVER", "WRITETEXT");
 
-static std::set<std::string_view> cmake_keywords = {
-    "option", "add_compile_options", "cmake_minimum_required", "project", "message", "add_dependencies", "add_test", "find_package", "include_directories", "configure_file", "target_link_libraries", "source_group", "set", "set_property", "include", "add_executable", "add_library", "if", "elseif", "endif", "find", "glob"
-};
+static constexpr auto cmake_keywords = MakeKeywordTable(
+    "option", "add_compile_options", "cmake_minimum_required", "project", "message", "add_dependencies", "add_test", "find_package", "include_directories", "configure_file", "target_link_libraries", "source_group", "set", "set_property", "include", "add_executable", "add_library", "if", "elseif", "endif", "find", "glob");
 
-static std::set<std::string_view> cmake_identifiers = {};
+static constexpr auto cmake_identifiers = MakeKeywordTable();
 
-static std::set<std::string_view> lua_keywords = {
-    "and", "break", "do", "", "else", "elseif", "end", "false", "for", "function", "if", "in", "", "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while"
-};
+static constexpr auto lua_keywords = MakeKeywordTable(
+    "and", "break", "do", "else", "elseif", "end", "false", "for", "function", "if", "in", "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while");
 
-static std::set<std::string_view> lua_identifiers = {
+static constexpr auto lua_identifiers = MakeKeywordTable(
     "assert", "collectgarbage", "dofile", "error", "getmetatable", "ipairs", "loadfile", "load", "loadstring", "next", "pairs", "pcall", "print", "rawequal", "rawlen", "rawget", "rawset",
     "select", "setmetatable", "tonumber", "tostring", "type", "xpcall", "_G", "_VERSION", "arshift", "band", "bnot", "bor", "bxor", "btest", "extract", "lrotate", "lshift", "replace",
     "rrotate", "rshift", "create", "resume", "running", "status", "wrap", "yield", "isyieldable", "debug", "getuservalue", "gethook", "getinfo", "getlocal", "getregistry", "getmetatable",
@@ -278,41 +268,68 @@ static std::set<std::string_view> lua_identifiers = {
     "pow", "frexp", "ldexp", "log10", "pi", "huge", "maxinteger", "mininteger", "loadlib", "searchpath", "seeall", "preload", "cpath", "path", "searchers", "loaded", "module", "require", "clock",
     "date", "difftime", "execute", "exit", "getenv", "remove", "rename", "setlocale", "time", "tmpname", "byte", "char", "dump", "find", "format", "gmatch", "gsub", "len", "lower", "match", "rep",
     "reverse", "sub", "upper", "pack", "packsize", "unpack", "concat", "maxn", "insert", "pack", "unpack", "remove", "move", "sort", "offset", "codepoint", "char", "len", "codes", "charpattern",
-    "coroutine", "table", "io", "os", "string", "utf8", "bit32", "math", "debug", "package"
+    "coroutine", "table", "io", "os", "string", "utf8", "bit32", "math", "debug", "package");
+
+static constexpr auto lisp_keywords = MakeKeywordTable(
+    "+", "-", "eval");
+
+static constexpr auto lisp_identifiers = MakeKeywordTable(
+    "cdr", "car");
+
+// The comments and strings; the lexer runs through these at each place, so the longer opens go first
+static const SyntaxRules cpp_rules = {
+    SyntaxRegion::RawString("R\"", '(', ')', "\""),
+    SyntaxRegion::LineComment("//"),
+    SyntaxRegion::BlockComment("/*", "*/"),
+    SyntaxRegion::String("\""),
+    SyntaxRegion::String("'")
+};
+
+static const SyntaxRules lisp_rules = {
+    SyntaxRegion::LineComment(";"),
+    SyntaxRegion::BlockComment("#|", "|#", true),
+    SyntaxRegion::String("\"")
 };
 
-static std::set<std::string_view> lisp_keywords = {
-    "+", "-", "eval"
+static const SyntaxRules cmake_rules = {
+    SyntaxRegion::RawString("#[", '[', ']', "]", "=", ThemeColor::Comment),
+    SyntaxRegion::LineComment("#"),
+    SyntaxRegion::RawString("[", '[', ']', "]", "="),
+    SyntaxRegion::String("\"")
 };
 
-static std::set<std::string_view> lisp_identifiers = {
-    "cdr", "car"
+static const SyntaxRules toml_rules = {
+    SyntaxRegion::LineComment("#"),
+    SyntaxRegion::String("\"\"\""),
+    SyntaxRegion::String("'''", 0),
+    SyntaxRegion::String("\"", '\\', false),
+    SyntaxRegion::String("'", 0, false)
 };
 
 void RegisterSyntaxProviders(ZepEditor& editor)
 {
     editor.RegisterSyntaxFactory({ ".vert", ".frag" }, SyntaxProvider{ "gl_shader", tSyntaxFactory([](ZepBuffer* pBuffer) {
-                                                                          return std::make_shared<ZepSyntax>(*pBuffer, glsl_keywords, glsl_identifiers);
+                                                                          return std::make_shared<ZepSyntax>(*pBuffer, glsl_keywords.Table(), glsl_identifiers.Table());
                                                                       }) });
 
     editor.RegisterSyntaxFactory({ ".hlsl", ".hlsli", ".vs", ".ps" }, SyntaxProvider{ "hlsl_shader", tSyntaxFactory([](ZepBuffer* pBuffer) {
-                                                                                         return std::make_shared<ZepSyntax>(*pBuffer, hlsl_keywords, hlsl_identifiers);
+                                                                                         return std::make_shared<ZepSyntax>(*pBuffer, hlsl_keywords.Table(), hlsl_identifiers.Table());
                                                                                      }) });
 
     editor.RegisterSyntaxFactory({ ".cpp", ".cxx", ".h", ".c" }, SyntaxProvider{ "cpp", tSyntaxFactory([](ZepBuffer* pBuffer) {
-                                                                                    return std::make_shared<ZepSyntax>(*pBuffer, cpp_keywords, cpp_identifiers);
+                                                                                    return std::make_shared<ZepSyntax>(*pBuffer, cpp_keywords.Table(), cpp_identifiers.Table(), 0, cpp_rules);
                                                                                 }) });
 
     editor.RegisterSyntaxFactory({ ".lisp", ".lsp" }, SyntaxProvider{ "lisp", tSyntaxFactory([](ZepBuffer* pBuffer) {
-                                                                         return std::make_shared<ZepSyntax>(*pBuffer, lisp_keywords, lisp_identifiers);
+                                                                         return std::make_shared<ZepSyntax>(*pBuffer, lisp_keywords.Table(), lisp_identifiers.Table(), 0, lisp_rules);
                                                                      }) });
 
     editor.RegisterSyntaxFactory({ ".cmake", "CMakeLists.txt" }, SyntaxProvider{ "cmake", tSyntaxFactory([](ZepBuffer* pBuffer) {
-                                                                                    return std::make_shared<ZepSyntax>(*pBuffer, cmake_keywords, cmake_identifiers, ZepSyntaxFlags::CaseInsensitive);
+                                                                                    return std::make_shared<ZepSyntax>(*pBuffer, cmake_keywords.Table(), cmake_identifiers.Table(), ZepSyntaxFlags::CaseInsensitive, cmake_rules);
                                                                                 }) });
 
     editor.RegisterSyntaxFactory({ ".toml" }, SyntaxProvider{ "cpp", tSyntaxFactory([](ZepBuffer* pBuffer) {
-                                                                 return std::make_shared<ZepSyntax>(*pBuffer, toml_keywords, toml_identifiers, ZepSyntaxFlags::CaseInsensitive);
+                                                                 return std::make_shared<ZepSyntax>(*pBuffer, toml_keywords.Table(), toml_identifiers.Table(), ZepSyntaxFlags::CaseInsensitive, toml_rules);
                                                              }) });
 }
 
@@ -11,58 +11,34 @@ namespace Zep
 ZepSyntaxAdorn_RainbowBrackets::ZepSyntaxAdorn_RainbowBrackets(ZepSyntax& syntax, ZepBuffer& buffer)
     : ZepSyntaxAdorn(syntax, buffer)
 {
-    syntax.GetEditor().RegisterCallback(this);
-
+    m_brackets.Insert(0, BufferLocation(buffer.GetText().size()));
     Update(0, buffer.EndLocation());
 }
 
 ZepSyntaxAdorn_RainbowBrackets::~ZepSyntaxAdorn_RainbowBrackets() = default;
 
-void ZepSyntaxAdorn_RainbowBrackets::Notify(std::shared_ptr<ZepMessage> message) 
-{
-    // Handle any interesting buffer messages
-    if (message->messageId == Msg::Buffer)
-    {
-        auto spBufferMsg = std::static_pointer_cast<BufferMessage>(message);
-        if (spBufferMsg->pBuffer != &m_buffer)
-        {
-            return;
-        }
-        if (spBufferMsg->type == BufferMessageType::TextDeleted)
-        {
-            Clear(spBufferMsg->startLocation, spBufferMsg->endLocation);
-        }
-        else if (spBufferMsg->type == BufferMessageType::TextAdded || spBufferMsg->type == BufferMessageType::Loaded)
-        {
-            Insert(spBufferMsg->startLocation, spBufferMsg->endLocation);
-            Update(spBufferMsg->startLocation, spBufferMsg->endLocation);
-        }
-        else if (spBufferMsg->type == BufferMessageType::TextChanged)
-        {
-            Update(spBufferMsg->startLocation, spBufferMsg->endLocation);
-        }
-    }
-}
-
 auto ZepSyntaxAdorn_RainbowBrackets::GetSyntaxAt(int32_t offset, bool& found) const -> SyntaxData
 {
     SyntaxData data;
-    auto itr = m_brackets.find(offset);
-    if (itr == m_brackets.end())
+    int32_t indent;
+    bool valid;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        found = m_brackets.Find(offset, indent, valid);
+    }
+    if (!found)
     {
-        found = false;
         return data;
     }
 
-    found = true;
-    if (!itr->second.valid)
+    if (!valid)
     {
         data.foreground = ThemeColor::Text;
         data.background = ThemeColor::Error;
     }
     else
     {
-        data.foreground = (ThemeColor)(((int32_t)ThemeColor::UniqueColor0 + itr->second.indent) % (int32_t)ThemeColor::UniqueColorLast);
+        data.foreground = (ThemeColor)(((int32_t)ThemeColor::UniqueColor0 + indent) % (int32_t)ThemeColor::UniqueColorLast);
         data.background = ThemeColor::None;
     }
 
@@ -71,136 +47,59 @@ auto ZepSyntaxAdorn_RainbowBrackets::GetSyntaxAt(int32_t offset, bool& found) co
 
 void ZepSyntaxAdorn_RainbowBrackets::Insert(int32_t start, int32_t end)
 {
-    // Adjust all the brackets after us by the same distance
-    auto diff = end - start;
-    std::map<BufferLocation, Bracket> replace;
-    for (auto& b : m_brackets)
-    {
-        if (b.first < start)
-        {
-            replace[b.first] = b.second;
-        }
-        else
-        {
-            replace[b.first + diff] = b.second;
-        }
-    }
-    std::swap(m_brackets, replace);
-
-    RefreshBrackets();
+    // Just moves the brackets after it along; the lex will find any in the new text
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_brackets.Insert(start, end - start);
 }
 
 void ZepSyntaxAdorn_RainbowBrackets::Clear(int32_t start, int32_t end)
 {
-    // Remove brackets in the erased section
-    for (auto current = start; current < end; current++)
-    {
-        m_brackets.erase(BufferLocation(current));
-    }
-
-    // Adjust remaining brackets by the difference
-    auto diff = end - start;
-    std::map<BufferLocation, Bracket> replace;
-    for (auto& b : m_brackets)
-    {
-        if (b.first < start)
-        {
-            replace[b.first] = b.second;
-        }
-        else
-        {
-            replace[b.first - diff] = b.second;
-        }
-    }
-    std::swap(m_brackets, replace);
-
-    RefreshBrackets();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_brackets.Erase(start, end);
 }
 
+// Find the brackets in some text which has changed, or been lexed for the first time
 void ZepSyntaxAdorn_RainbowBrackets::Update(int32_t start, int32_t end)
 {
     auto& buffer = m_buffer.GetText();
-    auto itrStart = buffer.begin() + start;
-    auto itrEnd = buffer.begin() + end;
-
-    for (auto itrBracket = itrStart; itrBracket != itrEnd; itrBracket++)
+    end = std::min(end, BufferLocation(buffer.size()));
+    if (start >= end)
     {
-        auto offset = itrBracket - buffer.begin();
-        if (*itrBracket == '(')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{ 0, BracketType::Bracket, true };
-        }
-        else if (*itrBracket == ')')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{ 0, BracketType::Bracket, false };
-        }
-        else if (*itrBracket == '[')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{ 0, BracketType::Group, true };
-        }
-        else if (*itrBracket == ']')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{ 0, BracketType::Group, false };
-        }
-        else if (*itrBracket == '{')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{ 0, BracketType::Brace, true };
-        }
-        else if (*itrBracket == '}')
-        {
-            m_brackets[BufferLocation(offset)] = Bracket{ 0, BracketType::Brace, false };
-        }
-        else
-        {
-            auto itr = m_brackets.find(BufferLocation(offset));
-            if (itr != std::end(m_brackets))
-            {
-                m_brackets.erase(itr);
-            }
-        }
+        return;
     }
-    RefreshBrackets();
-}
 
-void ZepSyntaxAdorn_RainbowBrackets::RefreshBrackets()
-{
-    std::vector<int32_t> indents((int)BracketType::Max, 0);
-    for (auto& b : m_brackets)
+    auto text = buffer.view(buffer.begin() + start, buffer.begin() + end, m_scratch);
+    m_found.clear();
+    for (size_t i = 0; i < text.size(); i++)
     {
-        auto& bracket = b.second;
-        if (!bracket.is_open)
-        {
-            indents[int(bracket.type)]--;
-        }
-        bracket.indent = indents[int(bracket.type)];
-        // Allow one bracket error, before going back to normal
-        bracket.valid = indents[int(bracket.type)] >= 0;
-        if (!bracket.valid)
-        {
-            indents[int(bracket.type)] = 0;
-        }
-        if (bracket.is_open)
-        {
-            indents[int(bracket.type)]++;
+        auto offset = start + int32_t(i);
+        switch (text[i])
+        {
+        case '(':
+            m_found.push_back(BracketMark{ offset, uint8_t(BracketType::Bracket), true });
+            break;
+        case ')':
+            m_found.push_back(BracketMark{ offset, uint8_t(BracketType::Bracket), false });
+            break;
+        case '[':
+            m_found.push_back(BracketMark{ offset, uint8_t(BracketType::Group), true });
+            break;
+        case ']':
+            m_found.push_back(BracketMark{ offset, uint8_t(BracketType::Group), false });
+            break;
+        case '{':
+            m_found.push_back(BracketMark{ offset, uint8_t(BracketType::Brace), true });
+            break;
+        case '}':
+            m_found.push_back(BracketMark{ offset, uint8_t(BracketType::Brace), false });
+            break;
+        default:
+            break;
         }
     }
 
-    auto MarkTails = [&](auto type) {
-        if (indents[int(type)] > 0)
-        {
-            for (auto& b : m_brackets)
-            {
-                if (b.second.type == type)
-                {
-                    b.second.valid = false;
-                    return;
-                }
-            }
-        }
-    };
-    MarkTails(BracketType::Brace);
-    MarkTails(BracketType::Bracket);
-    MarkTails(BracketType::Group);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_brackets.Assign(start, end, m_found);
 }
 
 } // namespace Zep
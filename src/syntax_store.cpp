@@ -0,0 +1,520 @@
+#include <algorithm>
+#include <cassert>
+
+#include "zep/syntax_store.hpp"
+
+namespace Zep
+{
+
+namespace
+{
+// Blocks are built with this many runs, split when they grow past twice it, and joined to a neighbour below a quarter of it
+const size_t BlockRuns = 256;
+const size_t MaxBlockRuns = BlockRuns * 2;
+const size_t MinBlockRuns = BlockRuns / 4;
+
+// The first run which ends after the offset
+auto FindRun(const SyntaxRuns& runs, int32_t offset) -> size_t
+{
+    return size_t(std::upper_bound(runs.begin(), runs.end(), offset, [](int32_t value, const SyntaxRun& run) {
+        return value < run.end;
+    }) - runs.begin());
+}
+
+auto RunStart(const SyntaxRuns& runs, size_t run) -> int32_t
+{
+    return run > 0 ? runs[run - 1].end : 0;
+}
+
+auto RunsLength(const SyntaxRuns& runs) -> int32_t
+{
+    return runs.empty() ? 0 : runs.back().end;
+}
+
+// Join any runs of the same colors, between the first and last given
+void JoinRuns(SyntaxRuns& runs, size_t first, size_t last)
+{
+    if (runs.empty())
+    {
+        return;
+    }
+
+    for (auto run = std::min(last, runs.size() - 1); run > first; run--)
+    {
+        if (runs[run - 1].data == runs[run].data)
+        {
+            runs.erase(runs.begin() + (run - 1));
+        }
+    }
+}
+
+// Cuts runs into new blocks, joining runs of the same colors
+class BlockBuilder
+{
+public:
+    explicit BlockBuilder(size_t blockRuns = BlockRuns)
+        : m_blockRuns(blockRuns)
+    {
+    }
+
+    void Append(int32_t length, const SyntaxData& data)
+    {
+        if (length <= 0)
+        {
+            return;
+        }
+
+        if (!m_current.empty() && m_current.back().data == data)
+        {
+            m_current.back().end += length;
+            return;
+        }
+
+        if (m_current.size() == m_blockRuns)
+        {
+            Flush();
+        }
+        m_current.push_back(SyntaxRun{ RunsLength(m_current) + length, data });
+    }
+
+    // The part of a run list from start to end
+    void Append(const SyntaxRuns& runs, int32_t start, int32_t end)
+    {
+        for (auto run = FindRun(runs, start); run < runs.size() && RunStart(runs, run) < end; run++)
+        {
+            Append(std::min(end, runs[run].end) - std::max(start, RunStart(runs, run)), runs[run].data);
+        }
+    }
+
+    auto Finish() -> std::vector<SyntaxRuns>
+    {
+        if (!m_current.empty())
+        {
+            Flush();
+        }
+        return std::move(m_blocks);
+    }
+
+private:
+    void Flush()
+    {
+        m_blocks.push_back(std::move(m_current));
+        m_current = SyntaxRuns();
+        m_current.reserve(m_blockRuns);
+    }
+
+    size_t m_blockRuns;
+    std::vector<SyntaxRuns> m_blocks;
+    SyntaxRuns m_current;
+};
+
+} // namespace
+
+void MarkSyntaxRuns(SyntaxRuns& runs, int32_t start, int32_t end, const SyntaxData& data)
+{
+    if (start >= end)
+    {
+        return;
+    }
+
+    auto append = [&](int32_t runEnd, const SyntaxData& runData) {
+        if (!runs.empty() && runs.back().data == runData)
+        {
+            runs.back().end = runEnd;
+        }
+        else
+        {
+            runs.push_back(SyntaxRun{ runEnd, runData });
+        }
+    };
+
+    auto length = RunsLength(runs);
+    if (start >= length)
+    {
+        if (start > length)
+        {
+            append(start, SyntaxData{});
+        }
+        append(end, data);
+        return;
+    }
+
+    // Over the top of earlier runs; keep the part of the one it starts in that comes before it
+    auto first = FindRun(runs, start);
+    if (RunStart(runs, first) < start)
+    {
+        runs.insert(runs.begin() + first, SyntaxRun{ start, runs[first].data });
+        first++;
+    }
+
+    // The run it finishes in keeps its end, so it loses just the part underneath
+    runs.erase(runs.begin() + first, runs.begin() + FindRun(runs, end));
+    runs.insert(runs.begin() + first, SyntaxRun{ end, data });
+    JoinRuns(runs, first > 0 ? first - 1 : 0, first + 1);
+}
+
+void AppendSyntaxRuns(SyntaxRuns& runs, int32_t start, const SyntaxRuns& more, int32_t end)
+{
+    auto runStart = start;
+    for (auto& run : more)
+    {
+        MarkSyntaxRuns(runs, runStart, start + run.end, run.data);
+        runStart = std::max(runStart, start + run.end);
+    }
+    MarkSyntaxRuns(runs, runStart, end, SyntaxData{});
+}
+
+auto SyntaxSnapshot::Get(int32_t offset) const -> SyntaxData
+{
+    auto itr = std::upper_bound(m_blockEnds.begin(), m_blockEnds.end(), offset);
+    if (offset < 0 || itr == m_blockEnds.end())
+    {
+        return SyntaxData{};
+    }
+
+    auto block = size_t(itr - m_blockEnds.begin());
+    auto& runs = *m_blocks[block];
+    return runs[FindRun(runs, offset - (block > 0 ? m_blockEnds[block - 1] : 0))].data;
+}
+
+void SyntaxStore::Resize(int32_t newSize)
+{
+    auto oldSize = size();
+    if (newSize > oldSize)
+    {
+        Insert(oldSize, newSize - oldSize);
+    }
+    else if (newSize < oldSize)
+    {
+        Erase(newSize, oldSize);
+    }
+}
+
+void SyntaxStore::Insert(int32_t offset, int32_t count)
+{
+    assert(offset >= 0 && offset <= size());
+    if (count > 0)
+    {
+        Replace(offset, offset, SyntaxRuns{}, count);
+    }
+}
+
+void SyntaxStore::Erase(int32_t start, int32_t end)
+{
+    end = std::min(end, size());
+    if (start < end)
+    {
+        Replace(start, end, SyntaxRuns{}, 0);
+    }
+}
+
+void SyntaxStore::Fill(int32_t start, int32_t end, const SyntaxData& data)
+{
+    end = std::min(end, size());
+    if (start < end)
+    {
+        Replace(start, end, SyntaxRuns{ SyntaxRun{ end - start, data } }, end - start);
+    }
+}
+
+void SyntaxStore::Assign(int32_t start, int32_t end, const SyntaxRuns& runs)
+{
+    end = std::min(end, size());
+    if (start < end)
+    {
+        Replace(start, end, runs, end - start);
+    }
+}
+
+auto SyntaxStore::Get(int32_t offset) const -> SyntaxData
+{
+    auto block = FindBlock(offset);
+    if (offset < 0 || block >= m_blocks.size())
+    {
+        return SyntaxData{};
+    }
+
+    auto& runs = *m_blocks[block];
+    return runs[FindRun(runs, offset - BlockStart(block))].data;
+}
+
+auto SyntaxStore::Publish() -> std::shared_ptr<const SyntaxSnapshot>
+{
+    auto spSnapshot = std::make_shared<SyntaxSnapshot>();
+    spSnapshot->m_blocks.assign(m_blocks.begin(), m_blocks.end());
+    spSnapshot->m_blockEnds = m_blockEnds;
+    spSnapshot->m_version = ++m_version;
+
+    // Everything is shared now
+    std::fill(m_published.begin(), m_published.end(), uint8_t(1));
+    return spSnapshot;
+}
+
+auto SyntaxStore::RunCount() const -> size_t
+{
+    size_t count = 0;
+    for (auto& spBlock : m_blocks)
+    {
+        count += spBlock->size();
+    }
+    return count;
+}
+
+// Everything comes through here: the text from start to end becomes length characters, colored by the runs and then the default
+void SyntaxStore::Replace(int32_t start, int32_t end, const SyntaxRuns& runs, int32_t length)
+{
+    assert(start >= 0 && start <= end && end <= size());
+    assert(RunsLength(runs) <= length);
+
+    if (m_blocks.empty())
+    {
+        BlockBuilder builder;
+        builder.Append(runs, 0, length);
+        builder.Append(length - RunsLength(runs), SyntaxData{});
+        ReplaceBlocks(0, 0, builder.Finish());
+        return;
+    }
+
+    // The common case, when an edit lexes lines which haven't changed; and the blocks stay shared with the snapshots
+    if (end - start == length && Matches(start, runs, length))
+    {
+        return;
+    }
+
+    // Text added at the very end goes in the last block
+    auto first = std::min(FindBlock(start), m_blocks.size() - 1);
+    auto last = end > start ? FindBlock(end - 1) : first;
+    if (first == last)
+    {
+        ReplaceInBlock(first, start - BlockStart(first), end - BlockStart(first), runs, length);
+        return;
+    }
+
+    // Across blocks, so build new ones for all it touches
+    auto firstStart = BlockStart(first);
+    auto lastStart = BlockStart(last);
+    BlockBuilder builder;
+    builder.Append(*m_blocks[first], 0, start - firstStart);
+    builder.Append(runs, 0, length);
+    builder.Append(length - RunsLength(runs), SyntaxData{});
+    builder.Append(*m_blocks[last], end - lastStart, RunsLength(*m_blocks[last]));
+
+    auto blocks = builder.Finish();
+    auto count = blocks.size();
+    ReplaceBlocks(first, last + 1, std::move(blocks));
+
+    // The new blocks at either end may be small enough to join their neighbours
+    if (count > 1)
+    {
+        Rebalance(first + count - 1);
+    }
+    if (!m_blocks.empty())
+    {
+        Rebalance(std::min(first, m_blocks.size() - 1));
+    }
+}
+
+// True if the text from start, for the length, already has these colors
+auto SyntaxStore::Matches(int32_t start, const SyntaxRuns& runs, int32_t length) const -> bool
+{
+    // Walk along the runs in the store, checking each part of the new ones
+    auto block = FindBlock(start);
+    auto run = block < m_blocks.size() ? FindRun(*m_blocks[block], start - BlockStart(block)) : 0;
+    auto check = [&](int32_t from, int32_t to, const SyntaxData& data) {
+        while (from < to)
+        {
+            if (block >= m_blocks.size())
+            {
+                return false;
+            }
+
+            auto& blockRuns = *m_blocks[block];
+            if (run >= blockRuns.size())
+            {
+                block++;
+                run = 0;
+                continue;
+            }
+
+            auto runEnd = BlockStart(block) + blockRuns[run].end;
+            if (runEnd <= from)
+            {
+                run++;
+                continue;
+            }
+
+            if (blockRuns[run].data != data)
+            {
+                return false;
+            }
+            from = runEnd;
+        }
+        return true;
+    };
+
+    int32_t runStart = 0;
+    for (auto& newRun : runs)
+    {
+        if (!check(start + runStart, start + newRun.end, newRun.data))
+        {
+            return false;
+        }
+        runStart = std::max(runStart, newRun.end);
+    }
+    return check(start + runStart, start + length, SyntaxData{});
+}
+
+void SyntaxStore::ReplaceInBlock(size_t block, int32_t start, int32_t end, const SyntaxRuns& runs, int32_t length)
+{
+    auto& data = WritableBlock(block);
+    auto first = FindRun(data, start);
+    auto last = FindRun(data, end);
+
+    // Keep the part of the first run before the start.  The run holding the end keeps its end, so it loses just the part replaced
+    SyntaxRun head{ start, first < data.size() ? data[first].data : SyntaxData{} };
+    auto hasHead = first < data.size() && RunStart(data, first) < start;
+
+    size_t count = hasHead ? 1 : 0;
+    int32_t runStart = 0;
+    for (auto& run : runs)
+    {
+        count += run.end > runStart ? 1 : 0;
+        runStart = run.end;
+    }
+    count += length > runStart ? 1 : 0;
+
+    data.erase(data.begin() + first, data.begin() + last);
+    data.insert(data.begin() + first, count, SyntaxRun{});
+
+    auto itr = data.begin() + first;
+    if (hasHead)
+    {
+        *itr++ = head;
+    }
+    runStart = 0;
+    for (auto& run : runs)
+    {
+        if (run.end > runStart)
+        {
+            *itr++ = SyntaxRun{ start + run.end, run.data };
+        }
+        runStart = run.end;
+    }
+    if (length > runStart)
+    {
+        *itr++ = SyntaxRun{ start + length, SyntaxData{} };
+    }
+
+    auto delta = length - (end - start);
+    for (; itr != data.end(); itr++)
+    {
+        itr->end += delta;
+    }
+
+    JoinRuns(data, first > 0 ? first - 1 : 0, first + count);
+    ShiftEnds(block, delta);
+    Rebalance(block);
+}
+
+// Keep blocks to a sensible number of runs.  Empty ones go, big ones are split evenly, and small ones join a neighbour
+// if they fit in one block together
+void SyntaxStore::Rebalance(size_t block)
+{
+    auto& runs = *m_blocks[block];
+    if (runs.empty())
+    {
+        ReplaceBlocks(block, block + 1, {});
+        return;
+    }
+
+    if (runs.size() > MaxBlockRuns)
+    {
+        auto pieces = (runs.size() + BlockRuns - 1) / BlockRuns;
+        BlockBuilder builder((runs.size() + pieces - 1) / pieces);
+        builder.Append(runs, 0, RunsLength(runs));
+        ReplaceBlocks(block, block + 1, builder.Finish());
+        return;
+    }
+
+    if (runs.size() >= MinBlockRuns)
+    {
+        return;
+    }
+
+    auto joinable = [&](size_t first) {
+        return first + 1 < m_blocks.size() && m_blocks[first]->size() + m_blocks[first + 1]->size() <= BlockRuns;
+    };
+
+    auto first = joinable(block) ? block : (block > 0 && joinable(block - 1) ? block - 1 : m_blocks.size());
+    if (first == m_blocks.size())
+    {
+        return;
+    }
+
+    BlockBuilder builder;
+    builder.Append(*m_blocks[first], 0, RunsLength(*m_blocks[first]));
+    builder.Append(*m_blocks[first + 1], 0, RunsLength(*m_blocks[first + 1]));
+    ReplaceBlocks(first, first + 2, builder.Finish());
+}
+
+// The first block which ends after the offset
+auto SyntaxStore::FindBlock(int32_t offset) const -> size_t
+{
+    return size_t(std::upper_bound(m_blockEnds.begin(), m_blockEnds.end(), offset) - m_blockEnds.begin());
+}
+
+auto SyntaxStore::BlockStart(size_t block) const -> int32_t
+{
+    return block > 0 ? m_blockEnds[block - 1] : 0;
+}
+
+auto SyntaxStore::WritableBlock(size_t block) -> SyntaxRuns&
+{
+    if (m_published[block] != 0)
+    {
+        m_blocks[block] = std::make_shared<SyntaxRuns>(*m_blocks[block]);
+        m_published[block] = 0;
+    }
+    return *m_blocks[block];
+}
+
+void SyntaxStore::ReplaceBlocks(size_t first, size_t last, std::vector<SyntaxRuns>&& blocks)
+{
+    auto start = BlockStart(first);
+    auto oldEnd = last > first ? m_blockEnds[last - 1] : start;
+
+    std::vector<std::shared_ptr<SyntaxRuns>> newBlocks;
+    std::vector<int32_t> newEnds;
+    newBlocks.reserve(blocks.size());
+    newEnds.reserve(blocks.size());
+    for (auto& block : blocks)
+    {
+        start += RunsLength(block);
+        newEnds.push_back(start);
+        newBlocks.push_back(std::make_shared<SyntaxRuns>(std::move(block)));
+    }
+
+    m_blocks.erase(m_blocks.begin() + first, m_blocks.begin() + last);
+    m_blocks.insert(m_blocks.begin() + first, newBlocks.begin(), newBlocks.end());
+    m_published.erase(m_published.begin() + first, m_published.begin() + last);
+    m_published.insert(m_published.begin() + first, newBlocks.size(), uint8_t(0));
+    m_blockEnds.erase(m_blockEnds.begin() + first, m_blockEnds.begin() + last);
+    m_blockEnds.insert(m_blockEnds.begin() + first, newEnds.begin(), newEnds.end());
+    ShiftEnds(first + newBlocks.size(), start - oldEnd);
+}
+
+// The blocks from here on start later or earlier; splits and joins don't move anything, so cost nothing
+void SyntaxStore::ShiftEnds(size_t first, int32_t delta)
+{
+    if (delta == 0)
+    {
+        return;
+    }
+
+    for (auto block = first; block < m_blockEnds.size(); block++)
+    {
+        m_blockEnds[block] += delta;
+    }
+}
+
+} // namespace Zep
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "longtext.tt"
+
+// Source code with tabs in it, repeated up to a big file
+inline auto MakeBenchText(size_t size) -> std::string
+{
+    std::string text;
+    text.reserve(size + longTextSample.size());
+    while (text.size() < size)
+    {
+        text += longTextSample;
+    }
+    return text;
+}
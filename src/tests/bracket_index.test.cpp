@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "zep/bracket_index.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+struct ReferenceBracket
+{
+    int32_t offset;
+    uint8_t kind;
+    bool open;
+    int32_t depth = 0;
+    bool valid = true;
+};
+
+// Walk every bracket from the start, as the rainbow brackets used to on every edit
+void ReferenceDepths(std::vector<ReferenceBracket>& brackets)
+{
+    std::vector<int32_t> depths(BracketIndex::MaxKinds, 0);
+    for (auto& bracket : brackets)
+    {
+        auto& depth = depths[bracket.kind];
+        if (!bracket.open)
+        {
+            depth--;
+        }
+        bracket.depth = depth;
+        bracket.valid = depth >= 0;
+        if (!bracket.valid)
+        {
+            depth = 0;
+        }
+        if (bracket.open)
+        {
+            depth++;
+        }
+    }
+
+    for (uint8_t kind = 0; kind < BracketIndex::MaxKinds; kind++)
+    {
+        if (depths[kind] > 0)
+        {
+            auto itr = std::find_if(brackets.begin(), brackets.end(), [&](const ReferenceBracket& bracket) { return bracket.kind == kind; });
+            itr->valid = false;
+        }
+    }
+}
+
+void CheckDepths(const BracketIndex& index, std::vector<ReferenceBracket> brackets)
+{
+    ReferenceDepths(brackets);
+    ASSERT_EQ(index.size(), brackets.size());
+    for (auto& bracket : brackets)
+    {
+        int32_t depth;
+        bool valid;
+        ASSERT_TRUE(index.Find(bracket.offset, depth, valid)) << bracket.offset;
+        ASSERT_EQ(valid, bracket.valid) << bracket.offset;
+        if (valid)
+        {
+            ASSERT_EQ(depth, bracket.depth) << bracket.offset;
+        }
+    }
+}
+
+} // namespace
+
+TEST(BracketIndex, Nesting)
+{
+    // ( [ ) ] ( ( ) }
+    BracketIndex index;
+    index.Insert(0, 20);
+    index.Assign(0, 20, { { 0, 0, true }, { 2, 1, true }, { 4, 0, false }, { 6, 1, false }, { 8, 0, true }, { 10, 0, true }, { 12, 0, false }, { 14, 2, false } });
+
+    int32_t depth;
+    bool valid;
+    ASSERT_FALSE(index.Find(1, depth, valid));
+    ASSERT_TRUE(index.Find(12, depth, valid));
+    ASSERT_EQ(depth, 1);
+    ASSERT_TRUE(valid);
+
+    // A close with nothing open
+    ASSERT_TRUE(index.Find(14, depth, valid));
+    ASSERT_FALSE(valid);
+
+    // The ( at 8 is never closed, so the first ( is marked
+    ASSERT_TRUE(index.Find(0, depth, valid));
+    ASSERT_FALSE(valid);
+
+    // Closing it fixes that; and the brackets after the edit move
+    index.Insert(13, 3);
+    index.Assign(13, 14, { { 13, 0, false } });
+    ASSERT_TRUE(index.Find(0, depth, valid));
+    ASSERT_TRUE(valid);
+    ASSERT_TRUE(index.Find(17, depth, valid));
+    ASSERT_FALSE(valid);
+
+    index.Erase(0, 5);
+    ASSERT_EQ(index.size(), 6u);
+    ASSERT_TRUE(index.Find(3, depth, valid));
+    ASSERT_EQ(depth, 0);
+}
+
+TEST(BracketIndex, RandomEdits)
+{
+    // Enough brackets for plenty of chunks
+    std::mt19937 gen(1);
+    auto randomBrackets = [&](int32_t start, int32_t end) {
+        std::vector<BracketMark> brackets;
+        for (auto offset = start; offset < end; offset++)
+        {
+            if (gen() % 3 == 0)
+            {
+                brackets.push_back(BracketMark{ offset, uint8_t(gen() % BracketIndex::MaxKinds), gen() % 2 == 0 });
+            }
+        }
+        return brackets;
+    };
+
+    int32_t textSize = 20000;
+    std::vector<ReferenceBracket> reference;
+    BracketIndex index;
+    index.Insert(0, textSize);
+    auto assign = [&](int32_t start, int32_t end) {
+        auto brackets = randomBrackets(start, end);
+        index.Assign(start, end, brackets);
+        reference.erase(std::remove_if(reference.begin(), reference.end(), [&](const ReferenceBracket& bracket) { return bracket.offset >= start && bracket.offset < end; }), reference.end());
+        for (auto& bracket : brackets)
+        {
+            reference.push_back(ReferenceBracket{ bracket.offset, bracket.kind, bracket.open });
+        }
+        std::sort(reference.begin(), reference.end(), [](const ReferenceBracket& lhs, const ReferenceBracket& rhs) { return lhs.offset < rhs.offset; });
+    };
+    assign(0, textSize);
+
+    for (int i = 0; i < 2000; i++)
+    {
+        auto start = int32_t(gen() % textSize);
+        auto length = int32_t(1 + gen() % (i % 100 == 0 ? 5000 : 50));
+        switch (gen() % 3)
+        {
+        case 0:
+            index.Insert(start, length);
+            for (auto& bracket : reference)
+            {
+                bracket.offset += bracket.offset >= start ? length : 0;
+            }
+            textSize += length;
+            assign(start, start + length);
+            break;
+        case 1:
+        {
+            // Big removals are small ones, so the text doesn't run out
+            auto end = std::min(start + 1 + length % 100, textSize);
+            index.Erase(start, end);
+            reference.erase(std::remove_if(reference.begin(), reference.end(), [&](const ReferenceBracket& bracket) { return bracket.offset >= start && bracket.offset < end; }), reference.end());
+            for (auto& bracket : reference)
+            {
+                bracket.offset -= bracket.offset >= end ? end - start : 0;
+            }
+            textSize -= end - start;
+            break;
+        }
+        default:
+            assign(start, std::min(start + length, textSize));
+            break;
+        }
+
+        auto brackets = index.ToVector();
+        ASSERT_EQ(brackets.size(), reference.size());
+        for (size_t b = 0; b < brackets.size(); b++)
+        {
+            ASSERT_EQ(brackets[b].offset, reference[b].offset);
+        }
+        if (i % 100 == 0)
+        {
+            CheckDepths(index, reference);
+        }
+    }
+    CheckDepths(index, reference);
+}
@@ -1,9 +1,327 @@
 #include <gtest/gtest.h>
 
+#include <cstdio>
+#include <filesystem>
+
 #include "zep/buffer.hpp"
+#include "zep/display.hpp"
+#include "zep/editor.hpp"
+#include "zep/filesystem.hpp"
+
+#include "zep/mcommon/animation/timer.hpp"
+#include "zep/mcommon/file/cpptoml.hpp"
+#include "zep/mcommon/string/stringutils.hpp"
 
 using namespace Zep;
 
 // TODO The buffer tests were depricated, need to replace?
 // They are covered pretty well by the mode tests
 
+// A file in the temp directory, removed again however the test ends
+struct TempFile
+{
+    explicit TempFile(const std::string& name)
+        : path(ZepPath(std::filesystem::temp_directory_path().string()) / name)
+    {
+    }
+
+    ~TempFile()
+    {
+        std::remove(path.string().c_str());
+    }
+
+    ZepPath path;
+};
+
+class BufferLoadTest : public testing::Test
+{
+public:
+    BufferLoadTest()
+    {
+        spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+
+        // Treat every file as a big one
+        auto spEditorConfig = cpptoml::make_table();
+        spEditorConfig->insert("piece_table_file_size", int64_t(1));
+        auto spConfig = cpptoml::make_table();
+        spConfig->insert("editor", spEditorConfig);
+        spEditor->LoadConfig(spConfig);
+
+    }
+
+    auto Load(const std::string& text) -> ZepBuffer*
+    {
+        spEditor->GetFileSystem().Write(path, text.c_str(), text.size());
+        return spEditor->GetFileBuffer(path);
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+    TempFile file{ "zep_buffer_load.test.txt" };
+    ZepPath& path = file.path;
+};
+
+TEST_F(BufferLoadTest, LoadBigFile)
+{
+    auto pBuffer = Load("Hello\nWorld\n");
+    ASSERT_EQ(pBuffer->GetStorageType(), TextStorageType::PieceTable);
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("Hello\nWorld\n") + '\0');
+    ASSERT_EQ(pBuffer->GetLineCount(), 3);
+
+    // Edits go on top of the file
+    pBuffer->Insert(5, ",");
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("Hello,\nWorld\n") + '\0');
+}
+
+TEST_F(BufferLoadTest, LoadBigFileWithTabs)
+{
+    auto pBuffer = Load("a\tb\r\nc");
+    ASSERT_EQ(pBuffer->GetStorageType(), TextStorageType::PieceTable);
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("a    b\nc") + '\0');
+    ASSERT_TRUE(pBuffer->TestFlags(FileFlags::StrippedCR));
+}
+
+TEST_F(BufferLoadTest, SaveCRLF)
+{
+    // Bigger than a save block, with edits in the middle, so the text comes out in several pieces
+    std::string text;
+    for (int line = 0; text.size() < 1024 * 1024; line++)
+    {
+        text += "line " + std::to_string(line) + "\r\n";
+    }
+
+    auto pBuffer = Load(text);
+    ASSERT_TRUE(pBuffer->TestFlags(FileFlags::StrippedCR));
+    pBuffer->Insert(10, "A\nB");
+    pBuffer->Insert(BufferLocation(pBuffer->GetText().size() / 2), "C");
+    auto expected = pBuffer->GetText().string();
+    expected.pop_back();
+    string_replace_in_place(expected, "\n", "\r\n");
+
+    int64_t size;
+    ASSERT_TRUE(pBuffer->Save(size));
+    ASSERT_EQ(size, int64_t(expected.size()));
+    ASSERT_FALSE(pBuffer->TestFlags(FileFlags::Dirty));
+    ASSERT_EQ(spEditor->GetFileSystem().Read(path), expected);
+}
+
+// A file system whose mapped files can't be replaced while they are mapped, like Windows
+class LockingFileSystem : public ZepFileSystemCPP
+{
+public:
+    class LockingMappedFile : public IZepMappedFile
+    {
+    public:
+        explicit LockingMappedFile(std::shared_ptr<IZepMappedFile> spFile)
+            : m_spFile(std::move(spFile))
+        {
+        }
+        auto Data() const -> const uint8_t* override
+        {
+            return m_spFile->Data();
+        }
+        auto Size() const -> size_t override
+        {
+            return m_spFile->Size();
+        }
+        auto LocksFile() const -> bool override
+        {
+            return true;
+        }
+
+    private:
+        std::shared_ptr<IZepMappedFile> m_spFile;
+    };
+
+    auto Map(const ZepPath& filePath, size_t minSize) -> std::shared_ptr<IZepMappedFile> override
+    {
+        auto spFile = ZepFileSystemCPP::Map(filePath, minSize);
+        if (!spFile)
+        {
+            return nullptr;
+        }
+        auto spLocking = std::make_shared<LockingMappedFile>(spFile);
+        wpMapped = spLocking;
+        mappings++;
+        return spLocking;
+    }
+
+    std::weak_ptr<IZepMappedFile> wpMapped;
+    int mappings = 0;
+};
+
+// The mapping is let go before the file is replaced, so the save can succeed
+TEST_F(BufferLoadTest, SaveLockedMapping)
+{
+    auto pFileSystem = new LockingFileSystem();
+    auto spLockingEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads, pFileSystem);
+    auto spEditorConfig = cpptoml::make_table();
+    spEditorConfig->insert("piece_table_file_size", int64_t(1));
+    auto spConfig = cpptoml::make_table();
+    spConfig->insert("editor", spEditorConfig);
+    spLockingEditor->LoadConfig(spConfig);
+
+    std::string text = "Hello\nWorld\n";
+    spLockingEditor->GetFileSystem().Write(path, text.c_str(), text.size());
+    auto pBuffer = spLockingEditor->GetFileBuffer(path);
+    ASSERT_FALSE(pFileSystem->wpMapped.expired());
+
+    pBuffer->Insert(5, ",");
+    int64_t size;
+    ASSERT_TRUE(pBuffer->Save(size));
+    ASSERT_TRUE(pFileSystem->wpMapped.expired());
+    ASSERT_EQ(spLockingEditor->GetFileSystem().Read(path), "Hello,\nWorld\n");
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("Hello,\nWorld\n") + '\0');
+}
+
+// A file system which can't write a file aside, so saves rewrite it where it is
+class InPlaceFileSystem : public ZepFileSystemCPP
+{
+public:
+    auto Map(const ZepPath& filePath, size_t minSize) -> std::shared_ptr<IZepMappedFile> override
+    {
+        auto spFile = ZepFileSystemCPP::Map(filePath, minSize);
+        wpMapped = spFile;
+        return spFile;
+    }
+
+    auto OpenWriter(const ZepPath&) -> std::shared_ptr<IZepFileWriter> override
+    {
+        return nullptr;
+    }
+
+    std::weak_ptr<IZepMappedFile> wpMapped;
+};
+
+// The file is rewritten under the mapping, so the text in it has to be copied out before the save
+TEST_F(BufferLoadTest, SaveInPlaceMapping)
+{
+    auto pFileSystem = new InPlaceFileSystem();
+    auto spInPlaceEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads, pFileSystem);
+    auto spEditorConfig = cpptoml::make_table();
+    spEditorConfig->insert("piece_table_file_size", int64_t(1));
+    auto spConfig = cpptoml::make_table();
+    spConfig->insert("editor", spEditorConfig);
+    spInPlaceEditor->LoadConfig(spConfig);
+
+    std::string text = "Hello\nWorld\n";
+    spInPlaceEditor->GetFileSystem().Write(path, text.c_str(), text.size());
+    auto pBuffer = spInPlaceEditor->GetFileBuffer(path);
+    ASSERT_FALSE(pFileSystem->wpMapped.expired());
+
+    // Moves all the unedited text along in the file
+    pBuffer->Insert(0, "Oh, ");
+    int64_t size;
+    ASSERT_TRUE(pBuffer->Save(size));
+    ASSERT_TRUE(pFileSystem->wpMapped.expired());
+    ASSERT_EQ(spInPlaceEditor->GetFileSystem().Read(path), "Oh, Hello\nWorld\n");
+    ASSERT_EQ(pBuffer->GetText().string(), std::string("Oh, Hello\nWorld\n") + '\0');
+}
+
+// Files too small for a piece table are just read
+TEST_F(BufferLoadTest, SmallFileNotMapped)
+{
+    auto pFileSystem = new LockingFileSystem();
+    auto spReadEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads, pFileSystem);
+
+    std::string text = "Hello\nWorld\n";
+    spReadEditor->GetFileSystem().Write(path, text.c_str(), text.size());
+    auto pBuffer = spReadEditor->GetFileBuffer(path);
+    ASSERT_EQ(pFileSystem->mappings, 0);
+    ASSERT_EQ(pBuffer->GetStorageType(), TextStorageType::GapBuffer);
+    ASSERT_EQ(pBuffer->GetText().string(), text + '\0');
+}
+
+TEST(BufferLoad, ChunkedSetText)
+{
+    // Big enough to be split up over the thread pool; the tabs and CRs will land on the chunk boundaries
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT);
+    auto pBuffer = spEditor->GetEmptyBuffer("chunks.txt");
+
+    std::string text;
+    std::string expected;
+    std::vector<int32_t> lineEnds;
+    for (int line = 0; text.size() < 10 * 1024 * 1024; line++)
+    {
+        std::string indent(line % 3, '\t');
+        std::string body = "line " + std::to_string(line);
+        text += indent + body + "\r\n";
+        expected += std::string(indent.size() * 4, ' ') + body + "\n";
+        lineEnds.push_back(int32_t(expected.size()));
+    }
+    lineEnds.push_back(int32_t(expected.size() + 1));
+
+    pBuffer->SetText(text);
+    ASSERT_EQ(pBuffer->GetText().string(), expected + '\0');
+    ASSERT_EQ(pBuffer->GetLineEnds().ToVector(), lineEnds);
+    ASSERT_TRUE(pBuffer->TestFlags(FileFlags::StrippedCR));
+}
+
+// With real worker threads the syntax is still lexing the old text when new text arrives, and can tie up the pool while it waits
+// for the change to finish; the new text still has to get made
+TEST(BufferLoad, ThreadedSetText)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::WorkerThreads);
+    auto pBuffer = spEditor->GetEmptyBuffer("threads.cpp");
+    ASSERT_NE(pBuffer->GetSyntax(), nullptr);
+
+    std::string text;
+    std::string expected;
+    for (int line = 0; text.size() < 10 * 1024 * 1024; line++)
+    {
+        text += "\tint x" + std::to_string(line) + " = 0; /* a\r\n */\r\n";
+        expected += "    int x" + std::to_string(line) + " = 0; /* a\n */\n";
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        pBuffer->SetText(text);
+        ASSERT_EQ(pBuffer->GetText().size(), expected.size() + 1);
+    }
+    ASSERT_EQ(pBuffer->GetText().string(), expected + '\0');
+}
+
+TEST(BufferLoad, StreamBigFile)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT);
+
+    // Stream everything
+    auto spEditorConfig = cpptoml::make_table();
+    spEditorConfig->insert("stream_file_size", int64_t(1));
+    auto spConfig = cpptoml::make_table();
+    spConfig->insert("editor", spEditorConfig);
+    spEditor->LoadConfig(spConfig);
+
+    // Tabs, so it can't just be mapped; and big enough that the worker fills the queue of blocks, and has to be started again
+    std::string text;
+    std::string expected;
+    for (int line = 0; text.size() < 30 * 1024 * 1024; line++)
+    {
+        text += "\tline " + std::to_string(line) + "\n";
+        expected += "    line " + std::to_string(line) + "\n";
+    }
+
+    TempFile file("zep_buffer_stream.test.txt");
+    auto& path = file.path;
+    spEditor->GetFileSystem().Write(path, text.c_str(), text.size());
+
+    // The start of the file is there straight away, and the rest arrives on the editor tick
+    auto pBuffer = spEditor->GetFileBuffer(path);
+    ASSERT_TRUE(pBuffer->TestFlags(FileFlags::Loading));
+    ASSERT_LT(pBuffer->GetLoadProgress(), 1.0F);
+    ASSERT_GT(pBuffer->GetText().size(), 1);
+
+    int64_t size;
+    ASSERT_FALSE(pBuffer->Save(size));
+
+    auto startTime = timer_get_time_now();
+    while (pBuffer->TestFlags(FileFlags::Loading) && timer_to_seconds(timer_get_time_now() - startTime) < 20.0)
+    {
+        spEditor->RefreshRequired();
+    }
+
+    ASSERT_FALSE(pBuffer->TestFlags(FileFlags::Loading));
+    ASSERT_FALSE(pBuffer->TestFlags(FileFlags::Dirty));
+    ASSERT_EQ(pBuffer->GetText().string(), expected + '\0');
+    ASSERT_EQ(pBuffer->GetLineCount(), int32_t(std::count(expected.begin(), expected.end(), '\n') + 1));
+}
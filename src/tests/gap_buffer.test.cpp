@@ -129,3 +129,84 @@ TEST(GapBuffer, Manipulations)
     out = buffer.string(true);
     ASSERT_TRUE(out == "coHelloA really long string|4|01");
 }
+
+TEST(GapBuffer, Segments)
+{
+    GapBuffer<char> buffer(0, 4);
+    std::string foo("HelloWorld");
+    buffer.assign(foo.begin(), foo.end());
+    std::string space(" ");
+    buffer.insert(buffer.begin() + 5, space.begin(), space.end());
+
+    // Either side of the gap
+    std::vector<std::string> segments;
+    buffer.ForEachSegment(0, buffer.size(), [&](const char* pBegin, const char* pEnd) {
+        segments.emplace_back(pBegin, pEnd);
+        return true;
+    });
+    ASSERT_EQ(segments, (std::vector<std::string>{ "Hello ", "World" }));
+
+    // Part of a run, and stopping early
+    segments.clear();
+    buffer.ForEachSegment(2, 8, [&](const char* pBegin, const char* pEnd) {
+        segments.emplace_back(pBegin, pEnd);
+        return false;
+    });
+    ASSERT_EQ(segments, (std::vector<std::string>{ "llo " }));
+}
+
+TEST(GapBuffer, GeometricGrowth)
+{
+    // Lots of pastes onto the end shouldn't mean lots of reallocations
+    GapBuffer<char> buffer(0, 16);
+    std::string block(100, 'x');
+    std::string expected;
+    for (int i = 0; i < 1000; i++)
+    {
+        block[0] = char('a' + i % 26);
+        buffer.insert(buffer.end(), block.begin(), block.end());
+        expected += block;
+    }
+    ASSERT_EQ(buffer.string(), expected);
+    ASSERT_EQ(buffer.GetStats().allocations, 1);
+    ASSERT_LT(buffer.GetStats().reallocations, 30);
+
+    // Pasting in the middle moves the end up as the buffer grows
+    buffer.insert(buffer.begin() + 5, block.begin(), block.end());
+    expected.insert(5, block);
+    ASSERT_EQ(buffer.string(), expected);
+
+    // A capped gap grows a bounded amount each time
+    GapBuffer<char> capped(0, 16);
+    capped.SetGrowth(GapBufferGrowth{ 16, 64, 0.5f });
+    for (int i = 0; i < 100; i++)
+    {
+        capped.insert(capped.end(), block.begin(), block.end());
+    }
+    ASSERT_EQ(capped.size(), 10000);
+    ASSERT_GT(capped.GetStats().reallocations, 50);
+}
+
+TEST(GapBuffer, FindAcrossGap)
+{
+    GapBuffer<char> buffer(0, 4);
+    std::string foo("abc def;ghi");
+    buffer.assign(foo.begin(), foo.end());
+
+    // Put the gap in the middle of the word we look for
+    std::string x("x");
+    buffer.insert(buffer.begin() + 9, x.begin(), x.end());
+    ASSERT_EQ(buffer.string(true), "abc def;gx|3|hi");
+
+    std::string delim(" ;");
+    ASSERT_EQ(buffer.find_first_of(buffer.cbegin(), buffer.cend(), delim.begin(), delim.end()) - buffer.cbegin(), 3);
+    ASSERT_EQ(buffer.find_first_of(buffer.cbegin() + 4, buffer.cend(), delim.begin(), delim.end()) - buffer.cbegin(), 7);
+    ASSERT_TRUE(buffer.find_first_of(buffer.cbegin() + 8, buffer.cend(), delim.begin(), delim.end()) == buffer.cend());
+
+    std::string letters("abcdefgx");
+    ASSERT_EQ(buffer.find_first_not_of(buffer.cbegin() + 8, buffer.cend(), letters.begin(), letters.end()) - buffer.cbegin(), 10);
+
+    ASSERT_EQ(buffer.find(buffer.cbegin(), buffer.cend(), 'h') - buffer.cbegin(), 10);
+    ASSERT_EQ(buffer.find(buffer.cbegin(), buffer.cend(), 'x') - buffer.cbegin(), 9);
+    ASSERT_TRUE(buffer.find(buffer.cbegin(), buffer.cbegin() + 9, 'x') == buffer.cend());
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+
+#include "zep/line_index.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+// The straightforward way to keep line ends, to check against
+void ReferenceInsert(std::vector<int32_t>& lineEnds, int32_t offset, int32_t length, const std::vector<int32_t>& newLineEnds)
+{
+    auto itrLine = std::upper_bound(lineEnds.begin(), lineEnds.end(), offset);
+    for (auto itr = itrLine; itr != lineEnds.end(); itr++)
+    {
+        *itr += length;
+    }
+    lineEnds.insert(itrLine, newLineEnds.begin(), newLineEnds.end());
+}
+
+void ReferenceErase(std::vector<int32_t>& lineEnds, int32_t startOffset, int32_t endOffset)
+{
+    auto itrFirst = std::upper_bound(lineEnds.begin(), lineEnds.end(), startOffset);
+    auto itrLast = std::upper_bound(itrFirst, lineEnds.end(), endOffset);
+    for (auto itr = itrLast; itr != lineEnds.end(); itr++)
+    {
+        *itr -= endOffset - startOffset;
+    }
+    lineEnds.erase(itrFirst, itrLast);
+}
+
+} // namespace
+
+TEST(PrefixSumTree, SumAndCount)
+{
+    PrefixSumTree tree;
+    tree.Build({ 3, 0, 5, 2 });
+    ASSERT_EQ(tree.Sum(0), 0);
+    ASSERT_EQ(tree.Sum(3), 8);
+    ASSERT_EQ(tree.Sum(4), 10);
+
+    ASSERT_EQ(tree.Count(2), 0);
+    ASSERT_EQ(tree.Count(3), 2);
+    ASSERT_EQ(tree.Count(9), 3);
+    ASSERT_EQ(tree.Count(100), 4);
+
+    tree.Add(1, 4);
+    ASSERT_EQ(tree.Sum(2), 7);
+    ASSERT_EQ(tree.Count(6), 1);
+}
+
+TEST(LineIndex, Lookup)
+{
+    LineIndex index;
+    index.Assign({ 4, 8, 9, 15 });
+    ASSERT_EQ(index.size(), 4);
+    ASSERT_EQ(index.LineEnd(0), 4);
+    ASSERT_EQ(index.LineEnd(3), 15);
+
+    ASSERT_EQ(index.LineFromOffset(0), 0);
+    ASSERT_EQ(index.LineFromOffset(4), 1);
+    ASSERT_EQ(index.LineFromOffset(8), 2);
+    ASSERT_EQ(index.LineFromOffset(14), 3);
+    ASSERT_EQ(index.LineFromOffset(15), 4);
+
+    index.Insert(5, 3, { 7 });
+    ASSERT_EQ(index.ToVector(), std::vector<int32_t>({ 4, 7, 11, 12, 18 }));
+
+    index.Erase(2, 8);
+    ASSERT_EQ(index.ToVector(), std::vector<int32_t>({ 5, 6, 12 }));
+}
+
+TEST(LineIndex, RandomEdits)
+{
+    // Enough lines for plenty of chunks, which get split and merged as we go
+    std::vector<int32_t> lineEnds;
+    for (int32_t line = 1; line <= 5000; line++)
+    {
+        lineEnds.push_back(line * 10);
+    }
+
+    LineIndex index;
+    index.Assign(lineEnds);
+
+    std::mt19937 gen(1);
+    for (int i = 0; i < 5000; i++)
+    {
+        auto textSize = lineEnds.back();
+        if (gen() % 2 == 0 || textSize < 2)
+        {
+            auto offset = int32_t(gen() % textSize);
+            auto length = int32_t(1 + gen() % 200);
+
+            std::vector<int32_t> newLineEnds;
+            for (auto end = offset + 1 + int32_t(gen() % 10); end <= offset + length; end += 1 + int32_t(gen() % 10))
+            {
+                newLineEnds.push_back(end);
+            }
+            ReferenceInsert(lineEnds, offset, length, newLineEnds);
+            index.Insert(offset, length, newLineEnds);
+        }
+        else
+        {
+            // Never remove the last line
+            auto startOffset = int32_t(gen() % (textSize - 1));
+            auto endOffset = std::min(startOffset + 1 + int32_t(gen() % 200), textSize - 1);
+            ReferenceErase(lineEnds, startOffset, endOffset);
+            index.Erase(startOffset, endOffset);
+        }
+
+        ASSERT_EQ(index.size(), lineEnds.size());
+        auto offset = int32_t(gen() % lineEnds.back());
+        ASSERT_EQ(index.LineFromOffset(offset), int32_t(std::upper_bound(lineEnds.begin(), lineEnds.end(), offset) - lineEnds.begin()));
+        auto line = int32_t(gen() % lineEnds.size());
+        ASSERT_EQ(index.LineEnd(line), lineEnds[line]);
+    }
+    ASSERT_EQ(index.ToVector(), lineEnds);
+}
+
+TEST(LineIndex, Iterate)
+{
+    std::vector<int32_t> lineEnds;
+    for (int32_t line = 1; line <= 1000; line++)
+    {
+        lineEnds.push_back(line * 3);
+    }
+
+    LineIndex index;
+    index.Assign(lineEnds);
+    index.Insert(10, 5, { 12 });
+
+    std::vector<int32_t> expected = index.ToVector();
+    ASSERT_EQ(std::vector<int32_t>(index.begin(), index.end()), expected);
+    ASSERT_EQ(index[500], expected[500]);
+
+    // And back again
+    auto itr = index.end();
+    for (auto line = int32_t(expected.size()) - 1; line >= 0; line--)
+    {
+        ASSERT_EQ(*--itr, expected[line]);
+    }
+    ASSERT_TRUE(itr == index.begin());
+}
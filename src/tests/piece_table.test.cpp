@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "zep/piece_table.hpp"
+#include "zep/text_storage.hpp"
+
+TEST(PieceTable, Assign)
+{
+    PieceTable<char> table;
+    ASSERT_TRUE(table.empty());
+
+    std::string foo("Hello");
+    table.assign(foo.begin(), foo.end());
+    ASSERT_EQ(table.string(), "Hello");
+    ASSERT_EQ(table.size(), 5);
+    ASSERT_EQ(table.piece_count(), 1);
+
+    table.clear();
+    ASSERT_TRUE(table.empty());
+    ASSERT_EQ(table.piece_count(), 0);
+}
+
+TEST(PieceTable, AssignView)
+{
+    PieceTable<char> table;
+
+    // The table shares the memory, and keeps it alive
+    auto spText = std::make_shared<std::string>("Hello World");
+    table.assign_view(spText->data(), spText->data() + spText->size(), spText);
+    ASSERT_EQ(spText.use_count(), 2);
+    ASSERT_EQ(&table[0], spText->data());
+
+    std::string bar(" Big");
+    table.insert(table.begin() + 5, bar.begin(), bar.end());
+    ASSERT_EQ(table.string(), "Hello Big World");
+    ASSERT_EQ(*spText, "Hello World");
+
+    table.clear();
+    ASSERT_EQ(spText.use_count(), 1);
+}
+
+TEST(PieceTable, OwnOriginal)
+{
+    PieceTable<char> table;
+    auto spText = std::make_shared<std::string>("Hello World");
+    table.assign_view(spText->data(), spText->data() + spText->size(), spText);
+
+    std::string bar(" Big");
+    table.insert(table.begin() + 5, bar.begin(), bar.end());
+    table.erase(table.begin(), table.begin() + 1);
+
+    // The text stays the same, but no longer needs the original
+    table.own_original();
+    ASSERT_EQ(spText.use_count(), 1);
+    (*spText)[7] = 'X';
+    ASSERT_EQ(table.string(), "ello Big World");
+
+    table.insert(table.end(), bar.begin(), bar.end());
+    ASSERT_EQ(table.string(), "ello Big World Big");
+}
+
+TEST(PieceTable, InsertErase)
+{
+    PieceTable<char> table;
+
+    std::string foo("Hello World");
+    table.assign(foo.begin(), foo.end());
+
+    std::string bar(" Big");
+    table.insert(table.begin() + 5, bar.begin(), bar.end());
+    ASSERT_EQ(table.string(), "Hello Big World");
+    ASSERT_EQ(table.piece_count(), 3);
+
+    ASSERT_EQ(table[0], 'H');
+    ASSERT_EQ(table[6], 'B');
+    ASSERT_EQ(table[14], 'd');
+
+    table.erase(table.begin() + 3, table.begin() + 8);
+    ASSERT_EQ(table.string(), "Helg World");
+
+    table.erase(table.begin());
+    ASSERT_EQ(table.string(), "elg World");
+
+    table.push_back('!');
+    ASSERT_EQ(table.string(), "elg World!");
+
+    table.pop_back();
+    table.pop_back();
+    ASSERT_EQ(table.string(), "elg Worl");
+}
+
+TEST(PieceTable, TypingCoalesces)
+{
+    PieceTable<char> table;
+
+    std::string foo("ab");
+    table.assign(foo.begin(), foo.end());
+
+    // Typing one character at a time in the middle should extend the same piece
+    std::string typed("Hello");
+    for (size_t i = 0; i < typed.size(); i++)
+    {
+        table.insert(table.begin() + 1 + i, typed.begin() + i, typed.begin() + i + 1);
+    }
+    ASSERT_EQ(table.string(), "aHellob");
+    ASSERT_EQ(table.piece_count(), 3);
+}
+
+TEST(PieceTable, Iterate)
+{
+    PieceTable<char> table;
+
+    std::string foo("one three");
+    table.assign(foo.begin(), foo.end());
+    std::string bar("two ");
+    table.insert(table.begin() + 4, bar.begin(), bar.end());
+
+    ASSERT_EQ(std::string(table.begin(), table.end()), "one two three");
+    ASSERT_EQ(std::find(table.begin(), table.end(), 'w') - table.begin(), 5);
+
+    std::string segments;
+    table.ForEachSegment(2, 10, [&](const char* pBegin, const char* pEnd) {
+        segments += std::string(pBegin, pEnd) + "|";
+        return true;
+    });
+    ASSERT_EQ(segments, "e |two |th|");
+}
+
+TEST(PieceTable, RandomEdits)
+{
+    // Check the table against a plain string
+    std::mt19937 gen(1);
+    std::string compare = "The quick brown fox jumps over the lazy dog\n";
+    PieceTable<char> table;
+    table.assign(compare.begin(), compare.end());
+
+    for (int i = 0; i < 2000; i++)
+    {
+        if (gen() % 3 != 0 || compare.empty())
+        {
+            auto pos = gen() % (compare.size() + 1);
+            std::string text(1 + gen() % 8, char('a' + gen() % 26));
+            compare.insert(pos, text);
+            table.insert(table.begin() + pos, text.begin(), text.end());
+        }
+        else
+        {
+            auto pos = gen() % compare.size();
+            auto count = std::min(size_t(1 + gen() % 8), compare.size() - pos);
+            compare.erase(pos, count);
+            table.erase(table.begin() + pos, table.begin() + pos + count);
+        }
+        ASSERT_EQ(table.size(), compare.size());
+    }
+    ASSERT_EQ(table.string(), compare);
+}
+
+TEST(TextStorage, SwitchType)
+{
+    TextStorage<char> storage;
+    ASSERT_EQ(storage.GetType(), TextStorageType::GapBuffer);
+
+    std::string foo("Hello World");
+    storage.assign(foo.begin(), foo.end());
+
+    storage.SetType(TextStorageType::PieceTable);
+    ASSERT_EQ(storage.GetType(), TextStorageType::PieceTable);
+    ASSERT_EQ(storage.string(), "Hello World");
+
+    storage.replace(storage.begin(), storage.begin() + 5, 'x');
+    ASSERT_EQ(storage.string(), "xxxxx World");
+
+    std::string space(" \t");
+    auto itr = storage.find_first_of(storage.begin(), storage.end(), space.begin(), space.end());
+    ASSERT_EQ(itr - storage.begin(), 5);
+    itr = storage.find_first_not_of(storage.begin(), storage.end(), foo.begin(), foo.end());
+    ASSERT_EQ(itr - storage.begin(), 0);
+
+    storage.SetType(TextStorageType::GapBuffer);
+    ASSERT_EQ(storage.GetType(), TextStorageType::GapBuffer);
+    ASSERT_EQ(storage.string(), "xxxxx World");
+}
+
+TEST(TextStorage, Segments)
+{
+    for (auto type : { TextStorageType::GapBuffer, TextStorageType::PieceTable })
+    {
+        TextStorage<char> storage;
+        std::string foo("Hello World");
+        storage.assign(foo.begin(), foo.end());
+        storage.SetType(type);
+        std::string comma(",");
+        storage.insert(storage.begin() + 5, comma.begin(), comma.end());
+
+        ASSERT_EQ(storage.string(storage.begin() + 3, storage.begin() + 9), "lo, Wo");
+
+        std::string joined;
+        storage.ForEachSegment(storage.begin(), storage.end(), [&](const char* pBegin, const char* pEnd) {
+            joined.append(pBegin, pEnd);
+            return true;
+        });
+        ASSERT_EQ(joined, "Hello, World");
+
+        // Finds run a segment at a time, across the edit
+        std::string delim(", ");
+        ASSERT_EQ(storage.find_first_of(storage.begin(), storage.end(), delim.begin(), delim.end()) - storage.begin(), 5);
+        ASSERT_EQ(storage.find_first_not_of(storage.begin() + 5, storage.end(), delim.begin(), delim.end()) - storage.begin(), 7);
+        ASSERT_EQ(storage.find(storage.begin() + 5, storage.end(), 'o') - storage.begin(), 8);
+        ASSERT_TRUE(storage.find(storage.begin(), storage.begin() + 4, 'o') == storage.end());
+    }
+}
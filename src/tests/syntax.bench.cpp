@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include "zep/buffer.hpp"
+#include "zep/display.hpp"
+#include "zep/editor.hpp"
+#include "zep/keyword_table.hpp"
+#include "zep/syntax.hpp"
+#include "zep/mcommon/animation/timer.hpp"
+
+#include <set>
+
+#include "bench_text.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+const int Repeats = 5;
+
+} // namespace
+
+TEST(SyntaxBench, Highlight)
+{
+    auto text = MakeBenchText(16 * 1024 * 1024);
+
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->GetEmptyBuffer("bench.cpp");
+    pBuffer->SetText(text);
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+
+    // Opening a string at the top, and closing it again, recolors the whole file each time
+    double seconds = 0.0;
+    for (int i = 0; i < Repeats; i++)
+    {
+        timer t;
+        timer_start(t);
+        if (i % 2)
+        {
+            pBuffer->Delete(0, 1);
+        }
+        else
+        {
+            pBuffer->Insert(0, "\"");
+        }
+        pSyntax->Wait();
+        seconds += timer_get_elapsed_seconds(t);
+    }
+
+    printf("Highlight: %.2f MB/s (%d lines)\n", (double(text.size()) * Repeats) / (seconds * 1024.0 * 1024.0), pBuffer->GetLineCount());
+}
+
+TEST(SyntaxBench, HighlightLoad)
+{
+    auto text = MakeBenchText(16 * 1024 * 1024);
+
+    // A new file is split into chunks over the thread pool; compare it with one thread
+    for (auto flags : { uint32_t(ZepEditorFlags::DisableThreads), uint32_t(0) })
+    {
+        auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, flags);
+        auto pBuffer = spEditor->GetEmptyBuffer("bench.cpp");
+
+        timer t;
+        timer_start(t);
+        pBuffer->SetText(text);
+        pBuffer->GetSyntax()->Wait();
+        auto seconds = timer_get_elapsed_seconds(t);
+
+        printf("Load and highlight (%s): %.2f MB/s (%zu threads)\n", flags != 0 ? "one thread" : "thread pool", double(text.size()) / (seconds * 1024.0 * 1024.0), spEditor->GetThreadPool().size());
+    }
+}
+
+TEST(SyntaxBench, KeywordLookup)
+{
+    static constexpr auto keywords = MakeKeywordTable("alignas", "auto", "bool", "break", "case", "char", "class", "const", "constexpr", "continue",
+        "do", "double", "else", "enum", "false", "float", "for", "if", "int", "namespace", "return", "static", "struct", "switch", "template", "true",
+        "typename", "using", "void", "while");
+    std::set<std::string_view> keywordSet = { "alignas", "auto", "bool", "break", "case", "char", "class", "const", "constexpr", "continue",
+        "do", "double", "else", "enum", "false", "float", "for", "if", "int", "namespace", "return", "static", "struct", "switch", "template", "true",
+        "typename", "using", "void", "while" };
+
+    // Split the sample into tokens, as the highlighter would
+    std::vector<std::string_view> tokens;
+    std::string_view sample(longTextSample);
+    size_t pos = 0;
+    while ((pos = sample.find_first_not_of(" \t.\n;(){}=:", pos)) != std::string_view::npos)
+    {
+        auto end = std::min(sample.find_first_of(" \t.\n;(){}=:", pos), sample.size());
+        tokens.push_back(sample.substr(pos, end - pos));
+        pos = end;
+    }
+
+    const int Lookups = 200;
+    auto table = keywords.Table();
+    auto run = [&](const char* pszName, auto&& contains) {
+        size_t found = 0;
+        size_t bytes = 0;
+        timer t;
+        timer_start(t);
+        for (int i = 0; i < Lookups; i++)
+        {
+            for (auto& token : tokens)
+            {
+                found += contains(token) ? 1 : 0;
+                bytes += token.size();
+            }
+        }
+        auto seconds = timer_get_elapsed_seconds(t);
+        printf("%-12s: %.2f MB/s of tokens (%zu found)\n", pszName, double(bytes) / (seconds * 1024.0 * 1024.0), found);
+        return found;
+    };
+
+    auto setFound = run("std::set", [&](std::string_view token) { return keywordSet.find(token) != keywordSet.end(); });
+    auto tableFound = run("KeywordTable", [&](std::string_view token) { return table.Contains(token); });
+    ASSERT_EQ(setFound, tableFound);
+}
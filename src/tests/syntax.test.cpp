@@ -1,10 +1,16 @@
 #include "zep/buffer.hpp"
 #include "zep/display.hpp"
 #include "zep/editor.hpp"
+#include "zep/line_widgets.hpp"
 #include "zep/syntax.hpp"
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <set>
+#include <string_view>
+#include <thread>
+
 using namespace Zep;
 class SyntaxTest : public testing::Test
 {
@@ -38,3 +44,352 @@ CPP_SYNTAX_TEST(cpp_identifier, "a = std::min(a,b);", 4, Identifier);
 CPP_SYNTAX_TEST(cpp_string,     "a = \"hello\";", 4, String);
 CPP_SYNTAX_TEST(cpp_number,     "a = 1234;", 4, Number);
 
+CPP_SYNTAX_TEST(cpp_comment,    "a = 1; // int", 10, Comment);
+CPP_SYNTAX_TEST(cpp_string_lines, "a = \"hello\nint\";", 12, String);
+
+TEST_F(SyntaxTest, IncrementalLines)
+{
+    std::string text;
+    for (int line = 0; line < 1000; line++)
+    {
+        text += "int a = " + std::to_string(line) + ";\n";
+    }
+
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText(text);
+    auto pSyntax = pBuffer->GetSyntax();
+    auto lineStart = [&](int32_t line) {
+        int32_t start, end;
+        pBuffer->GetLineOffsets(line, start, end);
+        return start;
+    };
+    pSyntax->Wait();
+    auto lexed = pSyntax->GetLexedLineCount();
+    ASSERT_GE(lexed, 1000);
+
+    // An edit at the bottom, then one at the top, only lexes the lines around them
+    pBuffer->Insert(lineStart(990), "x");
+    pBuffer->Insert(0, "int b;\n");
+    pSyntax->Wait();
+    ASSERT_LE(pSyntax->GetLexedLineCount() - lexed, 6);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(0).foreground, ThemeColor::Keyword);
+
+    // Opening a string changes everything after it, until it is closed again
+    lexed = pSyntax->GetLexedLineCount();
+    auto location = lineStart(500);
+    pBuffer->Insert(location, "\"");
+    pSyntax->Wait();
+    ASSERT_GT(pSyntax->GetLexedLineCount() - lexed, 400);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(800)).foreground, ThemeColor::String);
+
+    pBuffer->Delete(location, location + 1);
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(800)).foreground, ThemeColor::Keyword);
+}
+
+// Line widgets change how big the lines are, not their text, so the syntax leaves them alone
+TEST_F(SyntaxTest, LineWidgetsDontLex)
+{
+    std::string text;
+    for (int line = 0; line < 1000; line++)
+    {
+        text += "int a = " + std::to_string(line) + ";\n";
+    }
+
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText(text);
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+    auto lexed = pSyntax->GetLexedLineCount();
+
+    pBuffer->AddLineWidget(10, std::make_shared<FloatSlider>(*spEditor, 4));
+    pBuffer->AddLineWidget(900, std::make_shared<FloatSlider>(*spEditor, 4));
+    pBuffer->ClearLineWidgets(10);
+    pBuffer->ClearLineWidgets(-1);
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetLexedLineCount(), lexed);
+    ASSERT_EQ(pBuffer->GetLineWidgets(900), nullptr);
+}
+
+SYNTAX_TEST(cmake_keyword_case, "CMakeLists.txt", "PROJECT(zep)", 0, Keyword);
+
+// Comments and strings, from each provider's rules
+CPP_SYNTAX_TEST(cpp_block_comment, "a /* int */ b", 5, Comment);
+CPP_SYNTAX_TEST(cpp_after_block_comment, "a /* x */ int", 10, Keyword);
+CPP_SYNTAX_TEST(cpp_block_comment_lines, "/* a\nint\n*/ int", 5, Comment);
+CPP_SYNTAX_TEST(cpp_after_block_comment_lines, "/* a\nint\n*/ int", 12, Keyword);
+CPP_SYNTAX_TEST(cpp_comment_in_string, "a = \"/* x\"; int", 12, Keyword);
+CPP_SYNTAX_TEST(cpp_escaped_backslash, "a = \"\\\\\"; int", 10, Keyword);
+CPP_SYNTAX_TEST(cpp_raw_string, "a = R\"x(\")\" int\n)x\"; int", 14, String);
+CPP_SYNTAX_TEST(cpp_after_raw_string, "a = R\"x(\")\" int\n)x\"; int", 21, Keyword);
+SYNTAX_TEST(lisp_nested_comment, "test.lisp", "#| a #| b |# car |# car", 14, Comment);
+SYNTAX_TEST(lisp_after_nested_comment, "test.lisp", "#| a #| b |# car |# car", 20, Identifier);
+SYNTAX_TEST(lisp_line_comment, "test.lisp", "(car) ; car", 8, Comment);
+SYNTAX_TEST(cmake_bracket_comment, "CMakeLists.txt", "#[==[ project\n]] project ]==] project", 18, Comment);
+SYNTAX_TEST(cmake_after_bracket_comment, "CMakeLists.txt", "#[==[ project\n]] project ]==] project", 31, Keyword);
+SYNTAX_TEST(toml_single_line_string, "test.toml", "a = \"x\nb = 1", 11, Number);
+
+TEST_F(SyntaxTest, BlockCommentEdit)
+{
+    std::string text;
+    for (int line = 0; line < 1000; line++)
+    {
+        text += (line == 520) ? "*/\n" : "int a = " + std::to_string(line) + ";\n";
+    }
+
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText(text);
+    auto pSyntax = pBuffer->GetSyntax();
+    auto lineStart = [&](int32_t line) {
+        int32_t start, end;
+        pBuffer->GetLineOffsets(line, start, end);
+        return start;
+    };
+    pSyntax->Wait();
+
+    // Opening a comment only lexes as far as the close after it
+    auto lexed = pSyntax->GetLexedLineCount();
+    auto location = lineStart(500);
+    pBuffer->Insert(location, "/*");
+    pSyntax->Wait();
+    ASSERT_LE(pSyntax->GetLexedLineCount() - lexed, 25);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(510)).foreground, ThemeColor::Comment);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(521)).foreground, ThemeColor::Keyword);
+
+    pBuffer->Delete(location, location + 2);
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(510)).foreground, ThemeColor::Keyword);
+}
+
+TEST_F(SyntaxTest, KeywordAcrossGap)
+{
+    // The edit leaves the gap in the middle of the keyword, so the token has to be copied out to be found
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText("it a;");
+    pBuffer->Insert(1, "n");
+    pBuffer->GetSyntax()->Wait();
+    ASSERT_EQ(pBuffer->GetSyntax()->GetSyntaxAt(0).foreground, ThemeColor::Keyword);
+    ASSERT_EQ(pBuffer->GetSyntax()->GetSyntaxAt(4).foreground, ThemeColor::Normal);
+}
+
+TEST(KeywordTable, Lookup)
+{
+    static constexpr auto words = MakeKeywordTable("int", "for", "while", "tex1D", "tex1D", "", "static_assert");
+    auto table = words.Table();
+
+    for (auto word : { "int", "for", "while", "tex1D", "static_assert" })
+    {
+        ASSERT_TRUE(table.Contains(word)) << word;
+    }
+    for (auto word : { "", "in", "integer", "For", "static", "x" })
+    {
+        ASSERT_FALSE(table.Contains(word)) << word;
+    }
+
+    // The table holds lower case words; the token can be any case
+    ASSERT_TRUE(table.Contains("FOR", true));
+    ASSERT_TRUE(table.Contains("While", true));
+    ASSERT_FALSE(table.Contains("FORE", true));
+
+    ASSERT_FALSE(KeywordTable().Contains("int"));
+    ASSERT_FALSE(MakeKeywordTable().Table().Contains("int"));
+}
+
+// Word lists given at run time get the same lookup
+TEST(KeywordSet, Lookup)
+{
+    std::set<std::string_view> words;
+    std::vector<std::string> numbered;
+    for (int i = 0; i < 500; i++)
+    {
+        numbered.push_back("word" + std::to_string(i));
+    }
+    words.insert(numbered.begin(), numbered.end());
+    words.insert("");
+
+    KeywordSet set(words);
+    numbered.clear();
+    auto table = set.Table();
+    for (int i = 0; i < 500; i++)
+    {
+        ASSERT_TRUE(table.Contains("word" + std::to_string(i))) << i;
+        ASSERT_FALSE(table.Contains("word" + std::to_string(i + 500))) << i;
+    }
+    ASSERT_FALSE(table.Contains(""));
+    ASSERT_TRUE(table.Contains("WORD7", true));
+
+    ASSERT_FALSE(KeywordSet({}).Table().Contains("word1"));
+}
+
+// A syntax provider can still hand over sets of words
+TEST_F(SyntaxTest, WordSets)
+{
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.words");
+    pBuffer->SetSyntaxProvider(SyntaxProvider{ "words", tSyntaxFactory([](ZepBuffer* pBuffer) {
+                                                  return std::make_shared<ZepSyntax>(*pBuffer, std::set<std::string_view>{ "fish" }, std::set<std::string_view>{ "cake" });
+                                              }) });
+    pBuffer->SetText("fish cake int");
+    pBuffer->GetSyntax()->Wait();
+    ASSERT_EQ(pBuffer->GetSyntax()->GetSyntaxAt(0).foreground, ThemeColor::Keyword);
+    ASSERT_EQ(pBuffer->GetSyntax()->GetSyntaxAt(5).foreground, ThemeColor::Identifier);
+    ASSERT_EQ(pBuffer->GetSyntax()->GetSyntaxAt(10).foreground, ThemeColor::Normal);
+}
+
+TEST_F(SyntaxTest, ParallelChunks)
+{
+    // Strings which run across the chunk boundaries make some chunks guess their starting state wrong
+    std::string text;
+    for (int line = 0; line < 2000; line++)
+    {
+        text += (line % 97 == 0) ? "a = \"open\n" : (line % 97 == 3) ? "close\"; int b;\n" : "int a = " + std::to_string(line) + ";\n";
+    }
+
+    auto colors = [&](int32_t chunkSize) {
+        ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+        pBuffer->GetSyntax()->SetParallelChunkSize(chunkSize);
+        pBuffer->SetText(text);
+        std::vector<ThemeColor> result;
+        for (int32_t offset = 0; offset < int32_t(text.size()); offset++)
+        {
+            result.push_back(pBuffer->GetSyntax()->GetSyntaxAt(offset).foreground);
+        }
+        return result;
+    };
+
+    auto serial = colors(0);
+    for (auto chunkSize : { 50, 1000, 4096 })
+    {
+        ASSERT_EQ(colors(chunkSize), serial) << chunkSize;
+    }
+}
+
+// Edits don't wait for a lex to finish; it stops at the end of its line, and what it did after the edit is thrown away.
+// With worker threads the chunks are lexed on them too, and the edits also land while the chunks go into the store
+TEST_F(SyntaxTest, EditWhileLexing)
+{
+    std::string text;
+    for (int line = 0; line < 2000; line++)
+    {
+        text += "int a = " + std::to_string(line) + ";\n";
+    }
+
+    for (auto flags : { uint32_t(ZepEditorFlags::DisableThreads), uint32_t(ZepEditorFlags::WorkerThreads) })
+    {
+        auto spThreadEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, flags);
+        ZepBuffer* pBuffer = spThreadEditor->GetEmptyBuffer("test.cpp");
+        auto pSyntax = pBuffer->GetSyntax();
+        pSyntax->SetParallelChunkSize(1000);
+        pBuffer->SetText(text);
+
+        // Quotes going in and out turn big runs of lines into a string and back, while another thread keeps lexing
+        std::atomic<bool> done = { false };
+        std::thread lexer([&]() {
+            while (!done)
+            {
+                pSyntax->UpdateSyntax();
+            }
+        });
+        for (int edit = 0; edit < 200; edit++)
+        {
+            int32_t start, end;
+            pBuffer->GetLineOffsets((edit * 37) % 1900, start, end);
+            if (edit % 3 == 2)
+            {
+                pBuffer->Delete(start, start + 1);
+            }
+            else
+            {
+                pBuffer->Insert(start, "\"");
+            }
+        }
+        done = true;
+        lexer.join();
+        pSyntax->Wait();
+        pSyntax->UpdateSyntax();
+
+        auto editedText = pBuffer->GetText().string();
+        ZepBuffer* pFresh = spEditor->GetEmptyBuffer("fresh.cpp");
+        pFresh->SetText(editedText.substr(0, editedText.size() - 1));
+        for (int32_t offset = 0; offset < int32_t(editedText.size()) - 1; offset++)
+        {
+            ASSERT_EQ(pSyntax->GetSyntaxAt(offset).foreground, pFresh->GetSyntax()->GetSyntaxAt(offset).foreground) << flags << " " << offset;
+        }
+    }
+}
+
+TEST_F(SyntaxTest, RainbowBrackets)
+{
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText("f(a[1], (b)) }");
+    auto pSyntax = pBuffer->GetSyntax();
+    pSyntax->Wait();
+
+    auto depthColor = [](int32_t depth) {
+        return ThemeColor(int32_t(ThemeColor::UniqueColor0) + depth);
+    };
+    ASSERT_EQ(pSyntax->GetSyntaxAt(1).foreground, depthColor(0));
+    ASSERT_EQ(pSyntax->GetSyntaxAt(3).foreground, depthColor(0));
+    ASSERT_EQ(pSyntax->GetSyntaxAt(8).foreground, depthColor(1));
+    ASSERT_EQ(pSyntax->GetSyntaxAt(10).foreground, depthColor(1));
+    ASSERT_EQ(pSyntax->GetSyntaxAt(11).foreground, depthColor(0));
+    ASSERT_EQ(pSyntax->GetSyntaxAt(13).background, ThemeColor::Error);
+
+    // Everything after an edit moves up a level, and the open which is never closed is shown
+    pBuffer->Insert(0, "(");
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetSyntaxAt(0).background, ThemeColor::Error);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(2).foreground, depthColor(1));
+    ASSERT_EQ(pSyntax->GetSyntaxAt(9).foreground, depthColor(2));
+
+    pBuffer->Delete(0, 1);
+    pSyntax->Wait();
+    ASSERT_EQ(pSyntax->GetSyntaxAt(8).foreground, depthColor(1));
+}
+
+TEST(SyntaxLazy, ShowLinesFirst)
+{
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto spEditorConfig = cpptoml::make_table();
+    spEditorConfig->insert("lazy_syntax", true);
+    auto spConfig = cpptoml::make_table();
+    spConfig->insert("editor", spEditorConfig);
+    spEditor->LoadConfig(spConfig);
+
+    // A string runs over lines 2990 to 3060
+    std::string text;
+    for (int line = 0; line < 5000; line++)
+    {
+        text += (line == 2990) ? "a = \"open\n" : (line == 3060) ? "close\";\n" : "int a = " + std::to_string(line) + ";\n";
+    }
+
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.cpp");
+    pBuffer->SetText(text);
+    auto pSyntax = pBuffer->GetSyntax();
+    auto lineStart = [&](int32_t line) {
+        int32_t start, end;
+        pBuffer->GetLineOffsets(line, start, end);
+        return start;
+    };
+
+    // Nothing is done until a window shows it, and then only what it shows
+    ASSERT_EQ(pSyntax->GetLexedLineCount(), 0);
+    pSyntax->ShowLines(4900, 4949);
+    ASSERT_EQ(pSyntax->GetLexedLineCount(), 50);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(4900)).foreground, ThemeColor::Keyword);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(100)).foreground, ThemeColor::Normal);
+
+    // Showing it again is free
+    pSyntax->ShowLines(4900, 4949);
+    ASSERT_EQ(pSyntax->GetLexedLineCount(), 50);
+
+    // Inside the string, the guess at the starting state is wrong until the ticks get there
+    pSyntax->ShowLines(3000, 3010);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(3000)).foreground, ThemeColor::Keyword);
+    for (int tick = 0; tick < 1000 && pSyntax->GetProcessedChar() < int32_t(text.size()); tick++)
+    {
+        spEditor->RefreshRequired();
+    }
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(3000)).foreground, ThemeColor::String);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(3061)).foreground, ThemeColor::Keyword);
+    ASSERT_EQ(pSyntax->GetSyntaxAt(lineStart(100)).foreground, ThemeColor::Keyword);
+}
@@ -0,0 +1,156 @@
+#include "zep/buffer.hpp"
+#include "zep/display.hpp"
+#include "zep/editor.hpp"
+#include "zep/syntax_grammar.hpp"
+
+#include "zep/mcommon/file/cpptoml.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace Zep;
+
+namespace
+{
+
+auto CompileGrammar(const std::string& text, std::string& error) -> std::shared_ptr<SyntaxGrammar>
+{
+    std::istringstream stream(text);
+    cpptoml::parser parser(stream);
+    return SyntaxGrammar::Compile(parser.parse(), error);
+}
+
+auto MatchLength(const SyntaxGrammar& grammar, const std::string& text, int32_t& token) -> size_t
+{
+    size_t length = 0;
+    token = grammar.Match(text, length);
+    return token < 0 ? 0 : length;
+}
+
+} // namespace
+
+// The longest match wins, and the first rule on a tie
+TEST(SyntaxGrammar, LongestMatch)
+{
+    std::string error;
+    auto spGrammar = CompileGrammar(R"(
+name = "test"
+extensions = [".test"]
+keywords = ["if", "else"]
+
+[[token]]
+pattern = '[a-z_][a-z0-9_]*'
+
+[[token]]
+pattern = '0x[0-9a-f]+|\d+(\.\d*)?'
+color = "number"
+
+[[token]]
+pattern = '"([^"\\]|\\.)*"'
+color = "string"
+)",
+        error);
+    ASSERT_NE(spGrammar, nullptr) << error;
+
+    int32_t token;
+    EXPECT_EQ(MatchLength(*spGrammar, "if (", token), 2u);
+    EXPECT_EQ(spGrammar->TokenColor(token), ThemeColor::Keyword);
+    EXPECT_EQ(MatchLength(*spGrammar, "iffy = 1", token), 4u);
+    EXPECT_EQ(spGrammar->TokenColor(token), ThemeColor::Normal);
+    EXPECT_EQ(MatchLength(*spGrammar, "0x1f;", token), 4u);
+    EXPECT_EQ(spGrammar->TokenColor(token), ThemeColor::Number);
+    EXPECT_EQ(MatchLength(*spGrammar, "12.5)", token), 4u);
+    EXPECT_EQ(MatchLength(*spGrammar, "\"a\\\"b\" c", token), 6u);
+    EXPECT_EQ(spGrammar->TokenColor(token), ThemeColor::String);
+
+    // An unclosed string backs off to nothing
+    EXPECT_EQ(MatchLength(*spGrammar, "\"abc", token), 0u);
+    EXPECT_EQ(MatchLength(*spGrammar, "IF", token), 0u);
+}
+
+TEST(SyntaxGrammar, CaseInsensitive)
+{
+    std::string error;
+    auto spGrammar = CompileGrammar(R"(
+name = "test"
+extensions = [".test"]
+case_insensitive = true
+keywords = ["select"]
+
+[[token]]
+pattern = '[a-z]+'
+)",
+        error);
+    ASSERT_NE(spGrammar, nullptr) << error;
+
+    int32_t token;
+    EXPECT_EQ(MatchLength(*spGrammar, "SeLeCt *", token), 6u);
+    EXPECT_EQ(spGrammar->TokenColor(token), ThemeColor::Keyword);
+    EXPECT_EQ(MatchLength(*spGrammar, "FROM", token), 4u);
+}
+
+TEST(SyntaxGrammar, Errors)
+{
+    auto errorOf = [](const std::string& body) {
+        std::string error;
+        auto spGrammar = CompileGrammar("name = \"bad\"\nextensions = [\".bad\"]\n" + body, error);
+        EXPECT_EQ(spGrammar, nullptr);
+        return error;
+    };
+
+    EXPECT_NE(errorOf("[[token]]\npattern = '(ab'").find("missing )"), std::string::npos);
+    EXPECT_NE(errorOf("[[token]]\npattern = 'ab)'").find("unmatched )"), std::string::npos);
+    EXPECT_NE(errorOf("[[token]]\npattern = '[a-'").find("missing ]"), std::string::npos);
+    EXPECT_NE(errorOf("[[token]]\npattern = '*a'").find("nothing to repeat"), std::string::npos);
+    EXPECT_NE(errorOf("[[token]]\npattern = 'a'\ncolor = \"purple\"").find("purple"), std::string::npos);
+    EXPECT_NE(errorOf("[[region]]\nclose = 'a'").find("no open"), std::string::npos);
+
+    // Each (a|b) doubles the states a DFA needs to know where the 'a' was
+    EXPECT_NE(errorOf("[[token]]\npattern = '(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)'").find("states"), std::string::npos);
+}
+
+class SyntaxGrammarTest : public testing::Test
+{
+public:
+    SyntaxGrammarTest()
+    {
+        spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+};
+
+// The ini grammar in the syntax folder is loaded with the editor
+TEST_F(SyntaxGrammarTest, LoadedFromFolder)
+{
+    ZepBuffer* pBuffer = spEditor->GetEmptyBuffer("test.ini");
+    pBuffer->SetText("[core]\nname = trueish ; true\nsize = 12\nflag = TRUE\nbad = \"x\ny = \"a;b\" on");
+    auto pSyntax = pBuffer->GetSyntax();
+    ASSERT_NE(dynamic_cast<ZepGrammarSyntax*>(pSyntax), nullptr);
+    pSyntax->Wait();
+
+    auto lineStart = [&](int32_t line) {
+        int32_t start, end;
+        pBuffer->GetLineOffsets(line, start, end);
+        return start;
+    };
+    EXPECT_EQ(pSyntax->GetSyntaxAt(1).foreground, ThemeColor::Identifier);
+    EXPECT_EQ(pSyntax->GetSyntaxAt(lineStart(1) + 7).foreground, ThemeColor::Normal);
+    EXPECT_EQ(pSyntax->GetSyntaxAt(lineStart(1) + 17).foreground, ThemeColor::Comment);
+    EXPECT_EQ(pSyntax->GetSyntaxAt(lineStart(2) + 7).foreground, ThemeColor::Number);
+    EXPECT_EQ(pSyntax->GetSyntaxAt(lineStart(3) + 7).foreground, ThemeColor::Keyword);
+
+    // Strings don't run on to the next line, and a comment char inside one is just part of it
+    EXPECT_EQ(pSyntax->GetSyntaxAt(lineStart(4) + 6).foreground, ThemeColor::String);
+    EXPECT_EQ(pSyntax->GetSyntaxAt(lineStart(5)).foreground, ThemeColor::Normal);
+    EXPECT_EQ(pSyntax->GetSyntaxAt(lineStart(5) + 6).foreground, ThemeColor::String);
+    EXPECT_EQ(pSyntax->GetSyntaxAt(lineStart(5) + 10).foreground, ThemeColor::Keyword);
+}
+
+TEST_F(SyntaxGrammarTest, BadFile)
+{
+    EXPECT_FALSE(spEditor->LoadSyntaxGrammar(ZepPath(ZEP_ROOT) / "zep.cfg"));
+    EXPECT_NE(spEditor->GetCommandText().find("Failed to load syntax"), std::string::npos);
+}
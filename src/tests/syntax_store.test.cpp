@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "zep/syntax_store.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+auto Color(int32_t value) -> SyntaxData
+{
+    const ThemeColor colors[] = { ThemeColor::Keyword, ThemeColor::String, ThemeColor::Comment, ThemeColor::Number };
+    return SyntaxData{ colors[value % 4], ThemeColor::None };
+}
+
+void ExpectSame(const std::vector<SyntaxData>& reference, const SyntaxStore& store)
+{
+    ASSERT_EQ(int32_t(reference.size()), store.size());
+    for (int32_t i = 0; i < store.size(); i++)
+    {
+        ASSERT_EQ(reference[i].foreground, store.Get(i).foreground) << "at " << i;
+    }
+}
+
+} // namespace
+
+// Random edits over many blocks, checked against a plain vector
+TEST(SyntaxStore, MatchesVector)
+{
+    std::mt19937 rand(5);
+    std::vector<SyntaxData> reference;
+    SyntaxStore store;
+
+    store.Resize(20000);
+    reference.resize(20000);
+    ExpectSame(reference, store);
+    EXPECT_EQ(store.RunCount(), 1u);
+
+    // Lots of small runs, so the edits cross blocks
+    for (int32_t i = 0; i < 20000 / 7; i++)
+    {
+        store.Fill(i * 7, i * 7 + 3, Color(i));
+        std::fill(reference.begin() + i * 7, reference.begin() + i * 7 + 3, Color(i));
+    }
+    ExpectSame(reference, store);
+    EXPECT_GT(store.BlockCount(), 10u);
+
+    // Mostly short, to keep plenty of runs
+    auto span = [&]() {
+        return int32_t(rand() % (rand() % 4 == 0 ? 3000 : 50));
+    };
+
+    for (int i = 0; i < 2000; i++)
+    {
+        auto size = int32_t(reference.size());
+        auto start = int32_t(rand() % (size + 1));
+        switch (rand() % 3)
+        {
+        case 0:
+        {
+            auto count = span();
+            store.Insert(start, count);
+            reference.insert(reference.begin() + start, count, SyntaxData{});
+            break;
+        }
+        case 1:
+        {
+            auto end = std::min(size, start + span());
+            store.Erase(start, end);
+            reference.erase(reference.begin() + start, reference.begin() + end);
+            break;
+        }
+        case 2:
+        {
+            auto end = std::min(size, start + span());
+            auto color = Color(i);
+            store.Fill(start, end, color);
+            std::fill(reference.begin() + start, reference.begin() + end, color);
+            break;
+        }
+        }
+
+        if (i % 100 == 0)
+        {
+            ExpectSame(reference, store);
+        }
+
+        // Sometimes publish, so some blocks are shared when the next edit comes
+        if (rand() % 4 == 0)
+        {
+            store.Publish();
+        }
+    }
+    ExpectSame(reference, store);
+}
+
+// A snapshot keeps its colors, whatever happens to the store afterwards
+TEST(SyntaxStore, SnapshotUnchanged)
+{
+    SyntaxStore store;
+    store.Resize(10000);
+    store.Fill(0, 10000, SyntaxData{ ThemeColor::Keyword, ThemeColor::None });
+
+    auto spFirst = store.Publish();
+    store.Fill(100, 9000, SyntaxData{ ThemeColor::String, ThemeColor::None });
+    store.Insert(50, 5000);
+    store.Erase(0, 20);
+
+    auto spSecond = store.Publish();
+    EXPECT_GT(spSecond->Version(), spFirst->Version());
+
+    ASSERT_EQ(spFirst->size(), 10000);
+    for (int32_t i = 0; i < spFirst->size(); i++)
+    {
+        ASSERT_EQ(spFirst->Get(i).foreground, ThemeColor::Keyword);
+    }
+
+    EXPECT_EQ(spSecond->size(), 14980);
+    EXPECT_EQ(spSecond->Get(0).foreground, ThemeColor::Keyword);
+    EXPECT_EQ(spSecond->Get(30).foreground, ThemeColor::Normal);
+    EXPECT_EQ(spSecond->Get(5100).foreground, ThemeColor::String);
+
+    // Past the end is the default
+    EXPECT_EQ(spSecond->Get(20000).foreground, ThemeColor::Normal);
+}
+
+// Runs, not characters: a big buffer of a few colors is a few runs
+TEST(SyntaxStore, RunCount)
+{
+    SyntaxStore store;
+    store.Resize(1000000);
+    EXPECT_EQ(store.RunCount(), 1u);
+
+    store.Fill(1000, 2000, SyntaxData{ ThemeColor::Comment, ThemeColor::None });
+    EXPECT_EQ(store.RunCount(), 3u);
+
+    // Same colors either side join up
+    store.Fill(2000, 3000, SyntaxData{ ThemeColor::Comment, ThemeColor::None });
+    EXPECT_EQ(store.RunCount(), 3u);
+    store.Fill(1000, 3000, SyntaxData{});
+    EXPECT_EQ(store.RunCount(), 1u);
+
+    // Lots of tokens make lots of blocks, and go back to one when they are gone
+    for (int32_t i = 0; i < 10000; i++)
+    {
+        store.Fill(i * 10, i * 10 + 5, SyntaxData{ ThemeColor::Keyword, ThemeColor::None });
+    }
+    EXPECT_EQ(store.RunCount(), 20000u);
+    EXPECT_GT(store.BlockCount(), 40u);
+    EXPECT_EQ(store.Get(5).foreground, ThemeColor::Normal);
+    EXPECT_EQ(store.Get(99994).foreground, ThemeColor::Keyword);
+
+    store.Erase(0, 100000);
+    EXPECT_EQ(store.size(), 900000);
+    EXPECT_EQ(store.RunCount(), 1u);
+}
+
+// Assigning a lexed line over the old one
+TEST(SyntaxStore, AssignRuns)
+{
+    SyntaxRuns runs;
+    MarkSyntaxRuns(runs, 2, 6, SyntaxData{ ThemeColor::Keyword, ThemeColor::None });
+    MarkSyntaxRuns(runs, 7, 8, SyntaxData{ ThemeColor::Whitespace, ThemeColor::None });
+    MarkSyntaxRuns(runs, 8, 9, SyntaxData{ ThemeColor::Whitespace, ThemeColor::None });
+
+    // A comment over the top of the last part
+    MarkSyntaxRuns(runs, 4, 20, SyntaxData{ ThemeColor::Comment, ThemeColor::None });
+    ASSERT_EQ(runs.size(), 3u);
+    EXPECT_EQ(runs[0].end, 2);
+    EXPECT_EQ(runs[1].end, 4);
+    EXPECT_EQ(runs[2].end, 20);
+
+    SyntaxStore store;
+    store.Resize(100);
+    store.Fill(0, 100, SyntaxData{ ThemeColor::String, ThemeColor::None });
+    store.Assign(10, 40, runs);
+
+    auto spSnapshot = store.Publish();
+    EXPECT_EQ(store.Get(9).foreground, ThemeColor::String);
+    EXPECT_EQ(store.Get(11).foreground, ThemeColor::Normal);
+    EXPECT_EQ(store.Get(12).foreground, ThemeColor::Keyword);
+    EXPECT_EQ(store.Get(14).foreground, ThemeColor::Comment);
+    EXPECT_EQ(store.Get(30).foreground, ThemeColor::Normal); // Past the runs, up to the end
+    EXPECT_EQ(store.Get(40).foreground, ThemeColor::String);
+
+    // The same again changes nothing
+    store.Assign(10, 40, runs);
+    EXPECT_EQ(store.RunCount(), 6u);
+    store.Assign(10, 40, SyntaxRuns{});
+    EXPECT_EQ(store.RunCount(), 3u);
+    EXPECT_EQ(spSnapshot->Get(12).foreground, ThemeColor::Keyword);
+}
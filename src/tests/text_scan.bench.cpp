@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include "zep/buffer.hpp"
+#include "zep/display.hpp"
+#include "zep/editor.hpp"
+#include "zep/mcommon/animation/timer.hpp"
+#include "zep/mcommon/string/text_scan.hpp"
+
+#include "bench_text.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+const int Repeats = 10;
+
+} // namespace
+
+TEST(TextScanBench, ScanLineChars)
+{
+    auto text = MakeBenchText(64 * 1024 * 1024);
+    auto p = reinterpret_cast<const uint8_t*>(text.data());
+
+    for (auto level : { TextScanLevel::Scalar, TextScanLevel::SSE2, TextScanLevel::AVX2 })
+    {
+        if (level > GetTextScanLevel())
+        {
+            continue;
+        }
+
+        std::vector<size_t> offsets;
+        timer t;
+        timer_start(t);
+        for (int i = 0; i < Repeats; i++)
+        {
+            offsets.clear();
+            ScanLineChars(p, p + text.size(), offsets, level);
+        }
+        auto seconds = timer_get_elapsed_seconds(t);
+
+        printf("%-6s: %.2f GB/s (%zu found)\n", GetTextScanLevelName(level), (double(text.size()) * Repeats) / (seconds * 1024.0 * 1024.0 * 1024.0), offsets.size());
+    }
+}
+
+TEST(TextScanBench, SetText)
+{
+    auto text = MakeBenchText(64 * 1024 * 1024);
+
+    // Compare loading on one thread against loading in chunks on the thread pool
+    for (auto flags : { uint32_t(ZepEditorFlags::DisableThreads), uint32_t(0) })
+    {
+        auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, flags);
+        auto pBuffer = spEditor->GetEmptyBuffer("bench.txt");
+
+        timer t;
+        timer_start(t);
+        pBuffer->SetText(text);
+        auto seconds = timer_get_elapsed_seconds(t);
+
+        printf("SetText (%s): %.2f GB/s (%d lines)\n", flags != 0 ? "one thread" : "thread pool", double(text.size()) / (seconds * 1024.0 * 1024.0 * 1024.0), pBuffer->GetLineCount());
+    }
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "zep/mcommon/string/text_scan.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+auto ScanAll(const std::string& text, TextScanLevel level) -> std::vector<size_t>
+{
+    std::vector<size_t> offsets;
+    auto p = reinterpret_cast<const uint8_t*>(text.data());
+    ScanLineChars(p, p + text.size(), offsets, level);
+    return offsets;
+}
+
+} // namespace
+
+TEST(TextScan, LineChars)
+{
+    std::string text = "a\tb\r\nc\n";
+    std::vector<size_t> offsets;
+    auto p = reinterpret_cast<const uint8_t*>(text.data());
+    auto counts = ScanLineChars(p, p + text.size(), offsets);
+
+    ASSERT_EQ(offsets, std::vector<size_t>({ 1, 3, 4, 6 }));
+    ASSERT_EQ(counts.lineFeeds, 2);
+    ASSERT_EQ(counts.carriageReturns, 1);
+    ASSERT_EQ(counts.tabs, 1);
+}
+
+TEST(TextScan, LineEnds)
+{
+    std::string text = "abc\n\ndef\n";
+    std::vector<int32_t> lineEnds;
+    auto p = reinterpret_cast<const uint8_t*>(text.data());
+    ScanLineEnds(p, p + text.size(), 10, lineEnds);
+
+    ASSERT_EQ(lineEnds, std::vector<int32_t>({ 14, 15, 19 }));
+}
+
+TEST(TextScan, LevelsAgree)
+{
+    // Odd sizes, so the vector loops leave a tail for the scalar loop
+    std::mt19937 gen(1);
+    std::string chars = "abc \n\r\t";
+    for (auto size : { 0, 1, 15, 16, 17, 31, 33, 100, 1000 })
+    {
+        std::string text;
+        for (int i = 0; i < size; i++)
+        {
+            text += chars[gen() % chars.size()];
+        }
+
+        auto scalar = ScanAll(text, TextScanLevel::Scalar);
+        ASSERT_EQ(ScanAll(text, TextScanLevel::SSE2), scalar);
+        ASSERT_EQ(ScanAll(text, TextScanLevel::AVX2), scalar);
+    }
+}
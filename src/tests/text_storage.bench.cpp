@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "zep/mcommon/animation/timer.hpp"
+#include "zep/text_storage.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+const size_t TextSize = 16 * 1024 * 1024;
+const int EditCount = 2000;
+
+// Build a big file's worth of text
+auto MakeText() -> std::string
+{
+    std::string line = "The quick brown fox jumps over the lazy dog\n";
+    std::string text;
+    text.reserve(TextSize + line.size());
+    while (text.size() < TextSize)
+    {
+        text += line;
+    }
+    return text;
+}
+
+// Insert/delete at random places in the file, as a search and replace or a multi-cursor edit would
+auto RandomEdits(TextStorageType type) -> double
+{
+    auto text = MakeText();
+
+    TextStorage<uint8_t> storage;
+    storage.SetType(type);
+    storage.assign(text.begin(), text.end());
+
+    std::mt19937 gen(1);
+    std::string insert = "jumped";
+
+    timer t;
+    timer_start(t);
+    for (int i = 0; i < EditCount; i++)
+    {
+        auto pos = gen() % (storage.size() - insert.size());
+        if (i & 1)
+        {
+            storage.erase(storage.begin() + pos, storage.begin() + pos + insert.size());
+        }
+        else
+        {
+            storage.insert(storage.begin() + pos, insert.begin(), insert.end());
+        }
+    }
+    auto editTime = timer_get_elapsed_seconds(t);
+
+    // Reading it all back is the other half of the cost
+    timer_start(t);
+    size_t lines = 0;
+    for (auto itr = storage.begin(); itr != storage.end(); itr++)
+    {
+        lines += (*itr == '\n') ? 1 : 0;
+    }
+    auto readTime = timer_get_elapsed_seconds(t);
+
+    printf("%s: %d random edits on %zu MB: %.2f ms, sequential read: %.2f ms (%zu lines)\n",
+        type == TextStorageType::GapBuffer ? "GapBuffer " : "PieceTable",
+        EditCount,
+        TextSize / (1024 * 1024),
+        editTime * 1000.0,
+        readTime * 1000.0,
+        lines);
+    return editTime;
+}
+
+// Paste a block over and over, into the middle of the text, as a big macro or a paste loop would
+auto Pastes(const char* pName, const GapBufferGrowth& growth) -> double
+{
+    GapBuffer<uint8_t> buffer;
+    buffer.SetGrowth(growth);
+    std::string block(64 * 1024, 'x');
+
+    timer t;
+    timer_start(t);
+    for (int i = 0; i < 256; i++)
+    {
+        buffer.insert(buffer.begin() + buffer.size() / 2, block.begin(), block.end());
+    }
+    auto time = timer_get_elapsed_seconds(t);
+
+    auto& stats = buffer.GetStats();
+    printf("%s: 256 x 64KB pastes: %.2f ms, %llu reallocations (%llu in place), %.1f MB moved\n",
+        pName,
+        time * 1000.0,
+        (unsigned long long)stats.reallocations,
+        (unsigned long long)stats.inPlace,
+        stats.bytesMoved / (1024.0 * 1024.0));
+    return time;
+}
+
+// Tokenize the whole text as the syntax highlighter does, with the segment finds and with plain iterator algorithms
+void Finds(TextStorageType type)
+{
+    auto text = MakeText();
+
+    TextStorage<uint8_t> storage;
+    storage.SetType(type);
+    storage.assign(text.begin(), text.end());
+
+    // Split it up, as an edit in the middle would
+    std::string insert = "jumped";
+    storage.insert(storage.begin() + storage.size() / 2, insert.begin(), insert.end());
+
+    std::string delim(" \t.\n;(){}=:");
+    auto delimSet = MakeSpanFindSet<uint8_t>(delim.begin(), delim.end());
+    auto tokens = [&](auto&& findFirstOf, auto&& findFirstNotOf) {
+        size_t count = 0;
+        auto itr = storage.begin();
+        while (itr != storage.end())
+        {
+            auto itrFirst = findFirstNotOf(itr);
+            if (itrFirst == storage.end())
+            {
+                break;
+            }
+            itr = findFirstOf(itrFirst);
+            count++;
+        }
+        return count;
+    };
+
+    timer t;
+    timer_start(t);
+    auto segmentTokens = tokens(
+        [&](auto itr) { return storage.find_first_of(itr, storage.end(), delimSet); },
+        [&](auto itr) { return storage.find_first_not_of(itr, storage.end(), delimSet); });
+    auto segmentTime = timer_get_elapsed_seconds(t);
+
+    timer_start(t);
+    auto iteratorTokens = tokens(
+        [&](auto itr) { return std::find_first_of(itr, storage.end(), delim.begin(), delim.end()); },
+        [&](auto itr) { return std::find_if(itr, storage.end(), [&](uint8_t ch) { return delim.find(char(ch)) == std::string::npos; }); });
+    auto iteratorTime = timer_get_elapsed_seconds(t);
+
+    // And the line ends, which are one memchr per line
+    timer_start(t);
+    size_t lines = 0;
+    for (auto itr = storage.find(storage.begin(), storage.end(), '\n'); itr != storage.end(); itr = storage.find(itr + 1, storage.end(), '\n'))
+    {
+        lines++;
+    }
+    auto lineTime = timer_get_elapsed_seconds(t);
+
+    auto mb = storage.size() / (1024.0 * 1024.0);
+    printf("%s: tokens: segments %.0f MB/s, iterators %.0f MB/s (%zu/%zu); lines: %.0f MB/s (%zu)\n",
+        type == TextStorageType::GapBuffer ? "GapBuffer " : "PieceTable",
+        mb / std::max(segmentTime, 1e-9),
+        mb / std::max(iteratorTime, 1e-9),
+        segmentTokens,
+        iteratorTokens,
+        mb / std::max(lineTime, 1e-9),
+        lines);
+}
+
+} // namespace
+
+TEST(TextStorageBench, Find)
+{
+    Finds(TextStorageType::GapBuffer);
+    Finds(TextStorageType::PieceTable);
+}
+
+TEST(TextStorageBench, GapGrowth)
+{
+    // The old policy; just enough for the insert, plus a fixed gap
+    auto fixedTime = Pastes("Fixed gap    ", GapBufferGrowth{ 1000, 1000, 0.0f });
+    auto geometricTime = Pastes("Geometric gap", GapBufferGrowth());
+    printf("Geometric growth is %.1fx the speed of a fixed gap for pastes\n", fixedTime / std::max(geometricTime, 1e-9));
+}
+
+TEST(TextStorageBench, RandomEdits)
+{
+    auto gapTime = RandomEdits(TextStorageType::GapBuffer);
+    auto pieceTime = RandomEdits(TextStorageType::PieceTable);
+    printf("PieceTable is %.1fx the speed of the GapBuffer for random edits\n", gapTime / std::max(pieceTime, 1e-9));
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include "zep/buffer.hpp"
+#include "zep/display.hpp"
+#include "zep/editor.hpp"
+#include "zep/tab_window.hpp"
+#include "zep/window.hpp"
+#include "zep/mcommon/animation/timer.hpp"
+
+#include "bench_text.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+const int Repeats = 10;
+const int Keystrokes = 1000;
+
+} // namespace
+
+// Wrapping the whole buffer, as on a resize; wrapping after each key typed in the middle of it; and laying out without wrapping
+TEST(WindowBench, UpdateLineSpans)
+{
+    auto text = MakeBenchText(16 * 1024 * 1024);
+    auto spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+    auto pBuffer = spEditor->InitWithText("bench.txt", text);
+    auto pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+    spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(800.0f, 1024.0f));
+    pWindow->UpdateLayout(true);
+
+    timer t;
+    timer_start(t);
+    for (int i = 0; i < Repeats; i++)
+    {
+        // A new buffer wraps everything again
+        pWindow->SetBuffer(pBuffer);
+        pWindow->UpdateLayout(true);
+    }
+    auto seconds = timer_get_elapsed_seconds(t);
+    printf("Full wrap: %.2f MB/s (%d lines)\n", (double(text.size()) * Repeats) / (seconds * 1024.0 * 1024.0), pBuffer->GetLineCount());
+
+    auto offset = BufferLocation(text.size() / 2);
+    timer_start(t);
+    for (int i = 0; i < Keystrokes; i++)
+    {
+        pBuffer->Insert(offset + i, "x");
+        pWindow->UpdateLayout();
+    }
+    seconds = timer_get_elapsed_seconds(t);
+    printf("Keystroke: %.3f ms\n", seconds * 1000.0 / Keystrokes);
+
+    // Lines which don't wrap aren't measured
+    pWindow->SetWrap(false);
+    timer_start(t);
+    for (int i = 0; i < Repeats; i++)
+    {
+        pWindow->SetBuffer(pBuffer);
+        pWindow->UpdateLayout(true);
+    }
+    seconds = timer_get_elapsed_seconds(t);
+    printf("No wrap: %.2f MB/s\n", (double(text.size()) * Repeats) / (seconds * 1024.0 * 1024.0));
+}
@@ -0,0 +1,175 @@
+#include "zep/buffer.hpp"
+#include "zep/display.hpp"
+#include "zep/editor.hpp"
+#include "zep/line_widgets.hpp"
+#include "zep/tab_window.hpp"
+#include "zep/window.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+using namespace Zep;
+
+class WindowTest : public testing::Test
+{
+public:
+    WindowTest()
+    {
+        spEditor = std::make_shared<ZepEditor>(new ZepDisplayNull(), ZEP_ROOT, ZepEditorFlags::DisableThreads);
+        pBuffer = spEditor->InitWithText("Test Buffer", "");
+        pWindow = spEditor->GetActiveTabWindow()->GetActiveWindow();
+
+        // Narrow, so long lines wrap
+        spEditor->SetDisplayRegion(NVec2f(0.0f, 0.0f), NVec2f(200.0f, 1024.0f));
+    }
+
+    // Where the characters are on the screen
+    auto Layout() -> std::vector<NVec2i>
+    {
+        std::vector<NVec2i> positions;
+        for (BufferLocation offset = 0; offset < BufferLocation(pBuffer->GetText().size()); offset += 5)
+        {
+            positions.push_back(pWindow->BufferToDisplay(offset));
+        }
+        return positions;
+    }
+
+public:
+    std::shared_ptr<ZepEditor> spEditor;
+    ZepBuffer* pBuffer;
+    ZepWindow* pWindow;
+};
+
+// Edits only wrap the lines they touch again; the layout should be the same as wrapping everything
+TEST_F(WindowTest, IncrementalSpans)
+{
+    std::string text;
+    for (int line = 0; line < 100; line++)
+    {
+        text += std::string(size_t(line * 7 % 200), 'a' + char(line % 26)) + "\n";
+    }
+    pBuffer->SetText(text);
+    Layout();
+
+    std::mt19937 gen(1);
+    for (int edit = 0; edit < 200; edit++)
+    {
+        auto size = BufferLocation(pBuffer->GetText().size()) - 1;
+        auto offset = BufferLocation(gen() % size);
+        switch (gen() % 3)
+        {
+        case 0:
+            pBuffer->Insert(offset, std::string(gen() % 200, 'x'));
+            break;
+        case 1:
+            pBuffer->Insert(offset, "a\nb\n\nc");
+            break;
+        default:
+            pBuffer->Delete(offset, std::min(size, offset + BufferLocation(gen() % 300)));
+            break;
+        }
+
+        // Sometimes a few edits come before the next layout
+        if (gen() % 3 == 0)
+        {
+            continue;
+        }
+
+        auto incremental = Layout();
+        pWindow->SetBuffer(pBuffer);
+        ASSERT_EQ(Layout(), incremental) << edit;
+    }
+}
+
+// Without wrapping, every buffer line is one line on the screen however long it is
+TEST_F(WindowTest, NoWrap)
+{
+    std::string text;
+    for (int line = 0; line < 100; line++)
+    {
+        text += std::string(size_t(line * 7 % 200), 'a' + char(line % 26)) + "\n";
+    }
+    pBuffer->SetText(text);
+    pWindow->SetWrap(false);
+
+    auto checkLines = [&]() {
+        auto& buffer = pBuffer->GetText();
+        int32_t line = 0;
+        int32_t column = 0;
+        for (BufferLocation offset = 0; offset < BufferLocation(buffer.size()); offset++)
+        {
+            ASSERT_EQ(pWindow->BufferToDisplay(offset), NVec2i(column, line)) << offset;
+            column++;
+            if (buffer[offset] == '\n')
+            {
+                line++;
+                column = 0;
+            }
+        }
+    };
+    checkLines();
+
+    // Edits still only touch their own lines
+    pBuffer->Insert(10, std::string(500, 'x'));
+    pBuffer->Insert(1000, "a\nb\n\nc");
+    pBuffer->Delete(2000, 2600);
+    checkLines();
+
+    pWindow->SetWrap(true);
+    ASSERT_GT(pWindow->BufferToDisplay(BufferLocation(pBuffer->GetText().size()) - 1).y, pBuffer->GetLineCount());
+}
+
+// Only the lines near the view are wrapped, and the rest are guessed from their length; moving through the file, or jumping
+// about in it, should still give the same layout as wrapping everything in order
+TEST_F(WindowTest, VirtualLayout)
+{
+    std::string text;
+    for (int line = 0; line < 5000; line++)
+    {
+        text += std::string(size_t(line * 37 % 300), 'a' + char(line % 26)) + "\n";
+    }
+    pBuffer->SetText(text);
+
+    // Widgets make their lines taller than the guess, until they are wrapped
+    for (int line = 100; line < 5000; line += 500)
+    {
+        pBuffer->AddLineWidget(line, std::make_shared<FloatSlider>(*spEditor, 4));
+    }
+
+    // Show the middle of the file first, so the lines before it are measured after the ones in view
+    int32_t lineStart = 0;
+    int32_t lineEnd = 0;
+    pBuffer->GetLineOffsets(2500, lineStart, lineEnd);
+    pWindow->SetBufferCursor(lineStart);
+    pWindow->Display();
+    auto virtualLayout = Layout();
+
+    pWindow->SetBuffer(pBuffer);
+    ASSERT_EQ(Layout(), virtualLayout);
+
+    // Stepping down from the top reaches the end one span at a time
+    pWindow->SetBufferCursor(0);
+    int32_t steps = 0;
+    for (;;)
+    {
+        auto before = pWindow->BufferToDisplay().y;
+        pWindow->MoveCursorY(1);
+        auto after = pWindow->BufferToDisplay().y;
+        if (after == before)
+        {
+            break;
+        }
+        ASSERT_EQ(after, before + 1);
+        steps++;
+    }
+    ASSERT_EQ(pBuffer->GetBufferLine(pWindow->GetBufferCursor()), pBuffer->GetLineCount() - 1);
+
+    // And jumping to either end gets there at once
+    pWindow->SetBuffer(pBuffer);
+    pWindow->MoveCursorY(MaxCursorMove);
+    ASSERT_EQ(pWindow->BufferToDisplay().y, steps);
+    pWindow->Display();
+    pWindow->MoveCursorY(-MaxCursorMove);
+    ASSERT_EQ(pWindow->BufferToDisplay().y, 0);
+}
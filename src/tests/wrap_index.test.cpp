@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "zep/wrap_index.hpp"
+
+using namespace Zep;
+
+namespace
+{
+
+void CheckIndex(const WrapIndex& index, const std::vector<LineSize>& reference)
+{
+    ASSERT_EQ(index.size(), int32_t(reference.size()));
+
+    int32_t spans = 0;
+    float height = 0.0F;
+    for (int32_t line = 0; line < int32_t(reference.size()); line++)
+    {
+        ASSERT_EQ(index.SpansBefore(line), spans) << line;
+        ASSERT_EQ(index.HeightBefore(line), height) << line;
+        ASSERT_EQ(index.LineFromSpan(spans), line) << line;
+        ASSERT_EQ(index.LineFromSpan(spans + reference[line].spans - 1), line) << line;
+        ASSERT_EQ(index.LineFromHeight(height + reference[line].height * 0.5F), line) << line;
+        spans += reference[line].spans;
+        height += reference[line].height;
+    }
+    ASSERT_EQ(index.SpanCount(), spans);
+    ASSERT_EQ(index.Height(), height);
+}
+
+} // namespace
+
+TEST(WrapIndex, Lookup)
+{
+    WrapIndex index;
+    index.Assign({ { 1, 10.0F }, { 3, 30.0F }, { 2, 20.0F } });
+    ASSERT_EQ(index.SpanCount(), 6);
+    ASSERT_EQ(index.Height(), 60.0F);
+    ASSERT_EQ(index.LineFromSpan(3), 1);
+    ASSERT_EQ(index.LineFromSpan(4), 2);
+    ASSERT_EQ(index.LineFromHeight(39.0F), 1);
+    ASSERT_EQ(index.LineFromHeight(40.0F), 2);
+
+    // Off either end
+    ASSERT_EQ(index.LineFromSpan(-1), 0);
+    ASSERT_EQ(index.LineFromSpan(100), 2);
+    ASSERT_EQ(index.LineFromHeight(1000.0F), 2);
+
+    index.Set(0, { 2, 20.0F });
+    ASSERT_EQ(index.SpansBefore(2), 5);
+    ASSERT_EQ(index.HeightBefore(2), 50.0F);
+
+    index.Replace(1, 3, { { 1, 10.0F } });
+    ASSERT_EQ(index.size(), 2);
+    ASSERT_EQ(index.SpanCount(), 3);
+}
+
+TEST(WrapIndex, RandomEdits)
+{
+    // Enough lines for plenty of chunks
+    std::mt19937 gen(1);
+    auto randomLines = [&](size_t count) {
+        std::vector<LineSize> lines;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto spans = int32_t(1 + gen() % 4);
+            lines.push_back(LineSize{ spans, float(spans * 10 + 2) });
+        }
+        return lines;
+    };
+
+    auto reference = randomLines(5000);
+    WrapIndex index;
+    index.Assign(reference);
+    CheckIndex(index, reference);
+
+    for (int i = 0; i < 500; i++)
+    {
+        auto first = int32_t(gen() % (reference.size() + 1));
+        switch (gen() % 3)
+        {
+        case 0:
+        {
+            // Sometimes a big paste
+            auto lines = randomLines(i % 50 == 0 ? 3000 : gen() % 5);
+            auto last = std::min(first + int32_t(gen() % 3), int32_t(reference.size()));
+            index.Replace(first, last, lines);
+            reference.erase(reference.begin() + first, reference.begin() + last);
+            reference.insert(reference.begin() + first, lines.begin(), lines.end());
+            break;
+        }
+        case 1:
+        {
+            // Big removals are small ones, so the lines don't run out
+            auto last = std::min(first + int32_t(gen() % (i % 50 == 0 ? 2000 : 5)), int32_t(reference.size()));
+            if (reference.size() - (last - first) < 10)
+            {
+                last = first;
+            }
+            index.Replace(first, last, {});
+            reference.erase(reference.begin() + first, reference.begin() + last);
+            break;
+        }
+        default:
+            if (first < int32_t(reference.size()))
+            {
+                auto size = randomLines(1)[0];
+                index.Set(first, size);
+                reference[first] = size;
+            }
+            break;
+        }
+
+        auto lines = index.ToVector();
+        ASSERT_EQ(lines.size(), reference.size());
+        if (i % 50 == 0)
+        {
+            CheckIndex(index, reference);
+        }
+    }
+    CheckIndex(index, reference);
+}
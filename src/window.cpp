@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cctype>
 #include <cmath>
 #include <sstream>
@@ -26,6 +27,7 @@ inline auto UTF8_CHAR_LEN(T t) -> T
 };
 
 const float ScrollBarSize = 17.0F;
+const int32_t MaxSpanCapacity = 65536; // For guessing line sizes with a font that has no width
 ZepWindow::ZepWindow(ZepTabWindow& window, ZepBuffer* buffer)
     : ZepComponent(window.GetEditor())
     , m_tabWindow(window)
@@ -79,9 +81,10 @@ void ZepWindow::UpdateScrollers()
         m_scrollVisibilityChanged = (old_percent != m_vScroller->vScrollVisiblePercent);
         return;
     }
-    m_vScroller->vScrollVisiblePercent = std::min(float(m_maxDisplayLines) / float(m_windowLines.size()), 1.0F);
+    auto spanCount = std::max(m_lineSizes.SpanCount(), 1);
+    m_vScroller->vScrollVisiblePercent = std::min(float(m_maxDisplayLines) / float(spanCount), 1.0F);
     m_vScroller->vScrollPosition = std::abs(m_bufferOffsetYPx) / m_bufferSizeYPx;
-    m_vScroller->vScrollLinePercent = 1.0F / m_windowLines.size();
+    m_vScroller->vScrollLinePercent = 1.0F / spanCount;
     m_vScroller->vScrollPagePercent = m_vScroller->vScrollVisiblePercent;
 
     if (GetEditor().GetConfig().showScrollBar == 0)
@@ -134,7 +137,11 @@ void ZepWindow::UpdateAirline()
         };
     }
     m_airline.leftBoxes.push_back(AirBox{ m_pBuffer->GetDisplayName(), FilterActiveColor(m_pBuffer->GetTheme().GetColor(ThemeColor::AirlineBackground)) });
-    m_airline.rightBoxes.push_back(AirBox{ std::to_string(m_pBuffer->GetLineEnds().size()) + " Lines", m_pBuffer->GetTheme().GetColor(ThemeColor::LineNumberBackground) });
+    if (m_pBuffer->TestFlags(FileFlags::Loading))
+    {
+        m_airline.rightBoxes.push_back(AirBox{ "Loading " + std::to_string(int(m_pBuffer->GetLoadProgress() * 100.0F)) + "%", m_pBuffer->GetTheme().GetColor(ThemeColor::Warning) });
+    }
+    m_airline.rightBoxes.push_back(AirBox{ std::to_string(m_pBuffer->GetLineCount()) + " Lines", m_pBuffer->GetTheme().GetColor(ThemeColor::LineNumberBackground) });
 }
 
 void ZepWindow::SetCursorType(CursorType mode)
@@ -156,6 +163,15 @@ void ZepWindow::Notify(std::shared_ptr<ZepMessage> message)
 
         m_layoutDirty = true;
 
+        if (pMsg->type == BufferMessageType::TextAdded || pMsg->type == BufferMessageType::Loaded || pMsg->type == BufferMessageType::TextChanged || pMsg->type == BufferMessageType::LineWidgetsChanged)
+        {
+            MarkLinesChanged(pMsg->startLocation, pMsg->endLocation);
+        }
+        else if (pMsg->type == BufferMessageType::TextDeleted)
+        {
+            MarkLinesChanged(pMsg->startLocation, pMsg->startLocation);
+        }
+
         if (pMsg->type != BufferMessageType::PreBufferChange)
         {
             // Make sure the cursor is on its 'display' part of the flash cycle after an edit.
@@ -169,7 +185,7 @@ void ZepWindow::Notify(std::shared_ptr<ZepMessage> message)
         if (message->pComponent == m_vScroller.get())
         {
             auto pScroller = dynamic_cast<Scroller*>(message->pComponent);
-            m_bufferOffsetYPx = pScroller->vScrollPosition * (m_windowLines.size() * GetEditor().GetDisplay().GetFontHeightPixels());
+            m_bufferOffsetYPx = pScroller->vScrollPosition * m_bufferSizeYPx;
             UpdateVisibleLineRange();
             EnsureCursorVisible();
             DisableToolTipTillMove();
@@ -197,6 +213,30 @@ void ZepWindow::Notify(std::shared_ptr<ZepMessage> message)
     else if (message->messageId == Msg::ConfigChanged)
     {
         m_layoutDirty = true;
+        m_spansDirty = true;
+    }
+}
+
+// Remember which buffer lines need wrapping again.  The range is where the text is now, so lines remembered from earlier
+// edits move with this one
+void ZepWindow::MarkLinesChanged(BufferLocation start, BufferLocation end)
+{
+    auto lineCount = m_pBuffer->GetLineCount();
+    auto firstLine = m_pBuffer->GetBufferLine(start);
+    auto lastLine = std::min(m_pBuffer->GetBufferLine(end), lineCount - 1);
+    auto diff = lineCount - m_notifiedLineCount;
+    m_notifiedLineCount = lineCount;
+
+    auto shift = [&](int32_t line) {
+        return line > firstLine ? std::max(firstLine, line + diff) : line;
+    };
+    if (m_dirtyLines.x <= m_dirtyLines.y)
+    {
+        m_dirtyLines = NVec2i(std::min(shift(m_dirtyLines.x), firstLine), std::max(shift(m_dirtyLines.y), lastLine));
+    }
+    else
+    {
+        m_dirtyLines = NVec2i(firstLine, lastLine);
     }
 }
 
@@ -218,24 +258,16 @@ void ZepWindow::SetDisplayRegion(const NRectf& region)
 void ZepWindow::EnsureCursorVisible()
 {
     UpdateLayout();
-    BufferLocation loc = m_bufferCursor;
-    for (auto& line : m_windowLines)
+    auto cursorLine = BufferToDisplay(m_bufferCursor).y;
+    if (cursorLine < m_visibleLineRange.x)
     {
-        if (line->columnOffsets.first <= loc && line->columnOffsets.second > loc)
-        {
-            auto cursorLine = line->lineIndex;
-            if (cursorLine < m_visibleLineRange.x)
-            {
-                MoveCursorY(std::abs(m_visibleLineRange.x - cursorLine));
-            }
-            else if (cursorLine >= m_visibleLineRange.y)
-            {
-                MoveCursorY((m_visibleLineRange.y - cursorLine) - 1);
-            }
-            m_cursorMoved = false;
-            return;
-        }
+        MoveCursorY(std::abs(m_visibleLineRange.x - cursorLine));
+    }
+    else if (cursorLine >= m_visibleLineRange.y)
+    {
+        MoveCursorY((m_visibleLineRange.y - cursorLine) - 1);
     }
+    m_cursorMoved = false;
 }
 
 void ZepWindow::ScrollToCursor()
@@ -261,6 +293,27 @@ void ZepWindow::ScrollToCursor()
     m_bufferOffsetYPx = std::min(m_bufferOffsetYPx, m_bufferSizeYPx - float(m_maxDisplayLines) * (two_lines * .5F));
     m_bufferOffsetYPx = std::max(0.F, m_bufferOffsetYPx);
 
+    // Lines which don't wrap can go off the side, so keep a few characters either side of the cursor in view
+    if (!m_wrap)
+    {
+        NVec2f pos;
+        NVec2f size;
+        GetCursorInfo(pos, size);
+
+        auto cursorX = pos.x + m_bufferOffsetXPx - m_textRegion->rect.topLeftPx.x;
+        auto width = m_textRegion->rect.Width();
+        auto margin = std::min(GetEditor().GetDisplay().GetDefaultCharSize().x * 4, width * .25F);
+        if (cursorX - margin < m_bufferOffsetXPx)
+        {
+            m_bufferOffsetXPx = cursorX - margin;
+        }
+        else if (cursorX + size.x + margin > m_bufferOffsetXPx + width)
+        {
+            m_bufferOffsetXPx = cursorX + size.x + margin - width;
+        }
+        m_bufferOffsetXPx = std::max(0.F, m_bufferOffsetXPx);
+    }
+
     if (old_offset != m_bufferOffsetYPx)
     {
         UpdateVisibleLineRange();
@@ -318,143 +371,340 @@ auto ZepWindow::GetLineTopMargin(int32_t line) -> float
 }
 
 // This is the most expensive part of window update; applying line span generation for wrapped text.
-// It can take about a millisecond to do during editing on release buildj; but this is fast enough for now.
-// There are several ways in which this function can be optimized:
-// - Only regenerate spans which have changed, since only the edited line range will change.
-// - Generate blocks of text, based on syntax highlighting, instead of single characters.
-// - Have a no-wrap text mode and save a lot of the wrapping work.
-// - Do some threading
+// So only the lines around the view are wrapped.  The rest of the buffer just has a size for each line in the wrap index;
+// a guess from its length, until the line is wrapped for real.  An edit guesses the sizes of the lines it touched again,
+// and everything is guessed again if the window changes size, or the buffer or config changes
 void ZepWindow::UpdateLineSpans()
 {
     TIME_SCOPE(UpdateLineSpans);
 
     m_maxDisplayLines = std::max(0.0F, std::floor(m_textRegion->rect.Height() / m_defaultLineSize));
-    float screenPosX = m_textRegion->rect.topLeftPx.x;
 
-    // For now, we are compromising on ASCII; so don't query font fixed_size each time
-    const auto& textBuffer = m_pBuffer->GetText();
+    float textHeight = GetEditor().GetDisplay().GetFontHeightPixels();
 
-    int32_t bufferLine = 0;
-    int32_t spanLine = 0;
-    float bufferPosYPx = 0.0F;
+    // Lines that don't wrap don't care how wide the window is
+    auto wrapExtent = NVec2f(m_textRegion->rect.topLeftPx.x, m_wrap ? m_textRegion->rect.bottomRightPx.x : 0.0F);
+    auto lineCount = m_pBuffer->GetLineCount();
+    if (m_lineSizes.size() == 0 || wrapExtent != m_wrapExtentPx || textHeight != m_wrapTextHeight)
+    {
+        m_spansDirty = true;
+    }
 
-    // Nuke the existing spans
-    // In future we can in-place modify for speed
-    std::for_each(m_windowLines.begin(), m_windowLines.end(), [](SpanInfo* pInfo) { delete pInfo; });
-    m_windowLines.clear();
+    if (m_spansDirty)
+    {
+        // Keep the line at the top of the view there
+        auto topLine = m_lineSizes.LineFromHeight(m_bufferOffsetYPx);
+        auto topOffset = m_bufferOffsetYPx - m_lineSizes.HeightBefore(topLine);
+
+        m_wrapExtentPx = wrapExtent;
+        m_wrapTextHeight = textHeight;
+        UpdateLineEstimates();
+
+        std::vector<LineSize> sizes;
+        sizes.reserve(lineCount);
+        int32_t lineStart = 0;
+        for (auto lineEnd : m_pBuffer->GetLineEnds())
+        {
+            sizes.push_back(EstimateLine(lineEnd - lineStart));
+            lineStart = lineEnd;
+        }
+        m_lineSizes.Assign(sizes);
 
+        m_bufferOffsetYPx = topLine < m_lineSizes.size() ? m_lineSizes.HeightBefore(topLine) + topOffset : 0.0F;
+    }
+    else if (m_dirtyLines.x <= m_dirtyLines.y)
+    {
+        // The changed lines, as they are now, were these lines before
+        auto firstLine = std::min(m_dirtyLines.x, lineCount - 1);
+        auto lastLine = std::min(m_dirtyLines.y, lineCount - 1);
+        auto lineDiff = lineCount - m_lineSizes.size();
+
+        std::vector<LineSize> sizes;
+        sizes.reserve(lastLine - firstLine + 1);
+        for (auto line = firstLine; line <= lastLine; line++)
+        {
+            int32_t lineStart;
+            int32_t lineEnd;
+            m_pBuffer->GetLineOffsets(line, lineStart, lineEnd);
+            sizes.push_back(EstimateLine(lineEnd - lineStart));
+        }
+        m_lineSizes.Replace(firstLine, lastLine - lineDiff + 1, sizes);
+    }
+
+    m_spansDirty = false;
+    m_dirtyLines = NVec2i(std::numeric_limits<int32_t>::max(), -1);
+    m_notifiedLineCount = lineCount;
+
+    LayoutLines();
+
+    m_bufferSizeYPx = m_lineSizes.Height();
+
+    UpdateVisibleLineRange();
+    m_layoutDirty = true;
+}
+
+// What a line of plain text wraps to: how many characters of the default size fit on a span, wrapped the way WrapLine does it,
+// and how tall the spans are
+void ZepWindow::UpdateLineEstimates()
+{
     auto& display = GetEditor().GetDisplay();
+    auto charWidth = display.GetDefaultCharSize().x;
+    auto screenPosX = m_textRegion->rect.topLeftPx.x;
+    m_spanCapacity = 1;
+    while (charWidth > 0.0F && m_spanCapacity < MaxSpanCapacity && ((screenPosX + charWidth) + charWidth) < m_textRegion->rect.bottomRightPx.x)
+    {
+        screenPosX += charWidth;
+        m_spanCapacity++;
+    }
 
-    float textHeight = GetEditor().GetDisplay().GetFontHeightPixels();
+    auto margins = DPI(GetEditor().GetConfig().lineMargins);
+    m_firstSpanHeightPx = m_wrapTextHeight + margins.x + margins.y * 2.0F;
+    m_spanHeightPx = m_wrapTextHeight + (float)GetEditor().GetConfig().lineMargins.x + margins.y;
+}
+
+// A guess at the size of a line, from how many characters are in it.  Right for ASCII in a fixed width font, with no widgets
+auto ZepWindow::EstimateLine(int32_t length) const -> LineSize
+{
+    auto spans = m_wrap ? std::max(1, (length + m_spanCapacity - 1) / m_spanCapacity) : 1;
+    return LineSize{ spans, m_firstSpanHeightPx + float(spans - 1) * m_spanHeightPx };
+}
 
-    // Process every buffer line
-    for (;;)
+// Wrap the lines in view, and a screen's worth either side of them; so scrolling a little doesn't need anything wrapping
+void ZepWindow::LayoutLines()
+{
+    m_windowLines.clear();
+    m_measuredLine = -1;
+
+    auto lineCount = m_lineSizes.size();
+    if (lineCount == 0)
     {
-        // We haven't processed this line yet, so we can't display anything
-        // else
-        if (m_pBuffer->GetLineCount() <= bufferLine)
+        // Sanity
+        SpanInfo lineInfo;
+        lineInfo.columnOffsets.first = 0;
+        lineInfo.columnOffsets.second = 0;
+        lineInfo.lastNonCROffset = 0;
+        lineInfo.margins = NVec2f(0.0F);
+        lineInfo.textHeight = 0.0F;
+        lineInfo.bufferLineNumber = 0;
+        lineInfo.pixelRenderRange = NVec2f(0.0F, 0.0F);
+        m_windowLines.push_back(lineInfo);
+        m_laidOutLines = NVec2i(0, 0);
+        return;
+    }
+
+    auto viewHeight = std::max(m_textRegion->rect.Height(), m_defaultLineSize);
+    auto topLine = m_lineSizes.LineFromHeight(m_bufferOffsetYPx);
+    auto topOffset = m_bufferOffsetYPx - m_lineSizes.HeightBefore(topLine);
+    auto topPosYPx = 0.0F;
+
+    auto line = m_lineSizes.LineFromHeight(m_bufferOffsetYPx - viewHeight);
+    m_laidOutLines.x = line;
+    for (; line < lineCount; line++)
+    {
+        if (line > topLine)
         {
-            break;
+            auto& last = m_windowLines.back();
+            if (last.spanYPx + last.FullLineHeight() >= topPosYPx + topOffset + viewHeight * 2.0F)
+            {
+                break;
+            }
         }
 
-        BufferRange columnOffsets;
-        if (!m_pBuffer->GetLineOffsets(bufferLine, columnOffsets.first, columnOffsets.second))
+        auto firstSpan = m_windowLines.size();
+        MeasureLine(line, m_windowLines);
+        if (line == topLine)
         {
-            break;
+            topPosYPx = m_windowLines[firstSpan].spanYPx;
         }
+    }
+    m_laidOutLines.y = line;
 
-        NVec2f margins = NVec2f(GetLineTopMargin(bufferLine), DPI((float)GetEditor().GetConfig().lineMargins.y));
-        float fullLineHeight = textHeight + margins.x + margins.y;
-
-        // Start a new line
-        auto* lineInfo = new SpanInfo();
-        lineInfo->bufferLineNumber = bufferLine;
-        lineInfo->lineIndex = spanLine;
-        lineInfo->columnOffsets.first = columnOffsets.first;
-        lineInfo->columnOffsets.second = columnOffsets.first;
-        lineInfo->spanYPx = bufferPosYPx;
-        lineInfo->margins = margins;
-        lineInfo->textHeight = textHeight;
-        lineInfo->pixelRenderRange.x = screenPosX;
-
-        // These offsets are 0 -> n + 1, i.e. the last offset the buffer returns is 1 beyond the current
-        for (auto ch = columnOffsets.first; ch < columnOffsets.second; ch++)
-        {
-            const utf8* pCh = &textBuffer[ch];
-            const auto textSize = display.GetCharSize(pCh);
+    // The lines above the top one may have been a different size to the guess; they move, not the view
+    m_bufferOffsetYPx = topPosYPx + topOffset;
+}
 
-            // Wrap if we have displayed at least one char, and we have to
-            if (m_wrap && ch != columnOffsets.first)
-            {
-                // At least a single char has wrapped; close the old line, start a new one
-                if (((screenPosX + textSize.x) + textSize.x) >= (m_textRegion->rect.bottomRightPx.x))
-                {
-                    // Remember the offset beyond the end of the line
-                    lineInfo->columnOffsets.second = ch;
-                    lineInfo->pixelRenderRange.y = screenPosX;
-                    m_windowLines.push_back(lineInfo);
-
-                    // Next line
-                    lineInfo = new SpanInfo();
-                    spanLine++;
-                    bufferPosYPx += fullLineHeight;
-
-                    // Reset the line margin and height, because when we split a line we don't include a
-                    // custom widget space above it.  That goes just above the first part of the line
-                    margins.x = (float)GetEditor().GetConfig().lineMargins.x;
-                    fullLineHeight = textHeight + margins.x + margins.y;
-
-                    // Now jump to the next 'screen line' for the rest of this 'buffer line'
-                    lineInfo->columnOffsets = BufferRange(ch, ch + 1);
-                    lineInfo->lastNonCROffset = 0;
-                    lineInfo->lineIndex = spanLine;
-                    lineInfo->bufferLineNumber = bufferLine;
-                    lineInfo->spanYPx = bufferPosYPx;
-                    lineInfo->margins = margins;
-                    lineInfo->textHeight = textHeight;
-                    screenPosX = m_textRegion->rect.topLeftPx.x;
-                    lineInfo->pixelRenderRange.x = screenPosX;
-                }
-                else
-                {
-                    screenPosX += textSize.x;
-                }
-            }
+// Wrap a line where it is now, and remember its real size
+void ZepWindow::MeasureLine(int32_t line, std::vector<SpanInfo>& spans)
+{
+    auto spanLine = m_lineSizes.SpansBefore(line);
+    auto bufferPosYPx = m_lineSizes.HeightBefore(line);
+    auto firstSpan = spans.size();
+    WrapLine(line, spanLine, bufferPosYPx, spans);
+    if (spans.size() == firstSpan)
+    {
+        return;
+    }
+
+    LineSize size{ int32_t(spans.size() - firstSpan), 0.0F };
+    for (auto itr = spans.begin() + firstSpan; itr != spans.end(); itr++)
+    {
+        size.height += itr->FullLineHeight();
+    }
 
-            lineInfo->spanYPx = bufferPosYPx;
-            lineInfo->columnOffsets.second = ch + 1;
-            lineInfo->pixelRenderRange.y = screenPosX;
-            lineInfo->lastNonCROffset = std::max(ch, 0);
+    auto old = m_lineSizes.Get(line);
+    if (old.spans == size.spans && old.height == size.height)
+    {
+        return;
+    }
+
+    // A line above the view moves the view with it, so the same text stays on the screen
+    if (line < m_lineSizes.LineFromHeight(m_bufferOffsetYPx))
+    {
+        m_bufferOffsetYPx += size.height - old.height;
+    }
+    m_lineSizes.Set(line, size);
+    m_bufferSizeYPx = m_lineSizes.Height();
+
+    // Anything after it which is already wrapped moves
+    if (line < m_laidOutLines.x)
+    {
+        for (auto& info : m_windowLines)
+        {
+            info.lineIndex += size.spans - old.spans;
+            info.spanYPx += size.height - old.height;
         }
+    }
+    if (line < m_measuredLine)
+    {
+        m_measuredLine = -1;
+    }
+}
 
-        // Complete the line
-        m_windowLines.push_back(lineInfo);
+// The spans for a buffer line; from the lines in view, or else wrapped now
+auto ZepWindow::GetLineSpans(int32_t line) -> std::pair<SpanInfo*, SpanInfo*>
+{
+    if (line >= m_laidOutLines.x && line < m_laidOutLines.y)
+    {
+        auto byLine = [](const SpanInfo& info, int32_t line) {
+            return info.bufferLineNumber < line;
+        };
+        auto itrFirst = std::lower_bound(m_windowLines.begin(), m_windowLines.end(), line, byLine);
+        auto itrLast = std::lower_bound(itrFirst, m_windowLines.end(), line + 1, byLine);
+        return std::make_pair(&*itrFirst, &*itrFirst + (itrLast - itrFirst));
+    }
+
+    // Often the cursor line, which is asked for a lot
+    if (line != m_measuredLine)
+    {
+        m_measuredSpans.clear();
+        m_measuredLine = -1;
+        MeasureLine(line, m_measuredSpans);
+        m_measuredLine = line;
+    }
+    return std::make_pair(m_measuredSpans.data(), m_measuredSpans.data() + m_measuredSpans.size());
+}
+
+auto ZepWindow::GetSpan(int32_t span) -> SpanInfo&
+{
+    if (m_lineSizes.size() == 0)
+    {
+        return m_windowLines[0];
+    }
+
+    // The line is wrapped to find the span, which may turn out to be less spans than the guess
+    auto spans = GetLineSpans(m_lineSizes.LineFromSpan(span));
+    auto index = std::max(0, std::min(span - spans.first->lineIndex, int32_t(spans.second - spans.first) - 1));
+    return spans.first[index];
+}
 
-        // Next time round - down a buffer line, down a span line
-        bufferLine++;
+// Wrap one buffer line into spans, carrying on from the given span and height
+void ZepWindow::WrapLine(int32_t bufferLine, int32_t& spanLine, float& bufferPosYPx, std::vector<SpanInfo>& spans)
+{
+    // For now, we are compromising on ASCII; so don't query font fixed_size each time
+    const auto& textBuffer = m_pBuffer->GetText();
+    auto& display = GetEditor().GetDisplay();
+    float textHeight = display.GetFontHeightPixels();
+    float screenPosX = m_textRegion->rect.topLeftPx.x;
+
+    BufferRange columnOffsets;
+    if (!m_pBuffer->GetLineOffsets(bufferLine, columnOffsets.first, columnOffsets.second))
+    {
+        return;
+    }
+
+    NVec2f margins = NVec2f(GetLineTopMargin(bufferLine), DPI((float)GetEditor().GetConfig().lineMargins.y));
+    float fullLineHeight = textHeight + margins.x + margins.y;
+
+    // Start a new line
+    SpanInfo lineInfo;
+    lineInfo.bufferLineNumber = bufferLine;
+    lineInfo.lineIndex = spanLine;
+    lineInfo.columnOffsets.first = columnOffsets.first;
+    lineInfo.columnOffsets.second = columnOffsets.first;
+    lineInfo.spanYPx = bufferPosYPx;
+    lineInfo.margins = margins;
+    lineInfo.textHeight = textHeight;
+    lineInfo.pixelRenderRange.x = screenPosX;
+
+    // Without wrapping the span is the whole line, and there is no need to measure it.
+    // The width is a guess until the line is drawn
+    if (!m_wrap)
+    {
+        lineInfo.columnOffsets.second = columnOffsets.second;
+        lineInfo.lastNonCROffset = std::max(columnOffsets.second - 1, 0);
+        lineInfo.pixelRenderRange.y = screenPosX + float(columnOffsets.second - columnOffsets.first) * display.GetDefaultCharSize().x;
+        spans.push_back(lineInfo);
         spanLine++;
-        screenPosX = m_textRegion->rect.topLeftPx.x;
         bufferPosYPx += fullLineHeight;
+        return;
     }
 
-    // Sanity
-    if (m_windowLines.empty())
+    // These offsets are 0 -> n + 1, i.e. the last offset the buffer returns is 1 beyond the current
+    for (auto ch = columnOffsets.first; ch < columnOffsets.second; ch++)
     {
-        auto* lineInfo = new SpanInfo();
-        lineInfo->columnOffsets.first = 0;
-        lineInfo->columnOffsets.second = 0;
-        lineInfo->lastNonCROffset = 0;
-        lineInfo->margins = NVec2f(0.0F);
-        lineInfo->textHeight = 0.0F;
-        lineInfo->bufferLineNumber = 0;
-        lineInfo->pixelRenderRange = NVec2f(0.0F, 0.0F);
-        m_windowLines.push_back(lineInfo);
+        const utf8* pCh = &textBuffer[ch];
+        const auto textSize = display.GetCharSize(pCh);
+
+        // Wrap if we have displayed at least one char, and we have to
+        if (ch != columnOffsets.first)
+        {
+            // At least a single char has wrapped; close the old line, start a new one
+            if (((screenPosX + textSize.x) + textSize.x) >= (m_textRegion->rect.bottomRightPx.x))
+            {
+                // Remember the offset beyond the end of the line
+                lineInfo.columnOffsets.second = ch;
+                lineInfo.pixelRenderRange.y = screenPosX;
+                spans.push_back(lineInfo);
+
+                // Next line
+                lineInfo = SpanInfo();
+                spanLine++;
+                bufferPosYPx += fullLineHeight;
+
+                // Reset the line margin and height, because when we split a line we don't include a
+                // custom widget space above it.  That goes just above the first part of the line
+                margins.x = (float)GetEditor().GetConfig().lineMargins.x;
+                fullLineHeight = textHeight + margins.x + margins.y;
+
+                // Now jump to the next 'screen line' for the rest of this 'buffer line'
+                lineInfo.columnOffsets = BufferRange(ch, ch + 1);
+                lineInfo.lastNonCROffset = 0;
+                lineInfo.lineIndex = spanLine;
+                lineInfo.bufferLineNumber = bufferLine;
+                lineInfo.spanYPx = bufferPosYPx;
+                lineInfo.margins = margins;
+                lineInfo.textHeight = textHeight;
+                screenPosX = m_textRegion->rect.topLeftPx.x;
+                lineInfo.pixelRenderRange.x = screenPosX;
+            }
+            else
+            {
+                screenPosX += textSize.x;
+            }
+        }
+
+        lineInfo.spanYPx = bufferPosYPx;
+        lineInfo.columnOffsets.second = ch + 1;
+        lineInfo.pixelRenderRange.y = screenPosX;
+        lineInfo.lastNonCROffset = std::max(ch, 0);
     }
 
-    m_bufferSizeYPx = m_windowLines[m_windowLines.size() - 1]->spanYPx + textHeight + DPI(GetEditor().GetConfig().lineMargins.y);
+    // Complete the line
+    spans.push_back(lineInfo);
 
-    UpdateVisibleLineRange();
-    m_layoutDirty = true;
+    // Next time round - down a buffer line, down a span line
+    spanLine++;
+    bufferPosYPx += fullLineHeight;
 }
 
 void ZepWindow::UpdateVisibleLineRange()
@@ -463,23 +713,34 @@ void ZepWindow::UpdateVisibleLineRange()
 
     m_visibleLineExtents = NVec2f(m_bufferRegion->rect.Width(), 0);
 
-    m_visibleLineRange.x = m_windowLines.size();
-    m_visibleLineRange.y = 0;
-    for (int32_t line = 0; line < m_windowLines.size(); line++)
+    // Wrap the lines again if the view moved off the ones that are
+    auto movedOff = [&]() {
+        auto& first = m_windowLines.front();
+        auto& last = m_windowLines.back();
+        return (m_bufferOffsetYPx < first.spanYPx && m_laidOutLines.x > 0) || (m_bufferOffsetYPx + m_textRegion->rect.Height() > last.spanYPx + last.FullLineHeight() && m_laidOutLines.y < m_lineSizes.size());
+    };
+    if (m_windowLines.empty() || movedOff())
     {
-        auto& windowLine = *m_windowLines[line];
-        if ((windowLine.spanYPx + windowLine.FullLineHeight()) <= m_bufferOffsetYPx)
-        {
-            continue;
-        }
+        LayoutLines();
+    }
+
+    // The spans are in order down the screen, so the first one in view can be found without walking the ones above it
+    auto itrFirst = std::upper_bound(m_windowLines.begin(), m_windowLines.end(), m_bufferOffsetYPx, [](float offsetPx, const SpanInfo& info) {
+        return offsetPx < info.spanYPx + info.FullLineHeight();
+    });
 
+    m_visibleLineRange.x = m_lineSizes.SpanCount();
+    m_visibleLineRange.y = 0;
+    for (auto itr = itrFirst; itr != m_windowLines.end(); itr++)
+    {
+        auto& windowLine = *itr;
         if ((windowLine.spanYPx - m_bufferOffsetYPx) >= m_textRegion->rect.Height())
         {
             break;
         }
 
-        m_visibleLineRange.x = std::min(m_visibleLineRange.x, int32_t(line));
-        m_visibleLineRange.y = int32_t(line);
+        m_visibleLineRange.x = std::min(m_visibleLineRange.x, windowLine.lineIndex);
+        m_visibleLineRange.y = windowLine.lineIndex;
 
         m_visibleLineExtents.x = std::min(windowLine.pixelRenderRange.x, m_visibleLineExtents.x);
         m_visibleLineExtents.y = std::max(windowLine.pixelRenderRange.y, m_visibleLineExtents.y);
@@ -492,8 +753,8 @@ auto ZepWindow::GetCursorLineInfo(int32_t y) -> const SpanInfo&
 {
     UpdateLayout();
     y = std::max(0, y);
-    y = std::min(y, int32_t(m_windowLines.size() - 1));
-    return *m_windowLines[y];
+    y = std::min(y, m_lineSizes.SpanCount() - 1);
+    return GetSpan(y);
 }
 
 // Convert a normalized y coordinate to the window region
@@ -618,8 +879,8 @@ auto ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass) -> bool
         // Fill the background of the line
         display.DrawRectFilled(
             NRectf(
-                NVec2f(lineInfo.pixelRenderRange.x, ToWindowY(lineInfo.spanYPx)),
-                NVec2f(lineInfo.pixelRenderRange.y, ToWindowY(lineInfo.spanYPx + lineInfo.FullLineHeight()))),
+                NVec2f(lineInfo.pixelRenderRange.x - m_bufferOffsetXPx, ToWindowY(lineInfo.spanYPx)),
+                NVec2f(lineInfo.pixelRenderRange.y - m_bufferOffsetXPx, ToWindowY(lineInfo.spanYPx + lineInfo.FullLineHeight()))),
             GetBlendedColor(ThemeColor::Background));
 
         if (lineInfo.BufferCursorInside(m_bufferCursor))
@@ -707,15 +968,24 @@ auto ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass) -> bool
         }
     }
 
-    auto screenPosX = m_textRegion->rect.topLeftPx.x;
+    auto screenPosX = m_textRegion->rect.topLeftPx.x - m_bufferOffsetXPx;
     auto pSyntax = m_pBuffer->GetSyntax();
 
+    // One version of the colors for the whole line; the highlighter may publish another while we draw
+    auto spSnapshot = pSyntax != nullptr ? pSyntax->GetSnapshot() : nullptr;
+
     auto tipTimeSeconds = timer_get_elapsed_seconds(m_toolTipTimer);
 
     display.SetClipRect(m_textRegion->rect);
 
+    if (displayPass == WindowPass::Text)
+    {
+        DrawLineWidgets(lineInfo);
+    }
+
     // Walk from the start of the line to the end of the line (in buffer chars)
-    for (auto ch = lineInfo.columnOffsets.first; ch < lineInfo.columnOffsets.second; ch++)
+    auto ch = lineInfo.columnOffsets.first;
+    for (; ch < lineInfo.columnOffsets.second; ch++)
     {
         const utf8* pCh;
         const utf8* pEnd;
@@ -723,6 +993,19 @@ auto ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass) -> bool
         GetCharPointer(ch, pCh, pEnd, hiddenChar);
 
         auto textSize = display.GetTextSize(pCh, pEnd);
+
+        // A line which doesn't wrap may be scrolled off either side
+        if (m_bufferOffsetXPx > 0.0F && screenPosX + textSize.x <= m_textRegion->rect.topLeftPx.x)
+        {
+            screenPosX += textSize.x;
+            continue;
+        }
+        if (screenPosX >= m_textRegion->rect.bottomRightPx.x)
+        {
+            break;
+        }
+
+        auto syntax = pSyntax != nullptr ? pSyntax->GetSyntaxAt(*spSnapshot, ch) : SyntaxData{};
         if (displayPass == WindowPass::Background)
         {
             NRectf charRect(NVec2f(screenPosX, ToWindowY(lineInfo.spanYPx)), NVec2f(screenPosX + textSize.x, ToWindowY(lineInfo.spanYPx + lineInfo.FullLineHeight())));
@@ -733,9 +1016,9 @@ auto ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass) -> bool
             }
 
             // If the syntax overrides the background, show it first
-            if ((pSyntax != nullptr) && pSyntax->GetSyntaxAt(ch).background != ThemeColor::None)
+            if ((pSyntax != nullptr) && syntax.background != ThemeColor::None)
             {
-                display.DrawRectFilled(charRect, m_pBuffer->GetTheme().GetColor(pSyntax->GetSyntaxAt(ch).background));
+                display.DrawRectFilled(charRect, m_pBuffer->GetTheme().GetColor(syntax.background));
             }
 
             // Show any markers
@@ -807,12 +1090,10 @@ auto ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass) -> bool
         // Second pass, characters
         else
         {
-            DrawLineWidgets(lineInfo);
-
             if (!hiddenChar || ((m_windowFlags & WindowFlags::ShowCR) != 0))
             {
                 auto centerChar = NVec2f(screenPosX + textSize.x / 2, ToWindowY(lineInfo.spanYPx) + textSize.y / 2);
-                if (((m_windowFlags & WindowFlags::ShowWhiteSpace) != 0) && (pSyntax != nullptr) && pSyntax->GetSyntaxAt(ch).foreground == ThemeColor::Whitespace)
+                if (((m_windowFlags & WindowFlags::ShowWhiteSpace) != 0) && (pSyntax != nullptr) && syntax.foreground == ThemeColor::Whitespace)
                 {
                     // Show a dot
                     display.DrawRectFilled(NRectf(centerChar - NVec2f(1.0F, 1.0F), centerChar + NVec2f(1.0F, 1.0F)), m_pBuffer->GetTheme().GetColor(ThemeColor::Whitespace));
@@ -828,7 +1109,7 @@ auto ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass) -> bool
                     {
                         if (pSyntax != nullptr)
                         {
-                            col = m_pBuffer->GetTheme().GetColor(pSyntax->GetSyntaxAt(ch).foreground);
+                            col = m_pBuffer->GetTheme().GetColor(syntax.foreground);
                         }
                         else
                         {
@@ -838,7 +1119,7 @@ auto ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass) -> bool
 
                     if (pSyntax != nullptr)
                     {
-                        auto backgroundColor = pSyntax->GetSyntaxAt(ch).background;
+                        auto backgroundColor = syntax.background;
                         if (backgroundColor != ThemeColor::None)
                         {
                             display.DrawRectFilled(NRectf(centerChar - NVec2f(1.0F, 1.0F), centerChar + NVec2f(1.0F, 1.0F)), m_pBuffer->GetTheme().GetColor(backgroundColor));
@@ -852,6 +1133,12 @@ auto ZepWindow::DisplayLine(SpanInfo& lineInfo, int displayPass) -> bool
         screenPosX += textSize.x;
     }
 
+    // Now we know how wide it really is
+    if (!m_wrap && ch == lineInfo.columnOffsets.second)
+    {
+        lineInfo.pixelRenderRange.y = screenPosX + m_bufferOffsetXPx;
+    }
+
     DisplayCursor();
 
     display.SetClipRect(NRectf{});
@@ -928,6 +1215,24 @@ auto ZepWindow::GetWindowFlags() const -> uint32_t
     return m_windowFlags;
 }
 
+void ZepWindow::SetWrap(bool wrap)
+{
+    if (m_wrap == wrap)
+    {
+        return;
+    }
+    m_wrap = wrap;
+    m_bufferOffsetXPx = 0.0F;
+    m_spansDirty = true;
+    m_layoutDirty = true;
+    m_cursorMoved = true;
+}
+
+auto ZepWindow::GetWrap() const -> bool
+{
+    return m_wrap;
+}
+
 void ZepWindow::ToggleFlag(uint32_t flag)
 {
     if ((m_windowFlags & flag) != 0)
@@ -949,7 +1254,7 @@ auto ZepWindow::GetMaxDisplayLines() -> int32_t
 auto ZepWindow::GetNumDisplayedLines() -> int32_t
 {
     UpdateLayout();
-    return std::min((int32_t)m_windowLines.size(), GetMaxDisplayLines());
+    return std::min(m_lineSizes.SpanCount(), GetMaxDisplayLines());
 }
 
 void ZepWindow::SetBufferCursor(BufferLocation location)
@@ -978,7 +1283,9 @@ void ZepWindow::SetBuffer(ZepBuffer* pBuffer)
 
     m_pBuffer = pBuffer;
     m_layoutDirty = true;
+    m_spansDirty = true;
     m_bufferOffsetYPx = 0;
+    m_bufferOffsetXPx = 0;
     m_bufferCursor = pBuffer->Clamp(pBuffer->GetLastEditLocation());
     m_lastCursorColumn = 0;
     m_cursorMoved = false;
@@ -1060,7 +1367,7 @@ void ZepWindow::GetCursorInfo(NVec2f& pos, NVec2f& size)
     NVec2f cursorSize;
     auto& tex = m_pBuffer->GetText();
     bool found = false;
-    float xPos = m_textRegion->rect.topLeftPx.x;
+    float xPos = m_textRegion->rect.topLeftPx.x - m_bufferOffsetXPx;
     for (auto ch = cursorBufferLine.columnOffsets.first; ch < cursorBufferLine.columnOffsets.second; ch++)
     {
         cursorSize = display.GetCharSize(&tex[ch]);
@@ -1233,13 +1540,21 @@ void ZepWindow::Display()
         }
     }
 
+    // Lazy syntax colors the lines on screen when we ask for them
+    auto pSyntax = m_pBuffer->GetSyntax();
+    if (pSyntax != nullptr && m_visibleLineRange.x < m_visibleLineRange.y && m_visibleLineRange.y <= m_lineSizes.SpanCount())
+    {
+        auto firstLine = GetSpan(m_visibleLineRange.x).bufferLineNumber;
+        pSyntax->ShowLines(firstLine, GetSpan(m_visibleLineRange.y - 1).bufferLineNumber);
+    }
+
     {
         TIME_SCOPE(DrawLine);
         for (int displayPass = 0; displayPass < WindowPass::Max; displayPass++)
         {
             for (int32_t windowLine = m_visibleLineRange.x; windowLine < m_visibleLineRange.y; windowLine++)
             {
-                auto& lineInfo = *m_windowLines[windowLine];
+                auto& lineInfo = GetSpan(windowLine);
                 if (!DisplayLine(lineInfo, displayPass))
                 {
                     break;
@@ -1378,9 +1693,9 @@ void ZepWindow::MoveCursorY(int yDistance, LineLocation clampLocation)
     // Find the screen line relative target
     auto target = cursorCL + NVec2i(0, yDistance);
     target.y = std::max(0, target.y);
-    target.y = std::min(target.y, int32_t(m_windowLines.size() - 1));
+    target.y = std::min(target.y, m_lineSizes.SpanCount() - 1);
 
-    auto& line = *m_windowLines[target.y];
+    auto& line = GetSpan(target.y);
 
     // Snap to the new vertical column if necessary (see comment below)
     if (target.x < m_lastCursorColumn)
@@ -1448,23 +1763,27 @@ auto ZepWindow::BufferToDisplay(const BufferLocation& loc) -> NVec2i
     UpdateLayout();
 
     NVec2i ret(0, 0);
-    int line_number = 0;
+    if (m_lineSizes.size() == 0)
+    {
+        return ret;
+    }
 
-    // TODO(unknown):  A map
-    for (auto& line : m_windowLines)
+    // The line's spans follow each other along it; the one with the location is the last to start at or before it
+    auto spans = GetLineSpans(std::min(m_pBuffer->GetBufferLine(loc), m_lineSizes.size() - 1));
+    auto pInfo = std::upper_bound(spans.first, spans.second, loc, [](BufferLocation location, const SpanInfo& info) {
+        return location < info.columnOffsets.first;
+    });
+    if (pInfo != spans.first && pInfo[-1].columnOffsets.second > loc)
     {
-        if (line->columnOffsets.first <= loc && line->columnOffsets.second > loc)
-        {
-            ret.y = line_number;
-            ret.x = loc - line->columnOffsets.first;
-            return ret;
-        }
-        line_number++;
+        ret.y = pInfo[-1].lineIndex;
+        ret.x = loc - pInfo[-1].columnOffsets.first;
+        return ret;
     }
 
     // Max
-    ret.y = int(m_windowLines.size() - 1);
-    ret.x = m_windowLines[m_windowLines.size() - 1]->columnOffsets.second - 1;
+    auto& last = spans.second[-1];
+    ret.y = last.lineIndex;
+    ret.x = last.columnOffsets.second - 1;
     return ret;
 }
 
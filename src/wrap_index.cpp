@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "zep/wrap_index.hpp"
+
+namespace Zep
+{
+
+namespace
+{
+// Chunks are built this size, and split/merged when they drift too far from it
+const size_t ChunkLines = 256;
+const size_t MaxChunkLines = ChunkLines * 4;
+const size_t MinChunkLines = ChunkLines / 4;
+} // namespace
+
+WrapIndex::WrapIndex()
+{
+    UpdateTrees();
+}
+
+void WrapIndex::Assign(const std::vector<LineSize>& lines)
+{
+    m_chunks.clear();
+    Rebuild(0, 0, lines);
+    UpdateTrees();
+}
+
+void WrapIndex::Replace(int32_t first, int32_t last, const std::vector<LineSize>& lines)
+{
+    assert(first >= 0 && first <= last && last <= m_lineCount);
+    if (m_chunks.empty())
+    {
+        Assign(lines);
+        return;
+    }
+
+    // Lines going on the end go in the last chunk
+    auto firstChunk = std::min(FindChunk(first), m_chunks.size() - 1);
+    auto lastChunk = last > first ? FindChunk(last - 1) : firstChunk;
+    auto chunkStart = m_chunkLines.Sum(firstChunk);
+
+    // Mostly it is a few lines, all in one chunk
+    if (firstChunk == lastChunk)
+    {
+        auto& chunk = m_chunks[firstChunk];
+        auto newSize = chunk.lines.size() - size_t(last - first) + lines.size();
+        if (newSize <= MaxChunkLines && (newSize >= MinChunkLines || m_chunks.size() == 1))
+        {
+            auto itr = chunk.lines.erase(chunk.lines.begin() + (first - chunkStart), chunk.lines.begin() + (last - chunkStart));
+            chunk.lines.insert(itr, lines.begin(), lines.end());
+
+            auto oldSpans = chunk.spans;
+            auto oldHeight = chunk.height;
+            Total(chunk);
+            m_chunkLines.Add(firstChunk, int32_t(lines.size()) - (last - first));
+            m_chunkSpans.Add(firstChunk, chunk.spans - oldSpans);
+            m_chunkHeights.Add(firstChunk, chunk.height - oldHeight);
+            m_lineCount += int32_t(lines.size()) - (last - first);
+            return;
+        }
+    }
+
+    // Otherwise the chunks it touches, and one either side to merge small ones with, are made again
+    firstChunk = firstChunk > 0 ? firstChunk - 1 : firstChunk;
+    lastChunk = std::min(lastChunk + 1, m_chunks.size() - 1);
+    chunkStart = m_chunkLines.Sum(firstChunk);
+
+    std::vector<LineSize> merged;
+    auto line = chunkStart;
+    for (auto chunk = firstChunk; chunk <= lastChunk; chunk++)
+    {
+        for (auto& size : m_chunks[chunk].lines)
+        {
+            if (line == first)
+            {
+                merged.insert(merged.end(), lines.begin(), lines.end());
+            }
+            if (line < first || line >= last)
+            {
+                merged.push_back(size);
+            }
+            line++;
+        }
+    }
+    if (line == first)
+    {
+        merged.insert(merged.end(), lines.begin(), lines.end());
+    }
+
+    Rebuild(firstChunk, lastChunk + 1, merged);
+    UpdateTrees();
+}
+
+void WrapIndex::Set(int32_t line, const LineSize& size)
+{
+    assert(line >= 0 && line < m_lineCount);
+    auto chunk = FindChunk(line);
+    auto& old = m_chunks[chunk].lines[line - m_chunkLines.Sum(chunk)];
+    m_chunks[chunk].spans += size.spans - old.spans;
+    m_chunks[chunk].height += double(size.height) - double(old.height);
+    m_chunkSpans.Add(chunk, size.spans - old.spans);
+    m_chunkHeights.Add(chunk, double(size.height) - double(old.height));
+    old = size;
+}
+
+auto WrapIndex::Get(int32_t line) const -> LineSize
+{
+    assert(line >= 0 && line < m_lineCount);
+    auto chunk = FindChunk(line);
+    return m_chunks[chunk].lines[line - m_chunkLines.Sum(chunk)];
+}
+
+auto WrapIndex::SpanCount() const -> int32_t
+{
+    return m_chunkSpans.Sum(m_chunks.size());
+}
+
+auto WrapIndex::Height() const -> float
+{
+    return float(m_chunkHeights.Sum(m_chunks.size()));
+}
+
+auto WrapIndex::SpansBefore(int32_t line) const -> int32_t
+{
+    if (line >= m_lineCount)
+    {
+        return SpanCount();
+    }
+
+    auto chunk = FindChunk(line);
+    auto spans = m_chunkSpans.Sum(chunk);
+    auto& lines = m_chunks[chunk].lines;
+    for (auto itr = lines.begin(), itrEnd = lines.begin() + (line - m_chunkLines.Sum(chunk)); itr != itrEnd; itr++)
+    {
+        spans += itr->spans;
+    }
+    return spans;
+}
+
+auto WrapIndex::HeightBefore(int32_t line) const -> float
+{
+    if (line >= m_lineCount)
+    {
+        return Height();
+    }
+
+    auto chunk = FindChunk(line);
+    auto height = m_chunkHeights.Sum(chunk);
+    auto& lines = m_chunks[chunk].lines;
+    for (auto itr = lines.begin(), itrEnd = lines.begin() + (line - m_chunkLines.Sum(chunk)); itr != itrEnd; itr++)
+    {
+        height += itr->height;
+    }
+    return float(height);
+}
+
+auto WrapIndex::LineFromSpan(int32_t span) const -> int32_t
+{
+    if (m_lineCount == 0 || span <= 0)
+    {
+        return 0;
+    }
+
+    // Every line has at least one span, so the chunk with it is the one the sums before don't reach
+    auto chunk = m_chunkSpans.Count(span);
+    if (chunk >= m_chunks.size())
+    {
+        return m_lineCount - 1;
+    }
+
+    auto line = m_chunkLines.Sum(chunk);
+    span -= m_chunkSpans.Sum(chunk);
+    for (auto& size : m_chunks[chunk].lines)
+    {
+        if (span < size.spans)
+        {
+            break;
+        }
+        span -= size.spans;
+        line++;
+    }
+    return std::min(line, m_lineCount - 1);
+}
+
+auto WrapIndex::LineFromHeight(float height) const -> int32_t
+{
+    if (m_lineCount == 0 || height <= 0.0F)
+    {
+        return 0;
+    }
+
+    auto chunk = m_chunkHeights.Count(double(height));
+    if (chunk >= m_chunks.size())
+    {
+        return m_lineCount - 1;
+    }
+
+    auto line = m_chunkLines.Sum(chunk);
+    auto remaining = double(height) - m_chunkHeights.Sum(chunk);
+    for (auto& size : m_chunks[chunk].lines)
+    {
+        if (remaining < size.height)
+        {
+            break;
+        }
+        remaining -= size.height;
+        line++;
+    }
+    return std::min(line, m_lineCount - 1);
+}
+
+auto WrapIndex::ToVector() const -> std::vector<LineSize>
+{
+    std::vector<LineSize> lines;
+    lines.reserve(m_lineCount);
+    for (auto& chunk : m_chunks)
+    {
+        lines.insert(lines.end(), chunk.lines.begin(), chunk.lines.end());
+    }
+    return lines;
+}
+
+void WrapIndex::Total(Chunk& chunk)
+{
+    chunk.spans = 0;
+    chunk.height = 0.0;
+    for (auto& size : chunk.lines)
+    {
+        chunk.spans += size.spans;
+        chunk.height += size.height;
+    }
+}
+
+// Replace a range of chunks with new ones holding these lines
+void WrapIndex::Rebuild(size_t first, size_t last, const std::vector<LineSize>& lines)
+{
+    std::vector<Chunk> chunks;
+    chunks.reserve(lines.size() / ChunkLines + 1);
+    size_t line = 0;
+    while (line < lines.size())
+    {
+        // Don't leave a tiny chunk on the end
+        auto lastLine = lines.size() - line < ChunkLines + MinChunkLines ? lines.size() : line + ChunkLines;
+
+        Chunk chunk;
+        chunk.lines.assign(lines.begin() + line, lines.begin() + lastLine);
+        Total(chunk);
+        chunks.push_back(std::move(chunk));
+        line = lastLine;
+    }
+
+    auto itr = m_chunks.erase(m_chunks.begin() + first, m_chunks.begin() + last);
+    m_chunks.insert(itr, std::make_move_iterator(chunks.begin()), std::make_move_iterator(chunks.end()));
+}
+
+void WrapIndex::UpdateTrees()
+{
+    std::vector<int32_t> lines;
+    std::vector<int32_t> spans;
+    std::vector<double> heights;
+    lines.reserve(m_chunks.size());
+    spans.reserve(m_chunks.size());
+    heights.reserve(m_chunks.size());
+
+    m_lineCount = 0;
+    for (auto& chunk : m_chunks)
+    {
+        lines.push_back(int32_t(chunk.lines.size()));
+        spans.push_back(chunk.spans);
+        heights.push_back(chunk.height);
+        m_lineCount += int32_t(chunk.lines.size());
+    }
+    m_chunkLines.Build(lines);
+    m_chunkSpans.Build(spans);
+    m_chunkHeights.Build(heights);
+}
+
+// The chunk with the line in it; or the number of chunks, if it is past the end
+auto WrapIndex::FindChunk(int32_t line) const -> size_t
+{
+    return m_chunkLines.Count(line);
+}
+
+} // namespace Zep